@@ -0,0 +1,600 @@
+// Load generator for the HTTP file server.
+//
+// Closed loop: every connection keeps `pipeline` requests in flight and sends
+// the next batch as soon as the previous one is answered.
+// Open loop: requests are scheduled at a fixed aggregate rate and latency is
+// measured from the scheduled send time, so a stalled server is not hidden
+// by the client slowing down (coordinated omission).
+//
+// Results are printed as one JSON object (or a short text summary).
+#define _CRT_SECURE_NO_WARNINGS
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET socket_t;
+#define CLOSE_SOCKET closesocket
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define CLOSE_SOCKET close
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+typedef std::chrono::steady_clock Clock;
+
+// Request methods the generator can send
+enum LoadMethod { LOAD_GET = 0, LOAD_HEAD, LOAD_PUT, LOAD_POST, LOAD_DELETE, LOAD_METHOD_COUNT };
+static const char* const methodNames[LOAD_METHOD_COUNT] = { "GET", "HEAD", "PUT", "POST", "DELETE" };
+
+// Weighted body size used for PUT and POST requests
+struct SizeWeight
+{
+    size_t size;
+    double weight;
+};
+
+struct LoadOptions
+{
+    string host = "127.0.0.1";
+    int port = 80;
+    bool openLoop = false;
+    int concurrency = 4;
+    double rate = 1000.0;                // Open loop: total requests per second
+    double durationSec = 10.0;
+    long long maxRequests = 0;           // 0 = limited by duration only
+    bool keepAlive = true;
+    int pipeline = 1;
+    double methodWeights[LOAD_METHOD_COUNT] = { 1.0, 0.0, 0.0, 0.0, 0.0 };
+    vector<string> paths = { "/server_page.html" };
+    vector<SizeWeight> bodySizes = { { 128, 1.0 } };
+    int timeoutMs = 5000;
+    int mss = 0;                         // Advertised segment size, 0 = path default
+    unsigned seed = 1;
+    bool json = true;
+    string label;
+};
+
+// Per-worker results, merged at the end
+struct WorkerResult
+{
+    vector<uint64_t> latenciesNs;
+    long long requests = 0;
+    long long errors = 0;
+    long long connects = 0;
+    long long bytesSent = 0;
+    long long bytesReceived = 0;
+    long long perMethod[LOAD_METHOD_COUNT] = {};
+    long long statusClass[6] = {}; // index = status / 100
+};
+
+static std::atomic<long long> requestsIssued{ 0 };
+
+static bool splitPair(const string& item, char sep, string& left, string& right)
+{
+    size_t pos = item.find(sep);
+    if (pos == string::npos)
+        return false;
+    left = item.substr(0, pos);
+    right = item.substr(pos + 1);
+    return true;
+}
+
+static vector<string> splitList(const string& list)
+{
+    vector<string> items;
+    std::stringstream stream(list);
+    string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+// Parses "GET=70,HEAD=10,PUT=10,POST=5,DELETE=5"
+static bool parseMix(const string& value, LoadOptions& options)
+{
+    for (double& weight : options.methodWeights)
+        weight = 0.0;
+    for (const string& item : splitList(value))
+    {
+        string name, weight;
+        if (!splitPair(item, '=', name, weight))
+            return false;
+        int index = -1;
+        for (int i = 0; i < LOAD_METHOD_COUNT; i++)
+        {
+            if (name == methodNames[i])
+                index = i;
+        }
+        if (index < 0)
+            return false;
+        options.methodWeights[index] = atof(weight.c_str());
+    }
+    return true;
+}
+
+// Parses "128:0.5,4096:0.4,1048576:0.1"
+static bool parseSizes(const string& value, LoadOptions& options)
+{
+    options.bodySizes.clear();
+    for (const string& item : splitList(value))
+    {
+        string size, weight;
+        if (!splitPair(item, ':', size, weight))
+        {
+            size = item;
+            weight = "1";
+        }
+        options.bodySizes.push_back({ (size_t)strtoull(size.c_str(), nullptr, 10), atof(weight.c_str()) });
+    }
+    return !options.bodySizes.empty();
+}
+
+static void printUsage()
+{
+    cout << "Usage: load_generator [options]\n"
+        << "  --host <addr>            Server address (default 127.0.0.1)\n"
+        << "  --port <n>               Server port (default 80)\n"
+        << "  --mode closed|open       Closed loop or fixed-rate open loop (default closed)\n"
+        << "  --concurrency <n>        Number of connections (default 4)\n"
+        << "  --rate <rps>             Open loop aggregate request rate (default 1000)\n"
+        << "  --duration <sec>         Test duration (default 10)\n"
+        << "  --requests <n>           Stop after n requests (default unlimited)\n"
+        << "  --close                  Send Connection: close and reconnect per request\n"
+        << "  --pipeline <n>           Requests in flight per connection (default 1)\n"
+        << "  --mix GET=70,HEAD=10,... Method ratios (GET, HEAD, PUT, POST, DELETE)\n"
+        << "  --paths /a.html,/b.html  Target URIs\n"
+        << "  --body-sizes 128:0.9,65536:0.1  PUT/POST body size distribution\n"
+        << "  --timeout-ms <n>         Response timeout (default 5000)\n"
+        << "  --mss <bytes>            Advertise a smaller TCP segment size (e.g. 1448 to model\n"
+        << "                           an Ethernet path over loopback)\n"
+        << "  --seed <n>               Random seed (default 1)\n"
+        << "  --label <name>           Label copied into the result\n"
+        << "  --text                   Human-readable output instead of JSON\n";
+}
+
+static bool parseArguments(int argc, char* argv[], LoadOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--help")
+            return false;
+        else if (arg == "--close")
+            options.keepAlive = false;
+        else if (arg == "--text")
+            options.json = false;
+        else if (!hasValue)
+            return false;
+        else if (arg == "--host")
+            options.host = argv[++i];
+        else if (arg == "--port")
+            options.port = atoi(argv[++i]);
+        else if (arg == "--mode")
+            options.openLoop = string(argv[++i]) == "open";
+        else if (arg == "--concurrency")
+            options.concurrency = std::max(1, atoi(argv[++i]));
+        else if (arg == "--rate")
+            options.rate = atof(argv[++i]);
+        else if (arg == "--duration")
+            options.durationSec = atof(argv[++i]);
+        else if (arg == "--requests")
+            options.maxRequests = atoll(argv[++i]);
+        else if (arg == "--pipeline")
+            options.pipeline = std::max(1, atoi(argv[++i]));
+        else if (arg == "--mix")
+        {
+            if (!parseMix(argv[++i], options))
+                return false;
+        }
+        else if (arg == "--paths")
+            options.paths = splitList(argv[++i]);
+        else if (arg == "--body-sizes")
+        {
+            if (!parseSizes(argv[++i], options))
+                return false;
+        }
+        else if (arg == "--timeout-ms")
+            options.timeoutMs = atoi(argv[++i]);
+        else if (arg == "--mss")
+            options.mss = atoi(argv[++i]);
+        else if (arg == "--seed")
+            options.seed = (unsigned)atoi(argv[++i]);
+        else if (arg == "--label")
+            options.label = argv[++i];
+        else
+            return false;
+    }
+    return !options.paths.empty();
+}
+
+// Connects a blocking socket with a receive timeout
+static socket_t connectToServer(const LoadOptions& options)
+{
+    socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((unsigned short)options.port);
+    inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+
+#ifdef TCP_MAXSEG
+    // The server's segments are sized by the MSS advertised in our SYN
+    if (options.mss > 0)
+        setsockopt(sock, IPPROTO_TCP, TCP_MAXSEG, (const char*)&options.mss, sizeof(options.mss));
+#endif
+
+    if (connect(sock, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        CLOSE_SOCKET(sock);
+        return INVALID_SOCKET;
+    }
+
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+#ifdef _WIN32
+    DWORD timeout = (DWORD)options.timeoutMs;
+#else
+    timeval timeout;
+    timeout.tv_sec = options.timeoutMs / 1000;
+    timeout.tv_usec = (options.timeoutMs % 1000) * 1000;
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    return sock;
+}
+
+static bool sendAll(socket_t sock, const string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        int n = send(sock, data.data() + sent, (int)(data.size() - sent), 0);
+        if (n <= 0)
+            return false;
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+// Reads one response from the connection. `pending` holds bytes already read
+// past the previous response (pipelining). Returns the status code or -1.
+static int readResponse(socket_t sock, string& pending, bool isHead, bool& serverClosed, long long& bytesReceived)
+{
+    char chunk[16384];
+    size_t headerEnd;
+    while ((headerEnd = pending.find("\r\n\r\n")) == string::npos)
+    {
+        int n = recv(sock, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            return -1;
+        bytesReceived += n;
+        pending.append(chunk, (size_t)n);
+    }
+
+    int status = -1;
+    if (pending.compare(0, 7, "HTTP/1.") == 0 && pending.size() > 12)
+        status = atoi(pending.c_str() + 9);
+
+    // Header names are matched case-insensitively
+    string headers = pending.substr(0, headerEnd + 2);
+    string lower = headers;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)tolower(c); });
+
+    size_t contentLength = 0;
+    size_t pos = lower.find("\r\ncontent-length:");
+    if (pos != string::npos)
+        contentLength = (size_t)strtoull(headers.c_str() + pos + 17, nullptr, 10);
+    serverClosed = lower.find("\r\nconnection: close") != string::npos;
+    if (isHead)
+        contentLength = 0;
+
+    size_t total = headerEnd + 4 + contentLength;
+    while (pending.size() < total)
+    {
+        int n = recv(sock, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            return -1;
+        bytesReceived += n;
+        pending.append(chunk, (size_t)n);
+    }
+    pending.erase(0, total);
+    return status;
+}
+
+class RequestFactory
+{
+public:
+    RequestFactory(const LoadOptions& options, unsigned seed)
+        : options(options), random(seed)
+    {
+        double total = 0.0;
+        for (double weight : options.methodWeights)
+            total += weight;
+        double cumulative = 0.0;
+        for (int i = 0; i < LOAD_METHOD_COUNT; i++)
+        {
+            cumulative += total > 0.0 ? options.methodWeights[i] / total : (i == 0 ? 1.0 : 0.0);
+            methodCdf[i] = cumulative;
+        }
+
+        double sizeTotal = 0.0;
+        for (const SizeWeight& size : options.bodySizes)
+            sizeTotal += size.weight;
+        cumulative = 0.0;
+        for (const SizeWeight& size : options.bodySizes)
+        {
+            cumulative += size.weight / sizeTotal;
+            sizeCdf.push_back(cumulative);
+        }
+    }
+
+    // Builds the next request and reports which method it uses
+    string next(LoadMethod& method)
+    {
+        double pick = uniform(random);
+        int index = 0;
+        while (index < LOAD_METHOD_COUNT - 1 && pick > methodCdf[index])
+            index++;
+        method = (LoadMethod)index;
+
+        string path = options.paths[random() % options.paths.size()];
+        string body;
+        if (method == LOAD_PUT || method == LOAD_DELETE)
+        {
+            // Writes go to scratch files so GET targets are left intact
+            path = "/load_" + std::to_string(random() % 64) + ".txt";
+        }
+        if (method == LOAD_PUT || method == LOAD_POST)
+        {
+            double sizePick = uniform(random);
+            size_t sizeIndex = 0;
+            while (sizeIndex < sizeCdf.size() - 1 && sizePick > sizeCdf[sizeIndex])
+                sizeIndex++;
+            body.assign(std::max<size_t>(1, options.bodySizes[sizeIndex].size), 'x');
+        }
+
+        string request = string(methodNames[method]) + " " + path + " HTTP/1.1\r\n";
+        request += "Host: " + options.host + "\r\n";
+        request += options.keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+        if (!body.empty())
+            request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        request += "\r\n";
+        request += body;
+        return request;
+    }
+
+private:
+    const LoadOptions& options;
+    std::mt19937 random;
+    std::uniform_real_distribution<double> uniform{ 0.0, 1.0 };
+    double methodCdf[LOAD_METHOD_COUNT];
+    vector<double> sizeCdf;
+};
+
+static bool claimRequest(const LoadOptions& options)
+{
+    if (options.maxRequests <= 0)
+        return true;
+    return requestsIssued.fetch_add(1) < options.maxRequests;
+}
+
+static void runWorker(const LoadOptions& options, int workerIndex, Clock::time_point start,
+    Clock::time_point deadline, WorkerResult& result)
+{
+    RequestFactory factory(options, options.seed * 7919u + (unsigned)workerIndex);
+    socket_t sock = INVALID_SOCKET;
+    string pending;
+
+    // Open loop: this worker's share of the aggregate rate
+    double intervalSec = options.openLoop ? options.concurrency / std::max(options.rate, 0.001) : 0.0;
+    Clock::time_point nextSend = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(intervalSec * workerIndex / options.concurrency));
+
+    while (Clock::now() < deadline)
+    {
+        if (sock == INVALID_SOCKET)
+        {
+            sock = connectToServer(options);
+            pending.clear();
+            if (sock == INVALID_SOCKET)
+            {
+                result.errors++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            result.connects++;
+        }
+
+        // Build a batch of pipelined requests
+        int depth = options.keepAlive ? options.pipeline : 1;
+        string batch;
+        vector<LoadMethod> methods;
+        for (int i = 0; i < depth && claimRequest(options); i++)
+        {
+            LoadMethod method;
+            batch += factory.next(method);
+            methods.push_back(method);
+        }
+        if (methods.empty())
+            break;
+
+        Clock::time_point sendTime;
+        if (options.openLoop)
+        {
+            if (nextSend >= deadline)
+                break;
+            std::this_thread::sleep_until(nextSend);
+            sendTime = nextSend; // Latency counts from the intended send time
+            nextSend += std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(intervalSec * (double)methods.size()));
+        }
+        else
+        {
+            sendTime = Clock::now();
+        }
+
+        bool failed = !sendAll(sock, batch);
+        if (!failed)
+            result.bytesSent += (long long)batch.size();
+
+        bool serverClosed = false;
+        for (size_t i = 0; i < methods.size() && !failed; i++)
+        {
+            int status = readResponse(sock, pending, methods[i] == LOAD_HEAD, serverClosed, result.bytesReceived);
+            if (status < 0)
+            {
+                failed = true;
+                break;
+            }
+            uint64_t latency = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - sendTime).count();
+            result.latenciesNs.push_back(latency);
+            result.requests++;
+            result.perMethod[methods[i]]++;
+            if (status >= 100 && status < 600)
+                result.statusClass[status / 100]++;
+            if (serverClosed && i + 1 < methods.size())
+                failed = true; // Remaining pipelined requests were dropped by the server
+        }
+
+        if (failed)
+            result.errors++;
+        if (failed || serverClosed || !options.keepAlive)
+        {
+            CLOSE_SOCKET(sock);
+            sock = INVALID_SOCKET;
+        }
+    }
+
+    if (sock != INVALID_SOCKET)
+        CLOSE_SOCKET(sock);
+}
+
+static uint64_t percentile(const vector<uint64_t>& sorted, double q)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = (size_t)(q * (double)(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+int main(int argc, char* argv[])
+{
+    LoadOptions options;
+    if (!parseArguments(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+#ifdef _WIN32
+    WSAData wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != NO_ERROR)
+    {
+        cerr << "load_generator: Error at WSAStartup()" << endl;
+        return 1;
+    }
+#endif
+
+    vector<WorkerResult> results((size_t)options.concurrency);
+    vector<std::thread> workers;
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.durationSec));
+
+    for (int i = 0; i < options.concurrency; i++)
+        workers.emplace_back(runWorker, std::cref(options), i, start, deadline, std::ref(results[(size_t)i]));
+    for (std::thread& worker : workers)
+        worker.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Merge worker results
+    WorkerResult total;
+    for (WorkerResult& result : results)
+    {
+        total.latenciesNs.insert(total.latenciesNs.end(), result.latenciesNs.begin(), result.latenciesNs.end());
+        total.requests += result.requests;
+        total.errors += result.errors;
+        total.connects += result.connects;
+        total.bytesSent += result.bytesSent;
+        total.bytesReceived += result.bytesReceived;
+        for (int i = 0; i < LOAD_METHOD_COUNT; i++)
+            total.perMethod[i] += result.perMethod[i];
+        for (int i = 0; i < 6; i++)
+            total.statusClass[i] += result.statusClass[i];
+    }
+    std::sort(total.latenciesNs.begin(), total.latenciesNs.end());
+
+    double throughput = elapsed > 0.0 ? (double)total.requests / elapsed : 0.0;
+    double p50 = percentile(total.latenciesNs, 0.50) / 1000.0;
+    double p99 = percentile(total.latenciesNs, 0.99) / 1000.0;
+    double p999 = percentile(total.latenciesNs, 0.999) / 1000.0;
+    double maxLatency = total.latenciesNs.empty() ? 0.0 : total.latenciesNs.back() / 1000.0;
+
+    if (options.json)
+    {
+        cout << "{\"benchmark\":\"load\",\"label\":\"" << options.label << "\""
+            << ",\"mode\":\"" << (options.openLoop ? "open" : "closed") << "\""
+            << ",\"concurrency\":" << options.concurrency
+            << ",\"keep_alive\":" << (options.keepAlive ? "true" : "false")
+            << ",\"pipeline\":" << options.pipeline
+            << ",\"target_rate\":" << (options.openLoop ? options.rate : 0.0)
+            << ",\"duration_s\":" << elapsed
+            << ",\"requests\":" << total.requests
+            << ",\"errors\":" << total.errors
+            << ",\"connections\":" << total.connects
+            << ",\"bytes_sent\":" << total.bytesSent
+            << ",\"bytes_received\":" << total.bytesReceived
+            << ",\"throughput_rps\":" << throughput
+            << ",\"latency_us\":{\"p50\":" << p50 << ",\"p99\":" << p99
+            << ",\"p999\":" << p999 << ",\"max\":" << maxLatency << "}"
+            << ",\"methods\":{";
+        for (int i = 0; i < LOAD_METHOD_COUNT; i++)
+            cout << (i > 0 ? "," : "") << "\"" << methodNames[i] << "\":" << total.perMethod[i];
+        cout << "},\"status\":{";
+        for (int i = 1; i < 6; i++)
+            cout << (i > 1 ? "," : "") << "\"" << i << "xx\":" << total.statusClass[i];
+        cout << "}}" << endl;
+    }
+    else
+    {
+        cout << "Requests: " << total.requests << " in " << elapsed << "s (" << throughput << " req/s), "
+            << total.errors << " errors\n"
+            << "Latency (us): p50 " << p50 << ", p99 " << p99 << ", p999 " << p999 << ", max " << maxLatency << endl;
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return total.requests > 0 ? 0 : 2;
+}
@@ -0,0 +1,294 @@
+// Microbenchmarks for the request parsing and response serialization paths.
+//
+// Every benchmark is timed per iteration so the output carries latency
+// percentiles alongside throughput. Output is one JSON object per line.
+// On Linux the retired user-space instructions per iteration are reported
+// too when hardware counters are available (instructions_per_op).
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "VirtualHosts.h"
+#include "UriPath.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::endl;
+
+typedef std::chrono::steady_clock Clock;
+
+// Discards console logging done by the handlers while benchmarking
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// Counts retired user-space instructions (perf_event_open); inactive where unsupported
+class InstructionCounter
+{
+public:
+    InstructionCounter()
+    {
+#if defined(__linux__)
+        perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.size = sizeof(attributes);
+        attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+#endif
+    }
+
+    ~InstructionCounter()
+    {
+#if defined(__linux__)
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (fd < 0)
+            return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+#if defined(__linux__)
+        if (fd < 0)
+            return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != (ssize_t)sizeof(count))
+            count = 0;
+#endif
+        return count;
+    }
+
+private:
+    int fd = -1;
+};
+
+// Keeps results observable so the optimizer cannot drop the work
+static volatile size_t sink = 0;
+
+static uint64_t percentile(const vector<uint64_t>& sorted, double q)
+{
+    size_t index = (size_t)(q * (double)(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static void runBenchmark(std::ostream& out, const string& name, size_t iterations, const std::function<size_t()>& body)
+{
+    // Warm up caches and branch predictors
+    for (size_t i = 0; i < iterations / 10 + 1; i++)
+        sink = sink + body();
+
+    // Instruction count over an untimed pass, so the clock reads are not counted
+    InstructionCounter counter;
+    counter.start();
+    for (size_t i = 0; i < iterations; i++)
+        sink = sink + body();
+    uint64_t instructions = counter.stop();
+
+    vector<uint64_t> samples;
+    samples.reserve(iterations);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        Clock::time_point before = Clock::now();
+        sink = sink + body();
+        samples.push_back((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    std::sort(samples.begin(), samples.end());
+
+    out << "{\"benchmark\":\"micro\",\"name\":\"" << name << "\""
+        << ",\"iterations\":" << iterations
+        << ",\"ops_per_sec\":" << (double)iterations / elapsed
+        << ",\"p50_ns\":" << percentile(samples, 0.50)
+        << ",\"p99_ns\":" << percentile(samples, 0.99)
+        << ",\"p999_ns\":" << percentile(samples, 0.999)
+        << ",\"max_ns\":" << samples.back();
+    if (counter.available())
+        out << ",\"instructions_per_op\":" << (double)instructions / (double)iterations;
+    out << "}" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t iterations = argc > 1 ? (size_t)strtoull(argv[1], nullptr, 10) : 200000;
+    string filter = argc > 2 ? argv[2] : "";
+
+    // Handler logging on cout is swallowed; results go to the original stdout buffer
+    NullBuffer nullBuffer;
+    std::streambuf* consoleBuffer = cout.rdbuf(&nullBuffer);
+    std::ostream results(consoleBuffer);
+
+    const string getRequest =
+        "GET /server_page.html?lang=fr HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "User-Agent: bench\r\n"
+        "Accept: text/html\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+    const string putRequest =
+        "PUT /bench.txt HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Content-Length: 64\r\n"
+        "\r\n" + string(64, 'x');
+
+    struct Case
+    {
+        string name;
+        std::function<size_t()> body;
+    };
+    vector<Case> cases;
+
+    cases.push_back({ "handleRequest_get", [&]() {
+        HttpRequest request;
+        return (size_t)request.handleRequest(getRequest);
+    } });
+    cases.push_back({ "handleRequest_put", [&]() {
+        HttpRequest request;
+        return (size_t)request.handleRequest(putRequest);
+    } });
+
+    // Every method in turn, so method parsing and dispatch cannot ride on one predicted branch
+    vector<string> methodRequests;
+    for (const char* method : { "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "TRACE" })
+        methodRequests.push_back(string(method) + " /bench.txt HTTP/1.1\r\nHost: localhost\r\nContent-Length: 1\r\n\r\nx");
+    size_t methodTurn = 0;
+    cases.push_back({ "handleRequest_mixed_methods", [&]() {
+        HttpRequest request;
+        methodTurn = (methodTurn + 1) % methodRequests.size();
+        return (size_t)request.handleRequest(methodRequests[methodTurn]);
+    } });
+
+    HttpRequest parsedOptions;
+    parsedOptions.handleRequest("OPTIONS / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    cases.push_back({ "dispatch_options", [&]() {
+        return (size_t)parsedOptions.handlePerMethodRequest().getStatusCode();
+    } });
+
+    string normalized;
+    cases.push_back({ "normalize_uri", [&]() {
+        UriPath::normalize("/docs/./guide/../images/%E2%9C%93/logo%20large.png", normalized);
+        return normalized.size();
+    } });
+
+    // Document root with language variants for the route index
+    std::filesystem::path root = std::filesystem::temp_directory_path() / "web_server_bench";
+    std::filesystem::create_directories(root);
+    for (const char* language : { "en", "fr", "he" })
+        std::ofstream(root / (string("server_page_") + language + ".html")) << "<html>" << language << "</html>";
+    ServerConfig benchConfig;
+    benchConfig.documentRoot = root.string();
+    VirtualHostConfig blog;
+    blog.name = "blog";
+    blog.hostNames = { "blog.example.com", "www.blog.example.com" };
+    blog.documentRoot = root.string();
+    benchConfig.virtualHosts.push_back(blog);
+    VirtualHosts::instance().configure(benchConfig);
+
+    const vector<string> hostHeaders = { "blog.example.com", "WWW.Blog.Example.com:8080", "localhost", "127.0.0.1:80" };
+    size_t hostTurn = 0;
+    cases.push_back({ "select_virtual_host", [&]() {
+        hostTurn = (hostTurn + 1) % hostHeaders.size();
+        return VirtualHosts::instance().select(hostHeaders[hostTurn]).name.size();
+    } });
+
+    HttpRequest parsedGet;
+    parsedGet.handleRequest(getRequest);
+    cases.push_back({ "extractFilePath", [&]() {
+        return parsedGet.extractFilePath().size();
+    } });
+
+    cases.push_back({ "request_get_end_to_end", [&]() {
+        HttpRequest request;
+        request.handleRequest(getRequest);
+        return request.handlePerMethodRequest().toString().size();
+    } });
+
+    HttpRequest negotiatedGet;
+    negotiatedGet.handleRequest(
+        "GET /server_page.html HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Accept-Language: de-DE, he;q=0.9, fr;q=0.8, en;q=0.5\r\n"
+        "\r\n");
+    cases.push_back({ "extractFilePath_accept_language", [&]() {
+        return negotiatedGet.extractFilePath().size();
+    } });
+
+    // A path that does not exist: opened on disk every time, or found in the record of missing paths
+    RootDirectory benchRoot;
+    benchRoot.open(root.string());
+    const string missingPath = "wp-login.php";
+    cases.push_back({ "open_missing_file", [&]() {
+        return (size_t)(benchRoot.readFile(missingPath) != nullptr);
+    } });
+    NegativeCache missingPaths;
+    missingPaths.insert(missingPath);
+    cases.push_back({ "negative_cache_lookup", [&]() {
+        return (size_t)missingPaths.contains(missingPath);
+    } });
+    HttpRequest missingGet;
+    missingGet.handleRequest("GET /wp-login.php HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    cases.push_back({ "request_get_missing", [&]() {
+        return missingGet.handlePerMethodRequest().toString().size();
+    } });
+
+    HttpResponse smallResponse(200, "OK");
+    smallResponse.setContentType("text/html");
+    smallResponse.setConnection("keep-alive");
+    smallResponse.setBody("<!DOCTYPE html><html><body><h1>ok</h1></body></html>");
+    cases.push_back({ "toString_small", [&]() {
+        return smallResponse.toString().size();
+    } });
+
+    HttpResponse largeResponse(200, "OK");
+    largeResponse.setContentType("text/html");
+    largeResponse.setConnection("keep-alive");
+    largeResponse.setBody(string(64 * 1024, 'a'));
+    cases.push_back({ "toString_64k", [&]() {
+        return largeResponse.toString().size();
+    } });
+
+    for (const Case& benchmark : cases)
+    {
+        if (filter.empty() || benchmark.name.find(filter) != string::npos)
+            runBenchmark(results, benchmark.name, iterations, benchmark.body);
+    }
+
+    cout.rdbuf(consoleBuffer);
+    return 0;
+}
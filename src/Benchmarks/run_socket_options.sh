@@ -0,0 +1,60 @@
+#!/bin/sh
+# Measures small-GET latency under different TCP socket settings. Starts the
+# server once per variant with a generated configuration file, runs the load
+# generator against it and writes one JSON object per line.
+#
+# Usage: run_socket_options.sh [bin_dir] [document_root] [port] [output]
+#   BENCH_DURATION   seconds per scenario (default 5)
+#   BENCH_PATHS      GET targets (default /server_page.html)
+#   BENCH_MSS        segment size the client advertises (default 1448, an Ethernet path;
+#                    over loopback the default MSS is ~64K and Nagle never triggers)
+set -e
+
+BIN_DIR=${1:-.}
+ROOT=${2:-/var/www}
+PORT=${3:-8080}
+OUTPUT=${4:-socket_options_output.txt}
+DURATION=${BENCH_DURATION:-5}
+PATHS=${BENCH_PATHS:-/server_page.html}
+MSS=${BENCH_MSS:-1448}
+CONFIG=$(mktemp)
+
+: > "$OUTPUT"
+
+variant() {
+    name=$1
+    shift
+    {
+        echo "port = $PORT"
+        echo "document_root = $ROOT"
+        echo "max_connections_per_client = 0"
+        for setting in "$@"; do
+            echo "$setting"
+        done
+    } > "$CONFIG"
+
+    "$BIN_DIR/web_server" "$CONFIG" > /dev/null 2>&1 &
+    server=$!
+    sleep 1
+
+    for scenario in "keepalive_c1 --concurrency 1" "keepalive_c16 --concurrency 16" "close_c16 --concurrency 16 --close"; do
+        set -- $scenario
+        label=$1
+        shift
+        "$BIN_DIR/load_generator" --port "$PORT" --duration "$DURATION" --paths "$PATHS" --mss "$MSS" \
+            --label "$name/$label" "$@" >> "$OUTPUT" || true
+    done
+
+    kill "$server"
+    wait "$server" 2> /dev/null || true
+}
+
+variant default
+variant nagle           "tcp_nodelay = off"
+variant no_cork         "tcp_cork = off"
+variant defer_accept    "tcp_defer_accept_seconds = 5"
+variant small_sndbuf    "socket_send_buffer = 16K"
+variant notsent_lowat   "tcp_notsent_lowat = 16K"
+
+rm -f "$CONFIG"
+echo "Results written to $OUTPUT"
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Runs the microbenchmarks and a matrix of load scenarios against a running
+# server, writing one JSON object per line for regression tracking.
+#
+# Usage: run_suite.sh [bin_dir] [host] [port] [output]
+#   BENCH_DURATION   seconds per load scenario (default 10)
+#   BENCH_PATHS      comma-separated GET/HEAD targets (default /server_page.html)
+set -e
+
+BIN_DIR=${1:-.}
+HOST=${2:-127.0.0.1}
+PORT=${3:-80}
+OUTPUT=${4:-bench_output.txt}
+DURATION=${BENCH_DURATION:-10}
+PATHS=${BENCH_PATHS:-/server_page.html}
+
+: > "$OUTPUT"
+
+"$BIN_DIR/micro_benchmarks" >> "$OUTPUT"
+
+load() {
+    label=$1
+    shift
+    "$BIN_DIR/load_generator" --host "$HOST" --port "$PORT" --duration "$DURATION" \
+        --paths "$PATHS" --label "$label" "$@" >> "$OUTPUT" || true
+}
+
+load get_keepalive_c1     --concurrency 1
+load get_keepalive_c16    --concurrency 16
+load get_close_c16        --concurrency 16 --close
+load get_pipeline8_c4     --concurrency 4 --pipeline 8
+load head_keepalive_c16   --concurrency 16 --mix HEAD=1
+load mixed_c16            --concurrency 16 --mix GET=70,HEAD=10,PUT=10,POST=5,DELETE=5 \
+                          --body-sizes 128:0.6,4096:0.3,65536:0.1
+load open_1k              --mode open --rate 1000 --concurrency 16
+load open_5k              --mode open --rate 5000 --concurrency 32
+
+echo "Results written to $OUTPUT"
@@ -0,0 +1,760 @@
+// Unit tests for the parsers and encoders on the request path, checked
+// against published vectors where one exists (RFC 7541 appendix C for HPACK,
+// FIPS 180-4 / NIST examples for SHA-256, the POSIX ustar layout), and for
+// the file cache's shared loads under concurrent misses.
+//
+// Run by ctest; also runnable on its own. Prints one line per failed check
+// and exits non-zero if any failed.
+#include "UriPath.h"
+#include "HttpHeaders.h"
+#include "Hpack.h"
+#include "PartialUploads.h"
+#include "RootDirectory.h"
+#include "TarArchive.h"
+#include "Sha256.h"
+#include "BlobStore.h"
+#include "FileCache.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "RouteIndex.h"
+#include "HttpRequest.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::cout;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { failures++; cout << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; } } while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+    do { auto actualValue = (actual); auto expectedValue = (expected); if (!(actualValue == expectedValue)) { failures++; \
+        cout << __FILE__ << ":" << __LINE__ << ": " #actual " is \"" << actualValue << "\", expected \"" << expectedValue << "\"\n"; } } while (0)
+
+// "8286 8441" -> bytes; spaces are ignored
+static string fromHex(const char* text)
+{
+    string bytes;
+    int high = -1;
+    for (const char* c = text; *c != '\0'; c++)
+    {
+        if (*c == ' ')
+            continue;
+        int value = *c <= '9' ? *c - '0' : (*c | 0x20) - 'a' + 10;
+        if (high < 0)
+            high = value;
+        else
+        {
+            bytes += (char)(high * 16 + value);
+            high = -1;
+        }
+    }
+    return bytes;
+}
+
+// A scratch directory removed when the test ends
+class TemporaryDirectory
+{
+public:
+    explicit TemporaryDirectory(const char* name)
+        : path(std::filesystem::temp_directory_path() / name)
+    {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~TemporaryDirectory() { std::error_code error; std::filesystem::remove_all(path, error); }
+
+    string text() const { return path.string(); }
+
+    std::filesystem::path path;
+};
+
+// UriPath
+
+static void testUriPath()
+{
+    struct Case { const char* input; const char* expected; };
+    const Case valid[] = {
+        { "/", "/" },
+        { "/index.html", "/index.html" },
+        { "/a/b/../c", "/a/c" },
+        { "/a/./b", "/a/b" },
+        { "/a//b", "/a/b" },
+        { "/a/.", "/a/" },
+        { "/a/..", "/" },
+        { "/../../etc/passwd", "/etc/passwd" },
+        { "/%2e%2e/%2E%2E/etc", "/etc" },
+        { "/a/%2e/b", "/a/b" },
+        { "/a%2fb/../c", "/a/c" },     // An encoded slash separates segments like a literal one
+        { "/hello%20world", "/hello world" },
+        { "/caf%C3%A9", "/caf\xC3\xA9" },
+    };
+    for (const Case& c : valid)
+    {
+        string result;
+        CHECK(UriPath::normalize(c.input, result));
+        CHECK_EQUAL(result, string(c.expected));
+    }
+
+    const char* const invalid[] = {
+        "", "a/b", "/a%", "/a%2", "/a%zz", "/a%00b", "/a%0d%0a", "/a%5cb", "/a\\b", "/a%7f",
+    };
+    for (const char* input : invalid)
+    {
+        string result;
+        CHECK(!UriPath::normalize(input, result));
+    }
+
+    CHECK(UriPath::hasHiddenSegment("/.blobs/ab/cd"));
+    CHECK(UriPath::hasHiddenSegment("/docs/.report.pdf.upload"));
+    CHECK(UriPath::hasHiddenSegment(".missing"));
+    CHECK(!UriPath::hasHiddenSegment("/docs/report.pdf"));
+    CHECK(!UriPath::hasHiddenSegment("/a.b/c..d"));
+}
+
+// HttpHeaders
+
+static void testHttpHeaders()
+{
+    const char buffer[] = "Host: example.com\r\nContent-Length:  12 \r\nX-Custom: a, b\r\nconnection: keep-alive\r\n";
+    HttpHeaders headers;
+    CHECK(headers.parse(buffer, 0, sizeof(buffer) - 1));
+    CHECK_EQUAL(headers.size(), (size_t)4);
+    CHECK_EQUAL(string(headers.get(buffer, HEADER_HOST)), string("example.com"));
+    CHECK_EQUAL(string(headers.get(buffer, HEADER_CONTENT_LENGTH)), string("12"));
+    CHECK_EQUAL(string(headers.get(buffer, HEADER_CONNECTION)), string("keep-alive"));
+    CHECK_EQUAL(string(headers.find(buffer, "x-CUSTOM")), string("a, b"));
+    CHECK(headers.find(buffer, "X-Missing").empty());
+    CHECK(!headers.has(HEADER_RANGE));
+
+    const char* const malformed[] = {
+        "NoColon\r\n",
+        ": empty-name\r\n",
+        "Bad Name: x\r\n",
+        "Host: a\r\nHost: b\r\n",
+        "Content-Length: 1\r\nContent-Length: 2\r\n",
+    };
+    for (const char* text : malformed)
+    {
+        HttpHeaders rejected;
+        CHECK(!rejected.parse(text, 0, strlen(text)));
+    }
+
+    string many;
+    for (size_t i = 0; i <= HttpHeaders::MAX_FIELDS; i++)
+        many += "X-" + std::to_string(i) + ": v\r\n";
+    HttpHeaders tooMany;
+    CHECK(!tooMany.parse(many.data(), 0, many.size()));
+
+    CHECK(HttpHeaders::hasToken("keep-alive, Upgrade", "upgrade"));
+    CHECK(!HttpHeaders::hasToken("keep-alive, Upgraded", "upgrade"));
+}
+
+// Request framing on a pipelined connection
+
+static void testMessageLength()
+{
+    const string headers = "PUT /a.txt HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\n\r\n";
+    CHECK_EQUAL(HttpRequest::messageLength(headers + "hel"), (size_t)0);
+    CHECK_EQUAL(HttpRequest::messageLength(headers + "helloGET / HTTP/1.1\r\n"), headers.size() + 5);
+    CHECK_EQUAL(HttpRequest::expectedLength(headers), headers.size() + 5);
+
+    // Transfer-Encoding: the body is never framed, so chunk bytes cannot become a request
+    const string chunked = "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n";
+    CHECK_EQUAL(HttpRequest::messageLength(chunked + "5\r\nhello\r\n0\r\n\r\n"), chunked.size());
+    const string both = "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n";
+    CHECK_EQUAL(HttpRequest::messageLength(both + "hello"), both.size());
+    CHECK_EQUAL(HttpRequest::expectedLength(both), both.size());
+}
+
+// HPACK (RFC 7541)
+
+static bool decodeBlock(HpackDecoder& decoder, const char* hex, vector<HeaderField>& fields)
+{
+    string block = fromHex(hex);
+    fields.clear();
+    return decoder.decode((const uint8_t*)block.data(), block.size(), fields);
+}
+
+static void checkFields(const vector<HeaderField>& actual, const vector<HeaderField>& expected)
+{
+    CHECK_EQUAL(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size() && i < expected.size(); i++)
+    {
+        CHECK_EQUAL(actual[i].first, expected[i].first);
+        CHECK_EQUAL(actual[i].second, expected[i].second);
+    }
+}
+
+static void testHpackIntegers()
+{
+    // C.1.1 - C.1.3
+    string out;
+    Hpack::encodeInteger(10, 5, 0, out);
+    CHECK_EQUAL(out, fromHex("0a"));
+    out.clear();
+    Hpack::encodeInteger(1337, 5, 0, out);
+    CHECK_EQUAL(out, fromHex("1f9a0a"));
+    out.clear();
+    Hpack::encodeInteger(42, 8, 0, out);
+    CHECK_EQUAL(out, fromHex("2a"));
+
+    string encoded = fromHex("1f9a0a");
+    const uint8_t* position = (const uint8_t*)encoded.data();
+    uint64_t value = 0;
+    CHECK(Hpack::decodeInteger(position, position + encoded.size(), 5, value));
+    CHECK_EQUAL(value, (uint64_t)1337);
+
+    // Truncated continuation bytes
+    string truncated = fromHex("1f9a");
+    position = (const uint8_t*)truncated.data();
+    CHECK(!Hpack::decodeInteger(position, position + truncated.size(), 5, value));
+}
+
+static void testHpackRequestsWithoutHuffman()
+{
+    // C.3: three requests on one connection
+    HpackDecoder decoder;
+    vector<HeaderField> fields;
+    CHECK(decodeBlock(decoder, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d", fields));
+    checkFields(fields, { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" } });
+
+    CHECK(decodeBlock(decoder, "8286 84be 5808 6e6f 2d63 6163 6865", fields));
+    checkFields(fields, { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" },
+        { "cache-control", "no-cache" } });
+
+    CHECK(decodeBlock(decoder, "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65", fields));
+    checkFields(fields, { { ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" }, { ":authority", "www.example.com" },
+        { "custom-key", "custom-value" } });
+}
+
+static void testHpackRequestsWithHuffman()
+{
+    // C.4: the same requests, Huffman-coded
+    HpackDecoder decoder;
+    vector<HeaderField> fields;
+    CHECK(decodeBlock(decoder, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff", fields));
+    checkFields(fields, { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" } });
+
+    CHECK(decodeBlock(decoder, "8286 84be 5886 a8eb 1064 9cbf", fields));
+    checkFields(fields, { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" },
+        { "cache-control", "no-cache" } });
+
+    CHECK(decodeBlock(decoder, "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf", fields));
+    checkFields(fields, { { ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" }, { ":authority", "www.example.com" },
+        { "custom-key", "custom-value" } });
+}
+
+static void testHpackResponsesWithHuffman()
+{
+    // C.6: three responses, Huffman-coded, with evictions from a 256-byte table
+    HpackDecoder decoder;
+    vector<HeaderField> fields;
+    CHECK(decodeBlock(decoder,
+        "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6"
+        "2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae 43d3", fields));
+    checkFields(fields, { { ":status", "302" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+        { "location", "https://www.example.com" } });
+
+    CHECK(decodeBlock(decoder, "4883 640e ffc1 c0bf", fields));
+    checkFields(fields, { { ":status", "307" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+        { "location", "https://www.example.com" } });
+
+    CHECK(decodeBlock(decoder,
+        "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab"
+        "77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af 2708 7f36 72c1 ab27 0fb5 291f"
+        "9587 3160 65c0 03ed 4ee5 b106 3d50 07", fields));
+    checkFields(fields, { { ":status", "200" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:22 GMT" },
+        { "location", "https://www.example.com" }, { "content-encoding", "gzip" },
+        { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1" } });
+}
+
+static void testHpackDynamicTable()
+{
+    // The table states of C.5 / C.6 with SETTINGS_HEADER_TABLE_SIZE = 256
+    HpackDynamicTable table(256);
+    table.add(":status", "302");
+    table.add("cache-control", "private");
+    table.add("date", "Mon, 21 Oct 2013 20:13:21 GMT");
+    table.add("location", "https://www.example.com");
+    CHECK(table.get(65) != nullptr && table.get(65)->first == ":status");
+    table.add(":status", "307"); // Evicts ":status: 302"
+    CHECK(table.get(62) != nullptr && table.get(62)->second == "307");
+    CHECK(table.get(65) != nullptr && table.get(65)->first == "cache-control");
+    CHECK(table.get(66) == nullptr);
+    CHECK(table.get(0) == nullptr);
+    CHECK(table.get(2) != nullptr && table.get(2)->first == ":method" && table.get(2)->second == "GET");
+
+    table.add("date", "Mon, 21 Oct 2013 20:13:22 GMT");
+    table.add("content-encoding", "gzip");
+    table.add("set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1");
+    CHECK(table.get(62) != nullptr && table.get(62)->first == "set-cookie");
+    CHECK(table.get(63) != nullptr && table.get(63)->first == "content-encoding");
+    CHECK(table.get(64) != nullptr && table.get(64)->second == "Mon, 21 Oct 2013 20:13:22 GMT");
+    CHECK(table.get(65) == nullptr);
+}
+
+static void testHpackRoundTrip()
+{
+    // The encoder's choices (indexing, Huffman) are its own; the decoder must read them back
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    const vector<HeaderField> responses[] = {
+        { { ":status", "200" }, { "content-type", "text/html" }, { "content-length", "1234" } },
+        { { ":status", "200" }, { "content-type", "text/html" }, { "content-length", "99" }, { "x-custom", "\x01\xff binary" } },
+        { { ":status", "404" }, { "content-type", "text/html" }, { "server", string(300, 'x') } },
+    };
+    for (const vector<HeaderField>& fields : responses)
+    {
+        string block;
+        encoder.encode(fields, block);
+        vector<HeaderField> decoded;
+        CHECK(decoder.decode((const uint8_t*)block.data(), block.size(), decoded));
+        checkFields(decoded, fields);
+    }
+}
+
+static void testHpackMalformed()
+{
+    HpackDecoder decoder;
+    vector<HeaderField> fields;
+    CHECK(!decodeBlock(decoder, "80", fields));            // Index 0
+    CHECK(!decodeBlock(decoder, "ff 00", fields));         // Index 127 is past both tables
+    CHECK(!decodeBlock(decoder, "40 0a 6375 7374", fields)); // Literal shorter than its length
+    CHECK(!decodeBlock(decoder, "3f e2 1f", fields));      // Table size update to 4097, above the advertised 4096
+}
+
+static void testHpackHeaderListLimit()
+{
+    // One 4,000-byte literal added to the table, then referenced again and again
+    // by one-byte indexed fields: a 64 KiB block would decode to ~250 MB
+    string block = fromHex("40 0178");
+    Hpack::encodeInteger(4000, 7, 0, block);
+    block += string(4000, 'v');
+    block.resize(64 * 1024, (char)(0x80 | 62));
+    HpackDecoder decoder;
+    vector<HeaderField> fields;
+    CHECK(!decoder.decode((const uint8_t*)block.data(), block.size(), fields));
+    CHECK(fields.size() * 4000 <= HpackDecoder::MAX_HEADER_LIST_SIZE);
+
+    // A list just under the limit is accepted
+    HpackDecoder fresh;
+    string fits = fromHex("40 0178");
+    Hpack::encodeInteger(4000, 7, 0, fits);
+    fits += string(4000, 'v');
+    fits.append(14, (char)(0x80 | 62)); // 15 fields of 4,033 bytes
+    fields.clear();
+    CHECK(fresh.decode((const uint8_t*)fits.data(), fits.size(), fields));
+    CHECK_EQUAL(fields.size(), (size_t)15);
+}
+
+// PartialUploads
+
+static void testContentRange()
+{
+    uint64_t first, last, total;
+    CHECK(PartialUploads::parseContentRange("bytes 0-99/1000", first, last, total));
+    CHECK(first == 0 && last == 99 && total == 1000);
+    CHECK(PartialUploads::parseContentRange("bytes 999-999/1000", first, last, total));
+
+    const char* const invalid[] = {
+        "bytes 0-99/*", "bytes */1000", "bytes 100-99/1000", "bytes 0-1000/1000", "bytes -5-99/1000",
+        "bytes 0-99", "items 0-99/1000", "bytes 0-99/1000000000000000000000", "bytes 0x10-99/1000", "bytes 0-99/ 1000",
+    };
+    for (const char* value : invalid)
+        CHECK(!PartialUploads::parseContentRange(value, first, last, total));
+}
+
+static void testPartialUploadExtents()
+{
+    TemporaryDirectory directory("web_server_unit_uploads");
+    RootDirectory root;
+    CHECK(root.open(directory.text()));
+    PartialUploads uploads(root);
+
+    string received;
+    CHECK_EQUAL(uploads.write("file.bin", 10, 40, string(10, 'b'), received), UPLOAD_PARTIAL);
+    CHECK_EQUAL(received, string("bytes 10-19/40"));
+    CHECK_EQUAL(uploads.write("file.bin", 30, 40, string(5, 'd'), received), UPLOAD_PARTIAL);
+    CHECK_EQUAL(received, string("bytes 10-19,30-34/40"));
+    // Touching extents merge; overlapping ones too
+    CHECK_EQUAL(uploads.write("file.bin", 20, 40, string(5, 'c'), received), UPLOAD_PARTIAL);
+    CHECK_EQUAL(received, string("bytes 10-24,30-34/40"));
+    CHECK_EQUAL(uploads.write("file.bin", 22, 40, string(10, 'c'), received), UPLOAD_PARTIAL);
+    CHECK_EQUAL(received, string("bytes 10-34/40"));
+    CHECK_EQUAL(uploads.write("file.bin", 0, 41, string(1, 'x'), received), UPLOAD_CONFLICT);
+    CHECK(uploads.status("file.bin", received));
+
+    CHECK_EQUAL(uploads.write("file.bin", 35, 40, string(5, 'e'), received), UPLOAD_PARTIAL);
+    CHECK_EQUAL(uploads.write("file.bin", 0, 40, string(10, 'a'), received), UPLOAD_COMPLETE);
+    CHECK(!uploads.status("file.bin", received));
+
+    shared_ptr<const string> contents = root.readFile("file.bin");
+    CHECK(contents != nullptr);
+    if (contents)
+        CHECK_EQUAL(*contents, string(10, 'a') + string(10, 'b') + string(12, 'c') + string(3, 'd') + string(5, 'e'));
+    CHECK(!std::filesystem::exists(directory.path / ".file.bin.upload"));
+
+    // A total over the limit is refused before a staging file is made
+    uploads.setMaxTotal(100);
+    CHECK_EQUAL(uploads.write("big.bin", 0, 101, string(1, 'x'), received), UPLOAD_TOO_LARGE);
+    CHECK(!uploads.status("big.bin", received));
+    CHECK(!std::filesystem::exists(directory.path / ".big.bin.upload"));
+    CHECK_EQUAL(uploads.write("big.bin", 0, 100, string(100, 'x'), received), UPLOAD_COMPLETE);
+}
+
+// Only paths that do not exist may be remembered as missing
+static void testRootDirectoryMissing()
+{
+    TemporaryDirectory directory("web_server_unit_missing");
+    std::ofstream(directory.path / "file.txt") << "x";
+    std::filesystem::create_directory(directory.path / "docs");
+    RootDirectory root;
+    CHECK(root.open(directory.text()));
+
+    CHECK(root.isMissing("absent.txt"));
+    CHECK(root.isMissing("absent/page.html"));
+    CHECK(root.isMissing("file.txt/page.html"));   // ENOTDIR
+    CHECK(!root.isMissing("file.txt"));
+    CHECK(!root.isMissing("docs"));
+    CHECK(!root.isMissing("../file.txt"));         // Never resolved, so not known to be missing
+}
+
+// RouteIndex
+
+// Resolves a URI the way a request with one language preference does; "" if nothing matches
+static string resolve(const RouteIndex& routes, const string& uri, const string& language)
+{
+    RouteMatch match = routes.lookup(uri, { language });
+    return match.entry ? match.entry->uriPath + (match.negotiated ? " negotiated" : "") : string();
+}
+
+// Updating single files gives the same routes as indexing the tree again
+static void testRouteIndexUpdate()
+{
+    TemporaryDirectory directory("web_server_unit_routes");
+    std::filesystem::create_directory(directory.path / "docs");
+    std::ofstream(directory.path / "docs" / "page.html") << "plain";
+    std::ofstream(directory.path / "docs" / "page_fr.html") << "fr";
+    std::ofstream(directory.path / "docs" / "guide_de.html") << "de";
+    RouteIndex routes;
+    routes.setRoot(directory.text());
+
+    // Added, replaced and removed through update(), as PUT and DELETE do
+    std::ofstream(directory.path / "docs" / "page_de.html") << "de";
+    routes.update("docs/page_de.html");
+    std::ofstream(directory.path / "docs" / "guide.html") << "plain";
+    routes.update("docs/guide.html");
+    std::ofstream(directory.path / "new.txt") << "new";
+    routes.update("new.txt");
+    std::filesystem::remove(directory.path / "docs" / "page_fr.html");
+    routes.update("docs/page_fr.html");
+    std::filesystem::remove(directory.path / "docs" / "guide_de.html");
+    routes.update("docs/guide_de.html");
+
+    RouteIndex rebuilt;
+    rebuilt.setRoot(directory.text());
+    const char* const uris[] = {
+        "/docs/page.html", "/docs/page_de.html", "/docs/page_fr.html", "/docs/guide.html", "/docs/guide_de.html", "/new.txt",
+    };
+    for (const char* uri : uris)
+    {
+        for (const char* language : { "", "en", "de", "fr" })
+            CHECK_EQUAL(resolve(routes, uri, language), resolve(rebuilt, uri, language));
+    }
+    CHECK_EQUAL(resolve(routes, "/docs/page.html", "de"), string("/docs/page_de.html negotiated"));
+    CHECK_EQUAL(resolve(routes, "/docs/page.html", "fr"), string("/docs/page.html negotiated"));
+    CHECK_EQUAL(resolve(routes, "/docs/guide.html", "de"), string("/docs/guide.html"));
+    CHECK_EQUAL(resolve(routes, "/new.txt", ""), string("/new.txt"));
+}
+
+// FileCache
+
+// Writes a file under the directory and returns the index entry describing it
+static FileEntry writeEntry(const TemporaryDirectory& directory, const string& name, const string& content)
+{
+    std::ofstream(directory.path / name, std::ios::binary) << content;
+    FileEntry entry;
+    entry.fullPath = (directory.path / name).string();
+    entry.uriPath = "/" + name;
+    entry.size = content.size();
+    entry.modified = 1700000000;
+    return entry;
+}
+
+// Current value of a counter in the metrics text (0 if absent)
+static uint64_t metricValue(const string& name)
+{
+    string text = Metrics::renderPrometheus();
+    size_t position = text.find("\n" + name + " ");
+    return position == string::npos ? 0 : std::strtoull(text.c_str() + position + name.size() + 2, nullptr, 10);
+}
+
+// Many threads miss on the same file at once: each gets the whole body, the file
+// is read once and it is cached once
+static void testFileCacheConcurrentMisses()
+{
+    TemporaryDirectory directory("web_server_unit_cache");
+    string content(64 * 1024, 'x');
+    FileEntry entry = writeEntry(directory, "shared.bin", content);
+    RootDirectory root;
+    CHECK(root.open(directory.text()));
+    FileCache cache(root);
+
+    for (int round = 0; round < 20; round++)
+    {
+        cache.clear();
+        uint64_t missesBefore = metricValue("web_server_cache_lookups_total{result=\"miss\"}");
+        uint64_t coalescedBefore = metricValue("web_server_cache_coalesced_total");
+        std::atomic<bool> start{ false };
+        std::atomic<int> wrong{ 0 };
+        vector<std::thread> threads;
+        for (int i = 0; i < 16; i++)
+        {
+            threads.emplace_back([&] {
+                while (!start.load())
+                    std::this_thread::yield();
+                shared_ptr<const string> body = cache.getBody(entry);
+                if (!body || *body != content)
+                    wrong++;
+            });
+        }
+        start = true;
+        for (std::thread& thread : threads)
+            thread.join();
+        CHECK_EQUAL(wrong.load(), 0);
+        CHECK_EQUAL(cache.getTotalBytes(), content.size());
+        uint64_t reads = (metricValue("web_server_cache_lookups_total{result=\"miss\"}") - missesBefore)
+            - (metricValue("web_server_cache_coalesced_total") - coalescedBefore);
+        CHECK_EQUAL(reads, (uint64_t)1);
+    }
+}
+
+// A load that throws passes the exception to the callers waiting on it, and the
+// next miss loads the file again instead of waiting on the failed load
+static void testFileCacheLoadFailure()
+{
+    TemporaryDirectory directory("web_server_unit_cache_failure");
+    FileEntry first = writeEntry(directory, "first.txt", string(100, 'a'));
+    FileEntry second = writeEntry(directory, "second.txt", string(100, 'b'));
+    RootDirectory root;
+    CHECK(root.open(directory.text()));
+    FileCache cache(root);
+    CHECK(cache.getBody(first) != nullptr);
+
+    // With no room for the second body, caching it asks the reclaimer for memory;
+    // this one fails as an allocation would, after a second caller has joined the load
+    MemoryBudget& budget = MemoryBudget::instance();
+    size_t limit = budget.getLimit();
+    budget.setLimit(budget.total() + 50);
+    std::atomic<bool> waiterStarted{ false };
+    std::promise<bool> waiterResult;
+    std::future<bool> waiterThrew = waiterResult.get_future();
+    std::thread waiter;
+    budget.setReclaimer([&](size_t) -> size_t {
+        if (!waiterStarted.exchange(true))
+        {
+            waiter = std::thread([&] {
+                try
+                {
+                    cache.getBody(second);
+                    waiterResult.set_value(false);
+                }
+                catch (const std::bad_alloc&)
+                {
+                    waiterResult.set_value(true);
+                }
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        throw std::bad_alloc();
+    });
+
+    bool threw = false;
+    try
+    {
+        cache.getBody(second);
+    }
+    catch (const std::bad_alloc&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    if (waiterThrew.wait_for(std::chrono::seconds(5)) != std::future_status::ready)
+    {
+        cout << __FILE__ << ":" << __LINE__ << ": a caller waiting on the failed load never returned\n";
+        std::exit(1);
+    }
+    CHECK(waiterThrew.get());
+    waiter.join();
+
+    budget.setReclaimer(nullptr);
+    budget.setLimit(limit);
+    shared_ptr<const string> body = cache.getBody(second);
+    CHECK(body != nullptr);
+    if (body)
+        CHECK_EQUAL(*body, string(100, 'b'));
+}
+
+// TarArchive
+
+static string flatten(const vector<BodyPart>& parts)
+{
+    string bytes;
+    for (const BodyPart& part : parts)
+        bytes.append(part.data->data() + part.offset, (size_t)part.length);
+    return bytes;
+}
+
+static unsigned long long octalField(const string& block, size_t offset, size_t width)
+{
+    return std::stoull(block.substr(offset, width), nullptr, 8);
+}
+
+static void testTarHeaders()
+{
+    TarArchive archive;
+    CHECK(archive.add("dir/hello.txt", 1700000000, string("hello")));
+    string longName = string(120, 'd') + "/" + string(90, 'f');
+    CHECK(archive.add(longName, 0, string(512, 'z')));
+    CHECK(!archive.add(string(101, 'n'), 0, string("x")));     // No '/' to split at
+    CHECK(!archive.add(string(160, 'd') + "/f", 0, string()));  // Prefix over 155 bytes
+    string bytes = flatten(archive.finish());
+
+    // header, 5 bytes padded to a block, header, 512 bytes, two end blocks
+    CHECK_EQUAL(bytes.size(), (size_t)(512 * 6));
+    if (bytes.size() != 512 * 6)
+        return;
+    for (size_t offset : { (size_t)0, (size_t)1024 })
+    {
+        string header = bytes.substr(offset, 512);
+        CHECK_EQUAL(header.substr(257, 6), string("ustar", 6));
+        CHECK_EQUAL(header.substr(263, 2), string("00"));
+        CHECK_EQUAL(header[156], '0');
+
+        // ustar checksum: byte sum with the checksum field read as spaces
+        unsigned long long sum = 0;
+        for (size_t i = 0; i < 512; i++)
+            sum += i >= 148 && i < 156 ? ' ' : (unsigned char)header[i];
+        CHECK_EQUAL(octalField(header, 148, 6), sum);
+        CHECK_EQUAL(header[154], '\0');
+        CHECK_EQUAL(header[155], ' ');
+    }
+
+    string first = bytes.substr(0, 512);
+    CHECK_EQUAL(string(first.c_str()), string("dir/hello.txt"));
+    CHECK_EQUAL(octalField(first, 124, 11), 5ull);
+    CHECK_EQUAL(octalField(first, 136, 11), 1700000000ull);
+    CHECK_EQUAL(octalField(first, 100, 7), 0644ull);
+    CHECK_EQUAL(bytes.substr(512, 5), string("hello"));
+    CHECK_EQUAL(bytes.substr(517, 507), string(507, '\0'));
+
+    string second = bytes.substr(1024, 512);
+    CHECK_EQUAL(string(second.c_str()), string(90, 'f'));
+    CHECK_EQUAL(string(second.c_str() + 345), string(120, 'd'));
+    CHECK_EQUAL(bytes.substr(2048, 1024), string(1024, '\0'));
+
+    // A modification time past the 11-digit field is written as the largest that fits
+    TarArchive late;
+    CHECK(late.add("late.txt", (time_t)(1ll << 40), string()));
+    string lateHeader = flatten(late.finish()).substr(0, 512);
+    CHECK_EQUAL(octalField(lateHeader, 136, 11), 077777777777ull);
+    CHECK_EQUAL(lateHeader[147], '\0');
+}
+
+// SHA-256 (FIPS 180-4; NIST example values)
+
+static string hexOf(const uint8_t* bytes, size_t length)
+{
+    static const char digits[] = "0123456789abcdef";
+    string text;
+    for (size_t i = 0; i < length; i++)
+    {
+        text += digits[bytes[i] >> 4];
+        text += digits[bytes[i] & 15];
+    }
+    return text;
+}
+
+static void testSha256()
+{
+    struct Vector { string message; const char* digest; };
+    const Vector vectors[] = {
+        { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+            "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+        { string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+    };
+    for (const Vector& v : vectors)
+    {
+        uint8_t digest[Sha256::DIGEST_SIZE];
+        Sha256::portableDigest(v.message.data(), v.message.size(), digest);
+        CHECK_EQUAL(hexOf(digest, sizeof(digest)), string(v.digest));
+        CHECK_EQUAL(Sha256::hex(v.message.data(), v.message.size()), string(v.digest));
+    }
+
+    // RFC 9530 Repr-Digest carries the same digest in base64
+    CHECK_EQUAL(BlobStore::reprDigest(vectors[1].digest), string("sha-256=:ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=:"));
+
+    // Every length around the padding boundaries (55, 56, 63, 64 bytes) agrees with digest()
+    string message;
+    for (size_t length = 0; length < 200; length++)
+    {
+        uint8_t portable[Sha256::DIGEST_SIZE], reference[Sha256::DIGEST_SIZE];
+        Sha256::portableDigest(message.data(), message.size(), portable);
+        Sha256::digest(message.data(), message.size(), reference);
+        CHECK(memcmp(portable, reference, sizeof(portable)) == 0);
+        message += (char)('a' + length % 26);
+    }
+}
+
+int main()
+{
+    const std::pair<const char*, std::function<void()>> tests[] = {
+        { "uri_path", testUriPath },
+        { "http_headers", testHttpHeaders },
+        { "message_length", testMessageLength },
+        { "hpack_integers", testHpackIntegers },
+        { "hpack_requests", testHpackRequestsWithoutHuffman },
+        { "hpack_requests_huffman", testHpackRequestsWithHuffman },
+        { "hpack_responses_huffman", testHpackResponsesWithHuffman },
+        { "hpack_dynamic_table", testHpackDynamicTable },
+        { "hpack_round_trip", testHpackRoundTrip },
+        { "hpack_malformed", testHpackMalformed },
+        { "hpack_header_list_limit", testHpackHeaderListLimit },
+        { "content_range", testContentRange },
+        { "partial_upload_extents", testPartialUploadExtents },
+        { "root_directory_missing", testRootDirectoryMissing },
+        { "route_index_update", testRouteIndexUpdate },
+        { "file_cache_concurrent_misses", testFileCacheConcurrentMisses },
+        { "file_cache_load_failure", testFileCacheLoadFailure },
+        { "tar_headers", testTarHeaders },
+        { "sha256", testSha256 },
+    };
+    for (const auto& test : tests)
+    {
+        int before = failures;
+        test.second();
+        cout << (failures == before ? "ok   " : "FAIL ") << test.first << "\n";
+    }
+    if (failures > 0)
+        cout << failures << " check(s) failed\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+#include "BlobStore.h"
+#include "RootDirectory.h"
+#include "Sha256.h"
+
+static const char* const BLOB_DIRECTORY = ".blobs"; // Hidden, so the route index skips it
+
+// Two-level fan-out keeps directories small: ".blobs/ab/ab12..."
+string BlobStore::blobPath(const string& digest)
+{
+    return string(BLOB_DIRECTORY) + "/" + digest.substr(0, 2) + "/" + digest;
+}
+
+string BlobStore::parseDigest(string_view value)
+{
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        value = value.substr(1, value.size() - 2);
+    if (value.size() != Sha256::DIGEST_SIZE * 2)
+        return string();
+    string digest;
+    for (char c : value)
+    {
+        if (c >= 'A' && c <= 'F')
+            c = (char)(c - 'A' + 'a');
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+            return string();
+        digest += c;
+    }
+    return digest;
+}
+
+bool BlobStore::store(const string& relativePath, const string& content, string& digest, bool& reused) const
+{
+    digest = Sha256::hex(content.data(), content.size());
+    string blob = blobPath(digest);
+    // Compared byte for byte: a blob is only shared when it holds exactly this content
+    shared_ptr<const string> existing = root.readFile(blob);
+    reused = existing && *existing == content;
+    if (!reused)
+    {
+        // Written under a temporary name, so a blob is never seen half written
+        string directory = string(BLOB_DIRECTORY) + "/" + digest.substr(0, 2);
+        string temporary = directory + "/." + digest + ".tmp";
+        bool stored = root.makeDirectory(BLOB_DIRECTORY) && root.makeDirectory(directory)
+            && root.writeFile(temporary, content, false) && root.renameFile(temporary, blob);
+        if (!stored)
+        {
+            root.removeFile(temporary);
+            return root.writeFile(relativePath, content, false);
+        }
+    }
+    return root.linkFile(blob, relativePath) || root.writeFile(relativePath, content, false);
+}
+
+bool BlobStore::link(const string& relativePath, const string& digest) const
+{
+    // Hashed again before the name is pointed at it; a blob that no longer matches is dropped
+    string blob = blobPath(digest);
+    shared_ptr<const string> existing = root.readFile(blob);
+    if (!existing)
+        return false;
+    if (Sha256::hex(existing->data(), existing->size()) != digest)
+    {
+        root.removeFile(blob);
+        return false;
+    }
+    return root.linkFile(blob, relativePath);
+}
+
+string BlobStore::reprDigest(const string& digest)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint8_t bytes[Sha256::DIGEST_SIZE];
+    for (size_t i = 0; i < Sha256::DIGEST_SIZE; i++)
+        bytes[i] = (uint8_t)std::stoi(digest.substr(i * 2, 2), nullptr, 16);
+
+    string text = "sha-256=:";
+    for (size_t i = 0; i < Sha256::DIGEST_SIZE; i += 3)
+    {
+        uint32_t group = (uint32_t)bytes[i] << 16;
+        if (i + 1 < Sha256::DIGEST_SIZE)
+            group |= (uint32_t)bytes[i + 1] << 8;
+        if (i + 2 < Sha256::DIGEST_SIZE)
+            group |= bytes[i + 2];
+        text += alphabet[(group >> 18) & 63];
+        text += alphabet[(group >> 12) & 63];
+        text += i + 1 < Sha256::DIGEST_SIZE ? alphabet[(group >> 6) & 63] : '=';
+        text += i + 2 < Sha256::DIGEST_SIZE ? alphabet[group & 63] : '=';
+    }
+    return text + ":";
+}
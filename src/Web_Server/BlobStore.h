@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+
+using std::string;
+using std::string_view;
+
+class RootDirectory;
+
+// Content-addressed storage for PUT bodies (dedup_storage = on). Each distinct
+// body is stored once, as ".blobs/ab/<sha-256 hex>" under the site's root,
+// and the PUT path becomes a hard link to that blob. Uploading the same
+// artifact under many names costs one copy on disk, and the route index and
+// file cache serve the names like any other file.
+//
+// A client that knows the digest can skip the upload: a PUT with no body and
+// If-None-Match: "<digest>" links the name if the server has the blob.
+//
+// The store lives under the served root, but clients cannot write or delete
+// dot-prefixed paths (see UriPath::hasHiddenSegment), and a blob is compared
+// with the content before it is reused and rehashed before it is linked.
+//
+// Blobs stay when their names are deleted; one whose link count has dropped
+// to 1 is no longer used and may be removed.
+class BlobStore
+{
+public:
+    explicit BlobStore(const RootDirectory& root) : root(root) {}
+
+    // Stores content once and points relativePath at it. digest gets its SHA-256
+    // (hex); reused is true if the blob already existed. Falls back to writing
+    // a copy where hard links are not possible.
+    bool store(const string& relativePath, const string& content, string& digest, bool& reused) const;
+
+    // Points relativePath at an existing blob; false if there is no blob with this
+    // digest (or the stored one no longer hashes to it)
+    bool link(const string& relativePath, const string& digest) const;
+
+    // The digest in an If-None-Match value ("<hex>", quotes optional); empty if it is not one
+    static string parseDigest(string_view value);
+
+    // Repr-Digest header value (RFC 9530) for a hex digest: "sha-256=:<base64>:"
+    static string reprDigest(const string& digest);
+
+private:
+    static string blobPath(const string& digest);
+
+    const RootDirectory& root;
+};
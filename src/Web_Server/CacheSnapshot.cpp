@@ -0,0 +1,178 @@
+#include "CacheSnapshot.h"
+#include "VirtualHosts.h"
+#include "Platform.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+static const char MAGIC[4] = { 'W', 'S', 'H', 'S' };
+static const uint32_t VERSION = 1;
+static const unsigned PREWARM_THREADS = 4;
+
+template <typename T>
+static void writeValue(std::ostream& out, T value)
+{
+    out.write((const char*)&value, sizeof(value));
+}
+
+static void writeString(std::ostream& out, const string& text)
+{
+    writeValue<uint16_t>(out, (uint16_t)text.size());
+    out.write(text.data(), (std::streamsize)text.size());
+}
+
+template <typename T>
+static bool readValue(std::istream& in, T& value)
+{
+    return (bool)in.read((char*)&value, sizeof(value));
+}
+
+static bool readString(std::istream& in, string& text)
+{
+    uint16_t length;
+    if (!readValue(in, length))
+        return false;
+    text.resize(length);
+    return (bool)in.read(&text[0], length);
+}
+
+bool CacheSnapshot::save(const string& path, size_t maxFilesPerSite)
+{
+    const auto& sites = VirtualHosts::instance().allSites();
+    string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(MAGIC, sizeof(MAGIC));
+        writeValue<uint32_t>(out, VERSION);
+        writeValue<uint32_t>(out, (uint32_t)sites.size());
+        for (const auto& site : sites)
+        {
+            vector<HotFile> files = site->cache.hotFiles(maxFilesPerSite);
+            writeString(out, site->name);
+            writeValue<uint32_t>(out, (uint32_t)files.size());
+            for (const HotFile& file : files)
+            {
+                writeString(out, file.uriPath);
+                writeValue<uint64_t>(out, file.size);
+                writeValue<int64_t>(out, (int64_t)file.modified);
+                writeValue<uint32_t>(out, file.hits);
+            }
+        }
+        if (!out.flush())
+        {
+            out.close();
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+
+    // The data reaches the disk before the rename, and the rename before we report
+    // success, so a crash leaves the old snapshot or the new one, never a torn file
+    if (!Platform::syncFile(temporaryPath))
+    {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+        return false;
+    return Platform::syncDirectory(std::filesystem::path(path).parent_path().string());
+}
+
+// A file to load and the site it belongs to
+struct WarmTarget
+{
+    VirtualHost* site;
+    HotFile file;
+};
+
+static bool readSnapshot(const string& path, vector<WarmTarget>& targets)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    uint32_t version, siteCount;
+    if (!in.read(magic, sizeof(magic)) || std::char_traits<char>::compare(magic, MAGIC, sizeof(MAGIC)) != 0
+        || !readValue(in, version) || version != VERSION || !readValue(in, siteCount))
+        return false;
+
+    const auto& sites = VirtualHosts::instance().allSites();
+    for (uint32_t s = 0; s < siteCount; s++)
+    {
+        string name;
+        uint32_t fileCount;
+        if (!readString(in, name) || !readValue(in, fileCount))
+            return false;
+        VirtualHost* site = nullptr;
+        for (const auto& candidate : sites)
+            if (candidate->name == name)
+                site = candidate.get();
+        for (uint32_t f = 0; f < fileCount; f++)
+        {
+            HotFile file;
+            int64_t modified;
+            if (!readString(in, file.uriPath) || !readValue(in, file.size) || !readValue(in, modified) || !readValue(in, file.hits))
+                return false;
+            file.modified = (time_t)modified;
+            if (site != nullptr) // A site removed from the configuration is skipped
+                targets.push_back({ site, file });
+        }
+    }
+    return true;
+}
+
+size_t CacheSnapshot::prewarm(const string& path, int budgetMs)
+{
+    vector<WarmTarget> targets;
+    if (!readSnapshot(path, targets))
+        return 0;
+
+    // Most served first across all sites, so a short budget goes to the hottest files
+    std::stable_sort(targets.begin(), targets.end(),
+        [](const WarmTarget& a, const WarmTarget& b) { return a.file.hits > b.file.hits; });
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(budgetMs);
+    std::atomic<size_t> next{ 0 };
+    std::atomic<size_t> warmed{ 0 };
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < targets.size() && std::chrono::steady_clock::now() < deadline; i = next++)
+        {
+            VirtualHost& site = *targets[i].site;
+            const HotFile& file = targets[i].file;
+            RouteMatch match = site.routes.lookup(file.uriPath, {});
+            if (!match.entry || match.entry->uriPath != file.uriPath
+                || match.entry->size != file.size || match.entry->modified != file.modified)
+                continue; // Removed or changed since the snapshot
+            if (site.cache.isCacheable(*match.entry))
+            {
+                if (site.cache.getBody(*match.entry))
+                    warmed++;
+            }
+            else if (shared_ptr<OpenFile> opened = site.cache.openUncached(*match.entry))
+            {
+                opened->prefetch();
+                warmed++;
+            }
+        }
+    };
+
+    unsigned threadCount = std::max(1u, std::min(PREWARM_THREADS, std::thread::hardware_concurrency()));
+    vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; t++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+    return warmed;
+}
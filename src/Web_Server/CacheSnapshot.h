@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+using std::string;
+
+// Saves the files each site's cache serves most (path, size, mtime, hit count)
+// to a small binary file, and warms the caches from it after a restart so the
+// first requests do not all go to disk.
+//
+// Layout, in host byte order (a file from another architecture fails the version check):
+//   "WSHS", u32 version, u32 site count, then per site:
+//     u16 name length, name, u32 file count, then per file:
+//       u16 path length, URI path, u64 size, i64 mtime, u32 hits
+class CacheSnapshot
+{
+public:
+    // Writes the hot sets of all sites, up to maxFilesPerSite each. The file is
+    // written beside path and renamed over it, so a crash never leaves half a snapshot.
+    static bool save(const string& path, size_t maxFilesPerSite);
+
+    // Reads the snapshot and loads its files into the caches of the sites with the
+    // same names, most served first, on several threads, until all are loaded or
+    // budgetMs has passed. Files that changed since (size or mtime) are skipped;
+    // files too large for the cache are only prefetched into the page cache.
+    // Returns the number of files warmed.
+    static size_t prewarm(const string& path, int budgetMs);
+};
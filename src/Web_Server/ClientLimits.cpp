@@ -0,0 +1,153 @@
+#include "ClientLimits.h"
+#include <algorithm>
+#include <chrono>
+
+ClientLimits::ClientLimits() = default;
+
+uint64_t ClientLimits::nowMs()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // +1 so a bucket word is never 0 once started
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count() + 1;
+}
+
+size_t ClientLimits::slotOf(uint32_t address)
+{
+    // Fibonacci hashing spreads neighbouring addresses
+    return (size_t)((address * 2654435769u) >> 20) & (TABLE_SIZE - 1);
+}
+
+void ClientLimits::configure(uint32_t maxConnectionsPerClient, double requestsPerSecond, double burst)
+{
+    maxConnections.store(maxConnectionsPerClient, std::memory_order_relaxed);
+    tokensPerSecond.store((uint64_t)(requestsPerSecond * TOKEN_SCALE), std::memory_order_relaxed);
+    uint64_t scaledBurst = (uint64_t)(std::max(burst, 1.0) * TOKEN_SCALE);
+    burstTokens.store(std::min(scaledBurst, TOKEN_MASK), std::memory_order_relaxed);
+}
+
+ClientLimits::Entry* ClientLimits::find(uint32_t address)
+{
+    size_t slot = slotOf(address);
+    for (size_t probe = 0; probe < MAX_PROBES; probe++)
+    {
+        Entry& entry = entries[(slot + probe) & (TABLE_SIZE - 1)];
+        if (entry.address.load(std::memory_order_acquire) == address)
+            return &entry;
+    }
+    return nullptr;
+}
+
+ClientLimits::Entry* ClientLimits::findOrInsert(uint32_t address)
+{
+    // Swept slots leave holes, so the whole probe window is searched before inserting
+    Entry* existing = find(address);
+    if (existing != nullptr)
+        return existing;
+
+    size_t slot = slotOf(address);
+    for (size_t probe = 0; probe < MAX_PROBES; probe++)
+    {
+        Entry& entry = entries[(slot + probe) & (TABLE_SIZE - 1)];
+        uint32_t expected = 0;
+        if (entry.address.compare_exchange_strong(expected, address, std::memory_order_acq_rel))
+            return &entry;
+        if (expected == address)
+            return &entry; // Another thread inserted the same client
+    }
+    return nullptr;
+}
+
+bool ClientLimits::tryOpenConnection(uint32_t address)
+{
+    uint32_t limit = maxConnections.load(std::memory_order_relaxed);
+    Entry* entry = findOrInsert(address);
+    if (entry == nullptr)
+        return true; // Table crowded: fail open
+
+    uint32_t current = entry->connections.load(std::memory_order_relaxed);
+    do
+    {
+        if (current == RECLAIMING)
+            return true; // Slot is being swept: fail open
+        if (limit != 0 && current >= limit)
+            return false;
+    } while (!entry->connections.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+    return true;
+}
+
+void ClientLimits::closeConnection(uint32_t address)
+{
+    Entry* entry = find(address);
+    if (entry == nullptr)
+        return;
+    uint32_t current = entry->connections.load(std::memory_order_relaxed);
+    while (current > 0 && current != RECLAIMING &&
+        !entry->connections.compare_exchange_weak(current, current - 1, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t ClientLimits::refilledTokens(uint64_t bucket, uint64_t now) const
+{
+    uint64_t burst = burstTokens.load(std::memory_order_relaxed);
+    if (bucket == 0)
+        return burst; // First request from this client
+    uint64_t last = bucket >> TOKEN_BITS;
+    uint64_t tokens = bucket & TOKEN_MASK;
+    uint64_t elapsed = now > last ? now - last : 0;
+    uint64_t refill = elapsed * tokensPerSecond.load(std::memory_order_relaxed) / 1000;
+    return std::min(tokens + refill, burst);
+}
+
+bool ClientLimits::tryAcquireRequest(uint32_t address)
+{
+    if (tokensPerSecond.load(std::memory_order_relaxed) == 0)
+        return true;
+    Entry* entry = findOrInsert(address);
+    if (entry == nullptr)
+        return true;
+
+    uint64_t now = nowMs();
+    uint64_t bucket = entry->bucket.load(std::memory_order_relaxed);
+    while (true)
+    {
+        uint64_t tokens = refilledTokens(bucket, now);
+        if (tokens < TOKEN_SCALE)
+            return false;
+        uint64_t updated = (now << TOKEN_BITS) | (tokens - TOKEN_SCALE);
+        if (entry->bucket.compare_exchange_weak(bucket, updated, std::memory_order_relaxed))
+            return true;
+    }
+}
+
+unsigned ClientLimits::retryAfterSeconds() const
+{
+    uint64_t rate = tokensPerSecond.load(std::memory_order_relaxed);
+    if (rate == 0)
+        return 1;
+    // Time for one token, rounded up
+    return (unsigned)std::max<uint64_t>(1, (TOKEN_SCALE + rate - 1) / rate);
+}
+
+void ClientLimits::sweep()
+{
+    uint64_t now = nowMs();
+    uint64_t burst = burstTokens.load(std::memory_order_relaxed);
+    for (Entry& entry : entries)
+    {
+        if (entry.address.load(std::memory_order_acquire) == 0)
+            continue;
+        uint64_t bucket = entry.bucket.load(std::memory_order_relaxed);
+        if (bucket != 0 && refilledTokens(bucket, now) < burst)
+            continue; // Still limited; forgetting it would hand out a fresh burst
+
+        // Lock the connection count at 0 so no connection is counted in a freed slot
+        uint32_t idle = 0;
+        if (!entry.connections.compare_exchange_strong(idle, RECLAIMING, std::memory_order_acq_rel))
+            continue;
+        entry.bucket.store(0, std::memory_order_relaxed);
+        entry.address.store(0, std::memory_order_release);
+        entry.connections.store(0, std::memory_order_release);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+using std::atomic;
+
+// Per-client (IPv4 address) connection counts and request token buckets.
+//
+// Clients live in a fixed open-addressing table updated only with atomic
+// compare-and-swap, so the accept and request paths never take a lock.
+// A bucket is one 64-bit word (last refill time and token count) so a
+// refill-and-take is a single CAS. If a client cannot be placed within
+// MAX_PROBES slots it is let through rather than refused.
+class ClientLimits
+{
+public:
+    static const size_t TABLE_SIZE = 4096; // Power of two
+    static const size_t MAX_PROBES = 16;
+
+    ClientLimits();
+
+    // Limits apply to later calls; 0 disables the connection limit or the rate limit
+    void configure(uint32_t maxConnectionsPerClient, double requestsPerSecond, double burst);
+
+    // Counts a new connection; false if the client is at its connection limit
+    bool tryOpenConnection(uint32_t address);
+
+    // Releases a connection counted by tryOpenConnection
+    void closeConnection(uint32_t address);
+
+    // Takes one request token; false if the client is over its request rate
+    bool tryAcquireRequest(uint32_t address);
+
+    // Seconds until the client has a token again (for Retry-After)
+    unsigned retryAfterSeconds() const;
+
+    // Frees the slots of clients with no connections and a full bucket.
+    // Called periodically from the server loop.
+    void sweep();
+
+private:
+    // Bucket word: milliseconds since start in the high 40 bits, tokens in
+    // 1/TOKEN_SCALE units in the low 24 bits; 0 means "not started"
+    static constexpr int TOKEN_BITS = 24;
+    static constexpr uint64_t TOKEN_MASK = (1ull << TOKEN_BITS) - 1;
+    static constexpr uint64_t TOKEN_SCALE = 256;
+    static constexpr uint32_t RECLAIMING = UINT32_MAX; // Connection count while sweep() frees a slot
+
+    struct Entry
+    {
+        atomic<uint32_t> address{ 0 }; // 0 = free (0.0.0.0 never connects)
+        atomic<uint32_t> connections{ 0 };
+        atomic<uint64_t> bucket{ 0 };
+    };
+
+    Entry* find(uint32_t address);
+    Entry* findOrInsert(uint32_t address);
+    uint64_t refilledTokens(uint64_t bucket, uint64_t nowMs) const;
+    static uint64_t nowMs();
+    static size_t slotOf(uint32_t address);
+
+    Entry entries[TABLE_SIZE];
+    atomic<uint32_t> maxConnections{ 0 };
+    atomic<uint64_t> tokensPerSecond{ 0 }; // In 1/TOKEN_SCALE units
+    atomic<uint64_t> burstTokens{ 0 };     // In 1/TOKEN_SCALE units
+};
@@ -0,0 +1,185 @@
+#include "FileCache.h"
+#include "Metrics.h"
+#include "PhaseTrace.h"
+#include "MemoryBudget.h"
+#include <algorithm>
+
+shared_ptr<const string> FileCache::getBody(const FileEntry& entry)
+{
+    // The first caller to miss registers the load in the same critical section
+    // that found no body, so every later caller finds it and waits
+    std::shared_future<shared_ptr<const string>> pending;
+    std::promise<shared_ptr<const string>> loaded;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = items.find(entry.fullPath);
+        if (it != items.end() && it->second.size == entry.size && it->second.modified == entry.modified)
+        {
+            lru.splice(lru.begin(), lru, it->second.lruPosition);
+            it->second.hits++;
+            Metrics::recordCacheLookup(true);
+            return it->second.body;
+        }
+        Load& flight = loading[entry.fullPath];
+        if (flight.result.valid() && flight.size == entry.size && flight.modified == entry.modified)
+            pending = flight.result;
+        else
+            flight = { loaded.get_future().share(), entry.size, entry.modified }; // Replaces a load of an older version
+    }
+
+    Metrics::recordCacheLookup(false);
+    if (pending.valid())
+    {
+        Metrics::recordCacheCoalesced();
+        return pending.get(); // Loaded by the caller that missed first
+    }
+    return load(entry, loaded);
+}
+
+shared_ptr<const string> FileCache::getCached(const FileEntry& entry)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = items.find(entry.fullPath);
+    if (it == items.end() || it->second.size != entry.size || it->second.modified != entry.modified)
+        return nullptr;
+    lru.splice(lru.begin(), lru, it->second.lruPosition);
+    it->second.hits++;
+    Metrics::recordCacheLookup(true);
+    return it->second.body;
+}
+
+void FileCache::prefetch(const FileEntry& entry) const
+{
+    shared_ptr<OpenFile> file = root.openFile(entry.uriPath.substr(1));
+    if (file)
+        file->prefetch(); // The read-ahead continues after the file is closed
+}
+
+// Reads a missed file (outside the lock) and publishes the body to the callers waiting on it
+shared_ptr<const string> FileCache::load(const FileEntry& entry, std::promise<shared_ptr<const string>>& loaded)
+{
+    shared_ptr<const string> body;
+    try
+    {
+        TRACE_PROBE2(file__read__start, entry.fullPath.c_str(), entry.size);
+        body = root.readFile(entry.uriPath.substr(1)); // uriPath is the path under the root
+        TRACE_PROBE2(file__read__done, entry.fullPath.c_str(), body ? body->size() : 0);
+        if (body && body->size() == entry.size)
+            insert(entry, body); // A size mismatch means the index is stale; do not cache
+    }
+    catch (...)
+    {
+        // The waiters get the same exception (bad_alloc, say) instead of blocking,
+        // and the next miss on the file starts a new load
+        endLoad(entry);
+        loaded.set_exception(std::current_exception());
+        throw;
+    }
+
+    endLoad(entry);
+    loaded.set_value(body);
+    return body;
+}
+
+void FileCache::endLoad(const FileEntry& entry)
+{
+    // Callers arriving from now on find the body in the cache (or load a newer version)
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto flight = loading.find(entry.fullPath);
+    if (flight != loading.end() && flight->second.size == entry.size && flight->second.modified == entry.modified)
+        loading.erase(flight);
+}
+
+shared_ptr<OpenFile> FileCache::openUncached(const FileEntry& entry) const
+{
+    Metrics::recordCacheLookup(false);
+    return root.openFile(entry.uriPath.substr(1));
+}
+
+void FileCache::insert(const FileEntry& entry, const shared_ptr<const string>& body)
+{
+    if (body->size() > maxFileBytes || body->size() > maxTotalBytes)
+        return;
+    // Over the server's memory budget the body is served but not kept
+    if (!MemoryBudget::instance().reserve(MEMORY_FILE_CACHE, body->size()))
+        return;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = items.find(entry.fullPath);
+    if (it != items.end())
+    {
+        totalBytes -= it->second.body->size();
+        MemoryBudget::instance().release(MEMORY_FILE_CACHE, it->second.body->size());
+        lru.erase(it->second.lruPosition);
+        items.erase(it);
+    }
+
+    evictLocked(body->size());
+    lru.push_front(entry.fullPath);
+    items[entry.fullPath] = { body, entry.size, entry.modified, lru.begin(), entry.uriPath, 1 };
+    totalBytes += body->size();
+}
+
+void FileCache::evictLocked(size_t neededBytes)
+{
+    while (!lru.empty() && totalBytes + neededBytes > maxTotalBytes)
+        evictOldestLocked();
+}
+
+size_t FileCache::evictOldestLocked()
+{
+    auto it = items.find(lru.back());
+    size_t size = it->second.body->size();
+    totalBytes -= size;
+    MemoryBudget::instance().release(MEMORY_FILE_CACHE, size);
+    items.erase(it);
+    lru.pop_back();
+    return size;
+}
+
+size_t FileCache::shrink(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    size_t freed = 0;
+    while (!lru.empty() && freed < bytes)
+        freed += evictOldestLocked();
+    return freed;
+}
+
+void FileCache::setLimits(size_t maxTotal, size_t maxFile)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    maxTotalBytes = maxTotal;
+    maxFileBytes = maxFile;
+    evictLocked(0);
+}
+
+void FileCache::clear()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    items.clear();
+    lru.clear();
+    MemoryBudget::instance().release(MEMORY_FILE_CACHE, totalBytes);
+    totalBytes = 0;
+}
+
+size_t FileCache::getTotalBytes() const
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return totalBytes;
+}
+
+vector<HotFile> FileCache::hotFiles(size_t maxCount) const
+{
+    vector<HotFile> files;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        files.reserve(items.size());
+        for (const auto& item : items)
+            files.push_back({ item.second.uriPath, item.second.size, item.second.modified, item.second.hits });
+    }
+    std::sort(files.begin(), files.end(), [](const HotFile& a, const HotFile& b) { return a.hits > b.hits; });
+    if (files.size() > maxCount)
+        files.resize(maxCount);
+    return files;
+}
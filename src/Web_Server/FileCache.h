@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <list>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+#include <unordered_map>
+#include "RouteIndex.h"
+#include "RootDirectory.h"
+
+using std::string;
+using std::shared_ptr;
+using std::vector;
+
+// A cached file and how often it was served, for the hot-set snapshot
+struct HotFile
+{
+    string uriPath;
+    uint64_t size = 0;
+    time_t modified = 0;
+    uint32_t hits = 0;
+};
+
+// In-memory LRU cache of file bodies served by GET.
+//
+// Entries are keyed by full path and validated against the size and mtime
+// the route index recorded, so a hit never touches the filesystem. Misses
+// are read through the site's pinned root directory, once per file: callers
+// that miss on a file another caller is already loading wait for that load
+// and share its result instead of reading the file again.
+//
+// Cached bytes count against the server's MemoryBudget: an entry that does
+// not fit there is not kept, and the budget may shrink() the cache for
+// memory needed elsewhere.
+class FileCache
+{
+public:
+    explicit FileCache(const RootDirectory& root) : root(root) {}
+    ~FileCache() { clear(); }
+
+    // Returns the file body, loading it on a miss. nullptr if the file cannot be read.
+    // An exception while loading reaches the caller and every caller waiting on that load.
+    shared_ptr<const string> getBody(const FileEntry& entry);
+
+    // The cached body, or nullptr on a miss (nothing is loaded)
+    shared_ptr<const string> getCached(const FileEntry& entry);
+
+    // Starts reading a file into the page cache in the background, so a later getBody() is quick
+    void prefetch(const FileEntry& entry) const;
+
+    // False for files larger than the cache keeps; those are sent from disk
+    bool isCacheable(const FileEntry& entry) const { return entry.size <= maxFileBytes && entry.size <= maxTotalBytes; }
+
+    // Opens a file to send from disk (one not cacheable, or a miss the caller will
+    // not wait for); nullptr if it cannot be opened
+    shared_ptr<OpenFile> openUncached(const FileEntry& entry) const;
+
+    // Total bytes cached and largest single file that is kept in the cache
+    void setLimits(size_t maxTotalBytes, size_t maxFileBytes);
+
+    // Drops every cached body
+    void clear();
+
+    // Drops the least recently used bodies until at least bytes are freed (or the
+    // cache is empty); returns the bytes freed. Used when the memory budget runs out.
+    size_t shrink(size_t bytes);
+
+    // Bytes currently held
+    size_t getTotalBytes() const;
+
+    // Up to maxCount cached files, most served first
+    vector<HotFile> hotFiles(size_t maxCount) const;
+
+private:
+    struct CacheItem
+    {
+        shared_ptr<const string> body;
+        uint64_t size;
+        time_t modified;
+        std::list<string>::iterator lruPosition;
+        string uriPath;
+        uint32_t hits;
+    };
+
+    // A load in progress, shared by every caller that missed on the same file version
+    struct Load
+    {
+        std::shared_future<shared_ptr<const string>> result;
+        uint64_t size;
+        time_t modified;
+    };
+
+    shared_ptr<const string> load(const FileEntry& entry, std::promise<shared_ptr<const string>>& loaded);
+    void endLoad(const FileEntry& entry); // Forgets the load in progress for this file version
+    void insert(const FileEntry& entry, const shared_ptr<const string>& body);
+    void evictLocked(size_t neededBytes);
+    size_t evictOldestLocked(); // Returns the size of the body dropped
+
+    const RootDirectory& root;
+    mutable std::mutex cacheMutex;
+    std::unordered_map<string, CacheItem> items;
+    std::unordered_map<string, Load> loading;
+    std::list<string> lru; // Most recently used first
+    size_t totalBytes = 0;
+    size_t maxTotalBytes = 64 * 1024 * 1024;
+    size_t maxFileBytes = 1024 * 1024;
+};
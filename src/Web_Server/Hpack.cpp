@@ -0,0 +1,407 @@
+#include "Hpack.h"
+
+static const HeaderField STATIC_TABLE[] =
+{
+    { ":authority", "" }, { ":method", "GET" }, { ":method", "POST" }, { ":path", "/" },
+    { ":path", "/index.html" }, { ":scheme", "http" }, { ":scheme", "https" }, { ":status", "200" },
+    { ":status", "204" }, { ":status", "206" }, { ":status", "304" }, { ":status", "400" },
+    { ":status", "404" }, { ":status", "500" }, { "accept-charset", "" }, { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" }, { "accept-ranges", "" }, { "accept", "" }, { "access-control-allow-origin", "" },
+    { "age", "" }, { "allow", "" }, { "authorization", "" }, { "cache-control", "" },
+    { "content-disposition", "" }, { "content-encoding", "" }, { "content-language", "" }, { "content-length", "" },
+    { "content-location", "" }, { "content-range", "" }, { "content-type", "" }, { "cookie", "" },
+    { "date", "" }, { "etag", "" }, { "expect", "" }, { "expires", "" },
+    { "from", "" }, { "host", "" }, { "if-match", "" }, { "if-modified-since", "" },
+    { "if-none-match", "" }, { "if-range", "" }, { "if-unmodified-since", "" }, { "last-modified", "" },
+    { "link", "" }, { "location", "" }, { "max-forwards", "" }, { "proxy-authenticate", "" },
+    { "proxy-authorization", "" }, { "range", "" }, { "referer", "" }, { "refresh", "" },
+    { "retry-after", "" }, { "server", "" }, { "set-cookie", "" }, { "strict-transport-security", "" },
+    { "transfer-encoding", "" }, { "user-agent", "" }, { "vary", "" }, { "via", "" },
+    { "www-authenticate", "" },
+};
+static const size_t STATIC_COUNT = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+static const size_t ENTRY_OVERHEAD = 32;
+
+// Code length of each symbol (256 = EOS) from RFC 7541 Appendix B. The code is
+// canonical, so the lengths alone determine the codes.
+static const uint8_t HUFFMAN_LENGTHS[257] =
+{
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+namespace
+{
+    const int MAX_CODE_LENGTH = 30;
+
+    // Codes per symbol, and per length the first code and where its symbols start in bySymbolOrder
+    struct HuffmanCode
+    {
+        uint32_t codes[257];
+        uint32_t firstCode[MAX_CODE_LENGTH + 1] = {};
+        uint16_t count[MAX_CODE_LENGTH + 1] = {};
+        uint16_t offset[MAX_CODE_LENGTH + 1] = {};
+        uint16_t symbols[257];   // Sorted by code length, then symbol
+
+        HuffmanCode()
+        {
+            for (int symbol = 0; symbol < 257; symbol++)
+                count[HUFFMAN_LENGTHS[symbol]]++;
+            uint32_t code = 0;
+            uint16_t position = 0;
+            for (int length = 1; length <= MAX_CODE_LENGTH; length++)
+            {
+                code = (code + count[length - 1]) << 1;
+                firstCode[length] = code;
+                offset[length] = position;
+                position += count[length];
+            }
+            uint32_t next[MAX_CODE_LENGTH + 1];
+            uint16_t filled[MAX_CODE_LENGTH + 1] = {};
+            for (int length = 1; length <= MAX_CODE_LENGTH; length++)
+                next[length] = firstCode[length];
+            for (int symbol = 0; symbol < 257; symbol++)
+            {
+                int length = HUFFMAN_LENGTHS[symbol];
+                codes[symbol] = next[length]++;
+                symbols[offset[length] + filled[length]++] = (uint16_t)symbol;
+            }
+        }
+    };
+
+    const HuffmanCode& huffman()
+    {
+        static const HuffmanCode code;
+        return code;
+    }
+
+    size_t huffmanLength(const string& text)
+    {
+        size_t bits = 0;
+        for (unsigned char c : text)
+            bits += HUFFMAN_LENGTHS[c];
+        return (bits + 7) / 8;
+    }
+
+    void huffmanEncode(const string& text, string& out)
+    {
+        const HuffmanCode& code = huffman();
+        uint64_t pending = 0;
+        int pendingBits = 0;
+        for (unsigned char c : text)
+        {
+            pending = (pending << HUFFMAN_LENGTHS[c]) | code.codes[c];
+            pendingBits += HUFFMAN_LENGTHS[c];
+            while (pendingBits >= 8)
+            {
+                pendingBits -= 8;
+                out += (char)(uint8_t)(pending >> pendingBits);
+            }
+        }
+        if (pendingBits > 0) // Padded with the most significant bits of EOS (all ones)
+            out += (char)(uint8_t)((pending << (8 - pendingBits)) | (0xff >> pendingBits));
+    }
+
+    bool huffmanDecode(const uint8_t* data, size_t length, string& text)
+    {
+        const HuffmanCode& code = huffman();
+        uint32_t current = 0;
+        int bits = 0;
+        for (size_t i = 0; i < length; i++)
+        {
+            for (int bit = 7; bit >= 0; bit--)
+            {
+                current = (current << 1) | ((data[i] >> bit) & 1);
+                bits++;
+                if (bits > MAX_CODE_LENGTH)
+                    return false;
+                uint32_t index = current - code.firstCode[bits];
+                if (current >= code.firstCode[bits] && index < code.count[bits])
+                {
+                    uint16_t symbol = code.symbols[code.offset[bits] + index];
+                    if (symbol == 256)
+                        return false; // EOS inside a string is an error
+                    text += (char)symbol;
+                    current = 0;
+                    bits = 0;
+                }
+            }
+        }
+        // Padding: fewer than 8 bits, all ones
+        return bits < 8 && current == (1u << bits) - 1;
+    }
+}
+
+// Dynamic table
+
+const HeaderField* HpackDynamicTable::get(size_t index) const
+{
+    if (index == 0)
+        return nullptr;
+    if (index <= STATIC_COUNT)
+        return &STATIC_TABLE[index - 1];
+    index -= STATIC_COUNT + 1;
+    return index < entries.size() ? &entries[index] : nullptr;
+}
+
+void HpackDynamicTable::add(const string& name, const string& value)
+{
+    size_t entrySize = name.size() + value.size() + ENTRY_OVERHEAD;
+    if (entrySize > maxSize)
+    {
+        // An entry larger than the table empties it and is not added
+        entries.clear();
+        size = 0;
+        return;
+    }
+    entries.emplace_front(name, value);
+    size += entrySize;
+    evict();
+}
+
+void HpackDynamicTable::setMaxSize(size_t newSize)
+{
+    maxSize = newSize;
+    evict();
+}
+
+void HpackDynamicTable::evict()
+{
+    while (size > maxSize)
+    {
+        const HeaderField& oldest = entries.back();
+        size -= oldest.first.size() + oldest.second.size() + ENTRY_OVERHEAD;
+        entries.pop_back();
+    }
+}
+
+size_t HpackDynamicTable::find(const string& name, const string& value, bool& valueMatches) const
+{
+    size_t nameIndex = 0;
+    valueMatches = false;
+    for (size_t i = 0; i < STATIC_COUNT; i++)
+    {
+        if (STATIC_TABLE[i].first != name)
+            continue;
+        if (STATIC_TABLE[i].second == value)
+        {
+            valueMatches = true;
+            return i + 1;
+        }
+        if (nameIndex == 0)
+            nameIndex = i + 1;
+    }
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].first != name)
+            continue;
+        if (entries[i].second == value)
+        {
+            valueMatches = true;
+            return STATIC_COUNT + 1 + i;
+        }
+        if (nameIndex == 0)
+            nameIndex = STATIC_COUNT + 1 + i;
+    }
+    return nameIndex;
+}
+
+// Primitives
+
+void Hpack::encodeInteger(uint64_t value, int prefixBits, uint8_t firstByte, string& out)
+{
+    uint64_t limit = (1u << prefixBits) - 1;
+    if (value < limit)
+    {
+        out += (char)(firstByte | (uint8_t)value);
+        return;
+    }
+    out += (char)(firstByte | (uint8_t)limit);
+    value -= limit;
+    while (value >= 128)
+    {
+        out += (char)(uint8_t)((value & 127) | 128);
+        value >>= 7;
+    }
+    out += (char)(uint8_t)value;
+}
+
+bool Hpack::decodeInteger(const uint8_t*& position, const uint8_t* end, int prefixBits, uint64_t& value)
+{
+    if (position == end)
+        return false;
+    uint64_t limit = (1u << prefixBits) - 1;
+    value = *position++ & limit;
+    if (value < limit)
+        return true;
+    for (int shift = 0; position != end; shift += 7)
+    {
+        if (shift > 56)
+            return false;
+        uint8_t byte = *position++;
+        value += (uint64_t)(byte & 127) << shift;
+        if ((byte & 128) == 0)
+            return true;
+    }
+    return false;
+}
+
+void Hpack::encodeString(const string& text, string& out)
+{
+    size_t huffmanSize = huffmanLength(text);
+    if (huffmanSize < text.size())
+    {
+        encodeInteger(huffmanSize, 7, 0x80, out);
+        huffmanEncode(text, out);
+    }
+    else
+    {
+        encodeInteger(text.size(), 7, 0x00, out);
+        out += text;
+    }
+}
+
+bool Hpack::decodeString(const uint8_t*& position, const uint8_t* end, string& text)
+{
+    if (position == end)
+        return false;
+    bool isHuffman = (*position & 0x80) != 0;
+    uint64_t length;
+    if (!decodeInteger(position, end, 7, length) || length > (uint64_t)(end - position))
+        return false;
+    text.clear();
+    if (isHuffman)
+    {
+        if (!huffmanDecode(position, (size_t)length, text))
+            return false;
+    }
+    else
+    {
+        text.assign((const char*)position, (size_t)length);
+    }
+    position += length;
+    return true;
+}
+
+// Decoder
+
+bool HpackDecoder::decode(const uint8_t* block, size_t length, vector<HeaderField>& fields)
+{
+    const uint8_t* position = block;
+    const uint8_t* end = block + length;
+    bool fieldSeen = false;
+    size_t listSize = 0; // RFC 9113 section 6.5.2: name + value + 32 per field
+    while (position != end)
+    {
+        uint8_t first = *position;
+        uint64_t index;
+        if (first & 0x80)
+        {
+            // Indexed field
+            if (!Hpack::decodeInteger(position, end, 7, index))
+                return false;
+            const HeaderField* field = table.get((size_t)index);
+            if (field == nullptr)
+                return false;
+            // Indexed fields cost one byte each: without a cap a small block expands enormously
+            listSize += field->first.size() + field->second.size() + 32;
+            if (listSize > MAX_HEADER_LIST_SIZE)
+                return false;
+            fields.push_back(*field);
+            fieldSeen = true;
+            continue;
+        }
+        if ((first & 0xe0) == 0x20)
+        {
+            // Table size update, only before the first field
+            if (fieldSeen || !Hpack::decodeInteger(position, end, 5, index) || index > limit)
+                return false;
+            table.setMaxSize((size_t)index);
+            continue;
+        }
+
+        // Literal: with incremental indexing (01), without (0000) or never indexed (0001)
+        bool addToTable = (first & 0xc0) == 0x40;
+        if (!Hpack::decodeInteger(position, end, addToTable ? 6 : 4, index))
+            return false;
+        HeaderField field;
+        if (index != 0)
+        {
+            const HeaderField* named = table.get((size_t)index);
+            if (named == nullptr)
+                return false;
+            field.first = named->first;
+        }
+        else if (!Hpack::decodeString(position, end, field.first))
+            return false;
+        if (!Hpack::decodeString(position, end, field.second))
+            return false;
+        listSize += field.first.size() + field.second.size() + 32;
+        if (listSize > MAX_HEADER_LIST_SIZE)
+            return false;
+        if (addToTable)
+            table.add(field.first, field.second);
+        fields.push_back(std::move(field));
+        fieldSeen = true;
+    }
+    return true;
+}
+
+// Encoder
+
+void HpackEncoder::setMaxTableSize(size_t size)
+{
+    size_t capped = size < 4096 ? size : 4096;
+    if (capped != table.getMaxSize())
+    {
+        table.setMaxSize(capped);
+        sizeUpdatePending = true;
+    }
+}
+
+// Values that differ on nearly every response would only push useful entries out of the table
+static bool isWorthIndexing(const string& name)
+{
+    return name != "content-length" && name != "etag" && name != "last-modified" && name != "date";
+}
+
+void HpackEncoder::encode(const vector<HeaderField>& fields, string& out)
+{
+    if (sizeUpdatePending)
+    {
+        Hpack::encodeInteger(table.getMaxSize(), 5, 0x20, out);
+        sizeUpdatePending = false;
+    }
+    for (const HeaderField& field : fields)
+    {
+        bool valueMatches;
+        size_t index = table.find(field.first, field.second, valueMatches);
+        if (index != 0 && valueMatches)
+        {
+            Hpack::encodeInteger(index, 7, 0x80, out);
+            continue;
+        }
+        bool indexing = isWorthIndexing(field.first);
+        Hpack::encodeInteger(index, indexing ? 6 : 4, indexing ? 0x40 : 0x00, out);
+        if (index == 0)
+            Hpack::encodeString(field.first, out);
+        Hpack::encodeString(field.second, out);
+        if (indexing)
+            table.add(field.first, field.second);
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <cstdint>
+
+using std::string;
+using std::vector;
+
+// One header field; names are lowercase in HTTP/2
+typedef std::pair<string, string> HeaderField;
+
+// HPACK (RFC 7541) header compression for HTTP/2. Each direction of a
+// connection has its own dynamic table, so a connection owns one decoder
+// (request headers) and one encoder (response headers).
+class HpackDynamicTable
+{
+public:
+    explicit HpackDynamicTable(size_t maxSize = 4096) : maxSize(maxSize) {}
+
+    // Entry by HPACK index (1..61 static, then dynamic, newest first); nullptr if out of range
+    const HeaderField* get(size_t index) const;
+
+    void add(const string& name, const string& value);
+    void setMaxSize(size_t size);
+    size_t getMaxSize() const { return maxSize; }
+
+    // Index of a full match (value too) or a name-only match, 0 if none; static entries first
+    size_t find(const string& name, const string& value, bool& valueMatches) const;
+
+private:
+    void evict();
+
+    std::deque<HeaderField> entries; // Newest first
+    size_t size = 0;                 // Sum of name + value + 32 per entry
+    size_t maxSize;
+};
+
+class HpackDecoder
+{
+public:
+    // Largest decoded header list accepted (SETTINGS_MAX_HEADER_LIST_SIZE)
+    static const size_t MAX_HEADER_LIST_SIZE = 64 * 1024;
+
+    // block is one complete header block (HEADERS plus CONTINUATION fragments).
+    // Returns false on a compression error or a header list over
+    // MAX_HEADER_LIST_SIZE; either is fatal for the connection.
+    bool decode(const uint8_t* block, size_t length, vector<HeaderField>& fields);
+
+    // SETTINGS_HEADER_TABLE_SIZE we advertised: the limit for table size updates
+    void setMaxTableSize(size_t size) { limit = size; }
+
+private:
+    HpackDynamicTable table;
+    size_t limit = 4096;
+};
+
+class HpackEncoder
+{
+public:
+    // Appends the header block for fields to out
+    void encode(const vector<HeaderField>& fields, string& out);
+
+    // The peer's SETTINGS_HEADER_TABLE_SIZE; announced at the start of the next block
+    void setMaxTableSize(size_t size);
+
+private:
+    HpackDynamicTable table;
+    bool sizeUpdatePending = false;
+};
+
+// Integer and string representations (RFC 7541 section 5)
+class Hpack
+{
+public:
+    static void encodeInteger(uint64_t value, int prefixBits, uint8_t firstByte, string& out);
+    static bool decodeInteger(const uint8_t*& position, const uint8_t* end, int prefixBits, uint64_t& value);
+    // Huffman-coded when that is shorter
+    static void encodeString(const string& text, string& out);
+    static bool decodeString(const uint8_t*& position, const uint8_t* end, string& text);
+};
@@ -0,0 +1,737 @@
+#include "Http2Connection.h"
+#include "MemoryBudget.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+static const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const size_t PREFACE_LENGTH = sizeof(PREFACE) - 1;
+static const size_t FRAME_HEADER_LENGTH = 9;
+static const size_t MAX_FRAME_SIZE = 16384;            // The default; we never raise it
+static const size_t MAX_HEADER_BLOCK = 64 * 1024;      // Compressed, across CONTINUATION frames
+static const size_t MAX_REQUEST_BODY = 1024 * 1024;
+static const uint32_t MAX_CONCURRENT_STREAMS = 100;
+static const int64_t MAX_WINDOW = 0x7fffffff;
+
+// Frame types
+static const uint8_t FRAME_DATA = 0x0, FRAME_HEADERS = 0x1, FRAME_PRIORITY = 0x2, FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4, FRAME_PUSH_PROMISE = 0x5, FRAME_PING = 0x6, FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8, FRAME_CONTINUATION = 0x9;
+
+// Frame flags
+static const uint8_t FLAG_END_STREAM = 0x1, FLAG_ACK = 0x1, FLAG_END_HEADERS = 0x4, FLAG_PADDED = 0x8, FLAG_PRIORITY = 0x20;
+
+// Settings
+static const uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1, SETTINGS_ENABLE_PUSH = 0x2, SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4, SETTINGS_MAX_FRAME_SIZE = 0x5, SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+// Error codes
+static const uint32_t NO_ERROR = 0x0, PROTOCOL_ERROR = 0x1, FLOW_CONTROL_ERROR = 0x3, STREAM_CLOSED = 0x5,
+    FRAME_SIZE_ERROR = 0x6, REFUSED_STREAM = 0x7, COMPRESSION_ERROR = 0x9;
+
+static uint32_t read32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void append32(string& out, uint32_t value)
+{
+    out += (char)(uint8_t)(value >> 24);
+    out += (char)(uint8_t)(value >> 16);
+    out += (char)(uint8_t)(value >> 8);
+    out += (char)(uint8_t)value;
+}
+
+static void appendSetting(string& out, uint16_t id, uint32_t value)
+{
+    out += (char)(uint8_t)(id >> 8);
+    out += (char)(uint8_t)id;
+    append32(out, value);
+}
+
+// Headers that only mean something to one HTTP/1.1 hop
+static bool isConnectionSpecific(const string& name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "transfer-encoding" || name == "upgrade";
+}
+
+Http2Connection::Http2Connection(OutputQueue& output) : output(output)
+{
+}
+
+Http2Connection::~Http2Connection()
+{
+    for (auto& entry : streams)
+        releaseBody(entry.second);
+}
+
+Http2Preface Http2Connection::detectPreface(string_view data)
+{
+    size_t compared = std::min(data.size(), PREFACE_LENGTH);
+    if (data.compare(0, compared, string_view(PREFACE, compared)) != 0)
+        return H2_PREFACE_NO;
+    return compared < PREFACE_LENGTH ? H2_PREFACE_PARTIAL : H2_PREFACE_YES;
+}
+
+bool Http2Connection::acceptUpgrade(string_view http2Settings)
+{
+    // The value is a SETTINGS payload in base64url
+    string payload;
+    uint32_t bits = 0;
+    int bitCount = 0;
+    for (char c : http2Settings)
+    {
+        int value;
+        if (c >= 'A' && c <= 'Z')
+            value = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            value = c - '0' + 52;
+        else if (c == '-')
+            value = 62;
+        else if (c == '_')
+            value = 63;
+        else if (c == '=')
+            break;
+        else
+            return false;
+        bits = (bits << 6) | (uint32_t)value;
+        bitCount += 6;
+        if (bitCount >= 8)
+        {
+            bitCount -= 8;
+            payload += (char)(uint8_t)(bits >> bitCount);
+        }
+    }
+    if (payload.size() % 6 != 0 || !applySettings((const uint8_t*)payload.data(), payload.size()))
+        return false;
+
+    // The upgrade request is answered on stream 1, already complete
+    Stream& stream = streams[1];
+    stream.requestComplete = true;
+    stream.sendWindow = initialWindow;
+    lastStreamId = 1;
+    return true;
+}
+
+void Http2Connection::start()
+{
+    string settings;
+    appendSetting(settings, SETTINGS_MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS);
+    appendSetting(settings, SETTINGS_MAX_HEADER_LIST_SIZE, (uint32_t)HpackDecoder::MAX_HEADER_LIST_SIZE);
+    queueFrame(FRAME_SETTINGS, 0, 0, settings);
+}
+
+string Http2Connection::frameHeader(size_t length, uint8_t type, uint8_t flags, uint32_t streamId) const
+{
+    string header;
+    header.reserve(FRAME_HEADER_LENGTH);
+    header += (char)(uint8_t)(length >> 16);
+    header += (char)(uint8_t)(length >> 8);
+    header += (char)(uint8_t)length;
+    header += (char)type;
+    header += (char)flags;
+    append32(header, streamId & 0x7fffffff);
+    return header;
+}
+
+void Http2Connection::queueFrame(uint8_t type, uint8_t flags, uint32_t streamId, const string& payload)
+{
+    output.append(frameHeader(payload.size(), type, flags, streamId) + payload);
+}
+
+bool Http2Connection::fail(uint32_t errorCode)
+{
+    if (!failed)
+    {
+        string payload;
+        append32(payload, lastStreamId);
+        append32(payload, errorCode);
+        queueFrame(FRAME_GOAWAY, 0, 0, payload);
+        failed = true;
+        goAwaySent = true;
+    }
+    return false;
+}
+
+void Http2Connection::resetStream(uint32_t streamId, uint32_t errorCode)
+{
+    string payload;
+    append32(payload, errorCode);
+    queueFrame(FRAME_RST_STREAM, 0, streamId, payload);
+    closeStream(streamId);
+}
+
+void Http2Connection::closeStream(uint32_t streamId)
+{
+    auto found = streams.find(streamId);
+    if (found == streams.end())
+        return;
+    releaseBody(found->second);
+    streams.erase(found);
+}
+
+void Http2Connection::releaseBody(Stream& stream)
+{
+    MemoryBudget::instance().release(MEMORY_RECEIVE_BUFFERS, stream.body.size());
+    string().swap(stream.body);
+}
+
+void Http2Connection::resumeFlowControl()
+{
+    if (heldWindow == 0 || MemoryBudget::instance().overLimit())
+        return;
+    string increment;
+    append32(increment, (uint32_t)heldWindow);
+    queueFrame(FRAME_WINDOW_UPDATE, 0, 0, increment);
+    heldWindow = 0;
+    for (auto& entry : streams)
+    {
+        Stream& stream = entry.second;
+        if (stream.heldWindow > 0 && !stream.requestComplete)
+        {
+            increment.clear();
+            append32(increment, (uint32_t)stream.heldWindow);
+            queueFrame(FRAME_WINDOW_UPDATE, 0, entry.first, increment);
+        }
+        stream.heldWindow = 0;
+    }
+}
+
+void Http2Connection::goAway()
+{
+    if (goAwaySent)
+        return;
+    string payload;
+    append32(payload, lastStreamId);
+    append32(payload, NO_ERROR);
+    queueFrame(FRAME_GOAWAY, 0, 0, payload);
+    goAwaySent = true;
+}
+
+bool Http2Connection::receive(const char* data, size_t length)
+{
+    if (failed)
+        return false;
+    input.append(data, length);
+    size_t position = 0;
+    if (!prefaceReceived)
+    {
+        Http2Preface preface = detectPreface(input);
+        if (preface == H2_PREFACE_PARTIAL)
+            return true;
+        if (preface == H2_PREFACE_NO)
+            return fail(PROTOCOL_ERROR);
+        prefaceReceived = true;
+        position = PREFACE_LENGTH;
+    }
+
+    bool ok = true;
+    while (ok && input.size() - position >= FRAME_HEADER_LENGTH)
+    {
+        const uint8_t* header = (const uint8_t*)input.data() + position;
+        size_t frameLength = ((size_t)header[0] << 16) | ((size_t)header[1] << 8) | header[2];
+        if (frameLength > MAX_FRAME_SIZE)
+            return fail(FRAME_SIZE_ERROR);
+        if (input.size() - position < FRAME_HEADER_LENGTH + frameLength)
+            break;
+        ok = handleFrame(header[3], header[4], read32(header + 5) & 0x7fffffff, header + FRAME_HEADER_LENGTH, frameLength);
+        position += FRAME_HEADER_LENGTH + frameLength;
+    }
+    input.erase(0, position);
+    return ok;
+}
+
+bool Http2Connection::handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t length)
+{
+    // Nothing may come between the frames of one header block
+    if (continuationStream != 0 && (type != FRAME_CONTINUATION || streamId != continuationStream))
+        return fail(PROTOCOL_ERROR);
+
+    switch (type)
+    {
+    case FRAME_DATA:
+        return handleData(flags, streamId, payload, length);
+
+    case FRAME_HEADERS:
+        return handleHeaders(flags, streamId, payload, length);
+
+    case FRAME_CONTINUATION:
+        if (continuationStream == 0)
+            return fail(PROTOCOL_ERROR);
+        if (headerBlock.size() + length > MAX_HEADER_BLOCK)
+            return fail(PROTOCOL_ERROR);
+        headerBlock.append((const char*)payload, length);
+        return (flags & FLAG_END_HEADERS) == 0 || finishHeaderBlock();
+
+    case FRAME_PRIORITY:
+        if (streamId == 0)
+            return fail(PROTOCOL_ERROR);
+        if (length != 5)
+            resetStream(streamId, FRAME_SIZE_ERROR);
+        return true; // Streams are served in turn; priorities are not used
+
+    case FRAME_RST_STREAM:
+        if (streamId == 0 || streamId > lastStreamId)
+            return fail(PROTOCOL_ERROR);
+        if (length != 4)
+            return fail(FRAME_SIZE_ERROR);
+        closeStream(streamId); // Its queued turns are skipped by pump() and nextRequest()
+        return true;
+
+    case FRAME_SETTINGS:
+        if (streamId != 0)
+            return fail(PROTOCOL_ERROR);
+        if (flags & FLAG_ACK)
+            return length == 0 || fail(FRAME_SIZE_ERROR);
+        if (length % 6 != 0)
+            return fail(FRAME_SIZE_ERROR);
+        if (!applySettings(payload, length))
+            return false;
+        queueFrame(FRAME_SETTINGS, FLAG_ACK, 0, string());
+        return true;
+
+    case FRAME_PUSH_PROMISE:
+        return fail(PROTOCOL_ERROR); // Clients cannot push
+
+    case FRAME_PING:
+        if (streamId != 0)
+            return fail(PROTOCOL_ERROR);
+        if (length != 8)
+            return fail(FRAME_SIZE_ERROR);
+        if ((flags & FLAG_ACK) == 0)
+            queueFrame(FRAME_PING, FLAG_ACK, 0, string((const char*)payload, length));
+        return true;
+
+    case FRAME_GOAWAY:
+        if (streamId != 0)
+            return fail(PROTOCOL_ERROR);
+        peerGoingAway = true;
+        return true;
+
+    case FRAME_WINDOW_UPDATE:
+        return handleWindowUpdate(streamId, payload, length);
+
+    default:
+        return true; // Unknown frame types are ignored
+    }
+}
+
+bool Http2Connection::handleData(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t length)
+{
+    if (streamId == 0 || streamId > lastStreamId)
+        return fail(PROTOCOL_ERROR);
+
+    // The whole frame counts against flow control; give it back at once, the body
+    // is buffered here and its size is capped instead. Over the memory budget the
+    // window is held back, so the client stops sending until resumeFlowControl().
+    bool holdWindow = MemoryBudget::instance().overLimit();
+    if (length > 0 && holdWindow)
+        heldWindow += length;
+    else if (length > 0)
+    {
+        string increment;
+        append32(increment, (uint32_t)length);
+        queueFrame(FRAME_WINDOW_UPDATE, 0, 0, increment);
+    }
+    size_t padding = 0;
+    if (flags & FLAG_PADDED)
+    {
+        if (length == 0 || payload[0] >= length)
+            return fail(PROTOCOL_ERROR);
+        padding = payload[0] + 1;
+    }
+
+    auto found = streams.find(streamId);
+    if (found == streams.end())
+        return true; // Reset or already answered
+    Stream& stream = found->second;
+    if (stream.requestComplete)
+    {
+        resetStream(streamId, STREAM_CLOSED);
+        return true;
+    }
+
+    size_t dataLength = length - padding;
+    const char* data = (const char*)payload + ((flags & FLAG_PADDED) ? 1 : 0);
+    if (stream.body.size() + dataLength > MAX_REQUEST_BODY)
+    {
+        stream.tooLarge = true;
+        releaseBody(stream);
+    }
+    if (!stream.tooLarge && dataLength > 0)
+    {
+        // Buffered bodies count as receive buffers; with no room left the request is
+        // refused before it is processed, so the client may retry it later
+        if (!MemoryBudget::instance().reserve(MEMORY_RECEIVE_BUFFERS, dataLength))
+        {
+            resetStream(streamId, REFUSED_STREAM);
+            return true;
+        }
+        stream.body.append(data, dataLength);
+    }
+
+    if (flags & FLAG_END_STREAM)
+    {
+        stream.requestComplete = true;
+        ready.push_back(streamId);
+    }
+    else if (length > 0 && holdWindow)
+        stream.heldWindow += length;
+    else if (length > 0)
+    {
+        string increment;
+        append32(increment, (uint32_t)length);
+        queueFrame(FRAME_WINDOW_UPDATE, 0, streamId, increment);
+    }
+    return true;
+}
+
+bool Http2Connection::handleHeaders(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t length)
+{
+    if (streamId == 0)
+        return fail(PROTOCOL_ERROR);
+    size_t skip = 0, padding = 0;
+    if (flags & FLAG_PADDED)
+    {
+        if (length == 0)
+            return fail(PROTOCOL_ERROR);
+        padding = payload[0];
+        skip = 1;
+    }
+    if (flags & FLAG_PRIORITY)
+        skip += 5;
+    if (skip + padding > length)
+        return fail(PROTOCOL_ERROR);
+
+    auto found = streams.find(streamId);
+    if (found == streams.end())
+    {
+        // A new stream: client streams are odd and increasing
+        if (streamId % 2 == 0 || streamId <= lastStreamId)
+            return fail(PROTOCOL_ERROR);
+        lastStreamId = streamId;
+    }
+    else if (found->second.requestComplete || (flags & FLAG_END_STREAM) == 0)
+    {
+        // Trailers must end the stream; nothing may follow the end
+        return fail(PROTOCOL_ERROR);
+    }
+
+    headerBlock.assign((const char*)payload + skip, length - skip - padding);
+    continuationStream = streamId;
+    continuationEndsStream = (flags & FLAG_END_STREAM) != 0;
+    return (flags & FLAG_END_HEADERS) == 0 || finishHeaderBlock();
+}
+
+// A complete header block: a new request, or the trailers of one
+bool Http2Connection::finishHeaderBlock()
+{
+    uint32_t streamId = continuationStream;
+    continuationStream = 0;
+    vector<HeaderField> fields;
+    // Decoded even when the stream is refused, to keep the HPACK table in step
+    if (!decoder.decode((const uint8_t*)headerBlock.data(), headerBlock.size(), fields))
+        return fail(COMPRESSION_ERROR);
+    headerBlock.clear();
+
+    auto found = streams.find(streamId);
+    if (found != streams.end())
+    {
+        // Trailers are not used by any handler
+        found->second.requestComplete = true;
+        ready.push_back(streamId);
+        return true;
+    }
+    if (goAwaySent)
+        return true; // Opened after our GOAWAY: ignored, the client retries elsewhere
+    if (streams.size() >= MAX_CONCURRENT_STREAMS)
+    {
+        resetStream(streamId, REFUSED_STREAM);
+        return true;
+    }
+    if (!validRequestHeaders(fields))
+    {
+        resetStream(streamId, PROTOCOL_ERROR);
+        return true;
+    }
+
+    Stream& stream = streams[streamId];
+    stream.headers = std::move(fields);
+    stream.sendWindow = initialWindow;
+    if (continuationEndsStream)
+    {
+        stream.requestComplete = true;
+        ready.push_back(streamId);
+    }
+    return true;
+}
+
+// Malformed requests (RFC 9113 section 8.2): uppercase or invalid characters, unknown
+// or misplaced pseudo-headers, missing :method/:scheme/:path, HTTP/1.1 connection headers.
+// Rejecting CR and LF also keeps the HTTP/1.1 form of the request well formed.
+bool Http2Connection::validRequestHeaders(const vector<HeaderField>& headers) const
+{
+    bool regularSeen = false, method = false, scheme = false, path = false;
+    for (const HeaderField& field : headers)
+    {
+        const string& name = field.first;
+        if (name.empty())
+            return false;
+        for (size_t i = 0; i < name.size(); i++)
+        {
+            char c = name[i];
+            if ((c >= 'A' && c <= 'Z') || c == ' ' || c == '\r' || c == '\n' || c == '\0' || (c == ':' && i > 0))
+                return false;
+        }
+        if (field.second.find_first_of(string("\r\n\0", 3)) != string::npos)
+            return false;
+        if (name[0] == ':')
+        {
+            if (regularSeen)
+                return false;
+            if (name == ":method")
+                method = true;
+            else if (name == ":scheme")
+                scheme = true;
+            else if (name == ":path")
+                path = !field.second.empty();
+            else if (name != ":authority")
+                return false;
+            continue;
+        }
+        regularSeen = true;
+        if (isConnectionSpecific(name) || (name == "te" && field.second != "trailers"))
+            return false;
+    }
+    return method && scheme && path;
+}
+
+bool Http2Connection::applySettings(const uint8_t* payload, size_t length)
+{
+    for (size_t i = 0; i + 6 <= length; i += 6)
+    {
+        uint16_t id = (uint16_t)((payload[i] << 8) | payload[i + 1]);
+        uint32_t value = read32(payload + i + 2);
+        switch (id)
+        {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            encoder.setMaxTableSize(value);
+            break;
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+                return fail(PROTOCOL_ERROR);
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if (value > MAX_WINDOW)
+                return fail(FLOW_CONTROL_ERROR);
+            // Applies to the windows of open streams too, by the difference
+            int64_t delta = (int64_t)value - initialWindow;
+            initialWindow = value;
+            for (auto& entry : streams)
+            {
+                entry.second.sendWindow += delta;
+                if (entry.second.sendWindow > MAX_WINDOW)
+                    return fail(FLOW_CONTROL_ERROR);
+            }
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < 16384 || value > 16777215)
+                return fail(PROTOCOL_ERROR);
+            peerMaxFrame = value;
+            break;
+        default:
+            break; // SETTINGS_MAX_CONCURRENT_STREAMS only limits pushes, which we never send
+        }
+    }
+    return true;
+}
+
+bool Http2Connection::handleWindowUpdate(uint32_t streamId, const uint8_t* payload, size_t length)
+{
+    if (length != 4)
+        return fail(FRAME_SIZE_ERROR);
+    int64_t increment = read32(payload) & 0x7fffffff;
+    if (streamId == 0)
+    {
+        if (increment == 0)
+            return fail(PROTOCOL_ERROR);
+        connectionWindow += increment;
+        return connectionWindow <= MAX_WINDOW || fail(FLOW_CONTROL_ERROR);
+    }
+    if (streamId > lastStreamId)
+        return fail(PROTOCOL_ERROR);
+    auto found = streams.find(streamId);
+    if (found == streams.end())
+        return true; // Updates may still arrive for a stream we finished
+    if (increment == 0)
+        resetStream(streamId, PROTOCOL_ERROR);
+    else if ((found->second.sendWindow += increment) > MAX_WINDOW)
+        resetStream(streamId, FLOW_CONTROL_ERROR);
+    return true;
+}
+
+bool Http2Connection::nextRequest(uint32_t& streamId, string& rawRequest)
+{
+    while (!ready.empty())
+    {
+        streamId = ready.front();
+        ready.pop_front();
+        auto found = streams.find(streamId);
+        if (found == streams.end() || found->second.headers.empty())
+            continue; // Reset meanwhile, or stream 1 of an upgrade (answered already)
+        Stream& stream = found->second;
+
+        // The same request in HTTP/1.1 form; an oversized body makes it unparsable (400)
+        rawRequest.clear();
+        if (stream.tooLarge)
+            return true;
+        string method, path, authority;
+        for (const HeaderField& field : stream.headers)
+        {
+            if (field.first == ":method")
+                method = field.second;
+            else if (field.first == ":path")
+                path = field.second;
+            else if (field.first == ":authority")
+                authority = field.second;
+        }
+        rawRequest.reserve(256 + stream.body.size());
+        rawRequest += method + " " + path + " HTTP/1.1\r\n";
+        if (!authority.empty())
+            rawRequest += "Host: " + authority + "\r\n";
+        for (const HeaderField& field : stream.headers)
+        {
+            if (field.first[0] == ':' || field.first == "content-length" || (field.first == "host" && !authority.empty()))
+                continue;
+            rawRequest += field.first + ": " + field.second + "\r\n";
+        }
+        if (!stream.body.empty())
+            rawRequest += "Content-Length: " + std::to_string(stream.body.size()) + "\r\n";
+        rawRequest += "\r\n";
+        rawRequest += stream.body;
+
+        stream.headers.clear();
+        releaseBody(stream);
+        return true;
+    }
+    return false;
+}
+
+void Http2Connection::respond(uint32_t streamId, const HttpResponse& response, bool includeBody)
+{
+    auto found = streams.find(streamId);
+    if (found == streams.end() || failed)
+        return; // The client reset the stream
+    Stream& stream = found->second;
+
+    // Header fields from the HTTP/1.1 serialization, so both protocols send the same ones
+    vector<HeaderField> fields;
+    fields.emplace_back(":status", std::to_string(response.getStatusCode()));
+    string serialized = response.serializeHeaders();
+    size_t lineStart = serialized.find("\r\n") + 2;
+    while (lineStart < serialized.size())
+    {
+        size_t lineEnd = serialized.find("\r\n", lineStart);
+        if (lineEnd == string::npos || lineEnd == lineStart)
+            break;
+        size_t colon = serialized.find(':', lineStart);
+        if (colon != string::npos && colon < lineEnd)
+        {
+            string name = serialized.substr(lineStart, colon - lineStart);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+            size_t valueStart = colon + 1;
+            while (valueStart < lineEnd && serialized[valueStart] == ' ')
+                valueStart++;
+            if (!isConnectionSpecific(name))
+                fields.emplace_back(std::move(name), serialized.substr(valueStart, lineEnd - valueStart));
+        }
+        lineStart = lineEnd + 2;
+    }
+
+    if (includeBody)
+    {
+        for (BodyPart& part : response.getBodyParts())
+        {
+            stream.remaining += part.length;
+            if (part.length > 0)
+                stream.response.push_back(std::move(part));
+        }
+    }
+    bool endStream = stream.remaining == 0;
+
+    // HEADERS, then CONTINUATION frames if the block exceeds the peer's frame size
+    string block;
+    encoder.encode(fields, block);
+    size_t position = 0;
+    uint8_t type = FRAME_HEADERS;
+    do
+    {
+        size_t length = std::min(block.size() - position, peerMaxFrame);
+        bool last = position + length == block.size();
+        uint8_t flags = (uint8_t)((last ? FLAG_END_HEADERS : 0) | (type == FRAME_HEADERS && endStream ? FLAG_END_STREAM : 0));
+        output.append(frameHeader(length, type, flags, streamId) + block.substr(position, length));
+        position += length;
+        type = FRAME_CONTINUATION;
+    } while (position < block.size());
+
+    if (endStream)
+        streams.erase(found);
+    else
+        sending.push_back(streamId);
+}
+
+void Http2Connection::pump(uint64_t budget)
+{
+    // Streams are taken in turn, one frame each; a stream out of window waits for
+    // WINDOW_UPDATE and keeps its place. Stops after a full round with no progress.
+    size_t waiting = 0;
+    while (!sending.empty() && waiting < sending.size() && connectionWindow > 0 && output.pendingBytes() < budget)
+    {
+        uint32_t streamId = sending.front();
+        sending.pop_front();
+        auto found = streams.find(streamId);
+        if (found == streams.end())
+            continue; // Reset by the client
+        Stream& stream = found->second;
+        if (stream.sendWindow <= 0)
+        {
+            sending.push_back(streamId);
+            waiting++;
+            continue;
+        }
+        waiting = 0;
+
+        uint64_t length = std::min<uint64_t>({ stream.remaining, peerMaxFrame,
+            (uint64_t)stream.sendWindow, (uint64_t)connectionWindow });
+        bool last = length == stream.remaining;
+        output.append(frameHeader((size_t)length, FRAME_DATA, last ? FLAG_END_STREAM : 0, streamId));
+        // A frame may span several body parts (archive members)
+        for (uint64_t framed = 0; framed < length;)
+        {
+            BodyPart& part = stream.response.front();
+            uint64_t take = std::min(part.length, length - framed);
+            if (part.file)
+                output.appendFile(part.file, part.offset, take);
+            else
+                output.append(part.data, part.offset, take);
+            part.offset += take;
+            part.length -= take;
+            framed += take;
+            if (part.length == 0)
+                stream.response.pop_front();
+        }
+        stream.remaining -= length;
+        stream.sendWindow -= (int64_t)length;
+        connectionWindow -= (int64_t)length;
+
+        if (last)
+            streams.erase(found);
+        else
+            sending.push_back(streamId);
+    }
+}
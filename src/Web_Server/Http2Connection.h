@@ -0,0 +1,142 @@
+#pragma once
+
+#include "OutputQueue.h"
+#include "HttpResponse.h"
+#include "Hpack.h"
+#include <string>
+#include <string_view>
+#include <map>
+#include <deque>
+#include <memory>
+#include <cstdint>
+
+using std::string;
+using std::string_view;
+
+// Result of looking for the HTTP/2 client preface at the start of a connection
+enum Http2Preface
+{
+    H2_PREFACE_NO,       // Not HTTP/2: an HTTP/1.x request
+    H2_PREFACE_PARTIAL,  // Matches so far; wait for more bytes
+    H2_PREFACE_YES
+};
+
+// The HTTP/2 framing layer (RFC 9113) of one connection. Requests arrive as
+// frames on many streams at once; each complete one is handed out as the
+// equivalent HTTP/1.1 message, so the HttpRequest/HttpResponse handlers serve
+// both protocols. Responses go back as HPACK-compressed HEADERS and DATA
+// frames that are queued in the connection's OutputQueue.
+//
+// Bodies are not queued whole: pump() moves DATA frames into the queue as the
+// peer's flow control windows allow, taking turns between streams so a large
+// file does not hold up the small ones. Cached bodies and files are framed by
+// reference, the same as on HTTP/1.1.
+//
+// Entered three ways: the client preface on a plain connection (prior
+// knowledge), an "Upgrade: h2c" request, or "h2" chosen by TLS ALPN.
+class Http2Connection
+{
+public:
+    // Output bytes queued by pump() before it waits for the queue to drain
+    static const uint64_t QUEUE_BUDGET = 64 * 1024;
+
+    explicit Http2Connection(OutputQueue& output);
+    ~Http2Connection();
+
+    // Whether data begins with the client connection preface
+    static Http2Preface detectPreface(string_view data);
+
+    // h2c Upgrade: applies the HTTP2-Settings header value and opens stream 1 for
+    // the request that carried it. False if the value is malformed (no upgrade).
+    bool acceptUpgrade(string_view http2Settings);
+
+    // Queues the server preface (SETTINGS); call once, after a 101 response if upgrading
+    void start();
+
+    // Consumes bytes read from the connection. Returns false on a connection error:
+    // a GOAWAY is queued and the connection should close once it is sent.
+    bool receive(const char* data, size_t length);
+
+    // The next request whose headers and body are complete, as HTTP/1.1 text; false if none
+    bool nextRequest(uint32_t& streamId, string& rawRequest);
+
+    // Queues the response headers; the body follows from pump()
+    void respond(uint32_t streamId, const HttpResponse& response, bool includeBody);
+
+    // Queues DATA frames, round robin between streams, until the queue holds
+    // budget bytes or the flow control windows are used up
+    void pump(uint64_t budget = QUEUE_BUDGET);
+
+    // Sends the WINDOW_UPDATE frames held back while over the memory budget, once
+    // it is back under. holdingWindow(): some are held.
+    void resumeFlowControl();
+    bool holdingWindow() const { return heldWindow > 0; }
+
+    // Graceful shutdown: no new streams; those already received are still answered
+    void goAway();
+
+    // No stream waits for a response or for its body to be sent
+    bool idle() const { return streams.empty() && ready.empty(); }
+
+    // The connection should close once the queued output is sent
+    bool finished() const { return (goAwaySent || peerGoingAway) && idle(); }
+
+private:
+    struct Stream
+    {
+        vector<HeaderField> headers;
+        string body;
+        bool requestComplete = false;   // END_STREAM received (half-closed remote)
+        bool tooLarge = false;          // The body exceeded MAX_REQUEST_BODY and was dropped
+        int64_t heldWindow = 0;         // Received bytes not yet given back (over the memory budget)
+        int64_t sendWindow = 0;
+
+        // Response body still to send; the front part is trimmed as it is framed
+        std::deque<BodyPart> response;
+        uint64_t remaining = 0;
+    };
+
+    bool handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t length);
+    bool handleData(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t length);
+    bool handleHeaders(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t length);
+    bool applySettings(const uint8_t* payload, size_t length);
+    bool handleWindowUpdate(uint32_t streamId, const uint8_t* payload, size_t length);
+    bool finishHeaderBlock();
+    bool validRequestHeaders(const vector<HeaderField>& headers) const;
+
+    // Connection error: queues GOAWAY with the code; always returns false
+    bool fail(uint32_t errorCode);
+    void resetStream(uint32_t streamId, uint32_t errorCode);
+    // Forgets a stream, releasing its request body
+    void closeStream(uint32_t streamId);
+    // Frees a request body and its share of the memory budget
+    void releaseBody(Stream& stream);
+
+    void queueFrame(uint8_t type, uint8_t flags, uint32_t streamId, const string& payload);
+    string frameHeader(size_t length, uint8_t type, uint8_t flags, uint32_t streamId) const;
+
+    OutputQueue& output;
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+    string input;                       // Received bytes not yet forming a whole frame
+    bool prefaceReceived = false;
+    bool failed = false;
+    bool goAwaySent = false;
+    bool peerGoingAway = false;
+
+    std::map<uint32_t, Stream> streams; // Open and half-closed streams
+    std::deque<uint32_t> ready;         // Streams with a complete request, in arrival order
+    std::deque<uint32_t> sending;       // Streams with body left to send, in turn order
+    uint32_t lastStreamId = 0;          // Highest stream the client opened
+
+    // A header block split over CONTINUATION frames
+    uint32_t continuationStream = 0;
+    bool continuationEndsStream = false;
+    string headerBlock;
+
+    // Peer settings and flow control
+    int64_t connectionWindow = 65535;   // Bytes we may still send on the connection
+    int64_t initialWindow = 65535;      // SETTINGS_INITIAL_WINDOW_SIZE for new streams
+    size_t peerMaxFrame = 16384;
+    int64_t heldWindow = 0;             // Received bytes not yet given back (over the memory budget)
+};
@@ -0,0 +1,164 @@
+#include "HttpHeaders.h"
+#include <cstring>
+
+namespace
+{
+    // Canonical names, in KnownHeader order
+    const char* const knownNames[KNOWN_HEADER_COUNT] = {
+        "Host", "Connection", "Content-Length", "Content-Type", "Content-Range",
+        "Transfer-Encoding", "Accept", "Accept-Language", "Accept-Encoding", "Range",
+        "If-None-Match", "If-Modified-Since", "Expect", "User-Agent"
+    };
+
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    char toLower(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    // RFC 9110 token characters, allowed in field names
+    bool isTokenChar(char c)
+    {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+            return true;
+        return c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+    }
+}
+
+HttpHeaders::HttpHeaders()
+{
+    memset(known, -1, sizeof(known));
+}
+
+bool HttpHeaders::equalsIgnoreCase(string_view a, string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (toLower(a[i]) != toLower(b[i]))
+            return false;
+    }
+    return true;
+}
+
+KnownHeader HttpHeaders::classify(const char* name, size_t length, uint32_t hash)
+{
+    // The case labels are distinct compile-time hashes; a collision would not compile
+    KnownHeader id;
+    switch (hash)
+    {
+    case hashName("host"): id = HEADER_HOST; break;
+    case hashName("connection"): id = HEADER_CONNECTION; break;
+    case hashName("content-length"): id = HEADER_CONTENT_LENGTH; break;
+    case hashName("content-type"): id = HEADER_CONTENT_TYPE; break;
+    case hashName("content-range"): id = HEADER_CONTENT_RANGE; break;
+    case hashName("transfer-encoding"): id = HEADER_TRANSFER_ENCODING; break;
+    case hashName("accept"): id = HEADER_ACCEPT; break;
+    case hashName("accept-language"): id = HEADER_ACCEPT_LANGUAGE; break;
+    case hashName("accept-encoding"): id = HEADER_ACCEPT_ENCODING; break;
+    case hashName("range"): id = HEADER_RANGE; break;
+    case hashName("if-none-match"): id = HEADER_IF_NONE_MATCH; break;
+    case hashName("if-modified-since"): id = HEADER_IF_MODIFIED_SINCE; break;
+    case hashName("expect"): id = HEADER_EXPECT; break;
+    case hashName("user-agent"): id = HEADER_USER_AGENT; break;
+    default: return HEADER_OTHER;
+    }
+    // An unknown name can share a hash with a known one
+    return equalsIgnoreCase(string_view(name, length), knownNames[id]) ? id : HEADER_OTHER;
+}
+
+bool HttpHeaders::parse(const char* buffer, size_t begin, size_t end)
+{
+    size_t start = begin;
+    while (start < end)
+    {
+        // Find the end of the line
+        const char* lineEnd = (const char*)memchr(buffer + start, '\r', end - start);
+        size_t endPos = lineEnd ? (size_t)(lineEnd - buffer) : end;
+
+        // Name: token characters up to the colon (no whitespace before it)
+        size_t colonPos = start;
+        while (colonPos < endPos && isTokenChar(buffer[colonPos]))
+            colonPos++;
+        if (colonPos == start || colonPos >= endPos || buffer[colonPos] != ':')
+            return false; // Invalid header format
+        if (count == MAX_FIELDS || colonPos - start > UINT16_MAX)
+            return false;
+
+        // Value without surrounding whitespace
+        size_t valueStart = colonPos + 1;
+        size_t valueEnd = endPos;
+        while (valueStart < valueEnd && isSpace(buffer[valueStart]))
+            valueStart++;
+        while (valueEnd > valueStart && isSpace(buffer[valueEnd - 1]))
+            valueEnd--;
+
+        Field& field = fields[count];
+        field.nameOffset = (uint32_t)start;
+        field.nameLength = (uint16_t)(colonPos - start);
+        field.valueOffset = (uint32_t)valueStart;
+        field.valueLength = (uint32_t)(valueEnd - valueStart);
+        field.hash = hashName(buffer + start, field.nameLength);
+        KnownHeader id = classify(buffer + start, field.nameLength, field.hash);
+        field.id = (uint8_t)id;
+
+        if (id != HEADER_OTHER)
+        {
+            if (known[id] < 0)
+                known[id] = (int8_t)count;
+            else if (id == HEADER_HOST || id == HEADER_CONTENT_LENGTH)
+                return false; // Ambiguous framing or target
+        }
+        count++;
+
+        // Move to the next header
+        start = endPos + 2;
+    }
+    return true;
+}
+
+string_view HttpHeaders::get(const char* buffer, KnownHeader id) const
+{
+    if (known[id] < 0)
+        return string_view();
+    const Field& field = fields[known[id]];
+    return string_view(buffer + field.valueOffset, field.valueLength);
+}
+
+string_view HttpHeaders::find(const char* buffer, string_view name) const
+{
+    uint32_t hash = hashName(name.data(), name.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        const Field& field = fields[i];
+        if (field.hash == hash && equalsIgnoreCase(string_view(buffer + field.nameOffset, field.nameLength), name))
+            return string_view(buffer + field.valueOffset, field.valueLength);
+    }
+    return string_view();
+}
+
+bool HttpHeaders::hasToken(string_view value, string_view token)
+{
+    size_t start = 0;
+    while (start <= value.size())
+    {
+        size_t comma = value.find(',', start);
+        if (comma == string_view::npos)
+            comma = value.size();
+        size_t first = start;
+        size_t last = comma;
+        while (first < last && isSpace(value[first]))
+            first++;
+        while (last > first && isSpace(value[last - 1]))
+            last--;
+        if (equalsIgnoreCase(value.substr(first, last - first), token))
+            return true;
+        start = comma + 1;
+    }
+    return false;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+using std::string_view;
+
+// Header fields the server looks up by id
+enum KnownHeader
+{
+    HEADER_HOST,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_CONTENT_RANGE,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_LANGUAGE,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_RANGE,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_EXPECT,
+    HEADER_USER_AGENT,
+    KNOWN_HEADER_COUNT,
+    HEADER_OTHER = KNOWN_HEADER_COUNT
+};
+
+// Header fields of one request, stored as offset/length pairs into the
+// request buffer in a fixed array (no allocation per header).
+//
+// Names are matched case-insensitively. Each field name is hashed once while
+// parsing; known names resolve to a KnownHeader id through a switch on
+// compile-time hashes, so get(id) is a single array read. Other names are
+// found by a linear scan that compares hashes before bytes.
+//
+// Only offsets are stored, so the accessors take the buffer that was parsed.
+class HttpHeaders
+{
+public:
+    static const size_t MAX_FIELDS = 64;
+
+    HttpHeaders();
+
+    // Parses the "Name: value\r\n" lines in buffer[begin, end). Returns false for a
+    // malformed line, too many fields, or a repeated Host or Content-Length.
+    bool parse(const char* buffer, size_t begin, size_t end);
+
+    // Value of a known header (first occurrence), empty if absent
+    string_view get(const char* buffer, KnownHeader id) const;
+
+    // Value of any header by name (case-insensitive), empty if absent
+    string_view find(const char* buffer, string_view name) const;
+
+    bool has(KnownHeader id) const { return known[id] >= 0; }
+    size_t size() const { return count; }
+
+    // True if a comma-separated header value contains the token (case-insensitive)
+    static bool hasToken(string_view value, string_view token);
+
+    // Case-insensitive FNV-1a over a header name
+    static constexpr uint32_t hashName(const char* name, size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++)
+        {
+            char c = name[i];
+            if (c >= 'A' && c <= 'Z')
+                c = (char)(c - 'A' + 'a');
+            hash = (hash ^ (unsigned char)c) * 16777619u;
+        }
+        return hash;
+    }
+
+    static constexpr uint32_t hashName(const char* name)
+    {
+        size_t length = 0;
+        while (name[length] != '\0')
+            length++;
+        return hashName(name, length);
+    }
+
+    static bool equalsIgnoreCase(string_view a, string_view b);
+
+private:
+    struct Field
+    {
+        uint32_t nameOffset;
+        uint32_t valueOffset;
+        uint32_t valueLength;
+        uint32_t hash;
+        uint16_t nameLength;
+        uint8_t id; // KnownHeader, HEADER_OTHER if not known
+    };
+
+    static KnownHeader classify(const char* name, size_t length, uint32_t hash);
+
+    Field fields[MAX_FIELDS];
+    size_t count = 0;
+    int8_t known[KNOWN_HEADER_COUNT]; // Index into fields, -1 if absent
+};
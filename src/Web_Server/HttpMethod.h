@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Request methods known to the server. The order is used as an index into
+// the dispatch table (HttpRequest) and the per-method metrics counters.
+enum HttpMethod
+{
+    METHOD_GET,
+    METHOD_HEAD,
+    METHOD_POST,
+    METHOD_PUT,
+    METHOD_DELETE,
+    METHOD_OPTIONS,
+    METHOD_TRACE,
+    METHOD_UNKNOWN,
+    METHOD_COUNT
+};
+
+// Method token <-> enum conversion.
+//
+// A token is at most 7 bytes, so it is packed into one integer and matched
+// with a single switch whose case labels are generated at compile time from
+// the method names: no string compares and no hashing on the request path.
+class HttpMethods
+{
+public:
+    static const size_t MAX_LENGTH = 7;
+
+    // Packs up to 8 bytes into an integer (first byte lowest)
+    static constexpr uint64_t pack(const char* text, size_t length)
+    {
+        uint64_t key = 0;
+        for (size_t i = 0; i < length; i++)
+            key |= (uint64_t)(unsigned char)text[i] << (8 * i);
+        return key;
+    }
+
+    static constexpr uint64_t pack(const char* text)
+    {
+        size_t length = 0;
+        while (text[length] != '\0')
+            length++;
+        return pack(text, length);
+    }
+
+    // Parses a method token (case-sensitive, as required by RFC 9110)
+    static HttpMethod parse(const char* text, size_t length)
+    {
+        if (length == 0 || length > MAX_LENGTH)
+            return METHOD_UNKNOWN;
+        switch (pack(text, length))
+        {
+        case pack("GET"): return METHOD_GET;
+        case pack("HEAD"): return METHOD_HEAD;
+        case pack("POST"): return METHOD_POST;
+        case pack("PUT"): return METHOD_PUT;
+        case pack("DELETE"): return METHOD_DELETE;
+        case pack("OPTIONS"): return METHOD_OPTIONS;
+        case pack("TRACE"): return METHOD_TRACE;
+        default: return METHOD_UNKNOWN;
+        }
+    }
+
+    // Method token, or "other" for METHOD_UNKNOWN
+    static const char* name(HttpMethod method)
+    {
+        static const char* const names[METHOD_COUNT] = {
+            "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "TRACE", "other"
+        };
+        return (unsigned)method < METHOD_COUNT ? names[method] : "other";
+    }
+};
@@ -1,397 +1,582 @@
-#include "HttpRequest.h"
-#include "HttpResponse.h" 
-#include <algorithm>
-#include <cctype>
-#include <stdexcept> // For std::invalid_argument
-
-
-// Using specific types from the std namespace
-using std::string;
-using std::unordered_map;
-using std::unordered_set;
-using std::stoi;
-using std::cout;
-using std::endl;
-
-// Initialize static constants
-const size_t HttpRequest::MAX_METHOD_LENGTH = 7;
-const size_t HttpRequest::MAX_URI_LENGTH = 2048;
-
-// Initialize the static member with valid HTTP methods
-const unordered_set<string> HttpRequest::validMethods = {
-    "GET", "POST", "PUT", "DELETE", "HEAD", "OPTIONS", "TRACE"
-};
-
-// Constructor
-HttpRequest::HttpRequest() = default;
-
-// Handles the incoming HTTP request by parsing it
-bool HttpRequest::handleRequest(const string& http_request)
-{
-    originalRequest = http_request; //for the trace
-    size_t posHeaders = http_request.find("\r\n");
-    if (posHeaders == string::npos)
-        return false;
-
-    string requestLine = http_request.substr(0, posHeaders + 2);
-    if (!parseRequestLine(requestLine, method, uri, httpVersion))
-        return false;
-
-    size_t posBody = http_request.find("\r\n\r\n", posHeaders + 2);
-    if (posBody == string::npos)
-        return false;
-
-    string headers = http_request.substr(posHeaders + 2, posBody - (posHeaders + 2));
-    if (!parseHeaders(headers))
-        return false;
-
-    if ((method == "POST" || method == "PUT" || method == "PATCH") && headerContentLength == 0)
-        return false;
-
-    if (headerContentLength > 0) {
-        body = http_request.substr(posBody + 4, headerContentLength);
-    }    
-    return true;
-}
-
-// Parses the headers from the HTTP request
-bool HttpRequest::parseHeaders(const string& headers)
-{
-    size_t start = 0;
-
-    while (start < headers.length())
-    {
-        // Find the position of the colon that separates the header name and value
-        size_t colonPos = headers.find(':', start);
-        if (colonPos == string::npos)
-        {
-            return false; // Invalid header format
-        }
-
-        // Extract the header name
-        string headerName = headers.substr(start, colonPos - start);
-
-        // Find the start of the header value (skip spaces after the colon)
-        size_t valueStart = headers.find_first_not_of(' ', colonPos + 1);
-        if (valueStart == string::npos)
-        {
-            return false; // Invalid header value
-        }
-
-        // Find the end of the header line
-        size_t endPos = headers.find("\r\n", valueStart);
-        if (endPos == string::npos)
-        {
-            endPos = headers.length();
-        }
-
-        // Extract the header value
-        string headerValue = headers.substr(valueStart, endPos - valueStart);
-
-        // Handle specific headers
-        if (headerName == "Host")
-        {
-            headerHost = headerValue;
-        }
-        else if (headerName == "Content-Length")
-        {
-            try
-            {
-                headerContentLength = stoi(headerValue);
-            }
-            catch (const std::invalid_argument&)
-            {
-                return false; // Invalid Content-Length value
-            }
-        }
-        else if (headerName == "Connection")
-        {
-            headerConnection = headerValue; // Store the Connection header value
-        }
-
-        // Move to the next header
-        start = endPos + 2;
-    }
-    if(headerConnection.empty())
-        headerConnection = "keep-alive";
-
-
-    // Ensure the Host header is present
-    return !headerHost.empty();
-}
-
-
-// Checks if the HTTP method is valid
-bool HttpRequest::isValidMethod(const string& method)
-{
-    return validMethods.find(method) != validMethods.end();
-}
-
-// Checks if the URI contains invalid characters
-bool HttpRequest::isUriContainsInvalidChars(const string& uri)
-{
-    for (char ch : uri) {
-        if (ch == ' ' || ch == '"' || ch == '\\') {
-            return true;
-        }
-    }
-    return false;
-}
-
-// Parses the Request Line of the HTTP request
-bool HttpRequest::parseRequestLine(string& request, string& method, string& uri, string& httpVersion)
-{
-    size_t pos = request.find(' ');
-    if (pos == string::npos || pos > MAX_METHOD_LENGTH)
-        return false;
-
-    string found_method = request.substr(0, pos);
-    if (!isValidMethod(found_method))
-        return false;
-    method = found_method;
-
-    size_t start_pos_uri = pos + 1;
-    if (request[start_pos_uri] != '/')
-        return false;
-
-    size_t pos_end_url = request.find(' ', start_pos_uri);
-    if (pos_end_url == string::npos || pos_end_url - start_pos_uri > MAX_URI_LENGTH)
-        return false;
-
-    string found_uri = request.substr(start_pos_uri, pos_end_url - start_pos_uri);
-
-    found_uri.erase(std::remove(found_uri.begin(), found_uri.end(), '\n'), found_uri.end());
-    found_uri.erase(std::remove(found_uri.begin(), found_uri.end(), '\r'), found_uri.end());
-
-    if (isUriContainsInvalidChars(found_uri))
-        return false;
-    uri = found_uri;
-
-    size_t pos_start_version = pos_end_url + 1;
-    size_t pos_end_version = request.find("\r\n", pos_start_version);
-    if (pos_end_version == string::npos)
-        return false;
-
-    string found_version = request.substr(pos_start_version, pos_end_version - pos_start_version);
-    if (found_version != "HTTP/1.1")
-        return false;
-
-    httpVersion = found_version;
-
-    parseUriLang();
-    return true;
-}
-
-string HttpRequest::getSupportedMethods() const
-{
-    //std::cout << "Supported methods size: " << validMethods.size() << std::endl;
-    size_t index = 0;
-    string methods;
-    
-    for (auto it = validMethods.begin(); it != validMethods.end(); ++it, ++index)
-    {
-        if (index > 0)
-            methods += ", "; // Add a comma after the first method
-        methods += *it; // Add the method to the string
-        std::cout << *it << " "; // Print the method
-    }
-    /*
-    for (const auto& method : validMethods)
-    {
-        if (!methods.empty())
-            methods += ", ";
-        methods += method;
-    }
-    */
-    //std::cout << "Supported methods: " << methods << std::endl;
-    return methods;
-}
-
-
-
-void HttpRequest::parseUriLang()
-{
-    // Find the start of the query string
-    size_t queryStart = uri.find("?lang=");
-    if (queryStart != string::npos && queryStart + 6 < uri.size())
-    {
-        // Extract the language value (2 characters after ?lang=)
-        string langValue = uri.substr(queryStart + 6, 2);
-
-        // Check if the language is supported
-        if (langValue == "he" || langValue == "en" || langValue == "fr")
-        {
-            headerLang = langValue; // Update the language field
-        }
-        // Remove the query string from the URI
-        uri = uri.substr(0, queryStart);
-        cout << uri;
-    }
-}
-
-
-string HttpRequest::extractFilePath() const
-{
-    string rootDirectory = "C:\\temp\\";
-    string adjustedFilePath = uri; // Start with the requested URI
-
-    // Default language to English if not set
-    string effectiveLanguage = headerLang.empty() ? "en" : headerLang;
-
-    if (!adjustedFilePath.empty() && adjustedFilePath[0] == '/')
-    {
-        adjustedFilePath = adjustedFilePath.substr(1);
-    }
-
-    //(_en, _he, _fr)
-    size_t langPos = adjustedFilePath.find_last_of('_');
-    size_t dotPos = adjustedFilePath.find_last_of('.');
-
-    if (langPos != string::npos && dotPos != string::npos && langPos < dotPos)
-    {
-        string existingLang = adjustedFilePath.substr(langPos + 1, dotPos - langPos - 1);
-        if (existingLang == "en" || existingLang == "he" || existingLang == "fr")
-        {
-            string fullPath = rootDirectory + adjustedFilePath;
-            cout << "Full Path: " << fullPath << endl; // Debugging output
-            return fullPath;
-        }
-    }
-    // Append the language suffix before the extension
-    if (dotPos != string::npos)
-    {
-        // Insert the language suffix before the extension
-        adjustedFilePath = adjustedFilePath.substr(0, dotPos) + "_" + effectiveLanguage + adjustedFilePath.substr(dotPos);
-    }
-    else
-    {
-        // If no extension exists, simply append the language suffix
-        adjustedFilePath += "_" + effectiveLanguage;
-    }
-
-    string fullPath = rootDirectory + adjustedFilePath;
-    cout << "Full Path: " << fullPath << endl; // Debugging output
-    return fullPath;
-}
-    /*
-    // Append the language suffix before the extension
-    size_t dotPos = adjustedFilePath.find_last_of('.');
-    if (dotPos != string::npos)
-    {
-        // Insert the language suffix before the extension
-        adjustedFilePath = adjustedFilePath.substr(0, dotPos) + "_" + effectiveLanguage + adjustedFilePath.substr(dotPos);
-    }
-    else
-    {
-        // If no extension exists, simply append the language suffix
-        adjustedFilePath += "_" + effectiveLanguage;
-    }
-
-    string fullPath = rootDirectory + adjustedFilePath;
-    cout << fullPath;
-    return fullPath;
-}
-*/
-
-HttpResponse HttpRequest::handleGetRequest()
-{
-    // Extract the file path based on the language
-    string filePath = extractFilePath();
-
-    // Use static response creation function to generate the response
-    return HttpResponse::createGetResponse(filePath);
-}
-
-
-// Handles HEAD requests
-HttpResponse HttpRequest::handleHeadRequest()
-{
-    string filePath = extractFilePath();
-    return HttpResponse::createHeadResponse(filePath);
-}
-
-// Handles POST requests
-HttpResponse HttpRequest::handlePostRequest() 
-{
-    return HttpResponse::createPostResponse(body);
-}
-
-// Handles PUT requests
-HttpResponse HttpRequest::handlePutRequest()
-{
-    string filePath = uri;
-    return HttpResponse::createPutResponse(filePath, body);
-}
-
-// Handles DELETE requests
-HttpResponse HttpRequest::handleDeleteRequest()
-{
-    string filePath = uri;
-    return HttpResponse::createDeleteResponse(filePath);
-}
-
-// Handles OPTIONS requests
-HttpResponse HttpRequest::handleOptionsRequest()
-{
-   // string supportedMethods = getSupportedMethods();
-  // Manually define the supported methods
-    string supportedMethods = "GET, POST, PUT, DELETE, OPTIONS, TRACE, HEAD";
-    return HttpResponse::createOptionsResponse(supportedMethods);
-}
-
-// Handles TRACE requests
-HttpResponse HttpRequest::handleTraceRequest()
-{
-    return HttpResponse::createTraceResponse(originalRequest); 
-}
-
-// Handles unsupported HTTP methods
-HttpResponse HttpRequest::handleUnsupportedMethod()
-{
-    string allowedMethods = getSupportedMethods();
-    cout << "got here";
-    return HttpResponse::createMethodNotAllowedResponse(allowedMethods);
-}
-
-
-
-
-
-
-// Handles the HTTP request and returns the appropriate HttpResponse
-HttpResponse HttpRequest::handlePerMethodRequest()
-{
-    if (method == "GET")
-    {
-        return handleGetRequest();
-    }
-    else if (method == "HEAD")
-    {
-        return handleHeadRequest();
-    }
-    else if (method == "POST")
-    {
-        return handlePostRequest();
-    }
-    else if (method == "PUT")
-    {
-        return handlePutRequest();
-    }
-    else if (method == "DELETE")
-    {
-        return handleDeleteRequest();
-    }
-    else if (method == "OPTIONS")
-    {
-        return handleOptionsRequest();
-    }
-    else if (method == "TRACE")
-    {
-        return handleTraceRequest();
-    }
-    else
-    {
-        return handleUnsupportedMethod();
-    }
-}
-
+#include "HttpRequest.h"
+#include "HttpResponse.h" 
+#include "LanguageNegotiator.h"
+#include "VirtualHosts.h"
+#include "Metrics.h"
+#include "PhaseTrace.h"
+#include "UriPath.h"
+#include "TarArchive.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+
+// Using specific types from the std namespace
+using std::string;
+using std::unordered_map;
+using std::cout;
+using std::endl;
+
+// Initialize static constants
+const size_t HttpRequest::MAX_URI_LENGTH = 2048;
+
+// Dispatch table, in HttpMethod order
+const HttpRequest::Handler HttpRequest::handlers[METHOD_COUNT] = {
+    &HttpRequest::handleGetRequest,
+    &HttpRequest::handleHeadRequest,
+    &HttpRequest::handlePostRequest,
+    &HttpRequest::handlePutRequest,
+    &HttpRequest::handleDeleteRequest,
+    &HttpRequest::handleOptionsRequest,
+    &HttpRequest::handleTraceRequest,
+    &HttpRequest::handleUnsupportedMethod
+};
+
+// Constructor
+HttpRequest::HttpRequest() = default;
+
+// Handles the incoming HTTP request by parsing it
+bool HttpRequest::handleRequest(const string& http_request)
+{
+    originalRequest = http_request; //for the trace
+    site = &VirtualHosts::instance().defaultHost();
+    size_t posHeaders = http_request.find("\r\n");
+    if (posHeaders == string::npos)
+        return false;
+
+    string requestLine = http_request.substr(0, posHeaders + 2);
+    if (!parseRequestLine(requestLine, method, uri, httpVersion))
+        return false;
+
+    size_t posBody = http_request.find("\r\n\r\n", posHeaders + 2);
+    if (posBody == string::npos)
+        return false;
+
+    if (!parseHeaders(posHeaders + 2, posBody + 2))
+        return false;
+
+    // Everything after this is resolved against the site the Host header names
+    site = &VirtualHosts::instance().select(getHeader(HEADER_HOST));
+    parseUriLang();
+
+    // A transfer-coded body is not read; the request is answered with 501 and the connection closed
+    if (transferEncoded)
+        return true;
+
+    // An empty PUT writes an empty file (or links stored content by its digest)
+    if (method == METHOD_POST && headerContentLength == 0)
+        return false;
+
+    if (headerContentLength > 0) {
+        body = http_request.substr(posBody + 4, headerContentLength);
+    }    
+    return true;
+}
+
+// Content-Length value: digits only, and small enough to fit
+static bool parseContentLength(string_view text, size_t& value)
+{
+    if (text.empty() || text.size() > 18)
+        return false;
+    value = 0;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9')
+            return false;
+        value = value * 10 + (size_t)(c - '0');
+    }
+    return true;
+}
+
+size_t HttpRequest::messageLength(string_view data)
+{
+    size_t length = expectedLength(data);
+    return length > 0 && data.size() >= length ? length : 0;
+}
+
+size_t HttpRequest::expectedLength(string_view data)
+{
+    size_t headerEnd = data.find("\r\n\r\n");
+    if (headerEnd == string_view::npos)
+        return 0;
+    size_t length = headerEnd + 4;
+
+    // Only Content-Length is needed to find the end; the full parse comes later.
+    // With Transfer-Encoding the request is rejected and the connection closed
+    // (RFC 9112 section 6.3), so its body is never taken as the next request.
+    size_t bodyLength = 0;
+    size_t lineStart = data.find("\r\n") + 2;
+    while (lineStart < headerEnd + 2)
+    {
+        size_t lineEnd = data.find("\r\n", lineStart);
+        string_view line = data.substr(lineStart, lineEnd - lineStart);
+        size_t colon = line.find(':');
+        if (colon != string_view::npos && HttpHeaders::equalsIgnoreCase(line.substr(0, colon), "transfer-encoding"))
+            return length;
+        if (colon != string_view::npos && bodyLength == 0 && HttpHeaders::equalsIgnoreCase(line.substr(0, colon), "content-length"))
+        {
+            string_view value = line.substr(colon + 1);
+            while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+                value.remove_prefix(1);
+            while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+                value.remove_suffix(1);
+            if (!parseContentLength(value, bodyLength))
+                bodyLength = 0; // An invalid value is rejected by the parser
+        }
+        lineStart = lineEnd + 2;
+    }
+    return length + bodyLength;
+}
+
+// Parses the headers from the HTTP request
+bool HttpRequest::parseHeaders(size_t begin, size_t end)
+{
+    if (!headers.parse(originalRequest.data(), begin, end))
+        return false;
+
+    // Content-Length: digits only, and small enough to fit
+    string_view contentLength = headers.get(originalRequest.data(), HEADER_CONTENT_LENGTH);
+    if (headers.has(HEADER_CONTENT_LENGTH) && !parseContentLength(contentLength, headerContentLength))
+        return false; // Invalid Content-Length value
+
+    // Transfer-Encoding is not supported; together with Content-Length the framing is ambiguous
+    transferEncoded = headers.has(HEADER_TRANSFER_ENCODING);
+    if (transferEncoded && headers.has(HEADER_CONTENT_LENGTH))
+        return false;
+
+    // Ensure the Host header is present
+    return !headers.get(originalRequest.data(), HEADER_HOST).empty();
+}
+
+
+// Checks if the URI contains invalid characters
+bool HttpRequest::isUriContainsInvalidChars(const string& uri)
+{
+    for (char ch : uri) {
+        if (ch == ' ' || ch == '"' || ch == '\\') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parses the Request Line of the HTTP request
+bool HttpRequest::parseRequestLine(string& request, HttpMethod& method, string& uri, string& httpVersion)
+{
+    size_t pos = request.find(' ');
+    if (pos == string::npos || pos > HttpMethods::MAX_LENGTH)
+        return false;
+
+    HttpMethod found_method = HttpMethods::parse(request.data(), pos);
+    if (found_method == METHOD_UNKNOWN)
+        return false;
+    method = found_method;
+
+    size_t start_pos_uri = pos + 1;
+    if (request[start_pos_uri] != '/')
+        return false;
+
+    size_t pos_end_url = request.find(' ', start_pos_uri);
+    if (pos_end_url == string::npos || pos_end_url - start_pos_uri > MAX_URI_LENGTH)
+        return false;
+
+    string found_uri = request.substr(start_pos_uri, pos_end_url - start_pos_uri);
+
+    found_uri.erase(std::remove(found_uri.begin(), found_uri.end(), '\n'), found_uri.end());
+    found_uri.erase(std::remove(found_uri.begin(), found_uri.end(), '\r'), found_uri.end());
+
+    if (isUriContainsInvalidChars(found_uri))
+        return false;
+
+    // Decode and normalize the path; the query string is kept as sent
+    size_t queryStart = found_uri.find('?');
+    if (!UriPath::normalize(string_view(found_uri).substr(0, queryStart), uri))
+        return false;
+    if (queryStart != string::npos)
+        uri.append(found_uri, queryStart, string::npos);
+
+    size_t pos_start_version = pos_end_url + 1;
+    size_t pos_end_version = request.find("\r\n", pos_start_version);
+    if (pos_end_version == string::npos)
+        return false;
+
+    string found_version = request.substr(pos_start_version, pos_end_version - pos_start_version);
+    if (found_version != "HTTP/1.1")
+        return false;
+
+    httpVersion = found_version;
+    return true;
+}
+
+string HttpRequest::getSupportedMethods() const
+{
+    string methods;
+    for (int index = 0; index < METHOD_UNKNOWN; index++)
+    {
+        if (index > 0)
+            methods += ", "; // Add a comma after the first method
+        methods += HttpMethods::name((HttpMethod)index);
+    }
+    return methods;
+}
+
+
+
+void HttpRequest::parseUriLang()
+{
+    // Find the start of the query string
+    size_t queryStart = uri.find('?');
+    if (queryStart == string::npos)
+        return;
+
+    // Look for lang=xx among all query parameters
+    size_t paramStart = queryStart + 1;
+    while (paramStart < uri.size())
+    {
+        size_t paramEnd = uri.find('&', paramStart);
+        if (paramEnd == string::npos)
+            paramEnd = uri.size();
+
+        if (uri.compare(paramStart, 5, "lang=") == 0)
+        {
+            string langValue = uri.substr(paramStart + 5, paramEnd - paramStart - 5);
+
+            // Check if the language is supported
+            if (site->routes.isSupportedLanguage(langValue))
+            {
+                headerLang = langValue; // Update the language field
+            }
+        }
+        paramStart = paramEnd + 1;
+    }
+
+    // Remove the query string from the URI
+    uri = uri.substr(0, queryStart);
+}
+
+shared_ptr<const vector<string>> HttpRequest::getLanguagePreferences() const
+{
+    // An explicit ?lang= wins over the browser preferences
+    if (!headerLang.empty())
+        return std::make_shared<const vector<string>>(1, headerLang);
+    string_view acceptLanguage = getHeader(HEADER_ACCEPT_LANGUAGE);
+    if (!acceptLanguage.empty())
+        return LanguageNegotiator::preferences(string(acceptLanguage));
+    return std::make_shared<const vector<string>>();
+}
+
+RouteMatch HttpRequest::resolveFile() const
+{
+    return site->routes.lookup(uri, *getLanguagePreferences());
+}
+
+string HttpRequest::extractFilePath() const
+{
+    RouteMatch match = resolveFile();
+    if (match.entry)
+        return match.entry->fullPath;
+    return site->root.path() + buildRelativePath();
+}
+
+// Adds Content-Language and Vary for files selected by language
+void HttpRequest::setLanguageHeaders(HttpResponse& response, const RouteMatch& match) const
+{
+    if (response.getStatusCode() != 200 || !match.entry)
+        return;
+    if (!match.entry->language.empty())
+        response.setContentLanguage(match.entry->language);
+    if (match.negotiated)
+        response.setVary("Accept-Language");
+}
+
+string HttpRequest::buildRelativePath() const
+{
+    string adjustedFilePath = uri; // Start with the requested URI
+
+    // Default language to English if not set
+    string effectiveLanguage = headerLang.empty() ? RouteIndex::DEFAULT_LANGUAGE : headerLang;
+
+    if (!adjustedFilePath.empty() && adjustedFilePath[0] == '/')
+    {
+        adjustedFilePath = adjustedFilePath.substr(1);
+    }
+
+    //(_en, _he, _fr)
+    size_t langPos = adjustedFilePath.find_last_of('_');
+    size_t dotPos = adjustedFilePath.find_last_of('.');
+
+    if (langPos != string::npos && dotPos != string::npos && langPos < dotPos)
+    {
+        string existingLang = adjustedFilePath.substr(langPos + 1, dotPos - langPos - 1);
+        if (site->routes.isSupportedLanguage(existingLang))
+        {
+            cout << "File Path: " << adjustedFilePath << endl; // Debugging output
+            return adjustedFilePath;
+        }
+    }
+    // Append the language suffix before the extension
+    if (dotPos != string::npos)
+    {
+        // Insert the language suffix before the extension
+        adjustedFilePath = adjustedFilePath.substr(0, dotPos) + "_" + effectiveLanguage + adjustedFilePath.substr(dotPos);
+    }
+    else
+    {
+        // If no extension exists, simply append the language suffix
+        adjustedFilePath += "_" + effectiveLanguage;
+    }
+
+    cout << "File Path: " << adjustedFilePath << endl; // Debugging output
+    return adjustedFilePath;
+}
+    /*
+    // Append the language suffix before the extension
+    size_t dotPos = adjustedFilePath.find_last_of('.');
+    if (dotPos != string::npos)
+    {
+        // Insert the language suffix before the extension
+        adjustedFilePath = adjustedFilePath.substr(0, dotPos) + "_" + effectiveLanguage + adjustedFilePath.substr(dotPos);
+    }
+    else
+    {
+        // If no extension exists, simply append the language suffix
+        adjustedFilePath += "_" + effectiveLanguage;
+    }
+
+    string fullPath = rootDirectory + adjustedFilePath;
+    cout << fullPath;
+    return fullPath;
+}
+*/
+
+HttpResponse HttpRequest::handleGetRequest()
+{
+    // Built-in metrics endpoint
+    if (uri == "/__metrics")
+        return HttpResponse::createMetricsResponse();
+    // Phase timings of the last requests, in builds with WEB_SERVER_PHASE_TRACE
+    if (uri == "/__trace" && PhaseTrace::enabled())
+        return HttpResponse::createTraceResponse();
+
+    // Extract the file path based on the language
+    RouteMatch match = resolveFile();
+    if (!match.entry)
+    {
+        // Not indexed: look on disk, unless the path was already found missing there
+        string relativePath = buildRelativePath();
+        if (site->missing.contains(relativePath))
+        {
+            Metrics::recordNegativeCacheHit();
+            return HttpResponse::createNotFoundResponse();
+        }
+        HttpResponse response = HttpResponse::createGetResponse(site->root, relativePath);
+        if (response.getStatusCode() == 404 && site->root.isMissing(relativePath))
+            site->missing.insert(relativePath); // Not for EACCES or EMFILE, which may pass
+        return response;
+    }
+
+    // Use static response creation function to generate the response
+    HttpResponse response = HttpResponse::createGetResponse(*match.entry, site->cache);
+    setLanguageHeaders(response, match);
+    return response;
+}
+
+
+// Handles HEAD requests
+HttpResponse HttpRequest::handleHeadRequest()
+{
+    // A ranged PUT in progress: tell the client which parts are still missing
+    string received;
+    if (site->uploads.status(uri.substr(1), received))
+        return HttpResponse::createUploadStatusResponse(received);
+
+    // Size comes from the index, so the file does not have to be read
+    RouteMatch match = resolveFile();
+    if (match.entry)
+    {
+        HttpResponse response = HttpResponse::createHeadResponse(*match.entry);
+        setLanguageHeaders(response, match);
+        return response;
+    }
+
+    string relativePath = buildRelativePath();
+    if (site->missing.contains(relativePath))
+    {
+        Metrics::recordNegativeCacheHit();
+        return HttpResponse::createNotFoundResponse();
+    }
+    HttpResponse response = HttpResponse::createHeadResponse(site->root, relativePath);
+    if (response.getStatusCode() == 404 && site->root.isMissing(relativePath))
+        site->missing.insert(relativePath);
+    return response;
+}
+
+// Handles POST requests
+HttpResponse HttpRequest::handlePostRequest() 
+{
+    if (UriPath::hasHiddenSegment(uri))
+        return HttpResponse::createForbiddenResponse();
+    if (uri == "/__batch")
+        return handleBatchRequest();
+    return HttpResponse::createPostResponse(site->root, body);
+}
+
+// The body lists one path per line. Every file is resolved, and its read started,
+// before the first byte goes out: cached bodies are shared, the disk reads ahead
+// on all the misses at once, and large files are sent from disk while it does.
+// Paths that are not served (unknown, invalid or too long for tar, or large files past
+// MAX_BATCH_OPEN_FILES) are listed in a final ".missing" member instead of failing the
+// whole batch.
+HttpResponse HttpRequest::handleBatchRequest()
+{
+    struct Member
+    {
+        string name;
+        shared_ptr<const FileEntry> entry;
+        BodyPart contents;
+    };
+    vector<Member> members;
+    string missing;
+    size_t openFiles = 0;
+    shared_ptr<const vector<string>> languages = getLanguagePreferences();
+
+    size_t lineStart = 0;
+    while (lineStart < body.size())
+    {
+        size_t lineEnd = body.find('\n', lineStart);
+        if (lineEnd == string::npos)
+            lineEnd = body.size();
+        string line = body.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+        if (members.size() >= MAX_BATCH_FILES)
+            return HttpResponse::createBadRequestResponse();
+
+        Member member;
+        if (UriPath::normalize(line[0] == '/' ? line : "/" + line, member.name) && member.name.size() > 1 && !UriPath::hasHiddenSegment(member.name))
+            member.entry = site->routes.lookup(member.name, *languages).entry;
+        if (!member.entry)
+        {
+            missing += line + "\n";
+            continue;
+        }
+        member.name.erase(0, 1);
+
+        // Cache hits are shared as they are; everything else starts reading now
+        member.contents.data = site->cache.getCached(*member.entry);
+        if (!member.contents.data && site->cache.isCacheable(*member.entry))
+            site->cache.prefetch(*member.entry);
+        else if (!member.contents.data)
+        {
+            if (openFiles == MAX_BATCH_OPEN_FILES)
+            {
+                missing += line + "\n";
+                continue;
+            }
+            openFiles++;
+            member.contents.file = site->cache.openUncached(*member.entry);
+            if (member.contents.file)
+                member.contents.file->prefetch();
+        }
+        members.push_back(std::move(member));
+    }
+
+    TarArchive archive;
+    for (Member& member : members)
+    {
+        // Small misses are loaded (and cached) now; the read-ahead above has a head start on them
+        if (!member.contents.data && !member.contents.file)
+            member.contents.data = site->cache.getBody(*member.entry);
+        if (member.contents.data)
+            member.contents.length = member.contents.data->size();
+        else if (member.contents.file)
+            member.contents.length = member.contents.file->size();
+        if ((!member.contents.data && !member.contents.file) || !archive.add(member.name, member.entry->modified, member.contents))
+            missing += "/" + member.name + "\n";
+    }
+    if (!missing.empty())
+        archive.add(".missing", time(nullptr), missing);
+    return HttpResponse::createArchiveResponse(archive.finish());
+}
+
+// Handles PUT requests
+HttpResponse HttpRequest::handlePutRequest()
+{
+    // Dot-prefixed names hold the blob store and upload staging files
+    if (UriPath::hasHiddenSegment(uri))
+        return HttpResponse::createForbiddenResponse();
+    string filePath = uri.substr(1); // Relative to the document root
+    string_view contentRange = getHeader(HEADER_CONTENT_RANGE);
+    if (!contentRange.empty())
+    {
+        HttpResponse response = HttpResponse::createRangedPutResponse(site->uploads, filePath, contentRange, body);
+        if (response.getStatusCode() == 200) // The last part: the file is in place
+            VirtualHosts::instance().fileChanged(*site, filePath);
+        return response;
+    }
+
+    site->uploads.cancel(filePath); // Replaced as a whole
+    HttpResponse response;
+    if (site->deduplicate)
+    {
+        // No body and a digest in If-None-Match: link content that is already stored
+        string digest = body.empty() ? BlobStore::parseDigest(getHeader(HEADER_IF_NONE_MATCH)) : string();
+        response = !digest.empty() ? HttpResponse::createBlobLinkResponse(site->root, site->blobs, filePath, digest)
+            : HttpResponse::createBlobPutResponse(site->root, site->blobs, filePath, body);
+    }
+    else
+        response = HttpResponse::createPutResponse(site->root, filePath, body);
+    // Only this file's routes change; the rest of the index is kept
+    VirtualHosts::instance().fileChanged(*site, filePath);
+    return response;
+}
+
+// Handles DELETE requests
+HttpResponse HttpRequest::handleDeleteRequest()
+{
+    if (UriPath::hasHiddenSegment(uri))
+        return HttpResponse::createForbiddenResponse();
+    string filePath = uri.substr(1); // Relative to the document root
+    site->uploads.cancel(filePath);
+    HttpResponse response = HttpResponse::createDeleteResponse(site->root, filePath);
+    VirtualHosts::instance().fileChanged(*site, filePath);
+    return response;
+}
+
+// Handles OPTIONS requests
+HttpResponse HttpRequest::handleOptionsRequest()
+{
+    // Built once from the method table
+    static const string supportedMethods = getSupportedMethods();
+    return HttpResponse::createOptionsResponse(supportedMethods);
+}
+
+// Handles TRACE requests
+HttpResponse HttpRequest::handleTraceRequest()
+{
+    return HttpResponse::createTraceResponse(originalRequest); 
+}
+
+// Handles unsupported HTTP methods
+HttpResponse HttpRequest::handleUnsupportedMethod()
+{
+    string allowedMethods = getSupportedMethods();
+    return HttpResponse::createMethodNotAllowedResponse(allowedMethods);
+}
+
+
+
+
+
+
+// Handles the HTTP request and returns the appropriate HttpResponse
+HttpResponse HttpRequest::handlePerMethodRequest()
+{
+    if (transferEncoded)
+        return HttpResponse::createNotImplementedResponse();
+    // One indexed call instead of a chain of string compares
+    return (this->*handlers[method])();
+}
@@ -1,99 +1,143 @@
-﻿#pragma once
-
-#include <string>
-#include <unordered_map>
-#include <unordered_set>
-#include <iostream>
-#include "HttpResponse.h" 
-
-// Using specific types from the std namespace
-using std::string;
-using std::unordered_map;
-using std::unordered_set;
-
-
-class HttpRequest
-{
-private:
-    // Maximum allowed lengths for method and URI
-    static const size_t MAX_METHOD_LENGTH;
-    static const size_t MAX_URI_LENGTH;
-
-    // Set of valid HTTP methods
-    static const unordered_set<string> validMethods;
-
-    // Member variables to store request details
-    string originalRequest;                 // Stores the raw HTTP request (used for TRACE responses)
-    string method;                          // HTTP method (e.g., GET, POST, DELETE)
-    string uri;                             // The requested URI (e.g., "/index.html")
-    string httpVersion;                     // HTTP version (e.g., "HTTP/1.1")
-    string body;                            // Request body (used in POST and PUT methods)
-    string headerHost;                      // Host header from the request
-    string headerLang;                      // Language preference from the request (e.g., "en" or "fr")
-    size_t headerContentLength = 0;         // Value of Content-Length header (size of the body in bytes)
-    string headerConnection = "keep-alive"; // Connection header value (default is "keep-alive")
-
-public:
-    // Constructor
-    HttpRequest();
-
-    // Handles the incoming HTTP request by parsing it
-    bool handleRequest(const string& http_request);
-
-    // Get the preferred language from the request
-    string getLanguage() const { return headerLang; };
-
-    // Handles the HTTP request by dispatching it to the appropriate method handler
-    HttpResponse handlePerMethodRequest();
-
-    // Get the value of the Connection header
-    string getHeaderConnection() const { return headerConnection; }
-
-private:
-    // Parses the headers from the HTTP request
-    bool parseHeaders(const string& headers);
-
-    // Checks if the HTTP method is valid
-    bool isValidMethod(const string& method);
-
-    // Checks if the URI contains invalid characters
-    bool isUriContainsInvalidChars(const string& uri);
-
-    // Parses the Request Line (first line) of the HTTP request
-    bool parseRequestLine(string& request, string& method, string& uri, string& httpVersion);
-
-    // Gets a list of supported HTTP methods for the OPTIONS response
-    string getSupportedMethods() const;
-
-    // Extracts the file path from the URI
-    string extractFilePath() const;
-
-    // Parses the language from the URI (if specified as a query string parameter)
-    void parseUriLang();
-
- 
-    // Handles GET requests
-    HttpResponse handleGetRequest();
-
-    // Handles POST requests
-    HttpResponse handlePostRequest();
-
-    // Handles PUT requests
-    HttpResponse handlePutRequest();
-
-    // Handles DELETE requests
-    HttpResponse handleDeleteRequest();
-
-    // Handles OPTIONS requests
-    HttpResponse handleOptionsRequest();
-
-    // Handles TRACE requests
-    HttpResponse handleTraceRequest();
-
-    // Handles unsupported HTTP methods
-    HttpResponse handleUnsupportedMethod();
-
-    // Handles HEAD requests
-    HttpResponse handleHeadRequest();
-
-};
+﻿#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <iostream>
+#include <vector>
+#include <memory>
+#include "HttpResponse.h" 
+#include "HttpMethod.h"
+#include "HttpHeaders.h"
+#include "RouteIndex.h"
+
+// Using specific types from the std namespace
+using std::string;
+using std::unordered_map;
+using std::vector;
+using std::shared_ptr;
+
+struct VirtualHost;
+
+class HttpRequest
+{
+private:
+    // Maximum allowed length for the URI
+    static const size_t MAX_URI_LENGTH;
+
+    // Most files one /__batch request may list, and most of them sent straight from
+    // disk (each holds a descriptor until it is sent); further large files are listed as missing
+    static const size_t MAX_BATCH_FILES = 256;
+    static const size_t MAX_BATCH_OPEN_FILES = 32;
+
+    // Handler per HttpMethod, indexed by the enum
+    typedef HttpResponse (HttpRequest::*Handler)();
+    static const Handler handlers[METHOD_COUNT];
+
+    // Member variables to store request details
+    string originalRequest;                 // Stores the raw HTTP request (used for TRACE responses)
+    HttpMethod method = METHOD_UNKNOWN;     // HTTP method, parsed once from the request line
+    string uri;                             // The requested URI, path decoded and normalized (e.g., "/index.html")
+    string httpVersion;                     // HTTP version (e.g., "HTTP/1.1")
+    string body;                            // Request body (used in POST and PUT methods)
+    HttpHeaders headers;                    // All header fields, as offsets into originalRequest
+    string headerLang;                      // Language preference from the request (e.g., "en" or "fr")
+    size_t headerContentLength = 0;         // Value of Content-Length header (size of the body in bytes)
+    bool transferEncoded = false;           // Transfer-Encoding header present (answered with 501)
+    VirtualHost* site = nullptr;            // Site selected by the Host header
+
+public:
+    // Constructor
+    HttpRequest();
+
+    // Handles the incoming HTTP request by parsing it
+    bool handleRequest(const string& http_request);
+
+    // Length of the first complete request in data (headers plus the Content-Length body,
+    // headers only with Transfer-Encoding), or 0 if more bytes are needed. Lets a connection
+    // buffer hold partial and pipelined requests.
+    static size_t messageLength(string_view data);
+
+    // Length the first request in data will have (headers plus the Content-Length body),
+    // known once its headers are complete; 0 before that
+    static size_t expectedLength(string_view data);
+
+    // Get the preferred language from the request
+    string getLanguage() const { return headerLang; };
+
+    // Handles the HTTP request by dispatching it to the appropriate method handler
+    HttpResponse handlePerMethodRequest();
+
+    // Get the HTTP method of the request
+    HttpMethod getMethod() const { return method; }
+
+    // Value of a header (empty if absent); names are case-insensitive
+    string_view getHeader(KnownHeader id) const { return headers.get(originalRequest.data(), id); }
+    string_view getHeader(string_view name) const { return headers.find(originalRequest.data(), name); }
+
+    // The site serving this request (the default site until the headers are parsed)
+    VirtualHost& getVirtualHost() const { return *site; }
+
+    // True if the client asked to close the connection after this response, or sent a
+    // body whose end cannot be found (Transfer-Encoding)
+    bool wantsClose() const { return transferEncoded || HttpHeaders::hasToken(getHeader(HEADER_CONNECTION), "close"); }
+
+    // Extracts the file path from the URI
+    string extractFilePath() const;
+
+private:
+    // Parses the header lines in originalRequest[begin, end)
+    bool parseHeaders(size_t begin, size_t end);
+
+    // Checks if the URI contains invalid characters
+    bool isUriContainsInvalidChars(const string& uri);
+
+    // Parses the Request Line (first line) of the HTTP request
+    bool parseRequestLine(string& request, HttpMethod& method, string& uri, string& httpVersion);
+
+    // Gets a list of supported HTTP methods for the OPTIONS response
+    string getSupportedMethods() const;
+
+    // Parses the language from the URI (if specified as a query string parameter)
+    void parseUriLang();
+
+    // Languages to try for this request, most preferred first (?lang=, then Accept-Language)
+    shared_ptr<const vector<string>> getLanguagePreferences() const;
+
+    // Resolves the URI through the route index (entry is nullptr if not indexed)
+    RouteMatch resolveFile() const;
+
+    // Sets Content-Language and Vary on a response for a resolved file
+    void setLanguageHeaders(HttpResponse& response, const RouteMatch& match) const;
+
+    // Builds the path under the document root by string manipulation when the route index has no entry
+    string buildRelativePath() const;
+
+ 
+    // Handles GET requests
+    HttpResponse handleGetRequest();
+
+    // Handles POST requests
+    HttpResponse handlePostRequest();
+
+    // POST /__batch: the files listed in the body as one tar archive
+    HttpResponse handleBatchRequest();
+
+    // Handles PUT requests
+    HttpResponse handlePutRequest();
+
+    // Handles DELETE requests
+    HttpResponse handleDeleteRequest();
+
+    // Handles OPTIONS requests
+    HttpResponse handleOptionsRequest();
+
+    // Handles TRACE requests
+    HttpResponse handleTraceRequest();
+
+    // Handles unsupported HTTP methods
+    HttpResponse handleUnsupportedMethod();
+
+    // Handles HEAD requests
+    HttpResponse handleHeadRequest();
+
+};
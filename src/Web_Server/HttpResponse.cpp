@@ -1,444 +1,814 @@
-#include "HttpResponse.h"
-#include <sstream>
-#include <fstream>
-#include <iostream>
-
-using std::ifstream;
-using std::ostringstream;
-using std::to_string;
-
-
-// Constructors
-HttpResponse::HttpResponse()
-    : httpVersion("HTTP/1.1"), statusCode(200), statusMessage("OK"),
-    headerContentType(""), headerContentLength(0), allow(""), body("") {
-}
-
-HttpResponse::HttpResponse(int code, const string& message)
-    : httpVersion("HTTP/1.1"), statusCode(code), statusMessage(message),
-    headerContentType(""), headerContentLength(0), allow(""), body("") {
-}
-
-
-// Setters
-void HttpResponse::setStatus(int code, const string& message)
-{
-    statusCode = code;
-    statusMessage = message;
-}
-
-void HttpResponse::setContentType(const string& type)
-{
-    headerContentType = type;
-}
-
-void HttpResponse::setContentLength(size_t length)
-{
-    headerContentLength = length;
-}
-
-void HttpResponse::setBody(const string& content)
-{
-    body = content;
-    setContentLength(content.size());
-}
-
-void HttpResponse::setAllow(const string& methods)
-{
-    allow = methods; 
-}
-
-void HttpResponse::setConnection(const string& connection)
-{
-    headerConnection = connection;
-}
-
-// Utility function to read file content
-string HttpResponse::readFileContent(const string& fileName)
-{
-    // Construct the full path for the file in C:\temp
-    const string filePath = "C:\\temp\\" + fileName;
-    // Open the file for reading
-    ifstream file(filePath);
-    if (!file.is_open())
-    {
-        // Return an empty string if the file cannot be opened
-        return "";
-    }
-
-    // Read the entire file content into a string stream
-    ostringstream buffer;
-    buffer << file.rdbuf();
-
-    // Convert the buffer to a string and return
-    return buffer.str();
-}
-
-string HttpResponse::readFileContent_without_temp(const string& filePath)
-{
-    // Construct the full path for the file in C:\temp
-    //const string filePath = "C:\\temp\\" + fileName;
-    // Open the file for reading
-    ifstream file(filePath);
-    if (!file.is_open())
-    {
-        // Return an empty string if the file cannot be opened
-        return "";
-    }
-
-    // Read the entire file content into a string stream
-    ostringstream buffer;
-    buffer << file.rdbuf();
-
-    // Convert the buffer to a string and return
-    return buffer.str();
-}
-
-
-// Static methods for common responses
-HttpResponse HttpResponse::createBadRequestResponse()
-{
-    HttpResponse response(400, "Bad Request");
-    response.setContentType("text/html");
-    response.setConnection("close");
-    // Read the HTML file content
-    string fileContent = readFileContent("bad_request.html");
-    if (!fileContent.empty())
-    {
-        response.setBody(fileContent);
-    }
-    else
-    {
-        // Fallback to a default response if the file cannot be read
-        response.setBody("<!DOCTYPE html><html><body><h1>400 Bad Request</h1></body></html>");
-    }
-
-    return response;
-}
-
-
-HttpResponse HttpResponse::createNotFoundResponse()
-{
-    HttpResponse response(404, "Not Found");
-    response.setContentType("text/html");
-    response.setConnection("close");
-    // Load the HTML file for 404 response
-    string fileContent = readFileContent("not_found.html");
-    if (!fileContent.empty())
-    {
-        response.setBody(fileContent);
-    }
-    else
-    {
-        // Fallback content in case the file cannot be read
-        response.setBody("<!DOCTYPE html><html><body><h1>404 Page Not Found</h1></body></html>");
-    }
-
-    return response;
-}
-
-
-HttpResponse HttpResponse::createMethodNotAllowedResponse(const string& allowedMethods)
-{
-    ;
-    HttpResponse response(405, "Method Not Allowed");
-    response.setContentType("text/html");
-    response.setAllow(allowedMethods);
-    response.setConnection("close");
-
-    // Load the HTML file for 405 response
-    string fileContent = readFileContent("method_not_allowed.html");
-    if (!fileContent.empty())
-    {
-        response.setBody(fileContent);
-    }
-    else
-    {
-        // Fallback content in case the file cannot be read
-        response.setBody("<!DOCTYPE html><html><body><h1>405 Method Not Allowed</h1></body></html>");
-    }
-
-    return response;
-}
-
-
-HttpResponse HttpResponse::createNotImplementedResponse()
-{
-    HttpResponse response(501, "Not Implemented");
-    response.setContentType("text/html");
-    response.setConnection("close");
-    // Load the HTML file for 501 response
-    string fileContent = readFileContent("not_implemented.html");
-    if (!fileContent.empty())
-    {
-        response.setBody(fileContent);
-    }
-    else
-    {
-        // Fallback content in case the file cannot be read
-        response.setBody("<!DOCTYPE html><html><body><h1>501 Not Implemented</h1></body></html>");
-    }
-
-    return response;
-}
-
-HttpResponse HttpResponse::createInternalErrorResponse()
-{
-    HttpResponse response(500, "Internal Server Error");
-    response.setContentType("text/html");
-    response.setConnection("close");
-    // Load the HTML file for 500 response
-    string fileContent = readFileContent("internal_error.html");
-    if (!fileContent.empty())
-    {
-        response.setBody(fileContent);
-    }
-    else
-    {
-        // Fallback content in case the file cannot be read
-        response.setBody("<!DOCTYPE html><html><body><h1>500 Internal Server Error</h1><p>An unexpected error occurred on the server.</p></body></html>");
-    }
-
-    return response;
-}
-
-
-HttpResponse HttpResponse::createOptionsResponse(const string& supportedMethods)
-{
-    HttpResponse response(200, "OK");
-    response.setContentType("text/html");
-    response.setBody(""); // No body required for OPTIONS   
-    response.setConnection("keep-alive");
-    //std::cout << "Generated response before Allow: " << response.toString() << std::endl;
-    response.setAllow(supportedMethods); // Supported methods, e.g., "GET, POST, OPTIONS, TRACE"
-   // std::cout << "Generated response AFTER Allow: " << response.toString() << std::endl;
-
-    return response;
-}
-
-
-HttpResponse HttpResponse::createGetResponse(const string& filePath)
-{
-    HttpResponse response(200, "OK");
-    response.setContentType("text/html");
-    response.setConnection("keep-alive");
-    // Load the requested file
-    string fileContent = readFileContent_without_temp(filePath);
-    if (!fileContent.empty())
-    {
-        response.setBody(fileContent);
-    }
-    else
-    {
-        // If the file is not found, return a 404 response
-        return HttpResponse::createNotFoundResponse();
-    }
-
-    return response;
-}
-
-HttpResponse HttpResponse::createHeadResponse(const string& filePath)
-{
-    HttpResponse response(200, "OK");
-    response.setContentType("text/html");
-    response.setConnection("keep-alive");
-    // Load the requested file
-    std::cout << filePath;
-    string fileContent = readFileContent_without_temp(filePath);
-    if (!fileContent.empty())
-    {
-        response.setContentLength(fileContent.size());
-        std::cout << "\nheader Content Length: " << response.headerContentLength << std::endl;
-    }
-    else
-    {
-        // If the file is not found, return a 404 response
-        return HttpResponse::createNotFoundResponse();
-    }
-
-    return response;
-
-}
-/*VERSION 2
-HttpResponse HttpResponse::createHeadResponse(const string& filePath)
-{
-    HttpResponse response(200, "OK");
-    response.setContentType("text/html");
-    response.setConnection("keep-alive");
-
-    // Construct full file path in C:\temp
-   // const string filePath = "C:\\temp\\" + fileName;
-    std::cout << filePath;
-    // Open the file to check if it exists and get its size
-    ifstream file(filePath);
-    if (!file.is_open())
-    {
-        // File does not exist, return 404
-        return HttpResponse::createNotFoundResponse();
-    }
-
-
-    // Move the file pointer to the end
-    file.seekg(0, std::ios::end);
-
-    // Get the current position (file size)
-    size_t fileSize = file.tellg();
-
-    file.close();
-
-    // Set Content-Length based on file size
-    response.setContentLength(fileSize);
-
-    // No body for HEAD requests
-    return response;
-}
-*/
-/*version 1
-HttpResponse HttpResponse::createHeadResponse(const string& fileName)
-{
-    HttpResponse response(200, "OK");
-    response.setContentType("text/html");
-    response.setConnection("keep-alive");
-    // Construct full file path in C:\temp
-   //const string filePath = "C:\\temp\\" + fileName;
-    // No body for HEAD requests
-    string fileContent = readFileContent(fileName);
-    if (!fileContent.empty())
-    {
-        response.setContentLength(fileContent.size());
-    }
-    else
-    {
-        // If the file is not found, return a 404 response
-        return HttpResponse::createNotFoundResponse();
-    }
-
-    return response;
-}
-*/
-HttpResponse HttpResponse::createPostResponse(const string& requestBody)
-{
-    HttpResponse response(200, "OK"); // Set status to 200 OK
-    response.setContentType("text/plain"); // Set content type
-    response.setConnection("keep-alive"); // Set connection type
-
-    // File path in the C:\temp directory
-    const string filePath = "C:\\temp\\post.txt";
-
-    // Print the request body to the console
-    std::cout << "POST Request Body: " << requestBody << std::endl;
-
-    // Open the file in append mode
-    std::ofstream file(filePath, std::ios::app);
-    if (file.is_open())
-    {
-        file << requestBody << "\n"; // Write the request body to the file
-        file.close(); // Close the file
-        std::cout << "POST Request Body appended to " << filePath << std::endl;
-
-        // Response to the client
-        response.setBody("<!DOCTYPE html><html><body><h1>POST data appended successfully to post.txt</h1></body></html>");
-    }
-    else
-    {
-        // In case of failure to open the file
-        std::cout << "Failed to append POST Request Body to post.txt in C:\\temp!" << std::endl;
-        return HttpResponse::createInternalErrorResponse();
-    }
-
-    return response;
-}
-
-HttpResponse HttpResponse::createPutResponse(const string& fileName, const string& requestBody)
-{
-    HttpResponse response(200, "OK"); // Always return 200 OK
-    response.setContentType("text/html");
-    response.setConnection("keep-alive");
-
-    // Construct full file path in C:\temp
-    const string filePath = "C:\\temp\\" + fileName;
-    // Open the file for writing
-    std::ofstream file(filePath);
-    if (file.is_open())
-    {
-        file << requestBody; // Write the content to the file
-        file.close();
-
-        // Confirmation message in the response body
-        response.setBody("<!DOCTYPE html><html><body><h1>PUT operation completed</h1></body></html>");
-    }
-    else
-    {
-        // If the file cannot be created or written
-        return HttpResponse::createInternalErrorResponse();
-    }
-
-    return response;
-}
-
-
-HttpResponse HttpResponse::createDeleteResponse(const string& fileName)
-{
-    HttpResponse response(200, "OK");
-    response.setContentType("text/html");
-    response.setConnection("keep-alive");
-    // Construct full file path in C:\temp
-    const string filePath = "C:\\temp\\" + fileName;
-    // Attempt to delete the file
-    if (std::remove(filePath.c_str()) == 0)
-    {
-        response.setBody("<!DOCTYPE html><html><body><h1>DELETE operation completed</h1></body></html>");
-    }
-    else
-    {
-        // If the file cannot be deleted, return a 404 response
-        return HttpResponse::createNotFoundResponse();
-    }
-
-    return response;
-}
-
-HttpResponse HttpResponse::createTraceResponse(const string& originalRequest)
-{
-    HttpResponse response(200, "OK");
-    response.setContentType("message/http");
-    response.setConnection("keep-alive");
-    // Echo back the original request
-    response.setBody(originalRequest);
-    // Set the correct Content-Length based on the body
-    response.setContentLength(originalRequest.size());
-    std::cout << response.toString();
-    return response;
-}
-
-
-// Convert the response to a string format
-string HttpResponse::toString() const
-{
-    std::ostringstream responseStream;
-
-    // Status line
-    responseStream << httpVersion << " " << statusCode << " " << statusMessage << "\r\n";
-
-    // Headers
-    if (!headerContentType.empty())
-        responseStream << "Content-Type: " << headerContentType << "\r\n";
-
-    if (headerContentLength > 0)
-        responseStream << "Content-Length: " << headerContentLength << "\r\n";
-
-    if (!allow.empty())
-        responseStream << "Allow: " << allow << "\r\n";
-   
-    if (!headerConnection.empty())
-        responseStream << "Connection: " << headerConnection << "\r\n";
-
-    // Blank line to separate headers from body
-    responseStream << "\r\n";
-
-    // Body
-    responseStream << body;
-
-    return responseStream.str();
-}
-
+#include "HttpResponse.h"
+#include "Metrics.h"
+#include "PhaseTrace.h"
+#include "MemoryBudget.h"
+#include "MimeTypes.h"
+#include "RouteIndex.h"
+#include "FileCache.h"
+#include "RootDirectory.h"
+#include "OutputQueue.h"
+#include "PartialUploads.h"
+#include "BlobStore.h"
+#include "Platform.h"
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+using std::ifstream;
+using std::ostringstream;
+using std::to_string;
+
+
+// Constructors
+HttpResponse::HttpResponse()
+    : httpVersion("HTTP/1.1"), statusCode(200), statusMessage("OK"),
+    headerContentType(""), headerContentLength(0), allow(""), body("") {
+}
+
+HttpResponse::HttpResponse(int code, const string& message)
+    : httpVersion("HTTP/1.1"), statusCode(code), statusMessage(message),
+    headerContentType(""), headerContentLength(0), allow(""), body("") {
+}
+
+
+// Setters
+void HttpResponse::setStatus(int code, const string& message)
+{
+    statusCode = code;
+    statusMessage = message;
+}
+
+void HttpResponse::setContentType(const string& type)
+{
+    headerContentType = type;
+}
+
+void HttpResponse::setContentLength(size_t length)
+{
+    headerContentLength = length;
+}
+
+void HttpResponse::setBody(const string& content)
+{
+    body = content;
+    setContentLength(content.size());
+}
+
+void HttpResponse::setAllow(const string& methods)
+{
+    allow = methods; 
+}
+
+void HttpResponse::setConnection(const string& connection)
+{
+    headerConnection = connection;
+}
+
+void HttpResponse::setContentLanguage(const string& language)
+{
+    headerContentLanguage = language;
+}
+
+void HttpResponse::setVary(const string& headers)
+{
+    headerVary = headers;
+}
+
+void HttpResponse::setRetryAfter(unsigned seconds)
+{
+    headerRetryAfter = to_string(seconds);
+}
+
+void HttpResponse::setUploadRanges(const string& ranges)
+{
+    headerUploadRanges = ranges;
+}
+
+void HttpResponse::setReprDigest(const string& digest)
+{
+    headerReprDigest = digest;
+}
+
+void HttpResponse::setETag(const string& tag)
+{
+    headerETag = "\"" + tag + "\"";
+}
+
+void HttpResponse::setSharedBody(const shared_ptr<const string>& content)
+{
+    sharedBody = content;
+    bodyParts.clear();
+    body.clear();
+    setContentLength(content ? content->size() : 0);
+}
+
+void HttpResponse::setFileBody(const shared_ptr<OpenFile>& file)
+{
+    fileBody = file;
+    sharedBody.reset();
+    bodyParts.clear();
+    body.clear();
+    setContentLength(file ? (size_t)file->size() : 0);
+}
+
+void HttpResponse::setBodyParts(vector<BodyPart> parts)
+{
+    uint64_t length = 0;
+    for (const BodyPart& part : parts)
+        length += part.length;
+    bodyParts = std::move(parts);
+    fileBody.reset();
+    sharedBody.reset();
+    body.clear();
+    setContentLength((size_t)length);
+}
+
+void HttpResponse::setPrecomputedHeaders(const string& headers)
+{
+    precomputedHeaders = headers;
+}
+
+string HttpResponse::entityTag(uint64_t size, time_t modified)
+{
+    char tag[48];
+    snprintf(tag, sizeof(tag), "%llx-%llx", (unsigned long long)size, (unsigned long long)modified);
+    return tag;
+}
+
+string HttpResponse::buildFileHeaders(const FileEntry& entry)
+{
+    // RFC 7231 IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    struct tm modifiedTime;
+#ifdef _WIN32
+    gmtime_s(&modifiedTime, &entry.modified);
+#else
+    gmtime_r(&entry.modified, &modifiedTime);
+#endif
+    char lastModified[64];
+    strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", &modifiedTime);
+
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%s\"", entityTag(entry.size, entry.modified).c_str());
+
+    string headers;
+    headers.reserve(192);
+    headers += "Content-Type: ";
+    headers += entry.contentType;
+    headers += "\r\nContent-Length: ";
+    headers += to_string(entry.size);
+    headers += "\r\nETag: ";
+    headers += etag;
+    headers += "\r\nLast-Modified: ";
+    headers += lastModified;
+    headers += "\r\nCache-Control: public, max-age=60\r\n";
+    return headers;
+}
+
+// Utility function to read file content
+string HttpResponse::readFileContent(const string& fileName)
+{
+    // Construct the full path for the file in the document root
+    const string filePath = Platform::documentRoot() + fileName;
+    // Open the file for reading
+    ifstream file(filePath);
+    if (!file.is_open())
+    {
+        // Return an empty string if the file cannot be opened
+        return "";
+    }
+
+    // Read the entire file content into a string stream
+    ostringstream buffer;
+    buffer << file.rdbuf();
+
+    // Convert the buffer to a string and return
+    return buffer.str();
+}
+
+// Error page bodies by file name, shared by every response that uses them
+static std::mutex errorPagesMutex;
+static std::unordered_map<string, shared_ptr<const string>> errorPages;
+
+shared_ptr<const string> HttpResponse::readErrorPage(const string& fileName, const char* fallback)
+{
+    std::lock_guard<std::mutex> lock(errorPagesMutex);
+    auto found = errorPages.find(fileName);
+    if (found != errorPages.end())
+        return found->second;
+    string fileContent = readFileContent(fileName);
+    auto page = std::make_shared<const string>(fileContent.empty() ? string(fallback) : std::move(fileContent));
+    errorPages.emplace(fileName, page);
+    return page;
+}
+
+void HttpResponse::clearErrorPages()
+{
+    std::lock_guard<std::mutex> lock(errorPagesMutex);
+    errorPages.clear();
+}
+
+string HttpResponse::readFileContent_without_temp(const string& filePath)
+{
+    // Construct the full path for the file in C:\temp
+    //const string filePath = "C:\\temp\\" + fileName;
+    // Open the file for reading
+    ifstream file(filePath);
+    if (!file.is_open())
+    {
+        // Return an empty string if the file cannot be opened
+        return "";
+    }
+
+    // Read the entire file content into a string stream
+    ostringstream buffer;
+    buffer << file.rdbuf();
+
+    // Convert the buffer to a string and return
+    return buffer.str();
+}
+
+
+// Static methods for common responses
+HttpResponse HttpResponse::createBadRequestResponse()
+{
+    HttpResponse response(400, "Bad Request");
+    response.setContentType("text/html");
+    response.setConnection("close");
+    // Read once and shared; the built-in page is used if the file is missing
+    response.setSharedBody(readErrorPage("bad_request.html", "<!DOCTYPE html><html><body><h1>400 Bad Request</h1></body></html>"));
+
+    return response;
+}
+
+
+HttpResponse HttpResponse::createForbiddenResponse()
+{
+    HttpResponse response(403, "Forbidden");
+    response.setContentType("text/html");
+    response.setConnection("close");
+    // Read once and shared; the built-in page is used if the file is missing
+    response.setSharedBody(readErrorPage("forbidden.html", "<!DOCTYPE html><html><body><h1>403 Forbidden</h1></body></html>"));
+
+    return response;
+}
+
+HttpResponse HttpResponse::createNotFoundResponse()
+{
+    HttpResponse response(404, "Not Found");
+    response.setContentType("text/html");
+    response.setConnection("close");
+    // Read once and shared; the built-in page is used if the file is missing
+    response.setSharedBody(readErrorPage("not_found.html", "<!DOCTYPE html><html><body><h1>404 Page Not Found</h1></body></html>"));
+
+    return response;
+}
+
+
+HttpResponse HttpResponse::createMethodNotAllowedResponse(const string& allowedMethods)
+{
+    ;
+    HttpResponse response(405, "Method Not Allowed");
+    response.setContentType("text/html");
+    response.setAllow(allowedMethods);
+    response.setConnection("close");
+
+    // Read once and shared; the built-in page is used if the file is missing
+    response.setSharedBody(readErrorPage("method_not_allowed.html", "<!DOCTYPE html><html><body><h1>405 Method Not Allowed</h1></body></html>"));
+
+    return response;
+}
+
+
+HttpResponse HttpResponse::createNotImplementedResponse()
+{
+    HttpResponse response(501, "Not Implemented");
+    response.setContentType("text/html");
+    response.setConnection("close");
+    // Read once and shared; the built-in page is used if the file is missing
+    response.setSharedBody(readErrorPage("not_implemented.html", "<!DOCTYPE html><html><body><h1>501 Not Implemented</h1></body></html>"));
+
+    return response;
+}
+
+HttpResponse HttpResponse::createInternalErrorResponse()
+{
+    HttpResponse response(500, "Internal Server Error");
+    response.setContentType("text/html");
+    response.setConnection("close");
+    // Read once and shared; the built-in page is used if the file is missing
+    response.setSharedBody(readErrorPage("internal_error.html", "<!DOCTYPE html><html><body><h1>500 Internal Server Error</h1><p>An unexpected error occurred on the server.</p></body></html>"));
+
+    return response;
+}
+
+// Sent to connections refused by admission control, so no file is read
+HttpResponse HttpResponse::createServiceUnavailableResponse(unsigned retryAfterSeconds)
+{
+    HttpResponse response(503, "Service Unavailable");
+    response.setContentType("text/html");
+    response.setConnection("close");
+    response.setRetryAfter(retryAfterSeconds);
+    response.setBody("<!DOCTYPE html><html><body><h1>503 Service Unavailable</h1><p>The server is busy, please retry shortly.</p></body></html>");
+    return response;
+}
+
+// The connection stays open; the client may retry after the given delay
+HttpResponse HttpResponse::createTooManyRequestsResponse(unsigned retryAfterSeconds)
+{
+    HttpResponse response(429, "Too Many Requests");
+    response.setContentType("text/html");
+    response.setConnection("keep-alive");
+    response.setRetryAfter(retryAfterSeconds);
+    response.setBody("<!DOCTYPE html><html><body><h1>429 Too Many Requests</h1></body></html>");
+    return response;
+}
+
+
+HttpResponse HttpResponse::createOptionsResponse(const string& supportedMethods)
+{
+    HttpResponse response(200, "OK");
+    response.setContentType("text/html");
+    response.setBody(""); // No body required for OPTIONS   
+    response.setConnection("keep-alive");
+    //std::cout << "Generated response before Allow: " << response.toString() << std::endl;
+    response.setAllow(supportedMethods); // Supported methods, e.g., "GET, POST, OPTIONS, TRACE"
+   // std::cout << "Generated response AFTER Allow: " << response.toString() << std::endl;
+
+    return response;
+}
+
+
+HttpResponse HttpResponse::createGetResponse(const RootDirectory& root, const string& relativePath)
+{
+    HttpResponse response(200, "OK");
+    response.setContentType(MimeTypes::fromPath(relativePath));
+    response.setConnection("keep-alive");
+    // Not indexed, so not cached: sent from disk instead of being read into memory
+    shared_ptr<OpenFile> file = root.openFile(relativePath);
+    if (file && file->size() > 0)
+    {
+        response.setFileBody(file);
+    }
+    else
+    {
+        // If the file is not found, return a 404 response
+        return HttpResponse::createNotFoundResponse();
+    }
+
+    return response;
+}
+
+HttpResponse HttpResponse::createGetResponse(const FileEntry& entry, FileCache& cache)
+{
+    HttpResponse response(200, "OK");
+    response.setConnection("keep-alive");
+    uint64_t size;
+    shared_ptr<const string> fileContent;
+    if (cache.isCacheable(entry))
+    {
+        // Over the memory budget only hits are served from memory
+        if (MemoryBudget::instance().overLimit())
+            fileContent = cache.getCached(entry);
+        else
+        {
+            fileContent = cache.getBody(entry);
+            if (!fileContent)
+                return HttpResponse::createNotFoundResponse(); // The file disappeared since it was indexed
+        }
+    }
+    if (fileContent)
+    {
+        response.setSharedBody(fileContent);
+        size = fileContent->size();
+    }
+    else
+    {
+        // Too large to cache (or no memory to spare): sent from disk instead of being read into memory
+        shared_ptr<OpenFile> file = cache.openUncached(entry);
+        if (!file)
+            return HttpResponse::createNotFoundResponse();
+        response.setFileBody(file);
+        size = file->size();
+    }
+    if (size == entry.size)
+        response.setPrecomputedHeaders(entry.headerBlock);
+    else
+        response.setContentType(entry.contentType); // Changed on disk; the index will catch up
+    return response;
+}
+
+HttpResponse HttpResponse::createHeadResponse(const RootDirectory& root, const string& relativePath)
+{
+    HttpResponse response(200, "OK");
+    response.setContentType(MimeTypes::fromPath(relativePath));
+    response.setConnection("keep-alive");
+    // Only the size is needed
+    std::cout << relativePath;
+    uint64_t fileSize = 0;
+    if (root.fileSize(relativePath, fileSize) && fileSize > 0)
+    {
+        response.setContentLength((size_t)fileSize);
+        std::cout << "\nheader Content Length: " << response.headerContentLength << std::endl;
+    }
+    else
+    {
+        // If the file is not found, return a 404 response
+        return HttpResponse::createNotFoundResponse();
+    }
+
+    return response;
+
+}
+HttpResponse HttpResponse::createHeadResponse(const FileEntry& entry)
+{
+    // Same headers as GET, taken from the block built when the file was indexed
+    HttpResponse response(200, "OK");
+    response.setConnection("keep-alive");
+    response.setPrecomputedHeaders(entry.headerBlock);
+    return response;
+}
+
+/*VERSION 2
+HttpResponse HttpResponse::createHeadResponse(const string& filePath)
+{
+    HttpResponse response(200, "OK");
+    response.setContentType("text/html");
+    response.setConnection("keep-alive");
+
+    // Construct full file path in C:\temp
+   // const string filePath = "C:\\temp\\" + fileName;
+    std::cout << filePath;
+    // Open the file to check if it exists and get its size
+    ifstream file(filePath);
+    if (!file.is_open())
+    {
+        // File does not exist, return 404
+        return HttpResponse::createNotFoundResponse();
+    }
+
+
+    // Move the file pointer to the end
+    file.seekg(0, std::ios::end);
+
+    // Get the current position (file size)
+    size_t fileSize = file.tellg();
+
+    file.close();
+
+    // Set Content-Length based on file size
+    response.setContentLength(fileSize);
+
+    // No body for HEAD requests
+    return response;
+}
+*/
+/*version 1
+HttpResponse HttpResponse::createHeadResponse(const string& fileName)
+{
+    HttpResponse response(200, "OK");
+    response.setContentType("text/html");
+    response.setConnection("keep-alive");
+    // Construct full file path in C:\temp
+   //const string filePath = "C:\\temp\\" + fileName;
+    // No body for HEAD requests
+    string fileContent = readFileContent(fileName);
+    if (!fileContent.empty())
+    {
+        response.setContentLength(fileContent.size());
+    }
+    else
+    {
+        // If the file is not found, return a 404 response
+        return HttpResponse::createNotFoundResponse();
+    }
+
+    return response;
+}
+*/
+HttpResponse HttpResponse::createPostResponse(const RootDirectory& root, const string& requestBody)
+{
+    HttpResponse response(200, "OK"); // Set status to 200 OK
+    response.setContentType("text/plain"); // Set content type
+    response.setConnection("keep-alive"); // Set connection type
+
+    // Print the request body to the console
+    std::cout << "POST Request Body: " << requestBody << std::endl;
+
+    // Append to post.txt in the document root
+    if (root.writeFile("post.txt", requestBody + "\n", true))
+    {
+        std::cout << "POST Request Body appended to " << root.path() << "post.txt" << std::endl;
+
+        // Response to the client
+        response.setBody("<!DOCTYPE html><html><body><h1>POST data appended successfully to post.txt</h1></body></html>");
+    }
+    else
+    {
+        // In case of failure to open the file
+        std::cout << "Failed to append POST Request Body to post.txt in " << root.path() << "!" << std::endl;
+        return HttpResponse::createInternalErrorResponse();
+    }
+
+    return response;
+}
+
+HttpResponse HttpResponse::createPutResponse(const RootDirectory& root, const string& relativePath, const string& requestBody)
+{
+    HttpResponse response(200, "OK"); // Always return 200 OK
+    response.setContentType("text/html");
+    response.setConnection("keep-alive");
+
+    // Write the file beneath the document root
+    if (root.writeFile(relativePath, requestBody, false))
+    {
+        // Confirmation message in the response body
+        response.setBody("<!DOCTYPE html><html><body><h1>PUT operation completed</h1></body></html>");
+    }
+    else
+    {
+        // If the file cannot be created or written
+        return HttpResponse::createInternalErrorResponse();
+    }
+
+    return response;
+}
+
+HttpResponse HttpResponse::createRangedPutResponse(PartialUploads& uploads, const string& relativePath, string_view contentRange, const string& requestBody)
+{
+    uint64_t first, last, total;
+    if (!PartialUploads::parseContentRange(contentRange, first, last, total) || last - first + 1 != requestBody.size())
+        return HttpResponse::createBadRequestResponse();
+
+    string received;
+    UploadResult result = uploads.write(relativePath, first, total, requestBody, received);
+    HttpResponse response;
+    response.setContentType("text/html");
+    response.setConnection("keep-alive");
+    response.setUploadRanges(received);
+    switch (result)
+    {
+    case UPLOAD_COMPLETE:
+        response.setStatus(200, "OK");
+        response.setBody("<!DOCTYPE html><html><body><h1>PUT operation completed</h1></body></html>");
+        break;
+    case UPLOAD_PARTIAL:
+        // Accepted, but the file is not in place until the missing parts arrive
+        response.setStatus(202, "Accepted");
+        response.setBody("<!DOCTYPE html><html><body><h1>PUT part stored</h1></body></html>");
+        break;
+    case UPLOAD_CONFLICT:
+        response.setStatus(409, "Conflict");
+        response.setBody("<!DOCTYPE html><html><body><h1>409 Conflict</h1><p>Another upload of a different size is in progress.</p></body></html>");
+        break;
+    case UPLOAD_BUSY:
+        return HttpResponse::createServiceUnavailableResponse(5); // Slots free up as uploads complete
+    case UPLOAD_TOO_LARGE:
+        response.setStatus(413, "Content Too Large");
+        response.setConnection("close");
+        response.setBody("<!DOCTYPE html><html><body><h1>413 Content Too Large</h1><p>The file is larger than this server accepts.</p></body></html>");
+        break;
+    case UPLOAD_FAILED:
+    default:
+        response = HttpResponse::createInternalErrorResponse();
+        response.setUploadRanges(received);
+        break;
+    }
+    return response;
+}
+
+// The same ETag a GET of the path returns, and the content digest for digest-only uploads
+static void describeStoredFile(HttpResponse& response, const RootDirectory& root, const string& relativePath, const string& digest)
+{
+    uint64_t size;
+    time_t modified;
+    if (root.fileInfo(relativePath, size, modified))
+        response.setETag(HttpResponse::entityTag(size, modified));
+    response.setReprDigest(BlobStore::reprDigest(digest));
+}
+
+HttpResponse HttpResponse::createBlobPutResponse(const RootDirectory& root, const BlobStore& blobs, const string& relativePath, const string& requestBody)
+{
+    string digest;
+    bool reused = false;
+    if (!blobs.store(relativePath, requestBody, digest, reused))
+        return HttpResponse::createInternalErrorResponse();
+    Metrics::recordBlobPut(reused, requestBody.size());
+
+    HttpResponse response(200, "OK");
+    response.setContentType("text/html");
+    response.setConnection("keep-alive");
+    describeStoredFile(response, root, relativePath, digest);
+    response.setBody("<!DOCTYPE html><html><body><h1>PUT operation completed</h1></body></html>");
+    return response;
+}
+
+HttpResponse HttpResponse::createBlobLinkResponse(const RootDirectory& root, const BlobStore& blobs, const string& relativePath, const string& digest)
+{
+    HttpResponse response(200, "OK");
+    response.setContentType("text/html");
+    response.setConnection("keep-alive");
+    if (!blobs.link(relativePath, digest))
+    {
+        // Not stored here: the client has to send the body
+        response.setStatus(412, "Precondition Failed");
+        response.setBody("<!DOCTYPE html><html><body><h1>412 Precondition Failed</h1><p>No stored content has this digest; send the body.</p></body></html>");
+        return response;
+    }
+    Metrics::recordBlobPut(true, 0);
+    describeStoredFile(response, root, relativePath, digest);
+    response.setBody("<!DOCTYPE html><html><body><h1>PUT operation completed</h1></body></html>");
+    return response;
+}
+
+HttpResponse HttpResponse::createUploadStatusResponse(const string& received)
+{
+    HttpResponse response(202, "Accepted");
+    response.setContentType("text/html");
+    response.setConnection("keep-alive");
+    response.setUploadRanges(received);
+    return response;
+}
+
+
+HttpResponse HttpResponse::createDeleteResponse(const RootDirectory& root, const string& relativePath)
+{
+    HttpResponse response(200, "OK");
+    response.setContentType("text/html");
+    response.setConnection("keep-alive");
+    // Attempt to delete the file beneath the document root
+    if (root.removeFile(relativePath))
+    {
+        response.setBody("<!DOCTYPE html><html><body><h1>DELETE operation completed</h1></body></html>");
+    }
+    else
+    {
+        // If the file cannot be deleted, return a 404 response
+        return HttpResponse::createNotFoundResponse();
+    }
+
+    return response;
+}
+
+HttpResponse HttpResponse::createTraceResponse(const string& originalRequest)
+{
+    HttpResponse response(200, "OK");
+    response.setContentType("message/http");
+    response.setConnection("keep-alive");
+    // Echo back the original request
+    response.setBody(originalRequest);
+    // Set the correct Content-Length based on the body
+    response.setContentLength(originalRequest.size());
+    std::cout << response.toString();
+    return response;
+}
+
+HttpResponse HttpResponse::createMetricsResponse()
+{
+    HttpResponse response(200, "OK");
+    response.setContentType("text/plain; version=0.0.4");
+    response.setConnection("keep-alive");
+    response.setBody(Metrics::renderPrometheus());
+    return response;
+}
+
+HttpResponse HttpResponse::createTraceResponse()
+{
+    HttpResponse response(200, "OK");
+    response.setContentType("text/plain");
+    response.setConnection("keep-alive");
+    response.setBody(PhaseTrace::render());
+    return response;
+}
+
+HttpResponse HttpResponse::createArchiveResponse(vector<BodyPart> archive)
+{
+    HttpResponse response(200, "OK");
+    response.setContentType("application/x-tar");
+    response.setConnection("keep-alive");
+    response.setBodyParts(std::move(archive));
+    return response;
+}
+
+
+// Convert the response to a string format
+string HttpResponse::toString() const
+{
+    string response = serializeHeaders();
+    for (const BodyPart& part : bodyParts)
+    {
+        size_t start = response.size();
+        response.resize(start + (size_t)part.length);
+        if (part.file)
+            part.file->readAt(part.offset, &response[start], (size_t)part.length);
+        else
+            response.replace(start, (size_t)part.length, *part.data, (size_t)part.offset, (size_t)part.length);
+    }
+    if (!bodyParts.empty())
+        return response;
+    if (fileBody)
+    {
+        size_t start = response.size();
+        response.resize(start + (size_t)fileBody->size());
+        long long read = fileBody->readAt(0, &response[start], (size_t)fileBody->size());
+        response.resize(start + (size_t)std::max(read, 0LL));
+    }
+    else
+    {
+        response += sharedBody ? *sharedBody : body;
+    }
+    return response;
+}
+
+string HttpResponse::serializeHeaders() const
+{
+    string response;
+    response.reserve(256 + precomputedHeaders.size());
+
+    // Status line
+    response += httpVersion;
+    response += ' ';
+    response += to_string(statusCode);
+    response += ' ';
+    response += statusMessage;
+    response += "\r\n";
+
+    // Headers
+    if (!precomputedHeaders.empty())
+    {
+        response += precomputedHeaders;
+    }
+    else
+    {
+        if (!headerContentType.empty())
+            response += "Content-Type: " + headerContentType + "\r\n";
+
+        // Always sent, even for 0, so keep-alive clients know where the response ends
+        response += "Content-Length: " + to_string(headerContentLength) + "\r\n";
+    }
+
+    if (!allow.empty())
+        response += "Allow: " + allow + "\r\n";
+
+    if (!headerContentLanguage.empty())
+        response += "Content-Language: " + headerContentLanguage + "\r\n";
+
+    if (!headerVary.empty())
+        response += "Vary: " + headerVary + "\r\n";
+
+    if (!headerRetryAfter.empty())
+        response += "Retry-After: " + headerRetryAfter + "\r\n";
+
+    if (!headerUploadRanges.empty())
+        response += "Upload-Ranges: " + headerUploadRanges + "\r\n";
+
+    if (!headerETag.empty())
+        response += "ETag: " + headerETag + "\r\n";
+    if (!headerReprDigest.empty())
+        response += "Repr-Digest: " + headerReprDigest + "\r\n";
+
+    if (!headerConnection.empty())
+        response += "Connection: " + headerConnection + "\r\n";
+
+    // Blank line to separate headers from body
+    response += "\r\n";
+    return response;
+}
+
+void HttpResponse::queueTo(OutputQueue& queue, bool includeBody) const
+{
+    queue.append(serializeHeaders());
+    if (!includeBody)
+        return;
+    for (const BodyPart& part : bodyParts)
+    {
+        if (part.file)
+            queue.appendFile(part.file, part.offset, part.length);
+        else
+            queue.append(part.data, part.offset, part.length);
+    }
+    if (!bodyParts.empty())
+        return;
+    if (fileBody)
+        queue.appendFile(fileBody, 0, fileBody->size());
+    else if (sharedBody)
+        queue.append(sharedBody);
+    else
+        queue.append(body);
+}
+
+vector<BodyPart> HttpResponse::getBodyParts() const
+{
+    if (!bodyParts.empty())
+        return bodyParts;
+    BodyPart part;
+    if (fileBody)
+        part.file = fileBody;
+    else
+        part.data = sharedBody ? sharedBody : std::make_shared<const string>(body);
+    part.length = fileBody ? fileBody->size() : part.data->size();
+    return vector<BodyPart>(1, part);
+}
@@ -1,64 +1,151 @@
-#pragma once
-
-#include <string>
-
-using std::string;
-
-class HttpResponse
-{
-private:
-    string httpVersion;         // HTTP version
-    int statusCode;             // Status code
-    string statusMessage;       // Status message
-    string headerContentType;   // Content-Type header value
-    size_t headerContentLength; // Content-Length header value 
-    string headerConnection;    // Connection header value
-    string allow;               // Allow header value
-    string body;                // The response body content
-
-
-public:
-    // Constructors
-    HttpResponse();
-    HttpResponse(int code, const string& message);
-
-    // Setters for response properties
-    void setStatus(int code, const string& message); // Set status code and message
-    void setContentType(const string& type); // Set Content-Type header
-    void setContentLength(size_t length); // Set Content-Length header
-    void setAllow(const string& methods); // Set Allow header for supported methods
-    void setBody(const string& content); // Set the response body and update Content-Length
-    void setConnection(const string& connection); // Set Connection header
-
-    // Static methods to create standard HTTP responses
-    static HttpResponse createBadRequestResponse(); // Create 400 Bad Request response
-    static HttpResponse createNotFoundResponse(); // Create 404 Not Found response
-    static HttpResponse createMethodNotAllowedResponse(const string& allowedMethods); // Create 405 Method Not Allowed response
-    static HttpResponse createNotImplementedResponse(); // Create 501 Not Implemented response
-    static HttpResponse createInternalErrorResponse(); // Create 500 Internal Server Error response
-
-
-    // Methods to handle specific HTTP verbs
-    // OPTIONS
-    static HttpResponse createOptionsResponse(const string& supportedMethods);
-    // GET
-    static HttpResponse createGetResponse(const string& filePath);
-    // HEAD
-    static HttpResponse createHeadResponse(const string& fileName);
-    // POST
-    static HttpResponse createPostResponse(const string& requestBody);
-    // PUT
-    static HttpResponse createPutResponse(const string& fileName, const string& requestBody);
-    // DELETE
-    static HttpResponse createDeleteResponse(const string& fileName);
-    // TRACE
-    static HttpResponse createTraceResponse(const string& originalRequest);
-
-    // Utility methods to read file content
-    static string readFileContent_without_temp(const string& filePath); // Read file content directly from given file path
-    static string readFileContent(const string& fileName); // Read file content from the default directory (e.g., "C:\\temp")
-
-
-    // Function to convert the response to a string format
-    string toString() const;
-};
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <ctime>
+
+using std::string;
+using std::string_view;
+using std::shared_ptr;
+using std::vector;
+
+struct FileEntry;
+class FileCache;
+class RootDirectory;
+class OpenFile;
+class OutputQueue;
+class PartialUploads;
+class BlobStore;
+
+// A piece of a response body, queued by reference: bytes in memory or a range of a file
+struct BodyPart
+{
+    shared_ptr<const string> data; // Used when file is not set
+    shared_ptr<OpenFile> file;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+class HttpResponse
+{
+private:
+    string httpVersion;         // HTTP version
+    int statusCode;             // Status code
+    string statusMessage;       // Status message
+    string headerContentType;   // Content-Type header value
+    size_t headerContentLength; // Content-Length header value 
+    string headerConnection;    // Connection header value
+    string headerContentLanguage; // Content-Language header value
+    string headerVary;          // Vary header value
+    string headerRetryAfter;    // Retry-After header value
+    string headerUploadRanges;  // Upload-Ranges header value: the parts of a ranged PUT received so far
+    string headerETag;          // ETag header value, when not part of precomputedHeaders
+    string headerReprDigest;    // Repr-Digest header value: SHA-256 of a stored PUT body
+    string allow;               // Allow header value
+    string body;                // The response body content
+    shared_ptr<const string> sharedBody; // Cached file body, used instead of body when set
+    shared_ptr<OpenFile> fileBody;       // File sent from disk, used instead of body when set
+    vector<BodyPart> bodyParts;          // Body assembled from several pieces, used instead of body when set
+    string precomputedHeaders;  // Pre-serialized file headers, replace Content-Type/Content-Length
+
+
+public:
+    // Constructors
+    HttpResponse();
+    HttpResponse(int code, const string& message);
+
+    // Setters for response properties
+    void setStatus(int code, const string& message); // Set status code and message
+    void setContentType(const string& type); // Set Content-Type header
+    void setContentLength(size_t length); // Set Content-Length header
+    void setAllow(const string& methods); // Set Allow header for supported methods
+    void setBody(const string& content); // Set the response body and update Content-Length
+    void setConnection(const string& connection); // Set Connection header
+    void setContentLanguage(const string& language); // Set Content-Language header
+    void setVary(const string& headers); // Set Vary header
+    void setRetryAfter(unsigned seconds); // Set Retry-After header
+    void setUploadRanges(const string& ranges); // Set Upload-Ranges header
+    void setETag(const string& tag); // Set ETag header (quoted here)
+    void setReprDigest(const string& digest); // Set Repr-Digest header
+    void setSharedBody(const shared_ptr<const string>& content); // Serve a cached body without copying it
+    void setFileBody(const shared_ptr<OpenFile>& file); // Serve a file from disk without reading it into memory
+    void setBodyParts(vector<BodyPart> parts); // Serve a body made of several pieces (an archive), none copied
+    void setPrecomputedHeaders(const string& headers); // Use a file's pre-serialized header block
+
+    // Static methods to create standard HTTP responses
+    static HttpResponse createBadRequestResponse(); // Create 400 Bad Request response
+    static HttpResponse createForbiddenResponse(); // Create 403 Forbidden response
+    static HttpResponse createNotFoundResponse(); // Create 404 Not Found response
+    static HttpResponse createMethodNotAllowedResponse(const string& allowedMethods); // Create 405 Method Not Allowed response
+    static HttpResponse createNotImplementedResponse(); // Create 501 Not Implemented response
+    static HttpResponse createInternalErrorResponse(); // Create 500 Internal Server Error response
+    static HttpResponse createServiceUnavailableResponse(unsigned retryAfterSeconds); // Create 503 Service Unavailable response
+    static HttpResponse createTooManyRequestsResponse(unsigned retryAfterSeconds); // Create 429 Too Many Requests response
+
+
+    // Methods to handle specific HTTP verbs
+    // OPTIONS
+    static HttpResponse createOptionsResponse(const string& supportedMethods);
+    // GET
+    static HttpResponse createGetResponse(const RootDirectory& root, const string& relativePath); // File not in the route index
+    static HttpResponse createGetResponse(const FileEntry& entry, FileCache& cache); // Indexed file, body from the site's file cache
+    // HEAD
+    static HttpResponse createHeadResponse(const RootDirectory& root, const string& relativePath);
+    static HttpResponse createHeadResponse(const FileEntry& entry); // Indexed file, headers only
+    // POST (appends to post.txt in the site's document root)
+    static HttpResponse createPostResponse(const RootDirectory& root, const string& requestBody);
+    // PUT
+    static HttpResponse createPutResponse(const RootDirectory& root, const string& relativePath, const string& requestBody);
+    // PUT with Content-Range: one part of a resumable upload
+    static HttpResponse createRangedPutResponse(PartialUploads& uploads, const string& relativePath, string_view contentRange, const string& requestBody);
+    // PUT with dedup_storage: the body is stored by content, or with no body and
+    // If-None-Match: "<digest>", the name is pointed at content already stored
+    static HttpResponse createBlobPutResponse(const RootDirectory& root, const BlobStore& blobs, const string& relativePath, const string& requestBody);
+    static HttpResponse createBlobLinkResponse(const RootDirectory& root, const BlobStore& blobs, const string& relativePath, const string& digest);
+    // HEAD of a path with a ranged PUT in progress: 202 and the parts received
+    static HttpResponse createUploadStatusResponse(const string& received);
+    // DELETE
+    static HttpResponse createDeleteResponse(const RootDirectory& root, const string& relativePath);
+    // TRACE
+    static HttpResponse createTraceResponse(const string& originalRequest);
+    // GET /__metrics
+    static HttpResponse createMetricsResponse();
+    static HttpResponse createTraceResponse();
+    // POST /__batch: a tar archive of the requested files
+    static HttpResponse createArchiveResponse(vector<BodyPart> archive);
+
+    // Utility methods to read file content
+    static string readFileContent_without_temp(const string& filePath); // Read file content directly from given file path
+    static string readFileContent(const string& fileName); // Read file content from the default directory (e.g., "C:\\temp")
+
+    // Error page from the default document root, read on first use and then shared;
+    // fallback is used if the file cannot be read. clearErrorPages() makes the next use re-read it.
+    static shared_ptr<const string> readErrorPage(const string& fileName, const char* fallback);
+    static void clearErrorPages();
+
+
+    // Builds the Content-Type, Content-Length, ETag, Last-Modified and Cache-Control block for a file
+    static string buildFileHeaders(const FileEntry& entry);
+    // ETag (unquoted) of a file version, the same for GET, HEAD and the PUT that stored it
+    static string entityTag(uint64_t size, time_t modified);
+
+    // Get the status code of the response
+    int getStatusCode() const { return statusCode; }
+
+    // Function to convert the response to a string format
+    string toString() const;
+
+    // Status line, headers and the blank line that ends them
+    string serializeHeaders() const;
+
+    // Queues the response for sending; the body is shared or sent from disk, not copied.
+    // Without includeBody only the headers are queued (HEAD).
+    void queueTo(OutputQueue& queue, bool includeBody) const;
+
+    // The body for HTTP/2, which frames it itself, as pieces that share the cached
+    // bodies and open files the response holds
+    vector<BodyPart> getBodyParts() const;
+};
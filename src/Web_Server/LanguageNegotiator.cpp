@@ -0,0 +1,74 @@
+#include "LanguageNegotiator.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+std::mutex LanguageNegotiator::cacheMutex;
+std::unordered_map<string, shared_ptr<const vector<string>>> LanguageNegotiator::cache;
+
+vector<string> LanguageNegotiator::parseAcceptLanguage(const string& value)
+{
+    // e.g. "fr-CH, fr;q=0.9, en;q=0.8, *;q=0.5"
+    vector<std::pair<double, string>> weighted;
+    size_t start = 0;
+    while (start < value.size())
+    {
+        size_t end = value.find(',', start);
+        if (end == string::npos)
+            end = value.size();
+        string item = value.substr(start, end - start);
+        start = end + 1;
+
+        // Language range, up to the first ';'
+        size_t paramPos = item.find(';');
+        string range = item.substr(0, paramPos);
+        range.erase(std::remove(range.begin(), range.end(), ' '), range.end());
+        if (range.empty() || range == "*")
+            continue;
+
+        double quality = 1.0;
+        if (paramPos != string::npos)
+        {
+            size_t qPos = item.find("q=", paramPos);
+            if (qPos != string::npos)
+                quality = atof(item.c_str() + qPos + 2);
+        }
+        if (quality <= 0.0)
+            continue;
+
+        // Only the primary subtag selects a file variant ("fr-CH" -> "fr")
+        string language = range.substr(0, range.find('-'));
+        std::transform(language.begin(), language.end(), language.begin(),
+            [](unsigned char c) { return (char)std::tolower(c); });
+        weighted.push_back({ quality, language });
+    }
+
+    std::stable_sort(weighted.begin(), weighted.end(),
+        [](const std::pair<double, string>& a, const std::pair<double, string>& b) { return a.first > b.first; });
+
+    vector<string> languages;
+    for (const auto& item : weighted)
+    {
+        if (std::find(languages.begin(), languages.end(), item.second) == languages.end())
+            languages.push_back(item.second);
+    }
+    return languages;
+}
+
+shared_ptr<const vector<string>> LanguageNegotiator::preferences(const string& acceptLanguage)
+{
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = cache.find(acceptLanguage);
+        if (it != cache.end())
+            return it->second;
+    }
+
+    shared_ptr<const vector<string>> parsed = std::make_shared<const vector<string>>(parseAcceptLanguage(acceptLanguage));
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (cache.size() >= MAX_CACHE_ENTRIES)
+        cache.clear(); // Odd values from scanners should not grow the cache without bound
+    cache[acceptLanguage] = parsed;
+    return parsed;
+}
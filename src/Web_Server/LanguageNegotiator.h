@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+
+// Accept-Language parsing with a cache keyed by the raw header value.
+// Browsers send the same few values over and over, so most requests skip parsing.
+class LanguageNegotiator
+{
+public:
+    // Parses an Accept-Language value into primary language tags ordered by q-value
+    static vector<string> parseAcceptLanguage(const string& value);
+
+    // Cached version of parseAcceptLanguage
+    static shared_ptr<const vector<string>> preferences(const string& acceptLanguage);
+
+private:
+    static const size_t MAX_CACHE_ENTRIES = 256;
+
+    static std::mutex cacheMutex;
+    static std::unordered_map<string, shared_ptr<const vector<string>>> cache;
+};
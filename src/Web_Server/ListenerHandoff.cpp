@@ -0,0 +1,148 @@
+#include "ListenerHandoff.h"
+#include <cstring>
+#ifndef _WIN32
+#include <sys/un.h>
+#include <sys/time.h>
+#endif
+
+#ifndef _WIN32
+static bool makeAddress(const string& path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+        return false;
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+#endif
+
+SOCKET ListenerHandoff::requestListener(const string& path, SOCKET* secure)
+{
+    if (secure != nullptr)
+        *secure = INVALID_SOCKET;
+#ifdef _WIN32
+    (void)path;
+    return INVALID_SOCKET;
+#else
+    sockaddr_un address;
+    if (!makeAddress(path, address))
+        return INVALID_SOCKET;
+    SOCKET control = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (control == INVALID_SOCKET)
+        return INVALID_SOCKET;
+    if (connect(control, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(control);
+        return INVALID_SOCKET; // No server running
+    }
+
+    // The old server answers from its event loop; don't wait forever on a stuck one
+    timeval timeout = { 5, 0 };
+    setsockopt(control, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char tag = 0;
+    iovec data = { &tag, 1 };
+    alignas(cmsghdr) char controlBuffer[CMSG_SPACE(2 * sizeof(int))];
+    msghdr message = {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = controlBuffer;
+    message.msg_controllen = sizeof(controlBuffer);
+
+    // The HTTP listener, then the HTTPS one if the old server had it
+    SOCKET listener = INVALID_SOCKET;
+    if (recvmsg(control, &message, 0) == 1 && tag == 'L')
+    {
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        if (header != nullptr && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+        {
+            int descriptors[2];
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(descriptors, CMSG_DATA(header), count * sizeof(int));
+            listener = descriptors[0];
+            if (count > 1)
+            {
+                if (secure != nullptr)
+                    *secure = descriptors[1];
+                else
+                    close(descriptors[1]);
+            }
+        }
+    }
+    close(control);
+    return listener;
+#endif
+}
+
+SOCKET ListenerHandoff::openControlSocket(const string& path)
+{
+#ifdef _WIN32
+    (void)path;
+    return INVALID_SOCKET;
+#else
+    sockaddr_un address;
+    if (!makeAddress(path, address))
+        return INVALID_SOCKET;
+    SOCKET control = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (control == INVALID_SOCKET)
+        return INVALID_SOCKET;
+    unlink(path.c_str()); // Left by a previous server, or by the one we replaced
+    if (bind(control, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(control, 1) != 0)
+    {
+        close(control);
+        return INVALID_SOCKET;
+    }
+    Platform::setNonBlocking(control);
+    return control;
+#endif
+}
+
+bool ListenerHandoff::sendListener(SOCKET controlSocket, SOCKET listenSocket, SOCKET secureSocket)
+{
+#ifdef _WIN32
+    (void)controlSocket;
+    (void)listenSocket;
+    (void)secureSocket;
+    return false;
+#else
+    SOCKET peer = accept(controlSocket, nullptr, nullptr);
+    if (peer == INVALID_SOCKET)
+        return false;
+
+    char tag = 'L';
+    iovec data = { &tag, 1 };
+    int descriptors[2] = { listenSocket, secureSocket };
+    size_t count = secureSocket != INVALID_SOCKET ? 2 : 1;
+    alignas(cmsghdr) char controlBuffer[CMSG_SPACE(2 * sizeof(int))];
+    memset(controlBuffer, 0, sizeof(controlBuffer));
+    msghdr message = {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = controlBuffer;
+    message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(count * sizeof(int));
+    memcpy(CMSG_DATA(header), descriptors, count * sizeof(int));
+
+    bool sent = sendmsg(peer, &message, 0) == 1;
+    close(peer);
+    return sent;
+#endif
+}
+
+void ListenerHandoff::closeControlSocket(SOCKET controlSocket, const string& path, bool handedOff)
+{
+#ifdef _WIN32
+    (void)controlSocket;
+    (void)path;
+    (void)handedOff;
+#else
+    if (controlSocket != INVALID_SOCKET)
+        close(controlSocket);
+    if (!handedOff && !path.empty())
+        unlink(path.c_str());
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Platform.h"
+#include <string>
+
+using std::string;
+
+// Passes the listening socket from a running server to its replacement over
+// a Unix domain socket (SCM_RIGHTS), so an upgrade never closes the port:
+//
+//   1. The running server keeps a control socket open at the configured path.
+//   2. The new process connects to it and receives a duplicate of the listener
+//      (and of the HTTPS listener, if there is one).
+//   3. The old process stops accepting and drains; the new one accepts from
+//      the same kernel queue, so no connection attempt is refused.
+//
+// POSIX only; on Windows every call reports that no handoff happened.
+class ListenerHandoff
+{
+public:
+    // New process: asks a server running at path for its listener.
+    // Returns INVALID_SOCKET if nobody answers (normal cold start).
+    // secure, if given, receives the HTTPS listener or INVALID_SOCKET.
+    static SOCKET requestListener(const string& path, SOCKET* secure = nullptr);
+
+    // Running process: opens the control socket replacements connect to
+    static SOCKET openControlSocket(const string& path);
+
+    // Running process: accepts a replacement on the control socket and sends it the listeners
+    static bool sendListener(SOCKET controlSocket, SOCKET listenSocket, SOCKET secureSocket = INVALID_SOCKET);
+
+    // Closes the control socket; removes the path unless a replacement now owns it
+    static void closeControlSocket(SOCKET controlSocket, const string& path, bool handedOff);
+};
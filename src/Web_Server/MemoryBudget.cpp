@@ -0,0 +1,65 @@
+#include "MemoryBudget.h"
+
+MemoryBudget& MemoryBudget::instance()
+{
+    static MemoryBudget budget;
+    return budget;
+}
+
+void MemoryBudget::setReclaimer(std::function<size_t(size_t)> reclaimer)
+{
+    reclaim = std::move(reclaimer);
+}
+
+void MemoryBudget::add(MemoryCategory category, size_t bytes)
+{
+    usedBytes[category].fetch_add(bytes, std::memory_order_relaxed);
+    totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void MemoryBudget::release(MemoryCategory category, size_t bytes)
+{
+    usedBytes[category].fetch_sub(bytes, std::memory_order_relaxed);
+    totalBytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+// Adds bytes to the total unless that would pass the limit
+bool MemoryBudget::tryCount(MemoryCategory category, size_t bytes)
+{
+    size_t cap = limit.load(std::memory_order_relaxed);
+    size_t current = totalBytes.load(std::memory_order_relaxed);
+    do
+    {
+        if (cap != 0 && (bytes > cap || current > cap - bytes))
+            return false;
+    } while (!totalBytes.compare_exchange_weak(current, current + bytes, std::memory_order_relaxed));
+    usedBytes[category].fetch_add(bytes, std::memory_order_relaxed);
+    return true;
+}
+
+bool MemoryBudget::reserve(MemoryCategory category, size_t bytes)
+{
+    if (tryCount(category, bytes))
+        return true;
+
+    // Make room by dropping cached bodies. A cache entry only displaces other
+    // entries: if the cache cannot cover the shortfall, nothing is dropped for it.
+    size_t cap = limit.load(std::memory_order_relaxed);
+    size_t current = total();
+    size_t wanted = current + bytes > cap ? current + bytes - cap : 0;
+    if (reclaim && bytes <= cap && (category != MEMORY_FILE_CACHE || wanted <= used(MEMORY_FILE_CACHE)))
+    {
+        size_t freed = reclaim(wanted);
+        reclaimed.fetch_add(freed, std::memory_order_relaxed);
+        if (tryCount(category, bytes))
+            return true;
+    }
+    refused[category].fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool MemoryBudget::overLimit() const
+{
+    size_t cap = limit.load(std::memory_order_relaxed);
+    return cap != 0 && total() > cap;
+}
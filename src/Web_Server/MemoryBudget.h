@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+// What the accounted memory is held for
+enum MemoryCategory
+{
+    MEMORY_RECEIVE_BUFFERS = 0, // Connection receive buffers, including those grown for large requests
+    MEMORY_RESPONSE_QUEUES,     // Serialized headers and bodies owned by output queues
+    MEMORY_FILE_CACHE,          // File bodies kept by the sites' caches
+    MEMORY_CATEGORY_COUNT
+};
+
+// One limit for the memory the server holds on behalf of clients.
+//
+// The owners of large allocations report them here as they grow and shrink.
+// Growth that is optional asks first with reserve(): when the total would
+// exceed the limit, cached file bodies are dropped (least recently used
+// first, through the reclaimer) and if that is not enough the request is
+// refused, and the caller falls back: a cache miss is sent from disk instead
+// of being kept, a request too large for the remaining budget gets a 503.
+// Required memory (a connection's base buffer, headers being queued) is
+// counted with add() and never refused; while the total is over the limit,
+// connections with unsent responses are not read from (see overLimit()).
+//
+// Counters are atomic and may be updated from any thread.
+class MemoryBudget
+{
+public:
+    static MemoryBudget& instance();
+
+    // Total bytes allowed, 0 for no limit; takes effect on the next reservation
+    void setLimit(size_t bytes) { limit.store(bytes, std::memory_order_relaxed); }
+    size_t getLimit() const { return limit.load(std::memory_order_relaxed); }
+
+    // Frees cache memory: called with the bytes wanted, returns the bytes freed.
+    // Called without any lock of the budget held; it must not call reserve().
+    void setReclaimer(std::function<size_t(size_t)> reclaimer);
+
+    // Counts bytes that must be held regardless of the limit
+    void add(MemoryCategory category, size_t bytes);
+    void release(MemoryCategory category, size_t bytes);
+
+    // Counts bytes if they fit in the limit, reclaiming cache memory first if
+    // needed. False if they do not fit: nothing is counted.
+    bool reserve(MemoryCategory category, size_t bytes);
+
+    // The total is above the limit
+    bool overLimit() const;
+
+    size_t used(MemoryCategory category) const { return usedBytes[category].load(std::memory_order_relaxed); }
+    size_t total() const { return totalBytes.load(std::memory_order_relaxed); }
+
+    // Reservations refused, and cache bytes dropped to make room, since startup
+    uint64_t refusals(MemoryCategory category) const { return refused[category].load(std::memory_order_relaxed); }
+    uint64_t reclaimedBytes() const { return reclaimed.load(std::memory_order_relaxed); }
+
+private:
+    MemoryBudget() = default;
+
+    bool tryCount(MemoryCategory category, size_t bytes);
+
+    std::atomic<size_t> limit{ 0 };
+    std::atomic<size_t> totalBytes{ 0 };
+    std::atomic<size_t> usedBytes[MEMORY_CATEGORY_COUNT] = {};
+    std::atomic<uint64_t> refused[MEMORY_CATEGORY_COUNT] = {};
+    std::atomic<uint64_t> reclaimed{ 0 };
+    std::function<size_t(size_t)> reclaim;
+};
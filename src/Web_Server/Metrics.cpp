@@ -0,0 +1,476 @@
+#include "Metrics.h"
+#include "MemoryBudget.h"
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <sstream>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using std::atomic;
+using std::ostringstream;
+using std::vector;
+
+namespace
+{
+    // Counters owned by a single thread. Only the owner writes them (plain
+    // load + store, no read-modify-write), the scraper only reads them.
+    struct ThreadCounters
+    {
+        atomic<uint64_t> requests[METHOD_COUNT] = {};
+        atomic<uint64_t> statuses[Metrics::MAX_STATUS - Metrics::MIN_STATUS + 1] = {};
+        atomic<uint64_t> bytesIn{ 0 };
+        atomic<uint64_t> bytesOut{ 0 };
+        atomic<uint64_t> cacheHits{ 0 };
+        atomic<uint64_t> cacheMisses{ 0 };
+        atomic<uint64_t> negativeHits{ 0 };
+        atomic<uint64_t> cacheCoalesced{ 0 };
+        atomic<uint64_t> acceptDrops{ 0 };
+        atomic<uint64_t> accepted{ 0 };
+        atomic<uint64_t> acceptBatchesFull{ 0 };
+        atomic<uint64_t> acceptShed{ 0 };
+        atomic<uint64_t> rateLimited{ 0 };
+        atomic<uint64_t> timeouts{ 0 };
+        atomic<uint64_t> tlsFull{ 0 };
+        atomic<uint64_t> tlsResumed{ 0 };
+        atomic<uint64_t> tlsFailed{ 0 };
+        atomic<uint64_t> tlsKernelSend{ 0 };
+        atomic<uint64_t> http2Connections[H2_START_COUNT] = {};
+        atomic<uint64_t> blobsStored{ 0 };
+        atomic<uint64_t> blobsReused{ 0 };
+        atomic<uint64_t> blobBytesSaved{ 0 };
+        atomic<uint64_t> phaseSumNs[PHASE_COUNT] = {};
+        LatencyHistogram phases[PHASE_COUNT];
+    };
+
+    // Registry of all per-thread counters; locked only when a thread registers or on scrape
+    std::mutex registryMutex;
+    vector<ThreadCounters*> registry;
+    std::function<ConnectionStateCounts()> connectionStateProvider;
+    std::function<ListenQueueStats()> listenQueueProvider;
+
+    thread_local ThreadCounters* localCounters = nullptr;
+
+    ThreadCounters& counters()
+    {
+        if (localCounters == nullptr)
+        {
+            // Never freed, so totals stay monotonic after a thread exits
+            localCounters = new ThreadCounters();
+            std::lock_guard<std::mutex> lock(registryMutex);
+            registry.push_back(localCounters);
+        }
+        return *localCounters;
+    }
+
+    // Single-writer increment
+    inline void bump(atomic<uint64_t>& counter, uint64_t amount = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    inline uint64_t read(const atomic<uint64_t>& counter)
+    {
+        return counter.load(std::memory_order_relaxed);
+    }
+
+    inline int highestBit(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return (int)index;
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    // Returns the value (in nanoseconds) at the given quantile of merged histogram counts
+    uint64_t quantile(const vector<uint64_t>& counts, uint64_t total, double q)
+    {
+        if (total == 0)
+            return 0;
+        uint64_t target = (uint64_t)(q * (double)total);
+        if (target == 0)
+            target = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; i++)
+        {
+            seen += counts[i];
+            if (seen >= target)
+                return LatencyHistogram::bucketUpperBound(i);
+        }
+        return LatencyHistogram::bucketUpperBound(LatencyHistogram::BUCKET_COUNT - 1);
+    }
+
+    const char* const phaseNames[PHASE_COUNT] = { "parse", "handler", "send" };
+}
+
+// Histogram
+int LatencyHistogram::bucketIndex(uint64_t valueNs)
+{
+    if (valueNs < (uint64_t)SUB_BUCKETS)
+        return (int)valueNs;
+
+    int shift = highestBit(valueNs) - SUB_BUCKET_BITS;
+    int mantissa = (int)(valueNs >> shift); // In [SUB_BUCKETS, 2 * SUB_BUCKETS)
+    int index = (shift + 1) * SUB_BUCKETS + (mantissa - SUB_BUCKETS);
+    return index < BUCKET_COUNT ? index : BUCKET_COUNT - 1;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int index)
+{
+    int group = index / SUB_BUCKETS;
+    int offset = index % SUB_BUCKETS;
+    if (group == 0)
+        return (uint64_t)offset;
+
+    int shift = group - 1;
+    uint64_t lower = (uint64_t)(SUB_BUCKETS + offset) << shift;
+    return lower + ((uint64_t)1 << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t valueNs)
+{
+    bump(buckets[bucketIndex(valueNs)]);
+}
+
+void LatencyHistogram::addTo(uint64_t* counts) const
+{
+    for (int i = 0; i < BUCKET_COUNT; i++)
+        counts[i] += read(buckets[i]);
+}
+
+// Recording
+void Metrics::recordRequest(HttpMethod method, int statusCode)
+{
+    ThreadCounters& c = counters();
+    bump(c.requests[(unsigned)method < METHOD_COUNT ? method : METHOD_UNKNOWN]);
+    if (statusCode >= MIN_STATUS && statusCode <= MAX_STATUS)
+        bump(c.statuses[statusCode - MIN_STATUS]);
+}
+
+void Metrics::recordPhase(MetricsPhase phase, uint64_t elapsedNs)
+{
+    ThreadCounters& c = counters();
+    c.phases[phase].record(elapsedNs);
+    bump(c.phaseSumNs[phase], elapsedNs);
+}
+
+void Metrics::addBytesIn(size_t bytes)
+{
+    bump(counters().bytesIn, bytes);
+}
+
+void Metrics::addBytesOut(size_t bytes)
+{
+    bump(counters().bytesOut, bytes);
+}
+
+void Metrics::recordCacheLookup(bool hit)
+{
+    ThreadCounters& c = counters();
+    bump(hit ? c.cacheHits : c.cacheMisses);
+}
+
+void Metrics::recordCacheCoalesced()
+{
+    bump(counters().cacheCoalesced);
+}
+
+void Metrics::recordNegativeCacheHit()
+{
+    bump(counters().negativeHits);
+}
+
+void Metrics::recordAcceptDrop()
+{
+    bump(counters().acceptDrops);
+}
+
+void Metrics::recordAcceptBatch(int accepted, bool budgetExhausted)
+{
+    ThreadCounters& c = counters();
+    bump(c.accepted, (uint64_t)accepted);
+    if (budgetExhausted)
+        bump(c.acceptBatchesFull);
+}
+
+void Metrics::recordAcceptShed()
+{
+    bump(counters().acceptShed);
+}
+
+void Metrics::recordRateLimited()
+{
+    bump(counters().rateLimited);
+}
+
+void Metrics::recordTimeout()
+{
+    bump(counters().timeouts);
+}
+
+void Metrics::recordHttp2Connection(Http2Start start)
+{
+    bump(counters().http2Connections[start]);
+}
+
+void Metrics::recordBlobPut(bool reused, uint64_t bytes)
+{
+    ThreadCounters& c = counters();
+    bump(reused ? c.blobsReused : c.blobsStored);
+    if (reused)
+        bump(c.blobBytesSaved, bytes);
+}
+
+void Metrics::recordTlsHandshake(bool succeeded, bool resumed, bool kernelSend)
+{
+    ThreadCounters& c = counters();
+    bump(!succeeded ? c.tlsFailed : resumed ? c.tlsResumed : c.tlsFull);
+    if (kernelSend)
+        bump(c.tlsKernelSend);
+}
+
+uint64_t Metrics::now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Metrics::setConnectionStateProvider(std::function<ConnectionStateCounts()> provider)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    connectionStateProvider = provider;
+}
+
+void Metrics::setListenQueueProvider(std::function<ListenQueueStats()> provider)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    listenQueueProvider = provider;
+}
+
+// Exposition
+string Metrics::renderPrometheus()
+{
+    const int statusCount = MAX_STATUS - MIN_STATUS + 1;
+    uint64_t requests[METHOD_COUNT] = {};
+    vector<uint64_t> statuses(statusCount, 0);
+    uint64_t bytesIn = 0, bytesOut = 0, cacheHits = 0, cacheMisses = 0, acceptDrops = 0, rateLimited = 0, timeouts = 0;
+    uint64_t accepted = 0, acceptBatchesFull = 0, acceptShed = 0, negativeHits = 0, cacheCoalesced = 0;
+    uint64_t tlsFull = 0, tlsResumed = 0, tlsFailed = 0, tlsKernelSend = 0;
+    uint64_t http2Connections[H2_START_COUNT] = {};
+    uint64_t blobsStored = 0, blobsReused = 0, blobBytesSaved = 0;
+    uint64_t phaseSumNs[PHASE_COUNT] = {};
+    vector<vector<uint64_t>> phaseCounts(PHASE_COUNT, vector<uint64_t>(LatencyHistogram::BUCKET_COUNT, 0));
+    ConnectionStateCounts states;
+    ListenQueueStats listenQueue;
+
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const ThreadCounters* c : registry)
+        {
+            for (int i = 0; i < METHOD_COUNT; i++)
+                requests[i] += read(c->requests[i]);
+            for (int i = 0; i < statusCount; i++)
+                statuses[i] += read(c->statuses[i]);
+            bytesIn += read(c->bytesIn);
+            bytesOut += read(c->bytesOut);
+            cacheHits += read(c->cacheHits);
+            cacheMisses += read(c->cacheMisses);
+            negativeHits += read(c->negativeHits);
+            cacheCoalesced += read(c->cacheCoalesced);
+            acceptDrops += read(c->acceptDrops);
+            accepted += read(c->accepted);
+            acceptBatchesFull += read(c->acceptBatchesFull);
+            acceptShed += read(c->acceptShed);
+            rateLimited += read(c->rateLimited);
+            timeouts += read(c->timeouts);
+            tlsFull += read(c->tlsFull);
+            tlsResumed += read(c->tlsResumed);
+            tlsFailed += read(c->tlsFailed);
+            tlsKernelSend += read(c->tlsKernelSend);
+            for (int i = 0; i < H2_START_COUNT; i++)
+                http2Connections[i] += read(c->http2Connections[i]);
+            blobsStored += read(c->blobsStored);
+            blobsReused += read(c->blobsReused);
+            blobBytesSaved += read(c->blobBytesSaved);
+            for (int p = 0; p < PHASE_COUNT; p++)
+            {
+                phaseSumNs[p] += read(c->phaseSumNs[p]);
+                c->phases[p].addTo(phaseCounts[p].data());
+            }
+        }
+        if (connectionStateProvider)
+            states = connectionStateProvider();
+        if (listenQueueProvider)
+            listenQueue = listenQueueProvider();
+    }
+
+    ostringstream out;
+
+    out << "# HELP web_server_connections Sockets currently in each state.\n";
+    out << "# TYPE web_server_connections gauge\n";
+    out << "web_server_connections{state=\"listen\"} " << states.listen << "\n";
+    out << "web_server_connections{state=\"handshake\"} " << states.handshake << "\n";
+    out << "web_server_connections{state=\"receive\"} " << states.receive << "\n";
+    out << "web_server_connections{state=\"idle\"} " << states.idle << "\n";
+    out << "web_server_connections{state=\"send\"} " << states.send << "\n";
+
+    out << "# HELP web_server_requests_total Requests handled, by method.\n";
+    out << "# TYPE web_server_requests_total counter\n";
+    for (int i = 0; i < METHOD_COUNT; i++)
+        out << "web_server_requests_total{method=\"" << HttpMethods::name((HttpMethod)i) << "\"} " << requests[i] << "\n";
+
+    out << "# HELP web_server_responses_total Responses sent, by status code.\n";
+    out << "# TYPE web_server_responses_total counter\n";
+    for (int i = 0; i < statusCount; i++)
+    {
+        if (statuses[i] > 0)
+            out << "web_server_responses_total{code=\"" << (i + MIN_STATUS) << "\"} " << statuses[i] << "\n";
+    }
+
+    out << "# HELP web_server_received_bytes_total Bytes read from client sockets.\n";
+    out << "# TYPE web_server_received_bytes_total counter\n";
+    out << "web_server_received_bytes_total " << bytesIn << "\n";
+    out << "# HELP web_server_sent_bytes_total Bytes written to client sockets.\n";
+    out << "# TYPE web_server_sent_bytes_total counter\n";
+    out << "web_server_sent_bytes_total " << bytesOut << "\n";
+
+    out << "# HELP web_server_cache_lookups_total File cache lookups, by result.\n";
+    out << "# TYPE web_server_cache_lookups_total counter\n";
+    out << "web_server_cache_lookups_total{result=\"hit\"} " << cacheHits << "\n";
+    out << "web_server_cache_lookups_total{result=\"miss\"} " << cacheMisses << "\n";
+    out << "# HELP web_server_cache_hit_ratio Fraction of file cache lookups that hit.\n";
+    out << "# TYPE web_server_cache_hit_ratio gauge\n";
+    uint64_t lookups = cacheHits + cacheMisses;
+    out << "web_server_cache_hit_ratio " << (lookups == 0 ? 0.0 : (double)cacheHits / (double)lookups) << "\n";
+    out << "# HELP web_server_cache_coalesced_total File cache misses that waited for another request's load of the same file instead of reading it.\n";
+    out << "# TYPE web_server_cache_coalesced_total counter\n";
+    out << "web_server_cache_coalesced_total " << cacheCoalesced << "\n";
+    out << "# HELP web_server_negative_cache_hits_total Requests answered 404 from the record of missing paths, without a disk lookup.\n";
+    out << "# TYPE web_server_negative_cache_hits_total counter\n";
+    out << "web_server_negative_cache_hits_total " << negativeHits << "\n";
+
+    out << "# HELP web_server_accept_dropped_total Connections refused by admission control (global or per-client connection limit).\n";
+    out << "# TYPE web_server_accept_dropped_total counter\n";
+    out << "web_server_accept_dropped_total " << acceptDrops << "\n";
+    out << "# HELP web_server_accepted_total Connections accepted from the listen queue.\n";
+    out << "# TYPE web_server_accepted_total counter\n";
+    out << "web_server_accepted_total " << accepted << "\n";
+    out << "# HELP web_server_accept_batches_full_total Loop iterations that stopped accepting at accept_batch with more possibly waiting.\n";
+    out << "# TYPE web_server_accept_batches_full_total counter\n";
+    out << "web_server_accept_batches_full_total " << acceptBatchesFull << "\n";
+    out << "# HELP web_server_accept_shed_total Connections closed unanswered because no file descriptor was left.\n";
+    out << "# TYPE web_server_accept_shed_total counter\n";
+    out << "web_server_accept_shed_total " << acceptShed << "\n";
+    if (listenQueue.depthKnown)
+    {
+        out << "# HELP web_server_listen_queue_length Connections waiting in the accept queue.\n";
+        out << "# TYPE web_server_listen_queue_length gauge\n";
+        out << "web_server_listen_queue_length " << listenQueue.length << "\n";
+        out << "# HELP web_server_listen_queue_limit Accept queue limit (listen backlog, capped by somaxconn).\n";
+        out << "# TYPE web_server_listen_queue_limit gauge\n";
+        out << "web_server_listen_queue_limit " << listenQueue.limit << "\n";
+    }
+    if (listenQueue.overflowsKnown)
+    {
+        out << "# HELP web_server_listen_overflows_total Host-wide connections dropped because an accept queue was full (TcpExt ListenOverflows).\n";
+        out << "# TYPE web_server_listen_overflows_total counter\n";
+        out << "web_server_listen_overflows_total " << listenQueue.overflows << "\n";
+        out << "# HELP web_server_listen_drops_total Host-wide connections dropped at the listener for any reason (TcpExt ListenDrops).\n";
+        out << "# TYPE web_server_listen_drops_total counter\n";
+        out << "web_server_listen_drops_total " << listenQueue.drops << "\n";
+    }
+    out << "# HELP web_server_rate_limited_total Requests answered with 429 by the per-client rate limit.\n";
+    out << "# TYPE web_server_rate_limited_total counter\n";
+    out << "web_server_rate_limited_total " << rateLimited << "\n";
+    out << "# HELP web_server_idle_timeouts_total Connections closed by the idle timeout.\n";
+    out << "# TYPE web_server_idle_timeouts_total counter\n";
+    out << "web_server_idle_timeouts_total " << timeouts << "\n";
+    out << "# HELP web_server_tls_handshakes_total TLS handshakes, by result (resumed = session ID or ticket, no full key exchange).\n";
+    out << "# TYPE web_server_tls_handshakes_total counter\n";
+    out << "web_server_tls_handshakes_total{result=\"full\"} " << tlsFull << "\n";
+    out << "web_server_tls_handshakes_total{result=\"resumed\"} " << tlsResumed << "\n";
+    out << "web_server_tls_handshakes_total{result=\"failed\"} " << tlsFailed << "\n";
+    out << "# HELP web_server_tls_ktls_connections_total TLS connections whose writes the kernel encrypts (kTLS), so files go out with sendfile().\n";
+    out << "# TYPE web_server_tls_ktls_connections_total counter\n";
+    out << "web_server_tls_ktls_connections_total " << tlsKernelSend << "\n";
+    out << "# HELP web_server_http2_connections_total Connections that switched to HTTP/2, by how it was negotiated.\n";
+    out << "# TYPE web_server_http2_connections_total counter\n";
+    out << "web_server_http2_connections_total{start=\"prior_knowledge\"} " << http2Connections[H2_PRIOR_KNOWLEDGE] << "\n";
+    out << "web_server_http2_connections_total{start=\"upgrade\"} " << http2Connections[H2_UPGRADE] << "\n";
+    out << "web_server_http2_connections_total{start=\"alpn\"} " << http2Connections[H2_ALPN] << "\n";
+
+    out << "# HELP web_server_blob_puts_total PUTs stored by content (dedup_storage), by whether the content was new.\n";
+    out << "# TYPE web_server_blob_puts_total counter\n";
+    out << "web_server_blob_puts_total{result=\"stored\"} " << blobsStored << "\n";
+    out << "web_server_blob_puts_total{result=\"reused\"} " << blobsReused << "\n";
+    out << "# HELP web_server_blob_saved_bytes_total Bytes not written because the same content was already stored.\n";
+    out << "# TYPE web_server_blob_saved_bytes_total counter\n";
+    out << "web_server_blob_saved_bytes_total " << blobBytesSaved << "\n";
+
+    const MemoryBudget& memory = MemoryBudget::instance();
+    static const char* const memoryNames[MEMORY_CATEGORY_COUNT] = { "receive_buffers", "response_queues", "file_cache" };
+    out << "# HELP web_server_memory_bytes Memory held for clients, by what it is used for.\n";
+    out << "# TYPE web_server_memory_bytes gauge\n";
+    for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+        out << "web_server_memory_bytes{category=\"" << memoryNames[i] << "\"} " << memory.used((MemoryCategory)i) << "\n";
+    out << "# HELP web_server_memory_limit_bytes The memory_limit setting (0 = no limit).\n";
+    out << "# TYPE web_server_memory_limit_bytes gauge\n";
+    out << "web_server_memory_limit_bytes " << memory.getLimit() << "\n";
+    out << "# HELP web_server_memory_refusals_total Allocations refused because the memory limit was reached.\n";
+    out << "# TYPE web_server_memory_refusals_total counter\n";
+    for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+        out << "web_server_memory_refusals_total{category=\"" << memoryNames[i] << "\"} " << memory.refusals((MemoryCategory)i) << "\n";
+    out << "# HELP web_server_memory_reclaimed_bytes_total Cached file bytes dropped to make room under the memory limit.\n";
+    out << "# TYPE web_server_memory_reclaimed_bytes_total counter\n";
+    out << "web_server_memory_reclaimed_bytes_total " << memory.reclaimedBytes() << "\n";
+
+    // Histogram buckets are reported per power of two (1us .. ~18min)
+    const int firstGroup = 10 - LatencyHistogram::SUB_BUCKET_BITS;
+    const int groupCount = LatencyHistogram::BUCKET_COUNT / LatencyHistogram::SUB_BUCKETS;
+    out << "# HELP web_server_phase_duration_seconds Time spent in each request phase.\n";
+    out << "# TYPE web_server_phase_duration_seconds histogram\n";
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        const vector<uint64_t>& counts = phaseCounts[p];
+        uint64_t cumulative = 0;
+        int next = 0;
+        for (int group = 1; group < groupCount; group++)
+        {
+            int lastIndex = (group + 1) * LatencyHistogram::SUB_BUCKETS - 1;
+            for (; next <= lastIndex; next++)
+                cumulative += counts[next];
+            if (group < firstGroup)
+                continue;
+            double le = (double)(LatencyHistogram::bucketUpperBound(lastIndex) + 1) / 1e9;
+            out << "web_server_phase_duration_seconds_bucket{phase=\"" << phaseNames[p]
+                << "\",le=\"" << le << "\"} " << cumulative << "\n";
+        }
+        out << "web_server_phase_duration_seconds_bucket{phase=\"" << phaseNames[p]
+            << "\",le=\"+Inf\"} " << cumulative << "\n";
+        out << "web_server_phase_duration_seconds_sum{phase=\"" << phaseNames[p] << "\"} "
+            << (double)phaseSumNs[p] / 1e9 << "\n";
+        out << "web_server_phase_duration_seconds_count{phase=\"" << phaseNames[p] << "\"} "
+            << cumulative << "\n";
+    }
+
+    out << "# HELP web_server_phase_duration_quantile_seconds Request phase latency quantiles.\n";
+    out << "# TYPE web_server_phase_duration_quantile_seconds gauge\n";
+    const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        uint64_t total = 0;
+        for (uint64_t count : phaseCounts[p])
+            total += count;
+        for (double q : quantiles)
+        {
+            out << "web_server_phase_duration_quantile_seconds{phase=\"" << phaseNames[p]
+                << "\",quantile=\"" << q << "\"} " << (double)quantile(phaseCounts[p], total, q) / 1e9 << "\n";
+        }
+    }
+
+    return out.str();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include "HttpMethod.h"
+
+using std::string;
+
+// Request phases that are timed separately
+enum MetricsPhase
+{
+    PHASE_PARSE = 0,   // HttpRequest::handleRequest
+    PHASE_HANDLER,     // handlePerMethodRequest + toString
+    PHASE_SEND,        // send() of the response
+    PHASE_COUNT
+};
+
+// Connection states reported by the server loop
+struct ConnectionStateCounts
+{
+    int listen = 0;
+    int handshake = 0;   // TLS handshakes in progress
+    int receive = 0;
+    int idle = 0;
+    int send = 0;
+};
+
+// How a connection came to speak HTTP/2
+enum Http2Start
+{
+    H2_PRIOR_KNOWLEDGE = 0,   // Client preface on a plain connection
+    H2_UPGRADE,               // "Upgrade: h2c" request
+    H2_ALPN,                  // "h2" chosen in the TLS handshake
+    H2_START_COUNT
+};
+
+// Listener accept queue, sampled at scrape time
+struct ListenQueueStats
+{
+    bool depthKnown = false;
+    uint32_t length = 0;       // Connections waiting for accept()
+    uint32_t limit = 0;        // Effective backlog
+    bool overflowsKnown = false;
+    uint64_t overflows = 0;    // Host-wide: handshakes dropped because the queue was full
+    uint64_t drops = 0;
+};
+
+// HDR-style log-linear latency histogram (values in nanoseconds).
+// Every power of two is split into SUB_BUCKETS linear buckets, which keeps
+// the relative error below 1/SUB_BUCKETS across the whole range.
+class LatencyHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_VALUE_BITS = 40; // ~18 minutes in nanoseconds
+    static const int BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    // Records a value; only called by the owning thread
+    void record(uint64_t valueNs);
+
+    // Adds this histogram's counts into a plain array of BUCKET_COUNT entries
+    void addTo(uint64_t* counts) const;
+
+    static int bucketIndex(uint64_t valueNs);
+    static uint64_t bucketUpperBound(int index); // Highest value that maps to the bucket
+
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+};
+
+class Metrics
+{
+public:
+    // Per-method counters are indexed by HttpMethod (METHOD_UNKNOWN counts as "other")
+    static const int MIN_STATUS = 100;
+    static const int MAX_STATUS = 599;
+
+    // Hot-path recording functions (lock-free, per-thread)
+    static void recordRequest(HttpMethod method, int statusCode);
+    static void recordPhase(MetricsPhase phase, uint64_t elapsedNs);
+    static void addBytesIn(size_t bytes);
+    static void addBytesOut(size_t bytes);
+    static void recordCacheLookup(bool hit);
+    static void recordCacheCoalesced();
+    static void recordNegativeCacheHit();
+    static void recordAcceptDrop();
+    static void recordAcceptBatch(int accepted, bool budgetExhausted);
+    static void recordAcceptShed();
+    static void recordRateLimited();
+    static void recordTimeout();
+    static void recordTlsHandshake(bool succeeded, bool resumed, bool kernelSend);
+    static void recordHttp2Connection(Http2Start start);
+    static void recordBlobPut(bool reused, uint64_t bytes); // reused: the content was already stored
+
+    // Monotonic timestamp in nanoseconds used for phase timing
+    static uint64_t now();
+
+    // Registers the function that reports current connection states at scrape time
+    static void setConnectionStateProvider(std::function<ConnectionStateCounts()> provider);
+
+    // Registers the function that samples the listener's accept queue at scrape time
+    static void setListenQueueProvider(std::function<ListenQueueStats()> provider);
+
+    // Renders all metrics in the Prometheus text exposition format
+    static string renderPrometheus();
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+using std::string;
+
+// Compile-time data behind MimeTypes.
+//
+// The table is laid out at compile time with a perfect hash: every known
+// extension lands in its own slot, so a lookup is one hash, one slot read and
+// one string compare. If an edit to the mapping list introduces a collision
+// the static_assert below fails; pick another HASH_SEED that passes.
+namespace MimeTypeTable
+{
+    struct Mapping
+    {
+        const char* extension; // Lowercase, without the dot
+        const char* type;
+    };
+
+    constexpr Mapping mappings[] = {
+        { "html", "text/html; charset=utf-8" },
+        { "htm", "text/html; charset=utf-8" },
+        { "css", "text/css; charset=utf-8" },
+        { "js", "text/javascript; charset=utf-8" },
+        { "mjs", "text/javascript; charset=utf-8" },
+        { "json", "application/json" },
+        { "map", "application/json" },
+        { "txt", "text/plain; charset=utf-8" },
+        { "csv", "text/csv; charset=utf-8" },
+        { "md", "text/markdown; charset=utf-8" },
+        { "xml", "application/xml" },
+        { "svg", "image/svg+xml" },
+        { "png", "image/png" },
+        { "jpg", "image/jpeg" },
+        { "jpeg", "image/jpeg" },
+        { "gif", "image/gif" },
+        { "webp", "image/webp" },
+        { "avif", "image/avif" },
+        { "ico", "image/x-icon" },
+        { "pdf", "application/pdf" },
+        { "wasm", "application/wasm" },
+        { "woff", "font/woff" },
+        { "woff2", "font/woff2" },
+        { "ttf", "font/ttf" },
+        { "otf", "font/otf" },
+        { "mp4", "video/mp4" },
+        { "webm", "video/webm" },
+        { "mp3", "audio/mpeg" },
+        { "wav", "audio/wav" },
+        { "zip", "application/zip" },
+        { "gz", "application/gzip" },
+        { "tar", "application/x-tar" },
+    };
+
+    constexpr size_t MAPPING_COUNT = sizeof(mappings) / sizeof(mappings[0]);
+    constexpr size_t TABLE_SIZE = 64; // Power of two
+    constexpr uint32_t HASH_SEED = 831;
+    constexpr size_t MAX_EXTENSION_LENGTH = 8;
+
+    // Slot index + 1 per table entry (0 = empty)
+    struct Table
+    {
+        unsigned char slots[TABLE_SIZE];
+    };
+
+    constexpr char lower(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    constexpr size_t lengthOf(const char* text)
+    {
+        size_t length = 0;
+        while (text[length] != '\0')
+            length++;
+        return length;
+    }
+
+    // FNV-1a over the lowercased extension, seeded, with a final mix
+    constexpr size_t slotOf(const char* extension, size_t length)
+    {
+        uint32_t hash = 2166136261u ^ HASH_SEED;
+        for (size_t i = 0; i < length; i++)
+            hash = (hash ^ (unsigned char)lower(extension[i])) * 16777619u;
+        hash ^= hash >> 15;
+        hash *= 0x2c1b3c6du;
+        hash ^= hash >> 12;
+        return hash & (TABLE_SIZE - 1);
+    }
+
+    constexpr Table buildTable()
+    {
+        Table result = {};
+        for (size_t i = 0; i < MAPPING_COUNT; i++)
+        {
+            size_t slot = slotOf(mappings[i].extension, lengthOf(mappings[i].extension));
+            result.slots[slot] = (unsigned char)(i + 1);
+        }
+        return result;
+    }
+
+    // True if no two extensions share a slot
+    constexpr bool isPerfect()
+    {
+        Table built = buildTable();
+        for (size_t i = 0; i < MAPPING_COUNT; i++)
+        {
+            size_t slot = slotOf(mappings[i].extension, lengthOf(mappings[i].extension));
+            if (built.slots[slot] != i + 1 || lengthOf(mappings[i].extension) > MAX_EXTENSION_LENGTH)
+                return false;
+        }
+        return true;
+    }
+
+    constexpr Table table = buildTable();
+
+    static_assert(isPerfect(), "MimeTypes: extensions collide, choose another HASH_SEED");
+}
+
+// File extension -> Content-Type lookup
+class MimeTypes
+{
+public:
+    static constexpr const char* DEFAULT_TYPE = "application/octet-stream";
+
+    // Content-Type for a file path, based on its extension (case-insensitive)
+    static const char* fromPath(const string& path)
+    {
+        size_t dotPos = path.find_last_of('.');
+        size_t slashPos = path.find_last_of("/\\");
+        if (dotPos == string::npos || (slashPos != string::npos && dotPos < slashPos))
+            return DEFAULT_TYPE;
+        return fromExtension(path.c_str() + dotPos + 1, path.size() - dotPos - 1);
+    }
+
+    // Content-Type for an extension without the dot
+    static const char* fromExtension(const char* extension, size_t length)
+    {
+        if (length == 0 || length > MimeTypeTable::MAX_EXTENSION_LENGTH)
+            return DEFAULT_TYPE;
+        unsigned char slot = MimeTypeTable::table.slots[MimeTypeTable::slotOf(extension, length)];
+        if (slot == 0)
+            return DEFAULT_TYPE;
+        const MimeTypeTable::Mapping& mapping = MimeTypeTable::mappings[slot - 1];
+        if (MimeTypeTable::lengthOf(mapping.extension) != length)
+            return DEFAULT_TYPE;
+        for (size_t i = 0; i < length; i++)
+        {
+            if (MimeTypeTable::lower(extension[i]) != mapping.extension[i])
+                return DEFAULT_TYPE;
+        }
+        return mapping.type;
+    }
+};
@@ -0,0 +1,110 @@
+#include "NegativeCache.h"
+#include <functional>
+
+NegativeCache::NegativeCache(size_t maxEntries)
+{
+    setCapacity(maxEntries);
+}
+
+void NegativeCache::setCapacity(size_t maxEntries)
+{
+    std::lock_guard<std::mutex> lock(setMutex);
+    capacity = maxEntries;
+    current.clear();
+    previous.clear();
+
+    // Power-of-two filter size so a bit index is a mask, not a division
+    size_t bitCount = 64;
+    while (bitCount < maxEntries * BITS_PER_ENTRY)
+        bitCount <<= 1;
+    bitMask = bitCount - 1;
+    words = bitCount / 64;
+    bits.reset(new std::atomic<uint64_t>[words]);
+    for (size_t i = 0; i < words; i++)
+        bits[i].store(0, std::memory_order_relaxed);
+}
+
+// Double hashing: the k probes are h1 + i * h2
+void NegativeCache::setBits(uint64_t hash)
+{
+    uint64_t step = (hash >> 32) | 1;
+    for (int i = 0; i < HASH_COUNT; i++, hash += step)
+    {
+        size_t bit = (size_t)hash & bitMask;
+        bits[bit / 64].fetch_or(uint64_t(1) << (bit % 64), std::memory_order_relaxed);
+    }
+}
+
+bool NegativeCache::testBits(uint64_t hash) const
+{
+    uint64_t step = (hash >> 32) | 1;
+    for (int i = 0; i < HASH_COUNT; i++, hash += step)
+    {
+        size_t bit = (size_t)hash & bitMask;
+        if ((bits[bit / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (bit % 64))) == 0)
+            return false;
+    }
+    return true;
+}
+
+bool NegativeCache::contains(const string& relativePath) const
+{
+    if (capacity == 0 || !testBits(std::hash<string>()(relativePath)))
+        return false;
+    std::lock_guard<std::mutex> lock(setMutex);
+    return current.count(relativePath) > 0 || previous.count(relativePath) > 0;
+}
+
+void NegativeCache::insert(const string& relativePath)
+{
+    if (capacity == 0)
+        return;
+    std::lock_guard<std::mutex> lock(setMutex);
+    if (!current.insert(relativePath).second)
+        return;
+    if (current.size() > capacity / 2)
+    {
+        // Oldest half goes; the filter only needs the paths that stay
+        previous = std::move(current);
+        current.clear();
+        rebuildFilterLocked();
+    }
+    else
+    {
+        setBits(std::hash<string>()(relativePath));
+    }
+}
+
+void NegativeCache::erase(const string& relativePath)
+{
+    // Its bits stay set; contains() falls through to the sets, which no longer have it
+    std::lock_guard<std::mutex> lock(setMutex);
+    current.erase(relativePath);
+    previous.erase(relativePath);
+}
+
+void NegativeCache::clear()
+{
+    std::lock_guard<std::mutex> lock(setMutex);
+    if (current.empty() && previous.empty())
+        return;
+    current.clear();
+    previous.clear();
+    rebuildFilterLocked();
+}
+
+size_t NegativeCache::size() const
+{
+    std::lock_guard<std::mutex> lock(setMutex);
+    return current.size() + previous.size();
+}
+
+void NegativeCache::rebuildFilterLocked()
+{
+    for (size_t i = 0; i < words; i++)
+        bits[i].store(0, std::memory_order_relaxed);
+    for (const string& path : previous)
+        setBits(std::hash<string>()(path));
+    for (const string& path : current)
+        setBits(std::hash<string>()(path));
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <unordered_set>
+
+using std::string;
+
+// Relative paths recently found not to exist under a site's root, so repeated
+// requests for them (scanners, broken links) get a 404 without touching the disk.
+//
+// A Bloom filter sits in front of the exact set: a path that was never missing
+// is rejected with a few bit tests and no lock. The set is bounded by keeping
+// two generations; when the newer one fills up the older one is dropped and
+// the filter is rebuilt from what is left, since a Bloom filter cannot forget.
+// The owner clears the cache when the tree changes (see VirtualHosts).
+class NegativeCache
+{
+public:
+    explicit NegativeCache(size_t maxEntries = 4096);
+
+    // Paths kept at most; 0 disables the cache. Drops what is cached.
+    void setCapacity(size_t maxEntries);
+
+    // True if the path was recorded as missing
+    bool contains(const string& relativePath) const;
+
+    // Records a path that was looked up and not found
+    void insert(const string& relativePath);
+
+    // Forgets one path (it was just created) or all of them
+    void erase(const string& relativePath);
+    void clear();
+
+    size_t size() const;
+
+private:
+    static const int HASH_COUNT = 4;
+    static const size_t BITS_PER_ENTRY = 16; // About 0.2% false positives when full
+
+    void setBits(uint64_t hash);
+    bool testBits(uint64_t hash) const;
+    void rebuildFilterLocked();
+
+    size_t capacity;
+    size_t bitMask = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> bits;
+    size_t words = 0;
+
+    mutable std::mutex setMutex;
+    std::unordered_set<string> current;   // Receives new paths
+    std::unordered_set<string> previous;  // Dropped when current reaches half the capacity
+};
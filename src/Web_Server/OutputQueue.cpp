@@ -0,0 +1,239 @@
+#include "OutputQueue.h"
+#include "MemoryBudget.h"
+#include <algorithm>
+#include <cstring>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+static const int MAX_GATHER = 16;             // Buffers per gather write
+static const size_t FILE_CHUNK = 64 * 1024;   // Read size where sendfile() is not available
+static const size_t TLS_RECORD = 16 * 1024;   // Largest TLS record payload
+
+void OutputQueue::append(string data)
+{
+    if (data.empty())
+        return;
+    Segment segment;
+    segment.length = data.size();
+    segment.owned = std::move(data);
+    pending += segment.length;
+    owned += segment.length;
+    MemoryBudget::instance().add(MEMORY_RESPONSE_QUEUES, segment.length);
+    segments.push_back(std::move(segment));
+}
+
+void OutputQueue::append(const shared_ptr<const string>& data)
+{
+    if (data)
+        append(data, 0, data->size());
+}
+
+void OutputQueue::append(const shared_ptr<const string>& data, uint64_t offset, uint64_t length)
+{
+    if (!data || length == 0)
+        return;
+    Segment segment;
+    segment.shared = data;
+    segment.offset = offset;
+    segment.length = length;
+    pending += length;
+    segments.push_back(std::move(segment));
+}
+
+void OutputQueue::appendFile(const shared_ptr<OpenFile>& file, uint64_t offset, uint64_t length)
+{
+    if (!file || length == 0)
+        return;
+    Segment segment;
+    segment.file = file;
+    segment.offset = offset;
+    segment.length = length;
+    pending += length;
+    segments.push_back(std::move(segment));
+}
+
+void OutputQueue::clear()
+{
+    segments.clear();
+    pending = 0;
+    MemoryBudget::instance().release(MEMORY_RESPONSE_QUEUES, owned);
+    owned = 0;
+}
+
+void OutputQueue::consume(uint64_t count)
+{
+    pending -= count;
+    while (count > 0)
+    {
+        Segment& front = segments.front();
+        uint64_t used = std::min(count, front.length);
+        front.offset += used;
+        front.length -= used;
+        count -= used;
+        if (front.length == 0)
+        {
+            if (!front.shared && !front.file)
+            {
+                owned -= front.owned.size();
+                MemoryBudget::instance().release(MEMORY_RESPONSE_QUEUES, front.owned.size());
+            }
+            segments.pop_front();
+        }
+    }
+}
+
+long long OutputQueue::sendBuffers(SOCKET socketId, bool& full)
+{
+    int count = 0;
+    bool fileFollows = false;
+    uint64_t offered = 0;
+#ifdef _WIN32
+    WSABUF buffers[MAX_GATHER];
+    for (const Segment& segment : segments)
+    {
+        if (segment.file || count == MAX_GATHER)
+            break;
+        buffers[count].buf = (char*)segment.data();
+        buffers[count].len = (ULONG)std::min<uint64_t>(segment.length, 1u << 30);
+        offered += buffers[count].len;
+        count++;
+    }
+    (void)fileFollows;
+    DWORD sent = 0;
+    if (WSASend(socketId, buffers, (DWORD)count, &sent, 0, nullptr, nullptr) != 0)
+        return Platform::isWouldBlock(Platform::lastSocketError()) ? 0 : -1;
+    full = sent < offered;
+    return (long long)sent;
+#else
+    iovec buffers[MAX_GATHER];
+    for (const Segment& segment : segments)
+    {
+        if (segment.file)
+        {
+            fileFollows = true;
+            break;
+        }
+        if (count == MAX_GATHER)
+            break;
+        buffers[count].iov_base = (void*)segment.data();
+        buffers[count].iov_len = (size_t)segment.length;
+        offered += segment.length;
+        count++;
+    }
+    msghdr message = {};
+    message.msg_iov = buffers;
+    message.msg_iovlen = count;
+    int flags = 0;
+#ifdef MSG_MORE
+    if (fileFollows)
+        flags |= MSG_MORE; // The file comes next; let the kernel fill the segment with it
+#endif
+    ssize_t sent;
+    do
+        sent = sendmsg(socketId, &message, flags);
+    while (sent < 0 && errno == EINTR);
+    if (sent < 0)
+        return Platform::isWouldBlock(errno) ? 0 : -1;
+    full = (uint64_t)sent < offered;
+    return sent;
+#endif
+}
+
+long long OutputQueue::sendFile(SOCKET socketId, bool& full)
+{
+    Segment& front = segments.front();
+#ifdef __linux__
+    off_t offset = (off_t)front.offset;
+    size_t count = (size_t)std::min<uint64_t>(front.length, 0x7ffff000);
+    ssize_t sent;
+    do
+        sent = sendfile(socketId, front.file->descriptor(), &offset, count);
+    while (sent < 0 && errno == EINTR);
+    if (sent > 0)
+    {
+        full = (size_t)sent < count;
+        return sent;
+    }
+    if (sent == 0)
+        return -1; // The file shrank under us; the response cannot be completed
+    if (Platform::isWouldBlock(errno))
+        return 0;
+    if (errno != EINVAL && errno != ENOSYS)
+        return -1;
+    // This file system cannot sendfile(); read and send instead
+#endif
+    thread_local char chunk[FILE_CHUNK];
+    size_t wanted = (size_t)std::min<uint64_t>(front.length, FILE_CHUNK);
+    long long read = front.file->readAt(front.offset, chunk, wanted);
+    if (read <= 0)
+        return -1;
+    int sentBytes = send(socketId, chunk, (int)read, 0);
+    if (sentBytes == SOCKET_ERROR)
+        return Platform::isWouldBlock(Platform::lastSocketError()) ? 0 : -1;
+    full = sentBytes < read;
+    return sentBytes; // Anything not taken is read again on the next call
+}
+
+// Small buffers are joined so headers and a short body share one record.
+// OpenSSL needs a write that would block to be retried with the same bytes;
+// the front of the queue does not change until it is sent, so it is.
+long long OutputQueue::sendEncrypted(TlsSession& tls, bool& full)
+{
+    thread_local char staging[FILE_CHUNK];
+    const Segment& front = segments.front();
+    const char* data = staging;
+    size_t length = 0;
+    if (front.file)
+    {
+        long long read = front.file->readAt(front.offset, staging, (size_t)std::min<uint64_t>(front.length, FILE_CHUNK));
+        if (read <= 0)
+            return -1;
+        length = (size_t)read;
+    }
+    else if (front.length >= TLS_RECORD || segments.size() == 1 || segments[1].file)
+    {
+        data = front.data();
+        length = (size_t)std::min<uint64_t>(front.length, 1u << 30);
+    }
+    else
+    {
+        for (const Segment& segment : segments)
+        {
+            if (segment.file || length == TLS_RECORD)
+                break;
+            size_t part = (size_t)std::min<uint64_t>(segment.length, TLS_RECORD - length);
+            memcpy(staging + length, segment.data(), part);
+            length += part;
+        }
+    }
+
+    TlsStatus status;
+    long long sent = tls.write(data, length, status);
+    if (sent < 0)
+        return status == TLS_WANT_WRITE || status == TLS_WANT_READ ? 0 : -1;
+    full = (size_t)sent < length;
+    return sent;
+}
+
+bool OutputQueue::flush(SOCKET socketId, uint64_t& written, TlsSession* tls)
+{
+    written = 0;
+    bool encrypt = tls != nullptr && !tls->kernelSend();
+    while (!segments.empty())
+    {
+        bool full = false;
+        long long sent = encrypt ? sendEncrypted(*tls, full)
+            : segments.front().file ? sendFile(socketId, full) : sendBuffers(socketId, full);
+        if (sent < 0)
+            return false;
+        consume((uint64_t)sent);
+        written += (uint64_t)sent;
+        if (sent == 0 || full)
+            return true; // Socket buffer full; resume on the next writable event
+    }
+    return true;
+}
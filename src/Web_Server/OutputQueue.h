@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Platform.h"
+#include "RootDirectory.h"
+#include "Tls.h"
+#include <string>
+#include <memory>
+#include <deque>
+#include <cstdint>
+
+using std::string;
+using std::shared_ptr;
+
+// Bytes waiting to be written to one connection, in order: owned buffers
+// (serialized headers), shared bodies from the file cache (not copied) and
+// ranges of open files (sent from disk).
+//
+// flush() writes until the socket would block and keeps its place, so a
+// partial write resumes on the next writable event. Consecutive buffers go
+// out in one gather write (sendmsg / WSASend); file ranges use sendfile()
+// on Linux, with the preceding buffers sent with MSG_MORE so headers and
+// the start of the file share a segment. Elsewhere files are read in chunks.
+// On a TLS connection the same paths apply once the kernel encrypts (kTLS);
+// otherwise everything is written through OpenSSL.
+//
+// Owned buffers count against the MemoryBudget until they are sent; shared
+// bodies are counted by the cache that holds them.
+class OutputQueue
+{
+public:
+    OutputQueue() = default;
+    OutputQueue(const OutputQueue&) = delete;
+    OutputQueue& operator=(const OutputQueue&) = delete;
+    ~OutputQueue() { clear(); }
+
+    void append(string data);
+    void append(const shared_ptr<const string>& data);
+    void append(const shared_ptr<const string>& data, uint64_t offset, uint64_t length);
+    void appendFile(const shared_ptr<OpenFile>& file, uint64_t offset, uint64_t length);
+
+    // Bytes not yet written
+    uint64_t pendingBytes() const { return pending; }
+    bool empty() const { return pending == 0; }
+
+    // Writes queued data until the queue is empty or the socket would block.
+    // written receives the bytes sent. Returns false on a connection error.
+    bool flush(SOCKET socketId, uint64_t& written, TlsSession* tls = nullptr);
+
+    void clear();
+
+private:
+    struct Segment
+    {
+        string owned;                     // Data when shared and file are both null
+        shared_ptr<const string> shared;
+        shared_ptr<OpenFile> file;
+        uint64_t offset = 0;              // Next byte to send, within the data or the file
+        uint64_t length = 0;              // Bytes left in this segment
+
+        const char* data() const { return (shared ? shared->data() : owned.data()) + offset; }
+    };
+
+    // Sends buffer segments from the front; returns bytes sent (0 if blocked) or -1 on error.
+    // full is set when the socket took less than offered, so another call would block.
+    long long sendBuffers(SOCKET socketId, bool& full);
+    // Sends from the file segment at the front; same results
+    long long sendFile(SOCKET socketId, bool& full);
+    // Writes from the front through OpenSSL (TLS without kTLS); same results
+    long long sendEncrypted(TlsSession& tls, bool& full);
+    void consume(uint64_t count);
+
+    std::deque<Segment> segments;
+    uint64_t pending = 0;
+    uint64_t owned = 0;                   // Bytes of owned buffers, counted in the MemoryBudget
+};
@@ -0,0 +1,146 @@
+#include "PartialUploads.h"
+#include "RootDirectory.h"
+#include <algorithm>
+#include <iterator>
+
+// Decimal number: digits only, and small enough to fit
+static bool parseNumber(string_view text, uint64_t& value)
+{
+    if (text.empty() || text.size() > 18)
+        return false;
+    value = 0;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9')
+            return false;
+        value = value * 10 + (uint64_t)(c - '0');
+    }
+    return true;
+}
+
+bool PartialUploads::parseContentRange(string_view value, uint64_t& first, uint64_t& last, uint64_t& total)
+{
+    if (value.substr(0, 6) != "bytes ")
+        return false;
+    value.remove_prefix(6);
+    size_t dash = value.find('-');
+    size_t slash = value.find('/');
+    if (dash == string_view::npos || slash == string_view::npos || slash < dash)
+        return false;
+    return parseNumber(value.substr(0, dash), first)
+        && parseNumber(value.substr(dash + 1, slash - dash - 1), last)
+        && parseNumber(value.substr(slash + 1), total)
+        && first <= last && last < total;
+}
+
+string PartialUploads::stagingPath(const string& relativePath)
+{
+    size_t slash = relativePath.rfind('/');
+    size_t nameStart = slash == string::npos ? 0 : slash + 1;
+    return relativePath.substr(0, nameStart) + "." + relativePath.substr(nameStart) + ".upload";
+}
+
+void PartialUploads::addExtent(Upload& upload, uint64_t first, uint64_t end)
+{
+    // Absorb every extent that overlaps or touches [first, end)
+    auto it = upload.extents.upper_bound(first);
+    if (it != upload.extents.begin() && std::prev(it)->second >= first)
+        --it;
+    while (it != upload.extents.end() && it->first <= end)
+    {
+        first = std::min(first, it->first);
+        end = std::max(end, it->second);
+        it = upload.extents.erase(it);
+    }
+    upload.extents[first] = end;
+}
+
+string PartialUploads::describe(const Upload& upload)
+{
+    string text = "bytes ";
+    for (auto it = upload.extents.begin(); it != upload.extents.end(); ++it)
+    {
+        if (it != upload.extents.begin())
+            text += ',';
+        text += std::to_string(it->first) + "-" + std::to_string(it->second - 1);
+    }
+    return text + "/" + std::to_string(upload.total);
+}
+
+UploadResult PartialUploads::write(const string& relativePath, uint64_t first, uint64_t total, const string& data, string& received)
+{
+    // Refused before a staging file is created for it
+    uint64_t limit = maxTotal.load(std::memory_order_relaxed);
+    if (limit != 0 && total > limit)
+        return UPLOAD_TOO_LARGE;
+
+    std::lock_guard<std::mutex> lock(uploadsMutex);
+    auto found = uploads.find(relativePath);
+    if (found == uploads.end())
+    {
+        if (uploads.size() >= MAX_UPLOADS)
+            return UPLOAD_BUSY;
+        root.removeFile(stagingPath(relativePath)); // Left over from an earlier run
+        found = uploads.emplace(relativePath, Upload()).first;
+        found->second.total = total;
+    }
+    Upload& upload = found->second;
+    upload.lastWrite = time(nullptr);
+    if (upload.total != total)
+    {
+        received = describe(upload);
+        return UPLOAD_CONFLICT;
+    }
+
+    string staging = stagingPath(relativePath);
+    if (!root.writeAt(staging, first, data.data(), data.size()))
+    {
+        received = describe(upload);
+        return UPLOAD_FAILED;
+    }
+    addExtent(upload, first, first + data.size());
+
+    if (upload.extents.size() == 1 && upload.extents.begin()->first == 0 && upload.extents.begin()->second == total)
+    {
+        bool renamed = root.renameFile(staging, relativePath);
+        if (!renamed)
+            root.removeFile(staging);
+        uploads.erase(found);
+        return renamed ? UPLOAD_COMPLETE : UPLOAD_FAILED;
+    }
+    received = describe(upload);
+    return UPLOAD_PARTIAL;
+}
+
+bool PartialUploads::status(const string& relativePath, string& received) const
+{
+    std::lock_guard<std::mutex> lock(uploadsMutex);
+    auto found = uploads.find(relativePath);
+    if (found == uploads.end())
+        return false;
+    received = describe(found->second);
+    return true;
+}
+
+void PartialUploads::cancel(const string& relativePath)
+{
+    std::lock_guard<std::mutex> lock(uploadsMutex);
+    if (uploads.erase(relativePath) > 0)
+        root.removeFile(stagingPath(relativePath));
+}
+
+void PartialUploads::sweep()
+{
+    std::lock_guard<std::mutex> lock(uploadsMutex);
+    time_t now = time(nullptr);
+    for (auto it = uploads.begin(); it != uploads.end();)
+    {
+        if (now - it->second.lastWrite < ABANDON_SECONDS)
+        {
+            ++it;
+            continue;
+        }
+        root.removeFile(stagingPath(it->first));
+        it = uploads.erase(it);
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <mutex>
+#include <ctime>
+#include <cstdint>
+#include <atomic>
+#include <unordered_map>
+
+using std::string;
+using std::string_view;
+
+class RootDirectory;
+
+// Outcome of storing one chunk of a ranged PUT
+enum UploadResult
+{
+    UPLOAD_PARTIAL,   // Stored; parts of the file are still missing
+    UPLOAD_COMPLETE,  // Stored, and the file is now in place
+    UPLOAD_CONFLICT,  // The total size differs from the upload already in progress
+    UPLOAD_BUSY,      // Too many uploads in progress on the site
+    UPLOAD_TOO_LARGE, // The total size is over the site's maximum upload size
+    UPLOAD_FAILED     // The staging file could not be written or moved into place
+};
+
+// Resumable uploads of one site: PUT requests with "Content-Range: bytes
+// first-last/total" that each carry one part of a file. A part is written at its
+// offset into a hidden staging file next to the target (".name.upload", which
+// the route index skips), and the received extents are kept, merged, per path.
+// When the extents cover the whole file, the staging file is renamed over the
+// target, so readers see the old file or the new one, never a mix.
+//
+// Parts may arrive in any order and over several connections at once; a part
+// that was lost is simply sent again. Uploads with no part for
+// ABANDON_SECONDS are dropped together with their staging file.
+class PartialUploads
+{
+public:
+    static const size_t MAX_UPLOADS = 256;
+    static const time_t ABANDON_SECONDS = 3600;
+
+    explicit PartialUploads(const RootDirectory& root) : root(root) {}
+
+    // Largest total a ranged PUT may declare, 0 for no limit (max_upload_size)
+    void setMaxTotal(uint64_t bytes) { maxTotal.store(bytes, std::memory_order_relaxed); }
+
+    // Parses "bytes first-last/total"; the total must be known (not "*")
+    static bool parseContentRange(string_view value, uint64_t& first, uint64_t& last, uint64_t& total);
+
+    // Stores the part at first (its length is data's). received describes what the
+    // upload now holds, unless it completed.
+    UploadResult write(const string& relativePath, uint64_t first, uint64_t total, const string& data, string& received);
+
+    // Describes an upload in progress ("bytes 0-99,200-299/1000"); false if there is none
+    bool status(const string& relativePath, string& received) const;
+
+    // Drops the upload of a path (it was replaced or deleted as a whole)
+    void cancel(const string& relativePath);
+
+    // Drops abandoned uploads. Called periodically from the server loop.
+    void sweep();
+
+private:
+    struct Upload
+    {
+        uint64_t total = 0;
+        std::map<uint64_t, uint64_t> extents; // Received [first, end), merged and disjoint
+        time_t lastWrite = 0;
+    };
+
+    static string stagingPath(const string& relativePath);
+    static void addExtent(Upload& upload, uint64_t first, uint64_t end);
+    static string describe(const Upload& upload);
+
+    const RootDirectory& root;
+    mutable std::mutex uploadsMutex;
+    std::unordered_map<string, Upload> uploads;
+    std::atomic<uint64_t> maxTotal{ 0 };
+};
@@ -0,0 +1,181 @@
+#include "PhaseTrace.h"
+
+#ifdef WEB_SERVER_PHASE_TRACE
+#include "HttpMethod.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <sstream>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using std::atomic;
+using std::ostringstream;
+using std::vector;
+
+namespace
+{
+    // One request. Written only by the owning thread (relaxed stores); /__trace
+    // may read a record while it is being reused and then shows a mix of two requests.
+    struct TraceRecord
+    {
+        atomic<uint64_t> sequence{ 0 };  // 0: unused
+        atomic<int> socketId{ 0 };
+        atomic<int> method{ METHOD_UNKNOWN };
+        atomic<int> status{ 0 };
+        atomic<uint64_t> points[TRACE_POINT_COUNT] = {};
+    };
+
+    struct TraceRing
+    {
+        TraceRecord records[PhaseTrace::RING_SIZE];
+        atomic<uint64_t> next{ 1 };     // Sequence of the next record
+    };
+
+    // Registry of all per-thread rings, as for the metrics counters
+    std::mutex registryMutex;
+    vector<TraceRing*> registry;
+
+    thread_local TraceRing* localRing = nullptr;
+
+    TraceRing& ring()
+    {
+        if (localRing == nullptr)
+        {
+            // Never freed, so a thread's last requests can still be dumped after it exits
+            localRing = new TraceRing();
+            std::lock_guard<std::mutex> lock(registryMutex);
+            registry.push_back(localRing);
+        }
+        return *localRing;
+    }
+
+    uint64_t steadyNs()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Counter and clock read together at startup; the rate is measured against them
+    struct Calibration
+    {
+        uint64_t ticks = PhaseTrace::ticks();
+        uint64_t ns = steadyNs();
+    };
+
+    const Calibration& calibration()
+    {
+        static const Calibration start;
+        return start;
+    }
+
+    // Touch the calibration before main() so the measured interval is long
+    const Calibration& startCalibration = calibration();
+}
+
+uint64_t PhaseTrace::ticks()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return steadyNs();
+#endif
+}
+
+uint64_t PhaseTrace::begin(int socketId, uint64_t receivedTicks)
+{
+    TraceRing& local = ring();
+    uint64_t sequence = local.next.load(std::memory_order_relaxed);
+    local.next.store(sequence + 1, std::memory_order_relaxed);
+
+    TraceRecord& record = local.records[sequence & (RING_SIZE - 1)];
+    record.sequence.store(0, std::memory_order_relaxed); // Invalid while it is rewritten
+    record.socketId.store(socketId, std::memory_order_relaxed);
+    record.method.store(METHOD_UNKNOWN, std::memory_order_relaxed);
+    record.status.store(0, std::memory_order_relaxed);
+    record.points[TRACE_RECEIVED].store(receivedTicks, std::memory_order_relaxed);
+    for (int point = TRACE_RECEIVED + 1; point < TRACE_POINT_COUNT; point++)
+        record.points[point].store(0, std::memory_order_relaxed);
+    record.sequence.store(sequence, std::memory_order_release);
+    return sequence;
+}
+
+void PhaseTrace::stamp(uint64_t sequence, TracePoint point)
+{
+    TraceRecord& record = ring().records[sequence & (RING_SIZE - 1)];
+    if (record.sequence.load(std::memory_order_relaxed) == sequence)
+        record.points[point].store(ticks(), std::memory_order_relaxed);
+}
+
+void PhaseTrace::describe(uint64_t sequence, int method, int status)
+{
+    TraceRecord& record = ring().records[sequence & (RING_SIZE - 1)];
+    if (record.sequence.load(std::memory_order_relaxed) != sequence)
+        return;
+    record.method.store(method, std::memory_order_relaxed);
+    record.status.store(status, std::memory_order_relaxed);
+}
+
+string PhaseTrace::render()
+{
+    // Ticks per nanosecond since startup; 1 for the steady_clock fallback
+    const Calibration& start = calibration();
+    uint64_t elapsedTicks = ticks() - start.ticks;
+    uint64_t elapsedNs = steadyNs() - start.ns;
+    double ticksPerNs = elapsedNs > 0 && elapsedTicks > 0 ? (double)elapsedTicks / (double)elapsedNs : 1.0;
+
+    static const char* const phaseNames[TRACE_POINT_COUNT - 1] = { "parse", "handle", "queue", "send" };
+    ostringstream out;
+    out << "# Last " << RING_SIZE << " requests per thread, in nanoseconds; - if the phase did not end\n";
+    out << "# thread sequence socket method status";
+    for (const char* name : phaseNames)
+        out << ' ' << name;
+    out << " total\n";
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t thread = 0; thread < registry.size(); thread++)
+    {
+        const TraceRing& local = *registry[thread];
+        uint64_t next = local.next.load(std::memory_order_relaxed);
+        uint64_t first = next > RING_SIZE ? next - RING_SIZE : 1;
+        for (uint64_t sequence = first; sequence < next; sequence++)
+        {
+            const TraceRecord& record = local.records[sequence & (RING_SIZE - 1)];
+            if (record.sequence.load(std::memory_order_acquire) != sequence)
+                continue; // Being rewritten
+            uint64_t points[TRACE_POINT_COUNT];
+            for (int point = 0; point < TRACE_POINT_COUNT; point++)
+                points[point] = record.points[point].load(std::memory_order_relaxed);
+
+            out << thread << ' ' << sequence << ' ' << record.socketId.load(std::memory_order_relaxed)
+                << ' ' << HttpMethods::name((HttpMethod)record.method.load(std::memory_order_relaxed))
+                << ' ' << record.status.load(std::memory_order_relaxed);
+            // Each phase runs from the previous point that was stamped
+            uint64_t previous = points[TRACE_RECEIVED];
+            for (int point = TRACE_RECEIVED + 1; point < TRACE_POINT_COUNT; point++)
+            {
+                if (points[point] == 0 || points[point] < previous)
+                {
+                    out << " -";
+                    continue;
+                }
+                out << ' ' << (uint64_t)((double)(points[point] - previous) / ticksPerNs);
+                previous = points[point];
+            }
+            out << ' ' << (uint64_t)((double)(previous - points[TRACE_RECEIVED]) / ticksPerNs) << '\n';
+        }
+    }
+    return out.str();
+}
+
+#endif
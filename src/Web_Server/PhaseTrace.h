@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+using std::string;
+
+// Static tracepoints (USDT) at the phase boundaries of a request, for
+// bpftrace/perf on a running server without a rebuild:
+//
+//   bpftrace -e 'usdt:./web_server:web_server:handler__done { @[arg1] = count(); }'
+//
+// Built with WEB_SERVER_USDT (the default) where <sys/sdt.h> exists; a probe is
+// a single nop until a tracer attaches. Elsewhere the macros compile to nothing.
+#if defined(WEB_SERVER_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define WEB_SERVER_HAS_USDT 1
+#endif
+#endif
+
+#ifdef WEB_SERVER_HAS_USDT
+#define TRACE_PROBE1(name, a) DTRACE_PROBE1(web_server, name, a)
+#define TRACE_PROBE2(name, a, b) DTRACE_PROBE2(web_server, name, a, b)
+#define TRACE_PROBE3(name, a, b, c) DTRACE_PROBE3(web_server, name, a, b, c)
+#else
+#define TRACE_PROBE1(name, a) do { } while (0)
+#define TRACE_PROBE2(name, a, b) do { } while (0)
+#define TRACE_PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+// Phase boundaries timed by PhaseTrace, in request order
+enum TracePoint
+{
+    TRACE_RECEIVED = 0, // recv() completed the request
+    TRACE_PARSED,       // HttpRequest::handleRequest returned
+    TRACE_HANDLED,      // handlePerMethodRequest returned (file reads included)
+    TRACE_QUEUED,       // Headers serialized and the response queued
+    TRACE_SENT,         // The output queue drained (on HTTP/2, the whole connection's)
+    TRACE_POINT_COUNT
+};
+
+// Cycle-counter timestamps of each request's phase boundaries, kept in a ring
+// per thread and dumped at /__trace. Compiled in with WEB_SERVER_PHASE_TRACE;
+// otherwise every call is an empty inline and enabled() is false.
+//
+// The counter is rdtsc on x86 and cntvct_el0 on ARM64 (steady_clock elsewhere),
+// a few cycles per stamp. Ticks are converted to nanoseconds at dump time,
+// from the counter's rate over the life of the process.
+class PhaseTrace
+{
+public:
+    static const uint32_t RING_SIZE = 4096; // Requests kept per thread; power of two
+
+#ifdef WEB_SERVER_PHASE_TRACE
+    static bool enabled() { return true; }
+
+    static uint64_t ticks();
+
+    // Starts a record for a request received at receivedTicks; returns its sequence number
+    static uint64_t begin(int socketId, uint64_t receivedTicks);
+
+    // Stamps a point of a record started on this thread (ignored once overwritten)
+    static void stamp(uint64_t sequence, TracePoint point);
+
+    // Sets the method and status of a record
+    static void describe(uint64_t sequence, int method, int status);
+
+    // The recorded requests of every thread, oldest first, one line each, in nanoseconds
+    static string render();
+#else
+    static bool enabled() { return false; }
+    static uint64_t ticks() { return 0; }
+    static uint64_t begin(int, uint64_t) { return 0; }
+    static void stamp(uint64_t, TracePoint) {}
+    static void describe(uint64_t, int, int) {}
+    static string render() { return string(); }
+#endif
+};
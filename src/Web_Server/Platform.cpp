@@ -0,0 +1,304 @@
+#include "Platform.h"
+#include <cstdlib>
+#include <csignal>
+#include <fstream>
+#include <sstream>
+
+// Set by the signal handlers, cleared by takeSignal()
+static volatile sig_atomic_t pendingSignals[SIGNAL_COUNT] = {};
+
+#ifndef _WIN32
+// Held open so a connection can still be accepted (and closed) when no descriptor is left
+static int spareDescriptor = -1;
+
+// fsync, then close; false if the open that produced descriptor failed or the sync did
+static bool syncDescriptor(int descriptor)
+{
+    if (descriptor < 0)
+        return false;
+    int result;
+    do
+        result = fsync(descriptor);
+    while (result != 0 && errno == EINTR);
+    close(descriptor);
+    return result == 0;
+}
+#endif
+
+#ifdef _WIN32
+static BOOL WINAPI consoleHandler(DWORD event)
+{
+    if (event == CTRL_C_EVENT || event == CTRL_BREAK_EVENT || event == CTRL_CLOSE_EVENT)
+    {
+        pendingSignals[SIGNAL_SHUTDOWN] = 1;
+        return TRUE;
+    }
+    return FALSE;
+}
+#else
+static void signalHandler(int signalNumber)
+{
+    if (signalNumber == SIGHUP)
+        pendingSignals[SIGNAL_RELOAD] = 1;
+    else
+        pendingSignals[SIGNAL_SHUTDOWN] = 1;
+}
+#endif
+
+bool Platform::startup()
+{
+#ifdef _WIN32
+    WSAData wsaData;
+    return WSAStartup(MAKEWORD(2, 2), &wsaData) == NO_ERROR;
+#else
+    // A peer that closed its end must not kill the server with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    spareDescriptor = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return true;
+#endif
+}
+
+void Platform::cleanup()
+{
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+int Platform::lastSocketError()
+{
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+bool Platform::isWouldBlock(int error)
+{
+#ifdef _WIN32
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EWOULDBLOCK || error == EAGAIN;
+#endif
+}
+
+bool Platform::isInterrupted(int error)
+{
+#ifdef _WIN32
+    return error == WSAEINTR;
+#else
+    return error == EINTR;
+#endif
+}
+
+void Platform::installSignalHandlers()
+{
+#ifdef _WIN32
+    SetConsoleCtrlHandler(consoleHandler, TRUE);
+#else
+    // No SA_RESTART: select() returns EINTR so the loop sees the signal at once
+    struct sigaction action = {};
+    action.sa_handler = signalHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGHUP, &action, nullptr);
+#endif
+}
+
+bool Platform::takeSignal(ServerSignal which)
+{
+    if (!pendingSignals[which])
+        return false;
+    pendingSignals[which] = 0;
+    return true;
+}
+
+bool Platform::setNonBlocking(SOCKET socketId)
+{
+#ifdef _WIN32
+    unsigned long flag = 1;
+    return ioctlsocket(socketId, FIONBIO, &flag) == 0;
+#else
+    int flags = fcntl(socketId, F_GETFL, 0);
+    return flags >= 0 && fcntl(socketId, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+SOCKET Platform::acceptNonBlocking(SOCKET listenSocket, sockaddr_in& from)
+{
+    socklen_t fromLen = sizeof(from);
+#ifdef __linux__
+    return accept4(listenSocket, (sockaddr*)&from, &fromLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    SOCKET socketId = accept(listenSocket, (sockaddr*)&from, &fromLen);
+    if (socketId == INVALID_SOCKET)
+        return INVALID_SOCKET;
+#ifndef _WIN32
+    fcntl(socketId, F_SETFD, FD_CLOEXEC);
+#endif
+    if (!setNonBlocking(socketId))
+    {
+        int error = lastSocketError();
+        closesocket(socketId);
+#ifdef _WIN32
+        WSASetLastError(error);
+#else
+        errno = error;
+#endif
+        return INVALID_SOCKET;
+    }
+    return socketId;
+#endif
+}
+
+bool Platform::isOutOfDescriptors(int error)
+{
+#ifdef _WIN32
+    return error == WSAEMFILE || error == WSAENOBUFS;
+#else
+    return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+#endif
+}
+
+void Platform::shedPendingConnection(SOCKET listenSocket)
+{
+#ifdef _WIN32
+    (void)listenSocket;
+#else
+    if (spareDescriptor < 0)
+        return;
+    close(spareDescriptor);
+    int socketId = accept(listenSocket, nullptr, nullptr);
+    if (socketId >= 0)
+        close(socketId);
+    spareDescriptor = open("/dev/null", O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+bool Platform::listenQueueDepth(SOCKET listenSocket, uint32_t& length, uint32_t& limit)
+{
+#ifdef __linux__
+    // For a listener, tcpi_unacked is the accept queue length and tcpi_sacked its limit
+    tcp_info info = {};
+    socklen_t infoLen = sizeof(info);
+    if (getsockopt(listenSocket, IPPROTO_TCP, TCP_INFO, &info, &infoLen) != 0)
+        return false;
+    length = info.tcpi_unacked;
+    limit = info.tcpi_sacked;
+    return true;
+#else
+    (void)listenSocket;
+    (void)length;
+    (void)limit;
+    return false;
+#endif
+}
+
+bool Platform::listenOverflowCounts(uint64_t& overflows, uint64_t& drops)
+{
+#ifdef __linux__
+    // Pairs of lines: "TcpExt: <names>" then "TcpExt: <values>"
+    std::ifstream netstat("/proc/net/netstat");
+    string names, values;
+    while (std::getline(netstat, names) && std::getline(netstat, values))
+    {
+        if (names.compare(0, 7, "TcpExt:") != 0)
+            continue;
+        std::istringstream nameStream(names), valueStream(values);
+        string name, value;
+        bool found = false;
+        while (nameStream >> name && valueStream >> value)
+        {
+            if (name == "ListenOverflows")
+            {
+                overflows = strtoull(value.c_str(), nullptr, 10);
+                found = true;
+            }
+            else if (name == "ListenDrops")
+                drops = strtoull(value.c_str(), nullptr, 10);
+        }
+        return found;
+    }
+    return false;
+#else
+    (void)overflows;
+    (void)drops;
+    return false;
+#endif
+}
+
+void Platform::setReuseAddress(SOCKET socketId)
+{
+#ifdef _WIN32
+    (void)socketId;
+#else
+    int enable = 1;
+    setsockopt(socketId, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+#endif
+}
+
+static string& configuredRoot()
+{
+    static string root = []()
+    {
+#ifdef _WIN32
+        const char separator = '\\';
+        string path = "C:\\temp\\";
+#else
+        const char separator = '/';
+        string path = "/var/www/";
+#endif
+        const char* configured = getenv("WEB_SERVER_ROOT");
+        if (configured != nullptr && configured[0] != '\0')
+        {
+            path = configured;
+            if (path.back() != '/' && path.back() != '\\')
+                path += separator;
+        }
+        return path;
+    }();
+    return root;
+}
+
+const string& Platform::documentRoot()
+{
+    return configuredRoot();
+}
+
+void Platform::setDocumentRoot(const string& root)
+{
+    configuredRoot() = directoryPath(root);
+}
+
+string Platform::directoryPath(const string& path)
+{
+    if (path.empty() || path.back() == '/' || path.back() == '\\')
+        return path;
+    return path + '/';
+}
+
+bool Platform::syncFile(const string& path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    bool flushed = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return flushed;
+#else
+    return syncDescriptor(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+#endif
+}
+
+bool Platform::syncDirectory(const string& path)
+{
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    return syncDescriptor(open(path.empty() ? "." : path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+#endif
+}
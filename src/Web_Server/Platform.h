@@ -0,0 +1,107 @@
+#pragma once
+
+// Thin socket/filesystem layer so the server builds with Winsock and with
+// POSIX sockets. Server code keeps the Winsock names (SOCKET, closesocket,
+// INVALID_SOCKET, SOCKET_ERROR); on POSIX they map to file descriptors.
+
+#include <string>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef int socklen_t;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+typedef int SOCKET;
+typedef sockaddr SOCKADDR;
+const SOCKET INVALID_SOCKET = -1;
+const int SOCKET_ERROR = -1;
+inline int closesocket(SOCKET socketId) { return close(socketId); }
+#endif
+
+using std::string;
+
+// Process signals the server loop polls for
+enum ServerSignal
+{
+    SIGNAL_SHUTDOWN, // SIGTERM, SIGINT (Ctrl+C on Windows): drain and exit
+    SIGNAL_RELOAD,   // SIGHUP: re-read the configuration file
+    SIGNAL_COUNT
+};
+
+class Platform
+{
+public:
+    // Initializes the socket library (WSAStartup on Windows, ignores SIGPIPE on POSIX)
+    static bool startup();
+
+    // Releases the socket library
+    static void cleanup();
+
+    // Error code of the last failed socket call
+    static int lastSocketError();
+
+    // True if the error means "try again later" on a non-blocking socket
+    static bool isWouldBlock(int error);
+
+    // True if a blocking call was interrupted by a signal and should be retried
+    static bool isInterrupted(int error);
+
+    // Installs handlers that record ServerSignals instead of terminating the process
+    static void installSignalHandlers();
+
+    // True if the signal arrived since the last call (clears it)
+    static bool takeSignal(ServerSignal which);
+
+    // Puts a socket into non-blocking mode
+    static bool setNonBlocking(SOCKET socketId);
+
+    // Accepts a pending connection as a non-blocking, close-on-exec socket: one
+    // accept4() call on Linux, accept() plus fcntl/ioctlsocket elsewhere
+    static SOCKET acceptNonBlocking(SOCKET listenSocket, sockaddr_in& from);
+
+    // True if accept() failed because the process or system ran out of descriptors
+    static bool isOutOfDescriptors(int error);
+
+    // Accepts and closes one pending connection using a descriptor kept in reserve
+    // (POSIX). Without it a full descriptor table leaves the listener readable and
+    // the loop spinning on accept() errors while clients wait.
+    static void shedPendingConnection(SOCKET listenSocket);
+
+    // Connections waiting in the listener's accept queue and the queue limit (Linux TCP_INFO)
+    static bool listenQueueDepth(SOCKET listenSocket, uint32_t& length, uint32_t& limit);
+
+    // Host-wide counts of connections lost to a full accept queue (Linux TcpExt
+    // ListenOverflows and ListenDrops)
+    static bool listenOverflowCounts(uint64_t& overflows, uint64_t& drops);
+
+    // Lets a restarted server bind while old connections sit in TIME_WAIT (no-op on Windows,
+    // where SO_REUSEADDR would allow two servers on one port)
+    static void setReuseAddress(SOCKET socketId);
+
+    // Document root with a trailing separator: $WEB_SERVER_ROOT, or C:\temp\ on Windows and /var/www/ elsewhere
+    static const string& documentRoot();
+
+    // Overrides the document root (from the config file); a separator is appended if missing
+    static void setDocumentRoot(const string& root);
+
+    // The path with a trailing separator, as document roots are stored
+    static string directoryPath(const string& path);
+
+    // Flushes a written file to the disk (fsync, FlushFileBuffers on Windows); false on failure
+    static bool syncFile(const string& path);
+
+    // Makes the names just created or renamed in a directory durable (fsync of the
+    // directory; Windows has no equivalent and returns true)
+    static bool syncDirectory(const string& path);
+};
@@ -0,0 +1,455 @@
+#include "RootDirectory.h"
+#include "Platform.h"
+#include <atomic>
+#include <fstream>
+#include <cerrno>
+#include <cstdio>
+#include <climits>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/syscall.h>
+#if defined(__linux__) && defined(SYS_openat2) && __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#define HAVE_OPENAT2 1
+#endif
+#endif
+
+using std::string_view;
+
+OpenFile::~OpenFile()
+{
+#ifdef _WIN32
+    if (file != nullptr)
+        fclose(file);
+#else
+    if (fd >= 0)
+        close(fd);
+#endif
+}
+
+void OpenFile::prefetch() const
+{
+#if !defined(_WIN32) && !defined(__APPLE__)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#elif defined(__APPLE__)
+    radvisory advice = { 0, fileSize > (uint64_t)INT_MAX ? INT_MAX : (int)fileSize };
+    fcntl(fd, F_RDADVISE, &advice);
+#endif
+}
+
+long long OpenFile::readAt(uint64_t offset, char* buffer, size_t length) const
+{
+#ifdef _WIN32
+    if (_fseeki64(file, (long long)offset, SEEK_SET) != 0)
+        return -1;
+    size_t count = fread(buffer, 1, length, file);
+    return count == 0 && ferror(file) ? -1 : (long long)count;
+#else
+    ssize_t count;
+    do
+        count = pread(fd, buffer, length, (off_t)offset);
+    while (count < 0 && errno == EINTR);
+    return count;
+#endif
+}
+
+RootDirectory::~RootDirectory()
+{
+#ifndef _WIN32
+    if (rootFd >= 0)
+        close(rootFd);
+#endif
+}
+
+bool RootDirectory::open(const string& directory)
+{
+    rootPath = Platform::directoryPath(directory);
+#ifdef _WIN32
+    return true;
+#else
+    int descriptor = ::open(rootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rootFd >= 0)
+        close(rootFd);
+    rootFd = descriptor;
+    return rootFd >= 0;
+#endif
+}
+
+bool RootDirectory::isSafeRelative(const string& relativePath)
+{
+    if (relativePath.empty())
+        return false;
+    size_t start = 0;
+    while (start <= relativePath.size())
+    {
+        size_t end = relativePath.find('/', start);
+        if (end == string::npos)
+            end = relativePath.size();
+        string_view name(relativePath.data() + start, end - start);
+        if (name.empty() || name == "." || name == "..")
+            return false;
+        start = end + 1;
+    }
+    for (char c : relativePath)
+    {
+        if (c == '\0' || c == '\\')
+            return false;
+#ifdef _WIN32
+        if (c == ':')
+            return false; // Drive letters and alternate data streams
+#endif
+    }
+    return true;
+}
+
+#ifndef _WIN32
+int RootDirectory::openBeneath(const string& relativePath, int flags, int mode) const
+{
+    if (rootFd < 0 || !isSafeRelative(relativePath))
+        return -1;
+    flags |= O_CLOEXEC;
+
+#ifdef HAVE_OPENAT2
+    static std::atomic<bool> openat2Missing{ false }; // Kernels before 5.6; read by the prewarm threads too
+    if (!openat2Missing.load(std::memory_order_relaxed))
+    {
+        open_how how = {};
+        how.flags = (uint64_t)flags;
+        how.mode = (flags & O_CREAT) ? (uint64_t)mode : 0;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        int descriptor;
+        do
+            descriptor = (int)syscall(SYS_openat2, rootFd, relativePath.c_str(), &how, sizeof(how));
+        while (descriptor < 0 && errno == EAGAIN); // A concurrent rename raced the lookup
+        if (descriptor >= 0 || errno != ENOSYS)
+            return descriptor;
+        openat2Missing.store(true, std::memory_order_relaxed);
+    }
+#endif
+
+    // One component at a time, never following a symlink
+    int directory = rootFd;
+    size_t start = 0;
+    size_t slash;
+    while ((slash = relativePath.find('/', start)) != string::npos)
+    {
+        string name = relativePath.substr(start, slash - start);
+        int next = openat(directory, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (directory != rootFd)
+            close(directory);
+        if (next < 0)
+            return -1;
+        directory = next;
+        start = slash + 1;
+    }
+    int descriptor = openat(directory, relativePath.c_str() + start, flags | O_NOFOLLOW, mode);
+    if (directory != rootFd)
+        close(directory);
+    return descriptor;
+}
+#endif
+
+shared_ptr<const string> RootDirectory::readFile(const string& relativePath) const
+{
+#ifdef _WIN32
+    if (!isSafeRelative(relativePath))
+        return nullptr;
+    std::ifstream file(rootPath + relativePath, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return nullptr;
+    std::streamoff size = file.tellg();
+    if (size < 0)
+        return nullptr;
+    string content((size_t)size, '\0');
+    file.seekg(0, std::ios::beg);
+    if (size > 0 && !file.read(&content[0], size))
+        return nullptr;
+    return std::make_shared<const string>(std::move(content));
+#else
+    // O_NONBLOCK so a FIFO planted in the tree cannot stall the server
+    int descriptor = openBeneath(relativePath, O_RDONLY | O_NONBLOCK, 0);
+    if (descriptor < 0)
+        return nullptr;
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        close(descriptor);
+        return nullptr;
+    }
+
+    string content((size_t)info.st_size, '\0');
+    size_t done = 0;
+    while (done < content.size())
+    {
+        ssize_t count = pread(descriptor, &content[done], content.size() - done, (off_t)done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        done += (size_t)count;
+    }
+    close(descriptor);
+    if (done != content.size())
+        return nullptr; // Truncated while reading
+    return std::make_shared<const string>(std::move(content));
+#endif
+}
+
+shared_ptr<OpenFile> RootDirectory::openFile(const string& relativePath) const
+{
+    shared_ptr<OpenFile> opened(new OpenFile());
+#ifdef _WIN32
+    if (!isSafeRelative(relativePath))
+        return nullptr;
+    opened->file = fopen((rootPath + relativePath).c_str(), "rb");
+    if (opened->file == nullptr || _fseeki64(opened->file, 0, SEEK_END) != 0)
+        return nullptr;
+    opened->fileSize = (uint64_t)_ftelli64(opened->file);
+#else
+    opened->fd = openBeneath(relativePath, O_RDONLY | O_NONBLOCK, 0);
+    if (opened->fd < 0)
+        return nullptr;
+    struct stat info;
+    if (fstat(opened->fd, &info) != 0 || !S_ISREG(info.st_mode))
+        return nullptr;
+    opened->fileSize = (uint64_t)info.st_size;
+#endif
+    return opened;
+}
+
+bool RootDirectory::fileSize(const string& relativePath, uint64_t& size) const
+{
+    time_t modified;
+    return fileInfo(relativePath, size, modified);
+}
+
+bool RootDirectory::fileInfo(const string& relativePath, uint64_t& size, time_t& modified) const
+{
+#ifdef _WIN32
+    if (!isSafeRelative(relativePath))
+        return false;
+    struct _stat64 info;
+    if (_stat64((rootPath + relativePath).c_str(), &info) != 0 || (info.st_mode & _S_IFREG) == 0)
+        return false;
+#else
+    int descriptor = openBeneath(relativePath, O_RDONLY | O_NONBLOCK, 0);
+    if (descriptor < 0)
+        return false;
+    struct stat info;
+    bool regular = fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode);
+    close(descriptor);
+    if (!regular)
+        return false;
+#endif
+    size = (uint64_t)info.st_size;
+    modified = (time_t)info.st_mtime;
+    return true;
+}
+
+bool RootDirectory::isMissing(const string& relativePath) const
+{
+    if (!isSafeRelative(relativePath))
+        return false;
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64((rootPath + relativePath).c_str(), &info) == 0)
+        return false;
+#else
+    int descriptor = openBeneath(relativePath, O_RDONLY | O_NONBLOCK, 0);
+    if (descriptor >= 0)
+    {
+        close(descriptor);
+        return false;
+    }
+#endif
+    return errno == ENOENT || errno == ENOTDIR;
+}
+
+bool RootDirectory::writeFile(const string& relativePath, const string& content, bool append) const
+{
+#ifdef _WIN32
+    if (!isSafeRelative(relativePath))
+        return false;
+    std::ofstream file(rootPath + relativePath, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+    if (!file.is_open())
+        return false;
+    file << content;
+    return (bool)file;
+#else
+    int descriptor = openBeneath(relativePath, O_WRONLY | O_CREAT | O_NONBLOCK | (append ? O_APPEND : 0), 0644);
+    if (descriptor < 0)
+        return false;
+    struct stat info;
+    bool written = fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode);
+    string merged; // Old contents plus the appended ones, for a private copy
+    const string* data = &content;
+    if (written && info.st_nlink > 1)
+    {
+        // Shared with other names: unlink this one and write a private copy
+        close(descriptor);
+        if (append)
+        {
+            shared_ptr<const string> previous = readFile(relativePath);
+            merged = (previous ? *previous : string()) + content;
+            data = &merged;
+        }
+        if (!removeFile(relativePath))
+            return false;
+        descriptor = openBeneath(relativePath, O_WRONLY | O_CREAT | O_EXCL | O_NONBLOCK, 0644);
+        if (descriptor < 0)
+            return false;
+    }
+    else if (written && !append && ftruncate(descriptor, 0) != 0)
+        written = false;
+    size_t done = 0;
+    while (written && done < data->size())
+    {
+        ssize_t count = write(descriptor, data->data() + done, data->size() - done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        written = count > 0;
+        if (written)
+            done += (size_t)count;
+    }
+    close(descriptor);
+    return written;
+#endif
+}
+
+bool RootDirectory::writeAt(const string& relativePath, uint64_t offset, const char* data, size_t length) const
+{
+#ifdef _WIN32
+    if (!isSafeRelative(relativePath))
+        return false;
+    // "r+" keeps what is there but needs an existing file
+    std::FILE* file = fopen((rootPath + relativePath).c_str(), "r+b");
+    if (file == nullptr)
+        file = fopen((rootPath + relativePath).c_str(), "w+b");
+    if (file == nullptr)
+        return false;
+    bool written = _fseeki64(file, (long long)offset, SEEK_SET) == 0 && fwrite(data, 1, length, file) == length;
+    return fclose(file) == 0 && written;
+#else
+    int descriptor = openBeneath(relativePath, O_WRONLY | O_CREAT | O_NONBLOCK, 0644);
+    if (descriptor < 0)
+        return false;
+    struct stat info;
+    bool written = fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode);
+    size_t done = 0;
+    while (written && done < length)
+    {
+        ssize_t count = pwrite(descriptor, data + done, length - done, (off_t)(offset + done));
+        if (count < 0 && errno == EINTR)
+            continue;
+        written = count > 0;
+        if (written)
+            done += (size_t)count;
+    }
+    close(descriptor);
+    return written;
+#endif
+}
+
+#ifndef _WIN32
+int RootDirectory::openParent(const string& relativePath, const char*& name) const
+{
+    if (!isSafeRelative(relativePath))
+        return -1;
+    size_t slash = relativePath.rfind('/');
+    name = relativePath.c_str() + (slash == string::npos ? 0 : slash + 1);
+    if (slash == string::npos)
+        return rootFd;
+    return openBeneath(relativePath.substr(0, slash), O_RDONLY | O_DIRECTORY, 0);
+}
+#endif
+
+bool RootDirectory::removeFile(const string& relativePath) const
+{
+#ifdef _WIN32
+    if (!isSafeRelative(relativePath))
+        return false;
+    return std::remove((rootPath + relativePath).c_str()) == 0;
+#else
+    // Resolve the parent beneath the root; the last component itself is never followed
+    const char* name;
+    int parent = openParent(relativePath, name);
+    bool removed = parent >= 0 && unlinkat(parent, name, 0) == 0;
+    if (parent >= 0 && parent != rootFd)
+        close(parent);
+    return removed;
+#endif
+}
+
+bool RootDirectory::renameFile(const string& fromPath, const string& toPath) const
+{
+#ifdef _WIN32
+    if (!isSafeRelative(fromPath) || !isSafeRelative(toPath))
+        return false;
+    return MoveFileExA((rootPath + fromPath).c_str(), (rootPath + toPath).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    const char* fromName;
+    const char* toName;
+    int fromParent = openParent(fromPath, fromName);
+    int toParent = openParent(toPath, toName);
+    bool renamed = fromParent >= 0 && toParent >= 0 && renameat(fromParent, fromName, toParent, toName) == 0;
+    if (fromParent >= 0 && fromParent != rootFd)
+        close(fromParent);
+    if (toParent >= 0 && toParent != rootFd)
+        close(toParent);
+    return renamed;
+#endif
+}
+
+bool RootDirectory::linkFile(const string& existingPath, const string& newPath) const
+{
+    // The link is made under a temporary name and renamed over the target, so the
+    // target is never missing (link() itself refuses to replace a file)
+    size_t slash = newPath.rfind('/');
+    size_t nameStart = slash == string::npos ? 0 : slash + 1;
+    string temporary = newPath.substr(0, nameStart) + "." + newPath.substr(nameStart) + ".link";
+#ifdef _WIN32
+    if (!isSafeRelative(existingPath) || !isSafeRelative(newPath))
+        return false;
+    std::remove((rootPath + temporary).c_str());
+    if (!CreateHardLinkA((rootPath + temporary).c_str(), (rootPath + existingPath).c_str(), nullptr))
+        return false;
+#else
+    const char* fromName;
+    const char* toName;
+    int fromParent = openParent(existingPath, fromName);
+    int toParent = openParent(temporary, toName);
+    bool linked = fromParent >= 0 && toParent >= 0;
+    if (linked)
+    {
+        unlinkat(toParent, toName, 0); // Left over from an interrupted link
+        linked = linkat(fromParent, fromName, toParent, toName, 0) == 0;
+    }
+    if (fromParent >= 0 && fromParent != rootFd)
+        close(fromParent);
+    if (toParent >= 0 && toParent != rootFd)
+        close(toParent);
+    if (!linked)
+        return false;
+#endif
+    bool renamed = renameFile(temporary, newPath);
+    removeFile(temporary); // Still there if rename failed, or if both names were already the same file
+    return renamed;
+}
+
+bool RootDirectory::makeDirectory(const string& relativePath) const
+{
+#ifdef _WIN32
+    if (!isSafeRelative(relativePath))
+        return false;
+    return CreateDirectoryA((rootPath + relativePath).c_str(), nullptr) != 0 || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    const char* name;
+    int parent = openParent(relativePath, name);
+    bool made = parent >= 0 && (mkdirat(parent, name, 0755) == 0 || errno == EEXIST);
+    if (parent >= 0 && parent != rootFd)
+        close(parent);
+    return made;
+#endif
+}
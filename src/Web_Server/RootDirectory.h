@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+using std::string;
+using std::shared_ptr;
+
+// A regular file opened for reading, closed with its last reference. Responses
+// hold one to send a large file straight from disk instead of from memory.
+class OpenFile
+{
+public:
+    ~OpenFile();
+    OpenFile(const OpenFile&) = delete;
+    OpenFile& operator=(const OpenFile&) = delete;
+
+    // Size when the file was opened
+    uint64_t size() const { return fileSize; }
+
+    // Reads up to length bytes at offset; returns the count read, or -1 on error
+    long long readAt(uint64_t offset, char* buffer, size_t length) const;
+
+    // Asks the kernel to start reading the whole file into the page cache; returns at once
+    void prefetch() const;
+
+#ifndef _WIN32
+    int descriptor() const { return fd; }
+#endif
+
+private:
+    friend class RootDirectory;
+    OpenFile() = default;
+#ifdef _WIN32
+    std::FILE* file = nullptr;
+#else
+    int fd = -1;
+#endif
+    uint64_t fileSize = 0;
+};
+
+// A document root held open as a directory descriptor. Every file access is
+// resolved relative to it, so a request path can never leave the tree and
+// the kernel walks only the part below the root.
+//
+// Linux opens files with openat2(RESOLVE_BENEATH): symlinks are followed only
+// while they stay inside the root. Where openat2 is missing, each component
+// is opened with openat(O_NOFOLLOW), which refuses symlinks altogether.
+// Windows has no equivalent; paths are joined to the root string after the
+// same checks (no "..", "." or empty segments, no drive or stream colons).
+//
+// Relative paths use '/' separators and no leading '/' ("docs/page_fr.html").
+class RootDirectory
+{
+public:
+    RootDirectory() = default;
+    ~RootDirectory();
+    RootDirectory(const RootDirectory&) = delete;
+    RootDirectory& operator=(const RootDirectory&) = delete;
+
+    // Pins the directory (replacing any previous one). The path is kept with a trailing separator.
+    bool open(const string& directory);
+    const string& path() const { return rootPath; }
+
+    // Whole contents of a regular file; nullptr if it is missing, not a regular file or outside the root
+    shared_ptr<const string> readFile(const string& relativePath) const;
+
+    // Opens a regular file for reading; nullptr if it is missing, not a regular file or outside the root
+    shared_ptr<OpenFile> openFile(const string& relativePath) const;
+
+    // Size of a regular file; false if it cannot be opened
+    bool fileSize(const string& relativePath, uint64_t& size) const;
+
+    // Size and modification time of a regular file; false if it cannot be opened
+    bool fileInfo(const string& relativePath, uint64_t& size, time_t& modified) const;
+
+    // True only if nothing exists at the path (ENOENT, or ENOTDIR for a file used as a
+    // directory); false when it exists or cannot be checked (EACCES, EMFILE, ...)
+    bool isMissing(const string& relativePath) const;
+
+    // Creates or replaces a file (or appends to it); the parent directory must exist.
+    // A file with other hard links (a deduplicated blob) is replaced by a private copy
+    // first, so writing one name never changes the others.
+    bool writeFile(const string& relativePath, const string& content, bool append) const;
+
+    // Writes length bytes at offset, creating the file if needed; the rest of the file is kept
+    bool writeAt(const string& relativePath, uint64_t offset, const char* data, size_t length) const;
+
+    // Removes a file (not a directory)
+    bool removeFile(const string& relativePath) const;
+
+    // Renames a file, replacing any file at the new path in one step
+    bool renameFile(const string& fromPath, const string& toPath) const;
+
+    // Makes newPath another name (hard link) of existingPath, replacing any file there in one step
+    bool linkFile(const string& existingPath, const string& newPath) const;
+
+    // Creates a directory unless it exists; its parent must exist
+    bool makeDirectory(const string& relativePath) const;
+
+private:
+    static bool isSafeRelative(const string& relativePath);
+#ifndef _WIN32
+    int openBeneath(const string& relativePath, int flags, int mode) const;
+    // The directory holding a path, resolved beneath the root (rootFd itself for top-level
+    // names; close it unless it is rootFd), and the last component; -1 on failure
+    int openParent(const string& relativePath, const char*& name) const;
+    int rootFd = -1;
+#endif
+    string rootPath;
+};
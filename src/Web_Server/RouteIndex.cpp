@@ -0,0 +1,486 @@
+#include "RouteIndex.h"
+#include "HttpResponse.h"
+#include "MimeTypes.h"
+#include "UriPath.h"
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+using std::make_shared;
+
+const char* const RouteIndex::DEFAULT_LANGUAGE = "en";
+
+// Reports changes anywhere under the document root
+struct RouteIndex::Watcher
+{
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+
+    void watch(const string& root, const vector<string>&)
+    {
+        if (handle != INVALID_HANDLE_VALUE)
+            return; // Watches the whole subtree already
+        handle = FindFirstChangeNotificationA(root.c_str(), TRUE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+            FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    }
+
+    // No file names are reported here, so every change counts
+    bool poll(const std::unordered_set<string>&)
+    {
+        if (handle == INVALID_HANDLE_VALUE)
+            return false;
+        if (WaitForSingleObject(handle, 0) != WAIT_OBJECT_0)
+            return false;
+        FindNextChangeNotification(handle);
+        return true;
+    }
+
+    ~Watcher()
+    {
+        if (handle != INVALID_HANDLE_VALUE)
+            FindCloseChangeNotification(handle);
+    }
+#elif defined(__linux__)
+    int fd = -1;
+    std::unordered_map<int, string> watched; // Watch descriptor -> directory under the root ("" or "docs/")
+
+    void watch(const string& root, const vector<string>& directories)
+    {
+        if (fd < 0)
+            fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+            return;
+        // Adding an existing watch again is harmless; removed directories drop their watch
+        for (const string& directory : directories)
+        {
+            int descriptor = inotify_add_watch(fd, directory.c_str(), IN_CREATE | IN_DELETE | IN_MODIFY |
+                IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB);
+            if (descriptor < 0)
+                continue;
+            string relative = fs::path(directory).lexically_relative(root).generic_string();
+            watched[descriptor] = relative == "." || relative.empty() ? string() : relative + "/";
+        }
+    }
+
+    // Changes to hidden names (never served) and to the paths in applied (already
+    // updated through RouteIndex::update) do not count
+    bool poll(const std::unordered_set<string>& applied)
+    {
+        if (fd < 0)
+            return false;
+        alignas(inotify_event) char events[4096];
+        bool changed = false;
+        ssize_t length;
+        while ((length = read(fd, events, sizeof(events))) > 0)
+        {
+            for (ssize_t offset = 0; offset < length && !changed; )
+            {
+                const inotify_event* event = (const inotify_event*)(events + offset);
+                offset += (ssize_t)(sizeof(inotify_event) + event->len);
+                if (event->len == 0 || event->name[0] == '\0')
+                {
+                    changed = true; // The directory itself, or a queue overflow
+                    continue;
+                }
+                if (event->name[0] == '.')
+                    continue;
+                auto directory = watched.find(event->wd);
+                changed = directory == watched.end() || applied.count(directory->second + event->name) == 0;
+            }
+        }
+        return changed;
+    }
+
+    ~Watcher()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+#else
+    // No notification API: changes are only picked up through update() and invalidate()
+    void watch(const string&, const vector<string>&) {}
+    bool poll(const std::unordered_set<string>&) { return false; }
+#endif
+};
+
+static bool statFile(const string& path, uint64_t& size, time_t& modified)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path.c_str(), &info) != 0)
+        return false;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+#endif
+    size = (uint64_t)info.st_size;
+    modified = (time_t)info.st_mtime;
+    return true;
+}
+
+// The index entry of a regular file; nullptr if it cannot be read
+static shared_ptr<FileEntry> makeEntry(const fs::path& rootPath, const fs::path& file)
+{
+    shared_ptr<FileEntry> entry = make_shared<FileEntry>();
+    entry->fullPath = file.string();
+    entry->uriPath = "/" + file.lexically_relative(rootPath).generic_string();
+    if (!statFile(entry->fullPath, entry->size, entry->modified))
+        return nullptr;
+    entry->contentType = MimeTypes::fromPath(entry->uriPath);
+    entry->headerBlock = HttpResponse::buildFileHeaders(*entry);
+    return entry;
+}
+
+RouteIndex::RouteIndex() : watcher(new Watcher()) {}
+
+RouteIndex::~RouteIndex() = default;
+
+// Returns the "xx" of "name_xx.ext" (two ASCII letters, lowercased), or an empty string
+static string languageSuffix(const string& uriPath, size_t& langPos, size_t& dotPos)
+{
+    size_t slashPos = uriPath.find_last_of('/');
+    dotPos = uriPath.find_last_of('.');
+    if (dotPos == string::npos || dotPos < slashPos)
+        dotPos = uriPath.size();
+    langPos = uriPath.rfind('_', dotPos);
+    if (langPos == string::npos || langPos < slashPos || dotPos - langPos != 3)
+        return "";
+
+    string language = uriPath.substr(langPos + 1, 2);
+    for (char& c : language)
+    {
+        if (!isalpha((unsigned char)c))
+            return "";
+        c = (char)tolower((unsigned char)c);
+    }
+    return language;
+}
+
+bool RouteIndex::isSupportedLanguage(const string& language) const
+{
+    shared_ptr<const RouteTable> current = snapshot();
+    if (!current)
+        return language == DEFAULT_LANGUAGE;
+    for (const string& supported : current->languages)
+    {
+        if (supported == language)
+            return true;
+    }
+    return false;
+}
+
+vector<string> RouteIndex::getLanguages() const
+{
+    shared_ptr<const RouteTable> current = snapshot();
+    return current ? current->languages : vector<string>{ DEFAULT_LANGUAGE };
+}
+
+string RouteIndex::makeKey(const string& uri, const string& language)
+{
+    string key;
+    key.reserve(uri.size() + 1 + language.size());
+    key += uri;
+    key += '\n'; // Cannot appear in a parsed URI
+    key += language;
+    return key;
+}
+
+void RouteIndex::setRoot(const string& rootDirectory)
+{
+    root = rootDirectory;
+    rebuild();
+}
+
+bool RouteIndex::refreshIfChanged()
+{
+    bool changed = watcher->poll(applied);
+    applied.clear();
+    if (!changed && !dirty)
+        return false;
+    dirty = false;
+    rebuild();
+    return true;
+}
+
+shared_ptr<const RouteIndex::RouteTable> RouteIndex::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(tableMutex);
+    return table;
+}
+
+void RouteIndex::rebuild()
+{
+    shared_ptr<RouteTable> newTable = make_shared<RouteTable>();
+    newTable->shards.resize(SHARD_COUNT);
+    for (shared_ptr<RouteShard>& shard : newTable->shards)
+        shard = make_shared<RouteShard>();
+    vector<shared_ptr<FileEntry>> files;
+    vector<string> directories = { root };
+
+    // Pass 1: collect files and discover languages from "*_xx.html"
+    std::error_code error;
+    fs::path rootPath(root);
+    fs::recursive_directory_iterator it(rootPath, fs::directory_options::skip_permission_denied, error);
+    for (; !error && it != fs::recursive_directory_iterator(); it.increment(error))
+    {
+        const fs::directory_entry& item = *it;
+        string name = item.path().filename().string();
+        if (!name.empty() && name[0] == '.')
+        {
+            // Hidden files and directories are never served
+            if (item.is_directory(error))
+                it.disable_recursion_pending();
+            continue;
+        }
+        if (item.is_directory(error))
+        {
+            directories.push_back(item.path().string());
+            continue;
+        }
+        if (!item.is_regular_file(error))
+            continue;
+
+        shared_ptr<FileEntry> entry = makeEntry(rootPath, item.path());
+        if (!entry)
+            continue;
+
+        size_t langPos, dotPos;
+        string language = languageSuffix(entry->uriPath, langPos, dotPos);
+        if (!language.empty() && entry->uriPath.compare(dotPos, string::npos, ".html") == 0 &&
+            std::find(newTable->languages.begin(), newTable->languages.end(), language) == newTable->languages.end())
+        {
+            newTable->languages.push_back(language);
+        }
+        files.push_back(entry);
+    }
+
+    // Default language first, the rest in a stable order
+    vector<string>& languages = newTable->languages;
+    std::sort(languages.begin(), languages.end());
+    auto defaultIt = std::find(languages.begin(), languages.end(), DEFAULT_LANGUAGE);
+    if (defaultIt != languages.end())
+        languages.erase(defaultIt);
+    languages.insert(languages.begin(), DEFAULT_LANGUAGE);
+
+    // Pass 2: exact routes, grouping language variants by base URI
+    unordered_map<string, unordered_map<string, shared_ptr<const FileEntry>>> variants; // base URI -> language -> file
+    unordered_map<string, shared_ptr<const FileEntry>> plainFiles;                     // URI -> file without language
+    for (const shared_ptr<FileEntry>& entry : files)
+    {
+        // Split "/dir/name_xx.ext" into base URI "/dir/name.ext" and language "xx"
+        const string& uriPath = entry->uriPath;
+        size_t langPos, dotPos;
+        string language = languageSuffix(uriPath, langPos, dotPos);
+        string baseUri;
+        if (!language.empty() && std::find(languages.begin(), languages.end(), language) != languages.end())
+        {
+            entry->language = language;
+            baseUri = uriPath.substr(0, langPos) + uriPath.substr(dotPos);
+        }
+
+        // A file is always reachable by its own name, whatever the language preference
+        RouteTarget exact = { entry, true, false };
+        RouteShard& routes = newTable->routesOf(uriPath);
+        routes[makeKey(uriPath, "")] = exact;
+        for (const string& supported : languages)
+            routes[makeKey(uriPath, supported)] = exact;
+
+        if (baseUri.empty())
+            plainFiles[uriPath] = entry;
+        else
+            variants[baseUri][entry->language] = entry;
+    }
+
+    for (const auto& variant : variants)
+    {
+        auto plainIt = plainFiles.find(variant.first);
+        addLanguageRoutes(*newTable, variant.first, variant.second, plainIt != plainFiles.end() ? plainIt->second : nullptr);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        table = newTable;
+    }
+    watcher->watch(root, directories);
+}
+
+// Language routes for "/dir/name.ext": the variant itself, or a fallback to the
+// language-neutral file, then the default language, then any variant
+void RouteIndex::addLanguageRoutes(RouteTable& table, const string& baseUri,
+    const unordered_map<string, shared_ptr<const FileEntry>>& byLanguage, const shared_ptr<const FileEntry>& plain)
+{
+    const vector<string>& languages = table.languages;
+    shared_ptr<const FileEntry> defaultVariant;
+    shared_ptr<const FileEntry> anyVariant;
+    for (const string& language : languages)
+    {
+        auto fileIt = byLanguage.find(language);
+        if (fileIt == byLanguage.end())
+            continue;
+        if (!anyVariant)
+            anyVariant = fileIt->second;
+        if (language == DEFAULT_LANGUAGE)
+            defaultVariant = fileIt->second;
+    }
+
+    shared_ptr<const FileEntry> fallback = plain ? plain : (defaultVariant ? defaultVariant : anyVariant);
+    RouteShard& routes = table.routesOf(baseUri);
+    for (const string& language : languages)
+    {
+        auto fileIt = byLanguage.find(language);
+        if (fileIt != byLanguage.end())
+            routes[makeKey(baseUri, language)] = { fileIt->second, true, true };
+        else
+            routes[makeKey(baseUri, language)] = { fallback, false, true };
+    }
+
+    // No language requested: default language first, as extractFilePath always did
+    shared_ptr<const FileEntry> unspecified = defaultVariant ? defaultVariant : (plain ? plain : anyVariant);
+    routes[makeKey(baseUri, "")] = { unspecified, true, true };
+}
+
+void RouteIndex::update(const string& relativePath)
+{
+    applied.insert(relativePath);
+    shared_ptr<const RouteTable> current = snapshot();
+    if (!current || dirty)
+        return; // Rebuilt on the next refreshIfChanged() anyway
+
+    string uriPath = "/" + relativePath;
+    size_t langPos, dotPos;
+    string language = languageSuffix(uriPath, langPos, dotPos);
+    bool knownLanguage = !language.empty()
+        && std::find(current->languages.begin(), current->languages.end(), language) != current->languages.end();
+    if (!language.empty() && !knownLanguage && uriPath.compare(dotPos, string::npos, ".html") == 0)
+    {
+        // A new language adds routes to every negotiated URI: rescan
+        std::error_code error;
+        if (fs::is_regular_file(fs::path(root) / fs::path(relativePath).make_preferred(), error))
+        {
+            dirty = true;
+            return;
+        }
+    }
+
+    // Lookups in progress keep the old table: the new one shares every shard
+    // except the ones holding the changed URIs, which are copied
+    shared_ptr<RouteTable> newTable = make_shared<RouteTable>(*current);
+    vector<string> uris = { uriPath };
+    if (knownLanguage)
+        uris.push_back(uriPath.substr(0, langPos) + uriPath.substr(dotPos));
+    for (const string& uri : uris)
+    {
+        shared_ptr<RouteShard>& shard = newTable->shards[shardOf(uri)];
+        if (shard == current->shards[shardOf(uri)])
+            shard = make_shared<RouteShard>(*shard);
+        updateRoutes(*newTable, uri);
+    }
+    {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        table = newTable;
+    }
+}
+
+// Replaces the routes of one URI with what rebuild() would make of the files on
+// disk now: the file of that name, then the language routes if it has variants
+void RouteIndex::updateRoutes(RouteTable& table, const string& uri) const
+{
+    const vector<string>& languages = table.languages;
+    RouteShard& routes = table.routesOf(uri);
+    routes.erase(makeKey(uri, ""));
+    for (const string& language : languages)
+        routes.erase(makeKey(uri, language));
+
+    // The file as it is on disk, or nullptr if it is gone (or never served)
+    fs::path rootPath(root);
+    auto load = [&](const string& fileUri) -> shared_ptr<FileEntry> {
+        std::error_code error;
+        fs::path file = rootPath / fs::path(fileUri.substr(1)).make_preferred();
+        if (UriPath::hasHiddenSegment(fileUri) || !fs::is_regular_file(file, error))
+            return nullptr;
+        return makeEntry(rootPath, file);
+    };
+
+    size_t langPos, dotPos;
+    string language = languageSuffix(uri, langPos, dotPos);
+    shared_ptr<FileEntry> self = load(uri);
+    shared_ptr<const FileEntry> plain;
+    if (self)
+    {
+        if (!language.empty() && std::find(languages.begin(), languages.end(), language) != languages.end())
+            self->language = language;
+        else
+            plain = self;
+        RouteTarget exact = { self, true, false };
+        routes[makeKey(uri, "")] = exact;
+        for (const string& supported : languages)
+            routes[makeKey(uri, supported)] = exact;
+    }
+
+    // Variants are named "/dir/name_xx.ext" for "/dir/name.ext"
+    size_t slashPos = uri.find_last_of('/');
+    size_t extensionPos = uri.find_last_of('.');
+    if (extensionPos == string::npos || extensionPos < slashPos)
+        extensionPos = uri.size();
+    unordered_map<string, shared_ptr<const FileEntry>> byLanguage;
+    for (const string& supported : languages)
+    {
+        shared_ptr<FileEntry> variant = load(uri.substr(0, extensionPos) + "_" + supported + uri.substr(extensionPos));
+        if (!variant)
+            continue;
+        variant->language = supported;
+        byLanguage[supported] = variant;
+    }
+    if (!byLanguage.empty())
+        addLanguageRoutes(table, uri, byLanguage, plain);
+}
+
+RouteMatch RouteIndex::lookup(const string& uri, const vector<string>& languages) const
+{
+    RouteMatch match;
+    shared_ptr<const RouteTable> current = snapshot();
+    if (!current)
+        return match;
+
+    // The first probe normally settles it; later preferences are only tried
+    // when the first one resolved to a fallback
+    const RouteShard& routes = current->routesOf(uri);
+    const RouteTarget* target = nullptr;
+    for (const string& language : languages)
+    {
+        auto it = routes.find(makeKey(uri, language));
+        if (it == routes.end())
+            continue;
+        if (it->second.exactLanguage)
+        {
+            target = &it->second;
+            break;
+        }
+        if (target == nullptr)
+            target = &it->second;
+    }
+    if (target == nullptr)
+    {
+        auto it = routes.find(makeKey(uri, ""));
+        if (it != routes.end())
+            target = &it->second;
+    }
+
+    if (target != nullptr)
+    {
+        match.entry = target->entry;
+        match.negotiated = target->negotiated;
+    }
+    return match;
+}
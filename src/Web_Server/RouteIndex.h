@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <ctime>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+using std::unordered_map;
+
+// A file under the document root with the metadata captured when it was indexed
+struct FileEntry
+{
+    string fullPath;     // Path on disk (root + relative path)
+    string uriPath;      // Normalized URI of the file itself (e.g. "/page_fr.html")
+    string language;     // Language suffix of the file name, empty if none
+    uint64_t size = 0;   // File size in bytes
+    time_t modified = 0; // Last write time
+    string contentType;  // From the file extension
+    string headerBlock;  // Pre-serialized Content-Type/Length, ETag, Last-Modified, Cache-Control
+};
+
+// Result of resolving a URI
+struct RouteMatch
+{
+    shared_ptr<const FileEntry> entry; // nullptr if nothing matched
+    bool negotiated = false;           // True if the URI has language variants (response varies by language)
+};
+
+// Maps (normalized URI, language) to the file that should be served.
+//
+// The table is built by scanning the document root and already contains the
+// language fallbacks, so resolving a request is one hash probe in the common
+// case. The table is rebuilt when the directory watcher reports a change;
+// files written or removed through the server only have their own routes
+// replaced, in a copy of the one shard of the table that holds them.
+// The language set is discovered from "*_xx.html" file names.
+class RouteIndex
+{
+public:
+    RouteIndex();
+    ~RouteIndex();
+
+    // Sets the document root and builds the index
+    void setRoot(const string& rootDirectory);
+    const string& getRoot() const { return root; }
+
+    // Rebuilds the table if the watcher saw a change or invalidate() was called.
+    // Cheap to call on every loop iteration. Returns true if the table was rebuilt.
+    bool refreshIfChanged();
+
+    // Forces a rebuild on the next refreshIfChanged()
+    void invalidate() { dirty = true; }
+
+    // A file the server itself wrote or removed (PUT, DELETE): re-reads it and
+    // replaces only its routes, and those of the URI it is a language variant of,
+    // instead of rescanning the tree. The watcher's events for it are ignored.
+    // A file in a language not seen before still makes the next refresh rebuild.
+    void update(const string& relativePath);
+
+    // Resolves a URI for the given language preferences (most preferred first)
+    RouteMatch lookup(const string& uri, const vector<string>& languages) const;
+
+    // Languages recognized as file name suffixes (discovered at the last rebuild)
+    bool isSupportedLanguage(const string& language) const;
+    vector<string> getLanguages() const;
+
+    // Default language used when the request does not ask for one
+    static const char* const DEFAULT_LANGUAGE;
+
+private:
+    struct RouteTarget
+    {
+        shared_ptr<const FileEntry> entry;
+        bool exactLanguage; // False if the entry is a fallback for the requested language
+        bool negotiated;    // True for base URIs that have language variants
+    };
+    typedef unordered_map<string, RouteTarget> RouteShard;
+
+    // Routes are split by URI hash, so all of one URI's routes are in one shard and
+    // update() copies that shard instead of the whole table
+    static constexpr size_t SHARD_COUNT = 256;
+    struct RouteTable
+    {
+        vector<shared_ptr<RouteShard>> shards; // Shared between tables; never changed once published
+        vector<string> languages;              // Default language first
+
+        RouteShard& routesOf(const string& uri) { return *shards[shardOf(uri)]; }
+        const RouteShard& routesOf(const string& uri) const { return *shards[shardOf(uri)]; }
+    };
+
+    static string makeKey(const string& uri, const string& language);
+    static size_t shardOf(const string& uri) { return std::hash<string>()(uri) % SHARD_COUNT; }
+
+    void rebuild();
+    void updateRoutes(RouteTable& table, const string& uri) const;
+    static void addLanguageRoutes(RouteTable& table, const string& baseUri,
+        const unordered_map<string, shared_ptr<const FileEntry>>& byLanguage, const shared_ptr<const FileEntry>& plain);
+    shared_ptr<const RouteTable> snapshot() const;
+
+    string root;
+    shared_ptr<const RouteTable> table;
+    mutable std::mutex tableMutex;
+    bool dirty = false;
+    std::unordered_set<string> applied; // Paths passed to update() since the last refresh
+
+    // Platform directory change notification (see RouteIndex.cpp)
+    struct Watcher;
+    std::unique_ptr<Watcher> watcher;
+};
@@ -1,335 +1,1162 @@
-﻿#define _CRT_SECURE_NO_WARNINGS
-#pragma comment(lib, "Ws2_32.lib")
-#include <iostream>
-#include <winsock2.h>
-#include <string.h>
-#include <time.h>
-#include <vector>
-#include <ctime>
-#include "HttpRequest.h"
-#include "HttpResponse.h"
-using namespace std;
-
-// Constants for server and sockets
-static const size_t MAX_MESSAGE_SIZE = 4096; // Max size for request/response buffer
-const int WEB_SERVER_PORT = 80;             // Port for the HTTP server
-const int MAX_SOCKETS = 60;                 // Maximum number of simultaneous sockets
-const int EMPTY = 0, LISTEN = 1, RECEIVE = 2, IDLE = 3, SEND = 4; // Socket states
-
-
-// Structure to maintain socket state
-struct SocketState
-{
-	SOCKET id;                        // Socket handle
-	int recv;                         // Receiving state
-	int send;                         // Sending state
-	char buffer[MAX_MESSAGE_SIZE];    // Buffer for HTTP messages
-	int len;                          // Length of data in the buffer
-	time_t lastActivity;              // Timestamp of last socket activity
-	bool closeAfterSend = false;      // Flag for closing connection after send
-};
-
-// Function declarations
-bool addSocket(SOCKET id, int what);
-void removeSocket(int index);
-void acceptConnection(int index);
-void receiveMessage(int index);
-void sendMessage(int index);
-
-// Array to store socket states
-struct SocketState sockets[MAX_SOCKETS] = { 0 };
-int socketsCount = 0;
-
-void main()
-{
-	
-	WSAData wsaData;
-	// Initialize Winsock
-	if (NO_ERROR != WSAStartup(MAKEWORD(2, 2), &wsaData))
-	{
-		cout << "Http Server: Error at WSAStartup()\n";
-		return;
-	}
-	// Create a listening socket
-	SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-
-	if (INVALID_SOCKET == listenSocket)
-	{
-		cout << "Http Server: Error at socket(): " << WSAGetLastError() << endl;
-		WSACleanup();
-		return;
-	}
-
-	// Configure the server address
-	sockaddr_in serverService;
-	serverService.sin_family = AF_INET;
-	serverService.sin_addr.s_addr = INADDR_ANY;
-	serverService.sin_port = htons(WEB_SERVER_PORT);
-
-	// Bind the socket to the port
-	if (SOCKET_ERROR == bind(listenSocket, (SOCKADDR*)&serverService, sizeof(serverService)))
-	{
-		cout << "Http Server: Error at bind(): " << WSAGetLastError() << endl;
-		closesocket(listenSocket);
-		WSACleanup();
-		return;
-	}
-
-	// Listen on the Socket for incoming connections.
-	// This socket accepts only one connection (no pending connections 
-	// from other clients). This sets the backlog parameter.
-	//*backlog parameter is 5 mean 5 clients can wait in the same time
-	if (SOCKET_ERROR == listen(listenSocket, 5))
-	{
-		cout << "Http Server: Error at listen(): " << WSAGetLastError() << endl;
-		closesocket(listenSocket);
-		WSACleanup();
-		return;
-	}
-	// Add listening socket to the array
-	addSocket(listenSocket, LISTEN); 
-
-	// Accept connections and handles them one by one.
-	while (true)
-	{
-		fd_set waitRecv;
-		FD_ZERO(&waitRecv);
-
-		// Populate the recv and send sets based on socket states
-		for (int i = 0; i < MAX_SOCKETS; i++)
-		{
-			if ((sockets[i].recv == LISTEN) || (sockets[i].recv == RECEIVE))
-				FD_SET(sockets[i].id, &waitRecv);
-		}
-
-		fd_set waitSend;
-		FD_ZERO(&waitSend);
-		for (int i = 0; i < MAX_SOCKETS; i++)
-		{
-			if (sockets[i].send == SEND)
-				FD_SET(sockets[i].id, &waitSend);
-		}
-		// Wait for activity on sockets
-		int nfd;
-		nfd = select(0, &waitRecv, &waitSend, NULL, NULL);
-		if (nfd == SOCKET_ERROR)
-		{
-			cout << "Http Server: Error at select(): " << WSAGetLastError() << endl;
-			WSACleanup();
-			return;
-		}
-
-		// Timeout Check 120sec
-		time_t currentTime = time(nullptr);
-		for (int i = 0; i < MAX_SOCKETS; i++)
-		{
-			if (sockets[i].recv != EMPTY && difftime(currentTime, sockets[i].lastActivity) > 120)
-			{
-				cout << "Http Server: Closing idle connection (timeout exceeded).\n";
-				closesocket(sockets[i].id);
-				removeSocket(i);
-			}
-		}
-
-		// Handle recv activity
-		for (int i = 0; i < MAX_SOCKETS && nfd > 0; i++)
-		{
-			if (FD_ISSET(sockets[i].id, &waitRecv))
-			{
-				nfd--;
-				switch (sockets[i].recv)
-				{
-				case LISTEN:
-					acceptConnection(i);
-					break;
-
-				case RECEIVE:
-					receiveMessage(i);
-					break;
-				}
-			}
-		}
-		// Handle send activity
-		for (int i = 0; i < MAX_SOCKETS && nfd > 0; i++)
-		{
-			if (FD_ISSET(sockets[i].id, &waitSend))
-			{
-				nfd--;
-				switch (sockets[i].send)
-				{
-				case SEND:
-					sendMessage(i);
-					break;
-				}
-			}
-		}
-	}
-
-	// Closing connections and Winsock.
-	cout << "Http Server: Closing Connection.\n";
-	closesocket(listenSocket);
-	WSACleanup();
-}
-
-// Adds a new socket to the array
-bool addSocket(SOCKET id, int what)
-{
-	for (int i = 0; i < MAX_SOCKETS; i++)
-	{
-		if (sockets[i].recv == EMPTY)
-		{
-			sockets[i].id = id;
-			sockets[i].recv = what;
-			sockets[i].send = IDLE;
-			sockets[i].len = 0;
-			sockets[i].lastActivity = time(nullptr);
-			return (true);
-		}
-	}
-	return false;
-}
-
-// Removes a socket from the array
-void removeSocket(int index)
-{
-	sockets[index].recv = EMPTY;
-	sockets[index].send = EMPTY;
-	sockets[index].len = 0;
-	socketsCount--;
-}
-
-// Accepts a new connection
-void acceptConnection(int index)
-{
-	SOCKET id = sockets[index].id;
-	struct sockaddr_in from;		// Address of sending partner
-	int fromLen = sizeof(from);
-
-	SOCKET msgSocket = accept(id, (struct sockaddr*)&from, &fromLen);
-	if (INVALID_SOCKET == msgSocket)
-	{
-		cout << "Http Server: Error at accept(): " << WSAGetLastError() << endl;
-		return;
-	}
-	//cout << "Http Server: Client " << inet_ntoa(from.sin_addr) << ":" << ntohs(from.sin_port) << " is connected." << endl;
-
-	//
-	// Set the socket to be in non-blocking mode.
-	//
-	unsigned long flag = 1;
-	if (ioctlsocket(msgSocket, FIONBIO, &flag) != 0)
-	{
-		cout << "Http Server: Error at ioctlsocket(): " << WSAGetLastError() << endl;
-	}
-
-	if (addSocket(msgSocket, RECEIVE) == false)
-	{
-		cout << "\t\tToo many connections, dropped!\n";
-		closesocket(id);
-	}
-	return;
-}
-
-// Handles incoming messages
-void receiveMessage(int index)
-{
-	SOCKET msgSocket = sockets[index].id;
-	int len = sockets[index].len;
-
-	int bytesRecv = recv(msgSocket, &sockets[index].buffer[len], sizeof(sockets[index].buffer) - len - 1, 0);
-	if (bytesRecv == SOCKET_ERROR)
-	{
-		int error = WSAGetLastError();
-		if (error == WSAEWOULDBLOCK)
-		{
-			return;
-		}
-		cout << "Http Server: Error at recv(): " << error << endl;
-		closesocket(msgSocket);
-		removeSocket(index);
-		return;
-	}
-	if (bytesRecv == 0)
-	{
-		cout << "Http Server: Client disconnected.\n";
-		closesocket(msgSocket);
-		removeSocket(index);
-		return;
-	}
-	// Buffer Overflow Check
-	if (sockets[index].len + bytesRecv >= sizeof(sockets[index].buffer))
-	{
-		cout << "Http Server: Buffer overflow detected. Closing connection.\n";
-		closesocket(msgSocket);
-		removeSocket(index);
-		return;
-	}
-
-
-	sockets[index].buffer[len + bytesRecv] = '\0'; // Null-terminate the string
-	cout << "Http Server: Received: " << bytesRecv << " bytes of \"" << &sockets[index].buffer[len] << "\" message.\n";
-	sockets[index].len += bytesRecv;
-	//update last activity
-	sockets[index].lastActivity = time(nullptr);
-
-	// Parse and handle the request
-	HttpRequest request;
-	string rawRequest(sockets[index].buffer);
-	bool parseSuccess = request.handleRequest(rawRequest);
-
-	if (!parseSuccess)
-	{
-		// 400 Bad Request
-		HttpResponse badRequest = HttpResponse::createBadRequestResponse();
-		string httpResponse = badRequest.toString();
-		memset(sockets[index].buffer, 0, sizeof(sockets[index].buffer));
-		strncpy(sockets[index].buffer, httpResponse.c_str(), sizeof(sockets[index].buffer) - 1);
-		sockets[index].len = (int)httpResponse.size();
-		sockets[index].send = SEND;
-		sockets[index].closeAfterSend = true; // Close after sending error response
-		return;
-	}
-
-	// Generate response based on request
-	HttpResponse response = request.handlePerMethodRequest();
-	string httpResponse = response.toString();;
-	memset(sockets[index].buffer, 0, sizeof(sockets[index].buffer));
-	strncpy(sockets[index].buffer, httpResponse.c_str(), sizeof(sockets[index].buffer) - 1);
-	sockets[index].len = (int)httpResponse.size();
-	sockets[index].send = SEND;
-
-	
-	if (request.getHeaderConnection() == "close")
-	{
-		sockets[index].closeAfterSend = true; // Mark for closure
-	}
-}
-
-// Sends a message to the client
-void sendMessage(int index)
-{
-	SOCKET msgSocket = sockets[index].id;
-	int bytesSent = send(msgSocket, sockets[index].buffer, sockets[index].len, 0);
-	if (bytesSent == SOCKET_ERROR)
-	{
-		cout << "Http Server: Error at send(): " << WSAGetLastError() << endl;
-		closesocket(msgSocket);
-		removeSocket(index);
-		return;
-	}
-	cout << "Http Server: Sent: " << bytesSent << " bytes of response.\n";
-
-	// Check if the connection should be closed after sending
-	if (sockets[index].closeAfterSend)
-	{
-		cout << "Http Server: Closing connection after send.\n";
-		closesocket(msgSocket);
-		removeSocket(index);
-		return;
-	}
-
-	// Reset the buffer and update the state
-	memset(sockets[index].buffer, 0, sizeof(sockets[index].buffer));
-	sockets[index].len = 0;
-	sockets[index].send = IDLE;
-}
+﻿#define _CRT_SECURE_NO_WARNINGS
+#include <iostream>
+#include "Platform.h"
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <ctime>
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Metrics.h"
+#include "VirtualHosts.h"
+#include "ServerConfig.h"
+#include "ClientLimits.h"
+#include "ListenerHandoff.h"
+#include "SocketOptions.h"
+#include "OutputQueue.h"
+#include "CacheSnapshot.h"
+#include "Tls.h"
+#include "Http2Connection.h"
+#include "PhaseTrace.h"
+#include "MemoryBudget.h"
+using namespace std;
+
+// Constants for server and sockets
+static const size_t MAX_MESSAGE_SIZE = 4096; // Receive buffer size; grows up to max_request_size for a larger request
+#ifdef _WIN32
+const int MAX_SOCKETS = 60;                 // Maximum number of simultaneous sockets (Winsock FD_SETSIZE is 64)
+#else
+const int MAX_SOCKETS = 1000;               // Maximum number of simultaneous sockets (descriptors must stay below FD_SETSIZE)
+#endif
+const int EMPTY = 0, LISTEN = 1, RECEIVE = 2, IDLE = 3, SEND = 4, HANDOFF = 5, HANDSHAKE = 6; // Socket states
+
+
+// Structure to maintain socket state
+struct SocketState
+{
+	SOCKET id;                        // Socket handle
+	int recv;                         // Receiving state
+	int send;                         // Sending state
+	vector<char> buffer;              // Received bytes: a partial request, or several pipelined ones
+	int len;                          // Length of data in the buffer
+	OutputQueue output;               // Responses not yet written, in request order
+	bool corked;                      // TCP_CORK is set until the output queue is empty
+	time_t lastActivity;              // Timestamp of last socket activity
+	bool closeAfterSend = false;      // Flag for closing connection after send
+	uint32_t clientAddress;           // Peer IPv4 address (host order), counted in clientLimits
+	bool secure;                      // Listener: accepts HTTPS connections
+	unique_ptr<TlsSession> tls;       // Connection: set for HTTPS
+	unique_ptr<Http2Connection> h2;   // Connection: set once it speaks HTTP/2
+	uint64_t receivedTicks;           // PhaseTrace counter when the last recv() completed
+	vector<uint64_t> unsent;          // PhaseTrace records whose responses are still queued
+};
+
+// Function declarations
+int addSocket(SOCKET id, int what);
+void removeSocket(int index);
+void acceptConnection(int index);
+void admitConnection(SOCKET msgSocket, const sockaddr_in& from, bool secure);
+void continueHandshake(int index);
+void receiveMessage(int index);
+void processRequests(int index);
+void answerRequest(int index, const string& rawRequest, uint32_t streamId = 0);
+void queueResponse(int index, uint32_t streamId, const HttpResponse& response, bool includeBody);
+void startHttp2(int index, Http2Start start);
+void processHttp2(int index);
+bool wantsToRead(const SocketState& socket);
+bool resizeBuffer(SocketState& socket, size_t size);
+size_t reclaimCacheMemory(size_t bytes);
+void sendMessage(int index);
+void rejectConnection(SOCKET msgSocket, bool secure);
+ConnectionStateCounts countConnectionStates();
+ListenQueueStats sampleListenQueue();
+SOCKET openListener(int port);
+void applyConfig(const ServerConfig& settings);
+void reloadConfig();
+void beginDrain(const char* reason);
+void continueDrain(time_t currentTime);
+void handOffListener(int index);
+void prewarmCaches();
+void saveCacheSnapshot();
+
+// Array to store socket states
+struct SocketState sockets[MAX_SOCKETS] = {};
+int socketsCount = 0; // Client connections (listening and handoff sockets are not counted)
+
+// Settings and admission control
+string configPath;
+ServerConfig config;
+ClientLimits clientLimits;
+int connectionLimit = MAX_SOCKETS - 1; // Client connections admitted at once (one slot is the listener)
+
+// Lifecycle
+SOCKET handoffSocket = INVALID_SOCKET; // Unix socket a replacement process connects to
+bool draining = false;                 // No new connections; exit when the last one closes
+bool handedOff = false;                // The listener now belongs to a replacement process
+time_t drainDeadline = 0;              // In-flight requests are cut off after this
+
+int main(int argc, char* argv[])
+{
+	// Load the configuration file, if one was given
+	configPath = ServerConfig::findConfigPath(argc, argv);
+	if (!configPath.empty())
+	{
+		string error;
+		if (!config.loadFile(configPath, error))
+		{
+			cout << "Http Server: Error in configuration: " << error << endl;
+			return 1;
+		}
+	}
+	// Load the certificate now, so a bad one stops the server before it takes the port
+	if (config.tls.port != 0)
+	{
+		string error;
+		if (!TlsContext::instance().configure(config.tls, config.http2, error))
+		{
+			cout << "Http Server: Error in TLS configuration: " << error << endl;
+			return 1;
+		}
+	}
+	// Index every site's document root before serving; caches give way to other memory
+	MemoryBudget::instance().setReclaimer(reclaimCacheMemory);
+	applyConfig(config);
+
+	// Initialize the socket library
+	if (!Platform::startup())
+	{
+		cout << "Http Server: Error at WSAStartup()\n";
+		return 1;
+	}
+	Platform::installSignalHandlers();
+
+	// Take over the listener of a running server, or open a new one. The caches are
+	// warmed first: before a handoff the old process keeps serving meanwhile; a new
+	// listener is opened first so clients wait in its backlog instead of being refused.
+	SOCKET listenSocket = INVALID_SOCKET;
+	SOCKET secureSocket = INVALID_SOCKET;
+	bool prewarmed = false;
+	if (!config.handoffSocket.empty())
+	{
+		prewarmCaches();
+		prewarmed = true;
+		listenSocket = ListenerHandoff::requestListener(config.handoffSocket, &secureSocket);
+		if (listenSocket != INVALID_SOCKET)
+		{
+			cout << "Http Server: Took over the listening socket from the running server.\n";
+			SocketOptions::applyToListener(listenSocket, config.tcp);
+		}
+		if (secureSocket != INVALID_SOCKET && config.tls.port == 0)
+		{
+			closesocket(secureSocket); // HTTPS was turned off for the new process
+			secureSocket = INVALID_SOCKET;
+		}
+		else if (secureSocket != INVALID_SOCKET)
+			SocketOptions::applyToListener(secureSocket, config.tcp);
+	}
+	if (listenSocket == INVALID_SOCKET)
+		listenSocket = openListener(config.port);
+	if (secureSocket == INVALID_SOCKET && config.tls.port != 0 && listenSocket != INVALID_SOCKET)
+	{
+		secureSocket = openListener(config.tls.port);
+		if (secureSocket == INVALID_SOCKET)
+		{
+			closesocket(listenSocket);
+			listenSocket = INVALID_SOCKET;
+		}
+	}
+	if (listenSocket == INVALID_SOCKET)
+	{
+		Platform::cleanup();
+		return 1;
+	}
+	if (!prewarmed)
+		prewarmCaches();
+	Platform::setNonBlocking(listenSocket);
+
+	// Add listening socket to the array
+	addSocket(listenSocket, LISTEN); 
+	if (secureSocket != INVALID_SOCKET)
+	{
+		Platform::setNonBlocking(secureSocket);
+		sockets[addSocket(secureSocket, LISTEN)].secure = true;
+	}
+	Metrics::setConnectionStateProvider(countConnectionStates);
+	Metrics::setListenQueueProvider(sampleListenQueue);
+
+	// Let a future replacement ask for the listener
+	if (!config.handoffSocket.empty())
+	{
+		handoffSocket = ListenerHandoff::openControlSocket(config.handoffSocket);
+		if (handoffSocket == INVALID_SOCKET)
+			cout << "Http Server: Error opening handoff socket " << config.handoffSocket << endl;
+		else
+			addSocket(handoffSocket, HANDOFF);
+	}
+
+	// Accept connections and handles them one by one, until a drain has finished
+	while (!draining || socketsCount > 0)
+	{
+		if (Platform::takeSignal(SIGNAL_SHUTDOWN) && !draining)
+			beginDrain("shutdown requested");
+		if (Platform::takeSignal(SIGNAL_RELOAD))
+			reloadConfig();
+
+		fd_set waitRecv;
+		FD_ZERO(&waitRecv);
+		SOCKET maxSocket = 0; // Highest descriptor, needed by POSIX select()
+
+		// Populate the recv and send sets based on socket states.
+		// A connection with a backlog of unsent output is not read until it drains.
+		for (int i = 0; i < MAX_SOCKETS; i++)
+		{
+			if ((sockets[i].recv == LISTEN) || (sockets[i].recv == RECEIVE && wantsToRead(sockets[i])) || (sockets[i].recv == HANDOFF)
+				|| (sockets[i].recv == HANDSHAKE && sockets[i].send != SEND))
+			{
+				FD_SET(sockets[i].id, &waitRecv);
+				if (sockets[i].id > maxSocket)
+					maxSocket = sockets[i].id;
+			}
+		}
+
+		fd_set waitSend;
+		FD_ZERO(&waitSend);
+		for (int i = 0; i < MAX_SOCKETS; i++)
+		{
+			if (sockets[i].send == SEND)
+			{
+				FD_SET(sockets[i].id, &waitSend);
+				if (sockets[i].id > maxSocket)
+					maxSocket = sockets[i].id;
+			}
+		}
+		// OpenSSL may already hold the next request (read along with an earlier record),
+		// which select() cannot see: don't wait, and treat those connections as readable
+		bool tlsBuffered = false;
+		for (int i = 0; i < MAX_SOCKETS && !tlsBuffered; i++)
+			tlsBuffered = sockets[i].recv == RECEIVE && sockets[i].tls && sockets[i].tls->hasBufferedInput() && wantsToRead(sockets[i]);
+
+		// Wait for activity on sockets (the first argument is ignored by Winsock).
+		// The timeout keeps idle checks and signal handling running on a quiet server.
+		timeval waitTime = { tlsBuffered ? 0 : 1, 0 };
+		int nfd;
+		nfd = select((int)maxSocket + 1, &waitRecv, &waitSend, NULL, &waitTime);
+		if (nfd == SOCKET_ERROR)
+		{
+			int error = Platform::lastSocketError();
+			if (Platform::isInterrupted(error))
+				continue; // A signal arrived; handled at the top of the loop
+			cout << "Http Server: Error at select(): " << error << endl;
+			Platform::cleanup();
+			return 1;
+		}
+		for (int i = 0; i < MAX_SOCKETS && tlsBuffered; i++)
+		{
+			if (sockets[i].recv == RECEIVE && sockets[i].tls && sockets[i].tls->hasBufferedInput()
+				&& wantsToRead(sockets[i]) && !FD_ISSET(sockets[i].id, &waitRecv))
+			{
+				FD_SET(sockets[i].id, &waitRecv);
+				nfd++;
+			}
+		}
+
+		// Pick up files added, changed or removed under the document roots
+		VirtualHosts::instance().refreshIfChanged();
+
+		// Idle timeout check
+		time_t currentTime = time(nullptr);
+		for (int i = 0; i < MAX_SOCKETS; i++)
+		{
+			// Only client connections time out (not the listening or handoff sockets)
+			if ((sockets[i].recv == RECEIVE || sockets[i].recv == HANDSHAKE) && difftime(currentTime, sockets[i].lastActivity) > config.idleTimeoutSeconds)
+			{
+				cout << "Http Server: Closing idle connection (timeout exceeded).\n";
+				Metrics::recordTimeout();
+				closesocket(sockets[i].id);
+				removeSocket(i);
+			}
+		}
+
+		// Forget idle clients once a second
+		static time_t lastSweep = 0;
+		if (currentTime != lastSweep)
+		{
+			lastSweep = currentTime;
+			clientLimits.sweep();
+			VirtualHosts::instance().sweep();
+			// HTTP/2 uploads paused over the memory budget resume once there is room
+			for (int i = 0; i < MAX_SOCKETS; i++)
+			{
+				if (sockets[i].recv == RECEIVE && sockets[i].h2 && sockets[i].h2->holdingWindow())
+					processHttp2(i);
+			}
+		}
+
+		// Record the hot files now and then, so a restart can warm up from them
+		static time_t lastSnapshot = currentTime;
+		if (difftime(currentTime, lastSnapshot) >= config.cacheSnapshotIntervalSeconds)
+		{
+			lastSnapshot = currentTime;
+			saveCacheSnapshot();
+		}
+
+		// Handle recv activity
+		for (int i = 0; i < MAX_SOCKETS && nfd > 0; i++)
+		{
+			// Empty slots keep a stale id that may have been reused by another slot
+			if (sockets[i].recv != EMPTY && FD_ISSET(sockets[i].id, &waitRecv))
+			{
+				nfd--;
+				switch (sockets[i].recv)
+				{
+				case LISTEN:
+					acceptConnection(i);
+					break;
+
+				case RECEIVE:
+					receiveMessage(i);
+					break;
+
+				case HANDSHAKE:
+					continueHandshake(i);
+					break;
+
+				case HANDOFF:
+					handOffListener(i);
+					break;
+				}
+			}
+		}
+		// Handle send activity
+		for (int i = 0; i < MAX_SOCKETS && nfd > 0; i++)
+		{
+			if (sockets[i].send == SEND && FD_ISSET(sockets[i].id, &waitSend))
+			{
+				nfd--;
+				switch (sockets[i].send)
+				{
+				case SEND:
+					if (sockets[i].recv == HANDSHAKE)
+						continueHandshake(i); // The handshake is waiting to write
+					else
+						sendMessage(i);
+					break;
+				}
+			}
+		}
+
+		if (draining)
+			continueDrain(currentTime);
+	}
+
+	// Closing connections and Winsock.
+	saveCacheSnapshot();
+	cout << "Http Server: Closing Connection.\n";
+	ListenerHandoff::closeControlSocket(INVALID_SOCKET, config.handoffSocket, handedOff);
+	Platform::cleanup();
+	return 0;
+}
+
+// Creates, binds and listens on a server socket; INVALID_SOCKET on error
+SOCKET openListener(int port)
+{
+	// Create a listening socket
+	SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	if (INVALID_SOCKET == listenSocket)
+	{
+		cout << "Http Server: Error at socket(): " << Platform::lastSocketError() << endl;
+		return INVALID_SOCKET;
+	}
+
+	Platform::setReuseAddress(listenSocket);
+	SocketOptions::applyToListener(listenSocket, config.tcp);
+
+	// Configure the server address
+	sockaddr_in serverService;
+	serverService.sin_family = AF_INET;
+	serverService.sin_addr.s_addr = INADDR_ANY;
+	serverService.sin_port = htons((unsigned short)port);
+
+	// Bind the socket to the port
+	if (SOCKET_ERROR == bind(listenSocket, (SOCKADDR*)&serverService, sizeof(serverService)))
+	{
+		cout << "Http Server: Error at bind(): " << Platform::lastSocketError() << endl;
+		closesocket(listenSocket);
+		return INVALID_SOCKET;
+	}
+
+	// Listen on the Socket for incoming connections.
+	// The backlog is how many completed connections may wait for accept()
+	if (SOCKET_ERROR == listen(listenSocket, config.listenBacklog))
+	{
+		cout << "Http Server: Error at listen(): " << Platform::lastSocketError() << endl;
+		closesocket(listenSocket);
+		return INVALID_SOCKET;
+	}
+	return listenSocket;
+}
+
+// Applies the settings that can change while running
+void applyConfig(const ServerConfig& settings)
+{
+	if (!settings.documentRoot.empty())
+		Platform::setDocumentRoot(settings.documentRoot);
+	connectionLimit = MAX_SOCKETS - 1;
+	if (settings.maxConnections > 0 && settings.maxConnections < connectionLimit)
+		connectionLimit = settings.maxConnections;
+	clientLimits.configure(settings.maxConnectionsPerClient, settings.clientRequestsPerSecond, settings.clientRequestBurst);
+	MemoryBudget::instance().setLimit(settings.memoryLimit);
+	VirtualHosts::instance().configure(settings);
+}
+
+// Frees cached file bodies for the memory budget, taking from each site in turn
+size_t reclaimCacheMemory(size_t bytes)
+{
+	size_t freed = 0;
+	for (const unique_ptr<VirtualHost>& site : VirtualHosts::instance().allSites())
+	{
+		if (freed >= bytes)
+			break;
+		freed += site->cache.shrink(bytes - freed);
+	}
+	return freed;
+}
+
+// Re-reads the configuration file (SIGHUP). Caches and open connections are kept;
+// a file with errors leaves the running configuration untouched.
+void reloadConfig()
+{
+	if (configPath.empty())
+	{
+		cout << "Http Server: Reload requested, but no configuration file was given.\n";
+		return;
+	}
+	ServerConfig next;
+	string error;
+	if (!next.loadFile(configPath, error))
+	{
+		cout << "Http Server: Reload failed, keeping the current configuration: " << error << endl;
+		return;
+	}
+
+	// The listener is already bound: these take a restart (or a handoff to a new process)
+	if (next.port != config.port || next.listenBacklog != config.listenBacklog || next.handoffSocket != config.handoffSocket
+		|| next.tls.port != config.tls.port)
+		cout << "Http Server: port, tls_port, listen_backlog and handoff_socket changes apply after a restart.\n";
+	next.port = config.port;
+	next.tls.port = config.tls.port;
+	next.listenBacklog = config.listenBacklog;
+	next.handoffSocket = config.handoffSocket;
+
+	// A renewed certificate is picked up here. The new context starts with an empty
+	// session cache and new ticket keys, so clients make one full handshake again.
+	if (next.tls.port != 0 && !TlsContext::instance().configure(next.tls, next.http2, error))
+	{
+		cout << "Http Server: Keeping the current TLS certificate: " << error << endl;
+		next.tls = config.tls;
+	}
+
+	config = next;
+	applyConfig(config);
+
+	// Connections accepted from now on pick up changed TCP settings from the listener
+	for (int i = 0; i < MAX_SOCKETS; i++)
+	{
+		if (sockets[i].recv == LISTEN)
+			SocketOptions::applyToListener(sockets[i].id, config.tcp);
+	}
+	cout << "Http Server: Configuration reloaded from " << configPath << endl;
+}
+
+// Stops accepting and closes idle keep-alive connections; requests in flight
+// are finished by the main loop, which exits once no connection is left
+void beginDrain(const char* reason)
+{
+	cout << "Http Server: Draining connections (" << reason << ").\n";
+	draining = true;
+	drainDeadline = time(nullptr) + config.drainTimeoutSeconds;
+	for (int i = 0; i < MAX_SOCKETS; i++)
+	{
+		if (sockets[i].recv == LISTEN)
+		{
+			closesocket(sockets[i].id);
+			removeSocket(i);
+		}
+		else if (sockets[i].recv == HANDOFF)
+		{
+			ListenerHandoff::closeControlSocket(sockets[i].id, config.handoffSocket, true);
+			removeSocket(i);
+		}
+		else if (sockets[i].h2)
+		{
+			sockets[i].h2->goAway(); // The client opens no more streams on this connection
+			sockets[i].send = SEND;
+		}
+	}
+	continueDrain(time(nullptr));
+}
+
+// Closes connections with nothing in flight; after the drain timeout, closes the rest
+void continueDrain(time_t currentTime)
+{
+	bool expired = currentTime >= drainDeadline;
+	for (int i = 0; i < MAX_SOCKETS; i++)
+	{
+		if (sockets[i].recv != RECEIVE && sockets[i].recv != HANDSHAKE)
+			continue;
+		bool idle = sockets[i].recv == HANDSHAKE
+			|| (sockets[i].output.empty() && sockets[i].len == 0 && (!sockets[i].h2 || sockets[i].h2->idle()));
+		if (idle || expired)
+		{
+			closesocket(sockets[i].id);
+			removeSocket(i);
+		}
+	}
+}
+
+// A new server process connected to the handoff socket: give it the listeners and drain
+void handOffListener(int index)
+{
+	SOCKET listenSocket = INVALID_SOCKET;
+	SOCKET secureSocket = INVALID_SOCKET;
+	for (int i = 0; i < MAX_SOCKETS; i++)
+	{
+		if (sockets[i].recv == LISTEN)
+			(sockets[i].secure ? secureSocket : listenSocket) = sockets[i].id;
+	}
+	if (listenSocket == INVALID_SOCKET || !ListenerHandoff::sendListener(sockets[index].id, listenSocket, secureSocket))
+	{
+		cout << "Http Server: Listener handoff failed, still serving.\n";
+		return;
+	}
+	cout << "Http Server: Listening socket handed to the new server.\n";
+	handedOff = true;
+	beginDrain("handed off to a new process");
+}
+
+// Loads the files of the last cache snapshot, within the configured time budget
+void prewarmCaches()
+{
+	if (config.cacheSnapshot.empty() || config.cachePrewarmBudgetMs == 0)
+		return;
+	uint64_t start = Metrics::now();
+	size_t warmed = CacheSnapshot::prewarm(config.cacheSnapshot, config.cachePrewarmBudgetMs);
+	cout << "Http Server: Prewarmed " << warmed << " files from " << config.cacheSnapshot << " in "
+		<< (Metrics::now() - start) / 1000000 << " ms.\n";
+}
+
+void saveCacheSnapshot()
+{
+	if (!config.cacheSnapshot.empty() && !CacheSnapshot::save(config.cacheSnapshot, (size_t)config.cacheSnapshotFiles))
+		cout << "Http Server: Error writing cache snapshot " << config.cacheSnapshot << endl;
+}
+
+// Adds a new socket to the array; returns its slot, or -1 if the array is full
+int addSocket(SOCKET id, int what)
+{
+	for (int i = 0; i < MAX_SOCKETS; i++)
+	{
+		if (sockets[i].recv == EMPTY)
+		{
+			sockets[i].id = id;
+			sockets[i].recv = what;
+			sockets[i].send = IDLE;
+			sockets[i].len = 0;
+			resizeBuffer(sockets[i], MAX_MESSAGE_SIZE);
+			sockets[i].lastActivity = time(nullptr);
+			sockets[i].closeAfterSend = false;
+			sockets[i].clientAddress = 0;
+			sockets[i].output.clear();
+			sockets[i].corked = false;
+			sockets[i].secure = false;
+			sockets[i].tls.reset();
+			sockets[i].h2.reset();
+			sockets[i].receivedTicks = 0;
+			sockets[i].unsent.clear();
+			if (what == RECEIVE || what == HANDSHAKE)
+				socketsCount++;
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Removes a socket from the array
+void removeSocket(int index)
+{
+	if (sockets[index].clientAddress != 0)
+		clientLimits.closeConnection(sockets[index].clientAddress);
+	if (sockets[index].recv == RECEIVE || sockets[index].recv == HANDSHAKE)
+		socketsCount--;
+	sockets[index].recv = EMPTY;
+	sockets[index].send = EMPTY;
+	sockets[index].len = 0;
+	resizeBuffer(sockets[index], MAX_MESSAGE_SIZE); // Frees a buffer grown for a large request
+	sockets[index].output.clear(); // Releases cached bodies and open files
+	sockets[index].tls.reset();
+	sockets[index].h2.reset();
+	sockets[index].unsent.clear();
+}
+
+// Accepts the connections waiting on the listener. At most accept_batch are taken per
+// loop iteration, so a connection storm empties the queue quickly without starving
+// the requests of connections already open; the rest are picked up on the next pass.
+void acceptConnection(int index)
+{
+	SOCKET id = sockets[index].id;
+	int accepted = 0;
+	for (int attempt = 0; attempt < config.acceptBatch; attempt++)
+	{
+		struct sockaddr_in from;		// Address of sending partner
+		SOCKET msgSocket = Platform::acceptNonBlocking(id, from);
+		if (INVALID_SOCKET == msgSocket)
+		{
+			int error = Platform::lastSocketError();
+			if (Platform::isWouldBlock(error))
+				break; // Queue is empty
+			if (Platform::isOutOfDescriptors(error))
+			{
+				// Close one waiting client rather than spin on a listener that stays readable
+				cout << "Http Server: Out of file descriptors, shedding a connection.\n";
+				Platform::shedPendingConnection(id);
+				Metrics::recordAcceptShed();
+				break;
+			}
+			// Aborted handshakes and the like only lose that one connection
+			cout << "Http Server: Error at accept(): " << error << endl;
+			continue;
+		}
+		//cout << "Http Server: Client " << inet_ntoa(from.sin_addr) << ":" << ntohs(from.sin_port) << " is connected." << endl;
+		accepted++;
+		admitConnection(msgSocket, from, sockets[index].secure);
+	}
+	Metrics::recordAcceptBatch(accepted, accepted == config.acceptBatch);
+}
+
+// Applies admission control to an accepted, non-blocking socket and adds it to the array.
+// An HTTPS connection starts in the HANDSHAKE state.
+void admitConnection(SOCKET msgSocket, const sockaddr_in& from, bool secure)
+{
+	SocketOptions::applyToConnection(msgSocket, config.tcp);
+
+	// Admission control: a global cap on connections, then a per-client cap
+	uint32_t clientAddress = ntohl(from.sin_addr.s_addr);
+	bool admitted = socketsCount < connectionLimit;
+#ifndef _WIN32
+	admitted = admitted && msgSocket < FD_SETSIZE;
+#endif
+	if (!admitted)
+	{
+		cout << "\t\tToo many connections, refused with 503!\n";
+		rejectConnection(msgSocket, secure);
+		return;
+	}
+	if (!clientLimits.tryOpenConnection(clientAddress))
+	{
+		cout << "\t\tToo many connections from one client, refused with 503!\n";
+		rejectConnection(msgSocket, secure);
+		return;
+	}
+
+	unique_ptr<TlsSession> session;
+	if (secure && !(session = TlsContext::instance().accept(msgSocket)))
+	{
+		clientLimits.closeConnection(clientAddress);
+		Metrics::recordTlsHandshake(false, false, false);
+		closesocket(msgSocket);
+		return;
+	}
+
+	int slot = addSocket(msgSocket, secure ? HANDSHAKE : RECEIVE);
+	if (slot < 0)
+	{
+		clientLimits.closeConnection(clientAddress);
+		cout << "\t\tToo many connections, dropped!\n";
+		rejectConnection(msgSocket, secure);
+		return;
+	}
+	sockets[slot].clientAddress = clientAddress;
+	if (secure)
+	{
+		sockets[slot].tls = std::move(session);
+		continueHandshake(slot); // The ClientHello is often here already
+	}
+}
+
+// Advances a TLS handshake; once done, the connection reads requests like any other.
+// While OpenSSL waits to write, the socket is watched for writability instead.
+void continueHandshake(int index)
+{
+	SocketState& socket = sockets[index];
+	TlsStatus status = socket.tls->handshake();
+	socket.lastActivity = time(nullptr);
+	if (status == TLS_WANT_READ || status == TLS_WANT_WRITE)
+	{
+		socket.send = status == TLS_WANT_WRITE ? SEND : IDLE;
+		return;
+	}
+	bool succeeded = status == TLS_OK;
+	Metrics::recordTlsHandshake(succeeded, succeeded && socket.tls->resumed(), succeeded && socket.tls->kernelSend());
+	if (!succeeded)
+	{
+		cout << "Http Server: TLS handshake failed.\n";
+		closesocket(socket.id);
+		removeSocket(index);
+		return;
+	}
+	socket.recv = RECEIVE;
+	socket.send = IDLE;
+	if (config.http2 && socket.tls->protocol() == "h2")
+		startHttp2(index, H2_ALPN);
+}
+
+// Answers a connection that is not admitted with 503 and closes it. The reply is
+// small enough for the empty socket send buffer, so one non-blocking send suffices.
+// An HTTPS client could not read a plain reply, so it is only closed.
+void rejectConnection(SOCKET msgSocket, bool secure)
+{
+	static const string busyResponse = HttpResponse::createServiceUnavailableResponse(1).toString();
+	Metrics::recordAcceptDrop();
+	if (!secure)
+	{
+		Metrics::recordRequest(METHOD_UNKNOWN, 503);
+		send(msgSocket, busyResponse.data(), (int)busyResponse.size(), 0);
+	}
+	closesocket(msgSocket);
+}
+
+// Handles incoming messages
+void receiveMessage(int index)
+{
+	SOCKET msgSocket = sockets[index].id;
+	int len = sockets[index].len;
+	char* into = &sockets[index].buffer[len];
+	int space = (int)sockets[index].buffer.size() - len - 1;
+
+	int bytesRecv;
+	if (sockets[index].tls)
+	{
+		// Decrypted by OpenSSL; an incomplete record is not an error, just nothing yet
+		TlsStatus status;
+		long long count = sockets[index].tls->read(into, (size_t)space, status);
+		if (count < 0 && (status == TLS_WANT_READ || status == TLS_WANT_WRITE))
+			return;
+		if (count < 0 && status == TLS_FAILED)
+		{
+			cout << "Http Server: TLS error at read.\n";
+			closesocket(msgSocket);
+			removeSocket(index);
+			return;
+		}
+		bytesRecv = count < 0 ? 0 : (int)count;
+	}
+	else
+		bytesRecv = recv(msgSocket, into, space, 0);
+	if (bytesRecv == SOCKET_ERROR)
+	{
+		int error = Platform::lastSocketError();
+		if (Platform::isWouldBlock(error))
+		{
+			return;
+		}
+		cout << "Http Server: Error at recv(): " << error << endl;
+		closesocket(msgSocket);
+		removeSocket(index);
+		return;
+	}
+	if (bytesRecv == 0)
+	{
+		cout << "Http Server: Client disconnected.\n";
+		if (!sockets[index].output.empty())
+		{
+			// Half-closed after pipelining: still deliver the queued responses
+			sockets[index].closeAfterSend = true;
+			sockets[index].len = 0;
+			return;
+		}
+		closesocket(msgSocket);
+		removeSocket(index);
+		return;
+	}
+	sockets[index].buffer[len + bytesRecv] = '\0'; // Null-terminate the string
+	if (sockets[index].h2)
+		cout << "Http Server: Received: " << bytesRecv << " bytes of HTTP/2 frames.\n";
+	else
+		cout << "Http Server: Received: " << bytesRecv << " bytes of \"" << &sockets[index].buffer[len] << "\" message.\n";
+	sockets[index].len += bytesRecv;
+	sockets[index].receivedTicks = PhaseTrace::ticks();
+	TRACE_PROBE2(request__received, index, bytesRecv);
+	Metrics::addBytesIn(bytesRecv);
+	//update last activity
+	sockets[index].lastActivity = time(nullptr);
+
+	processRequests(index);
+}
+
+// Whether select() should watch a connection for requests. Reading stops while the
+// unsent output is at the high-water mark (a client pipelining requests without
+// reading the responses), when the buffer is full, and once the connection is closing.
+// Over the memory budget, connections with responses still to send are not read
+// until those are sent, so they do not queue more.
+bool wantsToRead(const SocketState& socket)
+{
+	return !socket.closeAfterSend
+		&& socket.output.pendingBytes() < config.outputHighWater
+		&& (socket.output.empty() || !MemoryBudget::instance().overLimit())
+		&& socket.len < (int)socket.buffer.size() - 1;
+}
+
+// Resizes a receive buffer, keeping the bytes received, and counts it in the memory
+// budget. Growing past MAX_MESSAGE_SIZE fails if the budget has no room for it.
+bool resizeBuffer(SocketState& socket, size_t size)
+{
+	size_t current = socket.buffer.size();
+	MemoryBudget& budget = MemoryBudget::instance();
+	if (size > current)
+	{
+		if (size <= MAX_MESSAGE_SIZE)
+			budget.add(MEMORY_RECEIVE_BUFFERS, size - current);
+		else if (!budget.reserve(MEMORY_RECEIVE_BUFFERS, size - current))
+			return false;
+		socket.buffer.resize(size);
+	}
+	else if (size < current)
+	{
+		vector<char> smaller(size);
+		memcpy(smaller.data(), socket.buffer.data(), min((size_t)socket.len + 1, size));
+		socket.buffer.swap(smaller);
+		budget.release(MEMORY_RECEIVE_BUFFERS, current - size);
+	}
+	return true;
+}
+
+// Answers the complete requests in the buffer, in order, and keeps what follows them
+// (the start of the next request) for the next recv
+void processRequests(int index)
+{
+	SocketState& socket = sockets[index];
+	if (socket.h2)
+	{
+		processHttp2(index);
+		return;
+	}
+	// HTTP/2 with prior knowledge: the client preface comes instead of a request
+	if (config.http2 && socket.len > 0)
+	{
+		Http2Preface preface = Http2Connection::detectPreface(string_view(socket.buffer.data(), socket.len));
+		if (preface == H2_PREFACE_PARTIAL)
+			return;
+		if (preface == H2_PREFACE_YES)
+		{
+			startHttp2(index, H2_PRIOR_KNOWLEDGE);
+			processHttp2(index);
+			return;
+		}
+	}
+
+	size_t consumed = 0;
+	bool awaitingLarge = false;
+	while (!socket.closeAfterSend && !socket.h2 && socket.output.pendingBytes() < config.outputHighWater
+		&& (socket.output.empty() || !MemoryBudget::instance().overLimit()))
+	{
+		string_view pending(socket.buffer.data() + consumed, socket.len - consumed);
+		size_t length = HttpRequest::messageLength(pending);
+		if (length == 0)
+		{
+			// A body that does not fit: make room for the whole request, up to max_request_size
+			size_t expected = HttpRequest::expectedLength(pending);
+			if (expected >= socket.buffer.size() && expected <= config.maxRequestSize)
+			{
+				memmove(socket.buffer.data(), socket.buffer.data() + consumed, socket.len - consumed);
+				socket.len -= (int)consumed;
+				consumed = 0;
+				if (!resizeBuffer(socket, expected + 1))
+				{
+					cout << "Http Server: No memory left in the budget for a large request. Closing connection.\n";
+					Metrics::recordRequest(METHOD_UNKNOWN, 503);
+					queueResponse(index, 0, HttpResponse::createServiceUnavailableResponse(1), true);
+					socket.closeAfterSend = true;
+					break;
+				}
+				awaitingLarge = true;
+				break;
+			}
+			// A request larger than the buffer can never complete
+			if (consumed == 0 && socket.len >= (int)socket.buffer.size() - 1)
+			{
+				cout << "Http Server: Request too large for the buffer. Closing connection.\n";
+				answerRequest(index, string());
+			}
+			break;
+		}
+		answerRequest(index, string(pending.substr(0, length)));
+		consumed += length;
+	}
+
+	if (socket.closeAfterSend)
+		socket.len = 0; // Nothing after the last answered request is read
+	else if (consumed > 0)
+	{
+		socket.len -= (int)consumed;
+		memmove(socket.buffer.data(), socket.buffer.data() + consumed, socket.len);
+		socket.buffer[socket.len] = '\0';
+	}
+	// The large request was answered: give the memory back
+	if (!awaitingLarge && socket.buffer.size() > MAX_MESSAGE_SIZE && socket.len < (int)MAX_MESSAGE_SIZE)
+		resizeBuffer(socket, MAX_MESSAGE_SIZE);
+	if (socket.h2)
+	{
+		processHttp2(index); // Upgraded: what follows the request is the client preface
+		return;
+	}
+	if (!socket.output.empty())
+		socket.send = SEND;
+}
+
+// Switches a connection to HTTP/2 and queues the server preface
+void startHttp2(int index, Http2Start start)
+{
+	sockets[index].h2.reset(new Http2Connection(sockets[index].output));
+	sockets[index].h2->start();
+	Metrics::recordHttp2Connection(start);
+}
+
+// Feeds the received bytes to the HTTP/2 connection, answers the requests it has
+// completed and queues response data as far as flow control allows
+void processHttp2(int index)
+{
+	SocketState& socket = sockets[index];
+	Http2Connection& h2 = *socket.h2;
+	if (socket.len > 0)
+	{
+		if (!h2.receive(socket.buffer.data(), socket.len))
+		{
+			cout << "Http Server: HTTP/2 protocol error. Closing connection.\n";
+			socket.closeAfterSend = true;
+		}
+		socket.len = 0;
+	}
+
+	uint32_t streamId;
+	string rawRequest;
+	while (!socket.closeAfterSend && h2.nextRequest(streamId, rawRequest))
+		answerRequest(index, rawRequest, streamId);
+	if (draining)
+		h2.goAway();
+	h2.resumeFlowControl();
+	h2.pump();
+	if (h2.finished())
+		socket.closeAfterSend = true;
+	if (!socket.output.empty() || socket.closeAfterSend)
+		socket.send = SEND; // Also when closing with nothing left to send: sendMessage closes it
+}
+
+// Queues a response on the connection, or on its stream for HTTP/2
+void queueResponse(int index, uint32_t streamId, const HttpResponse& response, bool includeBody)
+{
+	if (sockets[index].h2)
+		sockets[index].h2->respond(streamId, response, includeBody);
+	else
+		response.queueTo(sockets[index].output, includeBody);
+}
+
+// Parses one request and queues its response. On HTTP/2, streamId is the request's
+// stream and only that stream is affected by errors.
+void answerRequest(int index, const string& rawRequest, uint32_t streamId)
+{
+	bool http2 = sockets[index].h2 != nullptr;
+	uint64_t trace = 0;
+	if (PhaseTrace::enabled())
+	{
+		trace = PhaseTrace::begin(index, sockets[index].receivedTicks);
+		sockets[index].unsent.push_back(trace);
+	}
+
+	// Parse and handle the request
+	HttpRequest request;
+	uint64_t parseStart = Metrics::now();
+	TRACE_PROBE2(parse__start, index, rawRequest.size());
+	bool parseSuccess = request.handleRequest(rawRequest);
+	TRACE_PROBE3(parse__done, index, (int)request.getMethod(), parseSuccess);
+	Metrics::recordPhase(PHASE_PARSE, Metrics::now() - parseStart);
+	PhaseTrace::stamp(trace, TRACE_PARSED);
+
+	if (!parseSuccess)
+	{
+		// 400 Bad Request
+		HttpResponse badRequest = HttpResponse::createBadRequestResponse();
+		Metrics::recordRequest(request.getMethod(), badRequest.getStatusCode());
+		PhaseTrace::describe(trace, request.getMethod(), badRequest.getStatusCode());
+		queueResponse(index, streamId, badRequest, true);
+		PhaseTrace::stamp(trace, TRACE_QUEUED);
+		if (!http2)
+			sockets[index].closeAfterSend = true; // Close after sending error response
+		return;
+	}
+
+	// "Upgrade: h2c": switch after a 101 response; this request is answered on stream 1
+	string_view http2Settings = request.getHeader("HTTP2-Settings");
+	if (!http2 && config.http2 && !sockets[index].tls && !draining && !http2Settings.empty()
+		&& HttpHeaders::hasToken(request.getHeader("Upgrade"), "h2c")
+		&& (request.getMethod() == METHOD_GET || request.getMethod() == METHOD_HEAD || request.getMethod() == METHOD_OPTIONS))
+	{
+		unique_ptr<Http2Connection> upgraded(new Http2Connection(sockets[index].output));
+		if (upgraded->acceptUpgrade(http2Settings))
+		{
+			sockets[index].output.append(string("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n"));
+			upgraded->start();
+			sockets[index].h2 = std::move(upgraded);
+			Metrics::recordHttp2Connection(H2_UPGRADE);
+			http2 = true;
+			streamId = 1;
+		}
+	}
+
+	// Per-client request rate limit (the site's own, if it sets one); the connection stays open
+	VirtualHost& site = request.getVirtualHost();
+	ClientLimits& requestLimits = site.limitRequests ? site.requestLimits : clientLimits;
+	if (!requestLimits.tryAcquireRequest(sockets[index].clientAddress))
+	{
+		HttpResponse limited = HttpResponse::createTooManyRequestsResponse(requestLimits.retryAfterSeconds());
+		Metrics::recordRateLimited();
+		Metrics::recordRequest(request.getMethod(), limited.getStatusCode());
+		PhaseTrace::describe(trace, request.getMethod(), limited.getStatusCode());
+		queueResponse(index, streamId, limited, request.getMethod() != METHOD_HEAD);
+		PhaseTrace::stamp(trace, TRACE_QUEUED);
+		if (!http2)
+			sockets[index].closeAfterSend = request.wantsClose();
+		return;
+	}
+
+	// Generate response based on request
+	uint64_t handlerStart = Metrics::now();
+	TRACE_PROBE2(handler__start, index, (int)request.getMethod());
+	HttpResponse response = request.handlePerMethodRequest();
+	TRACE_PROBE3(handler__done, index, (int)request.getMethod(), response.getStatusCode());
+	PhaseTrace::stamp(trace, TRACE_HANDLED);
+	PhaseTrace::describe(trace, request.getMethod(), response.getStatusCode());
+	if (draining)
+		response.setConnection("close"); // Tell the client before the connection goes away
+	// Headers are serialized here; cached bodies and files are queued by reference
+	queueResponse(index, streamId, response, request.getMethod() != METHOD_HEAD);
+	TRACE_PROBE3(response__queued, index, response.getStatusCode(), sockets[index].output.pendingBytes());
+	PhaseTrace::stamp(trace, TRACE_QUEUED);
+	Metrics::recordPhase(PHASE_HANDLER, Metrics::now() - handlerStart);
+	Metrics::recordRequest(request.getMethod(), response.getStatusCode());
+
+	// A pipelined request after this one must see the file it wrote or removed
+	if (request.getMethod() == METHOD_PUT || request.getMethod() == METHOD_DELETE)
+		VirtualHosts::instance().refreshIfChanged();
+
+	
+	if (!http2 && (request.wantsClose() || draining))
+	{
+		sockets[index].closeAfterSend = true; // Mark for closure
+	}
+}
+
+// Writes queued output until the queue is empty or the socket buffer is full
+void sendMessage(int index)
+{
+	SOCKET msgSocket = sockets[index].id;
+	Http2Connection* h2 = sockets[index].h2.get();
+	if (h2)
+		h2->pump(); // DATA frames the flow control windows allow by now
+	uint64_t bytesSent = 0;
+	uint64_t sendStart = Metrics::now();
+	TRACE_PROBE2(send__start, index, sockets[index].output.pendingBytes());
+	bool sendSuccess = sockets[index].output.flush(msgSocket, bytesSent, sockets[index].tls.get());
+	TRACE_PROBE3(send__done, index, bytesSent, sendSuccess);
+	Metrics::recordPhase(PHASE_SEND, Metrics::now() - sendStart);
+	if (!sendSuccess)
+	{
+		cout << "Http Server: Error at send(): " << Platform::lastSocketError() << endl;
+		closesocket(msgSocket);
+		removeSocket(index);
+		return;
+	}
+	if (bytesSent > 0)
+	{
+		cout << "Http Server: Sent: " << bytesSent << " bytes of response.\n";
+		Metrics::addBytesOut(bytesSent);
+		sockets[index].lastActivity = time(nullptr);
+	}
+
+	// The send buffer is full: finish on the next writable event. Corking until then
+	// keeps the kernel from pushing each partial write as its own short segment.
+	// HTTP/2 refills a drained queue with the next frames and stays in SEND.
+	if (h2 && sockets[index].output.empty())
+		h2->pump();
+	if (!sockets[index].output.empty())
+	{
+		if (config.tcp.cork && !sockets[index].corked)
+		{
+			SocketOptions::setCork(msgSocket, true);
+			sockets[index].corked = true;
+		}
+		return;
+	}
+	if (sockets[index].corked)
+	{
+		SocketOptions::setCork(msgSocket, false); // Pushes the last segment
+		sockets[index].corked = false;
+	}
+	// Every queued response has reached the socket
+	for (uint64_t trace : sockets[index].unsent)
+		PhaseTrace::stamp(trace, TRACE_SENT);
+	sockets[index].unsent.clear();
+
+	// Check if the connection should be closed after sending
+	if (sockets[index].closeAfterSend)
+	{
+		cout << "Http Server: Closing connection after send.\n";
+		closesocket(msgSocket);
+		removeSocket(index);
+		return;
+	}
+
+	// Answer pipelined requests that waited for the queue to drain
+	sockets[index].send = IDLE;
+	processRequests(index);
+}
+
+// Accept queue depth of the listener and the host's overflow counters, for the metrics endpoint
+ListenQueueStats sampleListenQueue()
+{
+	ListenQueueStats stats;
+	for (int i = 0; i < MAX_SOCKETS; i++)
+	{
+		uint32_t length, limit;
+		if (sockets[i].recv == LISTEN && Platform::listenQueueDepth(sockets[i].id, length, limit))
+		{
+			// With an HTTPS listener too, both queues add up
+			stats.depthKnown = true;
+			stats.length += length;
+			stats.limit += limit;
+		}
+	}
+	stats.overflowsKnown = Platform::listenOverflowCounts(stats.overflows, stats.drops);
+	return stats;
+}
+
+// Counts sockets per state for the metrics endpoint
+ConnectionStateCounts countConnectionStates()
+{
+	ConnectionStateCounts counts;
+	for (int i = 0; i < MAX_SOCKETS; i++)
+	{
+		if (sockets[i].recv == LISTEN)
+			counts.listen++;
+		else if (sockets[i].recv == HANDSHAKE)
+			counts.handshake++;
+		else if (sockets[i].recv == RECEIVE)
+			counts.receive++;
+
+		if (sockets[i].send == SEND)
+			counts.send++;
+		else if (sockets[i].send == IDLE && sockets[i].recv == RECEIVE)
+			counts.idle++;
+	}
+	return counts;
+}
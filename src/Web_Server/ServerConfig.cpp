@@ -0,0 +1,336 @@
+#include "ServerConfig.h"
+#include <cstdlib>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+
+using std::ifstream;
+using std::to_string;
+
+static string trim(const string& text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == string::npos)
+        return "";
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+static bool parseInt(const string& text, int minimum, int maximum, int& value)
+{
+    char* end = nullptr;
+    long parsed = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || parsed < minimum || parsed > maximum)
+        return false;
+    value = (int)parsed;
+    return true;
+}
+
+static bool parseDouble(const string& text, double minimum, double& value)
+{
+    char* end = nullptr;
+    double parsed = strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || !(parsed >= minimum))
+        return false;
+    value = parsed;
+    return true;
+}
+
+// Byte count with an optional K, M or G suffix
+static bool parseSize(const string& text, size_t& value)
+{
+    char* end = nullptr;
+    unsigned long long parsed = strtoull(text.c_str(), &end, 10);
+    if (text.empty() || !isdigit((unsigned char)text[0]))
+        return false;
+    int shift = 0;
+    switch (toupper((unsigned char)*end))
+    {
+    case 'K': shift = 10; end++; break;
+    case 'M': shift = 20; end++; break;
+    case 'G': shift = 30; end++; break;
+    }
+    if (*end != '\0' || parsed > (SIZE_MAX >> shift))
+        return false;
+    value = (size_t)(parsed << shift);
+    return true;
+}
+
+static bool parseBool(const string& text, bool& value)
+{
+    if (text == "on" || text == "yes" || text == "true" || text == "1")
+        value = true;
+    else if (text == "off" || text == "no" || text == "false" || text == "0")
+        value = false;
+    else
+        return false;
+    return true;
+}
+
+// Byte count that fits a socket option
+static bool parseSocketSize(const string& text, int& value)
+{
+    size_t size;
+    if (!parseSize(text, size) || size > (size_t)INT32_MAX)
+        return false;
+    value = (int)size;
+    return true;
+}
+
+// Comma or space separated host names, lowercased, with any trailing dot removed
+static bool parseHostNames(const string& text, vector<string>& names)
+{
+    names.clear();
+    string name;
+    for (size_t i = 0; i <= text.size(); i++)
+    {
+        char c = i < text.size() ? text[i] : ',';
+        if (c == ',' || c == ' ' || c == '\t')
+        {
+            if (!name.empty() && name.back() == '.')
+                name.pop_back();
+            if (!name.empty())
+                names.push_back(name);
+            name.clear();
+        }
+        else if (isalnum((unsigned char)c) || c == '-' || c == '.' || c == '_')
+            name += (char)tolower((unsigned char)c);
+        else
+            return false;
+    }
+    return !names.empty();
+}
+
+// Settings allowed inside a [vhost] section
+static bool parseVirtualHostSetting(const string& key, const string& value, VirtualHostConfig& site, bool& known)
+{
+    known = true;
+    if (key == "hosts")
+        return parseHostNames(value, site.hostNames);
+    if (key == "document_root")
+    {
+        site.documentRoot = value;
+        return !value.empty();
+    }
+    if (key == "client_requests_per_second")
+        return parseDouble(value, 0, site.requestsPerSecond);
+    if (key == "client_request_burst")
+        return parseDouble(value, 1, site.requestBurst);
+    if (key == "cache_max_bytes")
+        return parseSize(value, site.cacheMaxBytes);
+    if (key == "cache_max_file_bytes")
+        return parseSize(value, site.cacheMaxFileBytes);
+    known = false;
+    return false;
+}
+
+// A section is complete once it names its hosts and root; host names must not repeat across sections
+static bool checkVirtualHost(const vector<VirtualHostConfig>& sites, string& problem)
+{
+    const VirtualHostConfig& site = sites.back();
+    if (site.hostNames.empty())
+        problem = "[vhost " + site.name + "] needs a hosts setting";
+    else if (site.documentRoot.empty())
+        problem = "[vhost " + site.name + "] needs a document_root setting";
+    for (size_t i = 0; problem.empty() && i + 1 < sites.size(); i++)
+    {
+        if (sites[i].name == site.name)
+            problem = "[vhost " + site.name + "] is defined twice";
+        for (const string& hostName : site.hostNames)
+            for (const string& other : sites[i].hostNames)
+                if (problem.empty() && hostName == other)
+                    problem = "host " + hostName + " is already served by [vhost " + sites[i].name + "]";
+    }
+    return problem.empty();
+}
+
+bool ServerConfig::loadFile(const string& path, string& error)
+{
+    ifstream file(path);
+    if (!file.is_open())
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    string line;
+    int lineNumber = 0;
+    int sectionLine = 0;
+    string problem;
+    virtualHosts.clear();
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        size_t commentPos = line.find('#');
+        if (commentPos != string::npos)
+            line.erase(commentPos);
+        line = trim(line);
+        if (line.empty())
+            continue;
+
+        // "[vhost name]" starts a site; every later setting belongs to it
+        if (line.front() == '[')
+        {
+            if (!virtualHosts.empty() && !checkVirtualHost(virtualHosts, problem))
+            {
+                error = path + ":" + to_string(sectionLine) + ": " + problem;
+                return false;
+            }
+            string header = line.back() == ']' ? trim(line.substr(1, line.size() - 2)) : "";
+            string name = header.compare(0, 6, "vhost ") == 0 ? trim(header.substr(6)) : "";
+            if (name.empty())
+            {
+                error = path + ":" + to_string(lineNumber) + ": expected [vhost name]";
+                return false;
+            }
+            virtualHosts.push_back(VirtualHostConfig());
+            virtualHosts.back().name = name;
+            sectionLine = lineNumber;
+            continue;
+        }
+
+        size_t equalsPos = line.find('=');
+        if (equalsPos == string::npos)
+        {
+            error = path + ":" + to_string(lineNumber) + ": expected key = value";
+            return false;
+        }
+        string key = trim(line.substr(0, equalsPos));
+        string value = trim(line.substr(equalsPos + 1));
+
+        bool valid;
+        if (!virtualHosts.empty())
+        {
+            bool known;
+            valid = parseVirtualHostSetting(key, value, virtualHosts.back(), known);
+            if (!known)
+            {
+                error = path + ":" + to_string(lineNumber) + ": '" + key + "' cannot be set per virtual host";
+                return false;
+            }
+        }
+        else if (key == "port")
+            valid = parseInt(value, 1, 65535, port);
+        else if (key == "listen_backlog")
+            valid = parseInt(value, 1, 65535, listenBacklog);
+        else if (key == "accept_batch")
+            valid = parseInt(value, 1, 4096, acceptBatch);
+        else if (key == "max_connections")
+            valid = parseInt(value, 0, 1 << 20, maxConnections);
+        else if (key == "max_connections_per_client")
+            valid = parseInt(value, 0, 1 << 20, maxConnectionsPerClient);
+        else if (key == "client_requests_per_second")
+            valid = parseDouble(value, 0, clientRequestsPerSecond);
+        else if (key == "client_request_burst")
+            valid = parseDouble(value, 1, clientRequestBurst);
+        else if (key == "idle_timeout_seconds")
+            valid = parseInt(value, 1, 86400, idleTimeoutSeconds);
+        else if (key == "drain_timeout_seconds")
+            valid = parseInt(value, 0, 86400, drainTimeoutSeconds);
+        else if (key == "output_high_water")
+            valid = parseSize(value, outputHighWater) && outputHighWater > 0;
+        else if (key == "max_request_size")
+            valid = parseSize(value, maxRequestSize) && maxRequestSize > 0;
+        else if (key == "max_upload_size")
+            valid = parseSize(value, maxUploadSize);
+        else if (key == "memory_limit")
+            valid = parseSize(value, memoryLimit);
+        else if (key == "document_root")
+        {
+            documentRoot = value;
+            valid = !documentRoot.empty();
+        }
+        else if (key == "handoff_socket")
+        {
+            handoffSocket = value;
+            valid = !handoffSocket.empty();
+        }
+        else if (key == "cache_max_bytes")
+            valid = parseSize(value, cacheMaxBytes);
+        else if (key == "cache_max_file_bytes")
+            valid = parseSize(value, cacheMaxFileBytes);
+        else if (key == "negative_cache_entries")
+            valid = parseInt(value, 0, 1 << 20, negativeCacheEntries);
+        else if (key == "cache_snapshot")
+        {
+            cacheSnapshot = value;
+            valid = !cacheSnapshot.empty();
+        }
+        else if (key == "cache_snapshot_interval_seconds")
+            valid = parseInt(value, 1, 86400, cacheSnapshotIntervalSeconds);
+        else if (key == "cache_snapshot_files")
+            valid = parseInt(value, 1, 1 << 20, cacheSnapshotFiles);
+        else if (key == "cache_prewarm_budget_ms")
+            valid = parseInt(value, 0, 600000, cachePrewarmBudgetMs);
+        else if (key == "tcp_nodelay")
+            valid = parseBool(value, tcp.noDelay);
+        else if (key == "tcp_cork")
+            valid = parseBool(value, tcp.cork);
+        else if (key == "tcp_defer_accept_seconds")
+            valid = parseInt(value, 0, 3600, tcp.deferAcceptSeconds);
+        else if (key == "socket_send_buffer")
+            valid = parseSocketSize(value, tcp.sendBufferBytes);
+        else if (key == "socket_receive_buffer")
+            valid = parseSocketSize(value, tcp.receiveBufferBytes);
+        else if (key == "tcp_fastopen_queue")
+            valid = parseInt(value, 0, 65535, tcp.fastOpenQueue);
+        else if (key == "tcp_notsent_lowat")
+            valid = parseSocketSize(value, tcp.notSentLowWatermark);
+        else if (key == "http2")
+            valid = parseBool(value, http2);
+        else if (key == "dedup_storage")
+            valid = parseBool(value, dedupStorage);
+        else if (key == "tls_port")
+            valid = parseInt(value, 0, 65535, tls.port);
+        else if (key == "tls_certificate")
+        {
+            tls.certificateFile = value;
+            valid = !value.empty();
+        }
+        else if (key == "tls_private_key")
+        {
+            tls.privateKeyFile = value;
+            valid = !value.empty();
+        }
+        else if (key == "tls_ktls")
+            valid = parseBool(value, tls.kernelOffload);
+        else if (key == "tls_session_tickets")
+            valid = parseBool(value, tls.sessionTickets);
+        else if (key == "tls_session_cache_size")
+            valid = parseInt(value, 0, 1 << 24, tls.sessionCacheSize);
+        else
+        {
+            error = path + ":" + to_string(lineNumber) + ": unknown setting '" + key + "'";
+            return false;
+        }
+
+        if (!valid)
+        {
+            error = path + ":" + to_string(lineNumber) + ": invalid value for " + key + ": '" + value + "'";
+            return false;
+        }
+    }
+    if (!virtualHosts.empty() && !checkVirtualHost(virtualHosts, problem))
+    {
+        error = path + ":" + to_string(sectionLine) + ": " + problem;
+        return false;
+    }
+    if (tls.port != 0)
+    {
+        if (tls.certificateFile.empty() || tls.privateKeyFile.empty())
+            error = path + ": tls_port needs tls_certificate and tls_private_key";
+        else if (tls.port == port)
+            error = path + ": tls_port must differ from port";
+        if (!error.empty())
+            return false;
+    }
+    return true;
+}
+
+string ServerConfig::findConfigPath(int argc, char* argv[])
+{
+    if (argc > 1)
+        return argv[1];
+    const char* configured = getenv("WEB_SERVER_CONFIG");
+    return configured != nullptr ? configured : "";
+}
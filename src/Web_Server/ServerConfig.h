@@ -0,0 +1,132 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+using std::string;
+using std::vector;
+
+// TCP options for the listener and accepted connections; a size of 0 keeps the OS default
+struct TcpSettings
+{
+    bool noDelay = true;             // Send small responses at once instead of waiting for ACKs (Nagle)
+    bool cork = true;                // Hold back partial segments while a response needs several sends
+    int deferAcceptSeconds = 0;      // Linux: wake accept() only once the request has arrived
+    int sendBufferBytes = 0;
+    int receiveBufferBytes = 0;
+    int fastOpenQueue = 0;           // Linux: pending TCP Fast Open connections, 0 = off
+    int notSentLowWatermark = 0;     // Linux/macOS: unsent bytes allowed before the socket stops being writable
+};
+
+// HTTPS listener; off while port is 0. Resumption lets returning clients skip the
+// full handshake, and kTLS lets the kernel encrypt so files still go out with sendfile().
+struct TlsSettings
+{
+    int port = 0;
+    string certificateFile;          // PEM, leaf first, then intermediates
+    string privateKeyFile;           // PEM
+    bool kernelOffload = true;       // Linux: hand the record layer to the kernel (kTLS) when it supports the cipher
+    bool sessionTickets = true;
+    int sessionCacheSize = 20480;    // Server-side sessions for ID resumption, 0 = off
+};
+
+// One site served by this process, from a "[vhost name]" section.
+// Requests whose Host header matches one of hostNames are served from documentRoot
+// with their own route index and file cache.
+struct VirtualHostConfig
+{
+    string name;
+    vector<string> hostNames;              // Lowercase, without a port
+    string documentRoot;
+    double requestsPerSecond = -1;         // Per-client rate for this site; -1 = the server-wide limit
+    double requestBurst = 100;
+    size_t cacheMaxBytes = 64 * 1024 * 1024;
+    size_t cacheMaxFileBytes = 1024 * 1024;
+};
+
+// Server settings, read from a "key = value" file ('#' starts a comment).
+// Every setting has a default, so running without a file keeps the old behavior.
+//
+//   port = 80
+//   listen_backlog = 128
+//   accept_batch = 64                 # connections accepted per loop iteration
+//   max_connections = 0               # 0 = as many as the socket table holds
+//   max_connections_per_client = 0    # per IPv4 address, 0 = no per-client limit
+//   client_requests_per_second = 0    # token bucket rate per client, 0 = unlimited
+//   client_request_burst = 100        # token bucket size
+//   idle_timeout_seconds = 120
+//   drain_timeout_seconds = 30        # graceful shutdown: time allowed for in-flight requests
+//   output_high_water = 256K          # unsent bytes at which a connection is no longer read
+//   max_request_size = 1M             # headers plus body; larger requests get 400
+//   max_upload_size = 1G              # Content-Range total of a ranged PUT; larger get 413, 0 = no limit
+//   memory_limit = 256M               # receive buffers, queued responses and file caches together, 0 = no limit
+//   dedup_storage = off               # PUT bodies stored once by SHA-256, names hard-linked to them
+//   http2 = on                        # HTTP/2: h2c with prior knowledge or Upgrade, h2 over TLS (ALPN)
+//   document_root = /var/www/         # default: Platform::documentRoot()
+//   handoff_socket = /run/web_server.sock  # POSIX: Unix socket for passing the listener to a new process
+//   cache_max_bytes = 64M             # file cache of the default site (K/M/G suffixes allowed)
+//   cache_max_file_bytes = 1M
+//   negative_cache_entries = 4096     # per site: paths remembered as missing, 0 = off
+//   cache_snapshot = /var/lib/web_server/hot.bin  # hot files saved periodically and loaded at startup
+//   cache_snapshot_interval_seconds = 300
+//   cache_snapshot_files = 1000       # per site
+//   cache_prewarm_budget_ms = 2000    # startup time allowed for loading them
+//   tcp_nodelay = on
+//   tcp_cork = on
+//   tcp_defer_accept_seconds = 0
+//   socket_send_buffer = 0            # bytes (K/M suffixes allowed), 0 = OS default
+//   socket_receive_buffer = 0
+//   tcp_fastopen_queue = 0
+//   tcp_notsent_lowat = 0
+//   tls_port = 0                      # HTTPS listener, 0 = off; needs tls_certificate and tls_private_key
+//   tls_certificate = /etc/web_server/cert.pem
+//   tls_private_key = /etc/web_server/key.pem
+//   tls_ktls = on                     # Linux: kernel TLS, so sendfile() works over HTTPS
+//   tls_session_tickets = on
+//   tls_session_cache_size = 20480    # 0 = no server-side session cache
+//
+// Further sites follow in sections; requests with any other Host go to the default site:
+//
+//   [vhost blog]
+//   hosts = blog.example.com, www.blog.example.com
+//   document_root = /srv/blog/
+//   client_requests_per_second = 20  # optional; also client_request_burst, cache_max_bytes, cache_max_file_bytes
+class ServerConfig
+{
+public:
+    int port = 80;
+    int listenBacklog = 128;
+    int acceptBatch = 64;   // Connections accepted per loop iteration
+    int maxConnections = 0;
+    int maxConnectionsPerClient = 0;   // Off by default: clients behind one NAT share an address
+    double clientRequestsPerSecond = 0;
+    double clientRequestBurst = 100;
+    int idleTimeoutSeconds = 120;
+    int drainTimeoutSeconds = 30;
+    size_t outputHighWater = 256 * 1024; // A connection with this much unsent is not read from
+    size_t maxRequestSize = 1024 * 1024; // Receive buffers grow up to this for requests with a body
+    size_t maxUploadSize = 1024 * 1024 * 1024; // Largest file a ranged PUT may assemble, 0 = no limit
+    size_t memoryLimit = 256 * 1024 * 1024; // MemoryBudget total, 0 = unlimited
+    bool dedupStorage = false;           // Content-addressed PUT storage (see BlobStore)
+    bool http2 = true;                   // h2c (prior knowledge, Upgrade) and h2 through ALPN
+    string documentRoot;
+    string handoffSocket;
+    size_t cacheMaxBytes = 64 * 1024 * 1024;
+    size_t cacheMaxFileBytes = 1024 * 1024;
+    int negativeCacheEntries = 4096;
+    string cacheSnapshot;                     // Hot-set file; empty = no snapshot or prewarming
+    int cacheSnapshotIntervalSeconds = 300;
+    int cacheSnapshotFiles = 1000;            // Per site
+    int cachePrewarmBudgetMs = 2000;
+    TcpSettings tcp;
+    TlsSettings tls;
+    vector<VirtualHostConfig> virtualHosts;
+
+    // Reads settings from a file over the current values. On failure returns
+    // false and describes the first problem (with its line number) in error.
+    bool loadFile(const string& path, string& error);
+
+    // Config file named on the command line, else $WEB_SERVER_CONFIG, else empty
+    static string findConfigPath(int argc, char* argv[]);
+};
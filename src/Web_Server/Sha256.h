@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+using std::string;
+
+// SHA-256 of a buffer. With OpenSSL (WEB_SERVER_TLS) the digest comes from its
+// EVP code, which uses the CPU's SHA extensions or AVX2 where present; other
+// builds use the portable implementation here.
+class Sha256
+{
+public:
+    static const size_t DIGEST_SIZE = 32;
+
+    static void digest(const void* data, size_t length, uint8_t out[DIGEST_SIZE]);
+
+    // The built-in implementation, used by digest() when OpenSSL is absent
+    static void portableDigest(const void* data, size_t length, uint8_t out[DIGEST_SIZE]);
+
+    // Lowercase hex of the digest (64 characters)
+    static string hex(const void* data, size_t length);
+
+private:
+    static void compress(uint32_t state[8], const uint8_t block[64]);
+};
@@ -0,0 +1,57 @@
+#include "SocketOptions.h"
+
+static void setOption(SOCKET socketId, int level, int name, int value)
+{
+    setsockopt(socketId, level, name, (const char*)&value, sizeof(value));
+}
+
+// Nagle, buffer sizes and the unsent-data watermark: per connection, or on the listener where inherited
+static void applyStreamOptions(SOCKET socketId, const TcpSettings& settings)
+{
+    setOption(socketId, IPPROTO_TCP, TCP_NODELAY, settings.noDelay ? 1 : 0);
+    if (settings.sendBufferBytes > 0)
+        setOption(socketId, SOL_SOCKET, SO_SNDBUF, settings.sendBufferBytes);
+    if (settings.receiveBufferBytes > 0)
+        setOption(socketId, SOL_SOCKET, SO_RCVBUF, settings.receiveBufferBytes);
+#ifdef TCP_NOTSENT_LOWAT
+    if (settings.notSentLowWatermark > 0)
+        setOption(socketId, IPPROTO_TCP, TCP_NOTSENT_LOWAT, settings.notSentLowWatermark);
+#endif
+}
+
+void SocketOptions::applyToListener(SOCKET listenSocket, const TcpSettings& settings)
+{
+#ifdef __linux__
+    applyStreamOptions(listenSocket, settings);
+    setOption(listenSocket, IPPROTO_TCP, TCP_DEFER_ACCEPT, settings.deferAcceptSeconds);
+#else
+    if (settings.receiveBufferBytes > 0)
+        setOption(listenSocket, SOL_SOCKET, SO_RCVBUF, settings.receiveBufferBytes);
+#endif
+#ifdef TCP_FASTOPEN
+    if (settings.fastOpenQueue > 0)
+        setOption(listenSocket, IPPROTO_TCP, TCP_FASTOPEN, settings.fastOpenQueue);
+#endif
+}
+
+void SocketOptions::applyToConnection(SOCKET socketId, const TcpSettings& settings)
+{
+#ifdef __linux__
+    (void)socketId; // Inherited from the listener
+    (void)settings;
+#else
+    applyStreamOptions(socketId, settings);
+#endif
+}
+
+void SocketOptions::setCork(SOCKET socketId, bool corked)
+{
+#if defined(TCP_CORK)
+    setOption(socketId, IPPROTO_TCP, TCP_CORK, corked ? 1 : 0);
+#elif defined(TCP_NOPUSH)
+    setOption(socketId, IPPROTO_TCP, TCP_NOPUSH, corked ? 1 : 0);
+#else
+    (void)socketId;
+    (void)corked;
+#endif
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Platform.h"
+#include "ServerConfig.h"
+
+// Applies TcpSettings to sockets. Options the platform lacks are skipped.
+//
+// On Linux accepted sockets inherit the listener's options (Nagle, buffer
+// sizes, TCP_NOTSENT_LOWAT), so they are set once on the listener and
+// accept() needs no extra system calls; elsewhere they are set per connection.
+class SocketOptions
+{
+public:
+    // Listener options; call before listen() so the receive buffer sets the window scale.
+    // Safe to call again on a listening socket (a reload or a handed-over listener).
+    static void applyToListener(SOCKET listenSocket, const TcpSettings& settings);
+
+    // Options for an accepted connection that are not inherited from the listener
+    static void applyToConnection(SOCKET socketId, const TcpSettings& settings);
+
+    // Holds back partial segments until uncorked (TCP_CORK, TCP_NOPUSH on BSD/macOS).
+    // Uncorking sends what is pending at once. No-op on Windows.
+    static void setCork(SOCKET socketId, bool corked);
+};
@@ -0,0 +1,105 @@
+#include "TarArchive.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+// Zero bytes for member padding and the end-of-archive marker, shared by every archive
+static const shared_ptr<const string>& zeroBlocks()
+{
+    static const shared_ptr<const string> zeros = std::make_shared<const string>(1024, '\0');
+    return zeros;
+}
+
+// Writes value as a NUL-terminated octal number filling field[0, width), zero padded;
+// a value with more than width - 1 digits is written as the largest that fits
+static void writeOctal(char* field, size_t width, uint64_t value)
+{
+    size_t digits = width - 1;
+    if (digits * 3 < 64 && value >> (digits * 3) != 0)
+        value = (1ull << (digits * 3)) - 1;
+    field[digits] = '\0';
+    for (size_t i = digits; i > 0; i--)
+    {
+        field[i - 1] = (char)('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+bool TarArchive::buildHeader(const string& name, uint64_t size, time_t modified, string& header)
+{
+    // Names over 100 bytes go into the prefix field, split at a directory separator
+    string prefix;
+    string member = name;
+    if (member.size() > 100)
+    {
+        size_t slash = name.find('/', name.size() > 101 ? name.size() - 101 : 0);
+        if (slash == string::npos || slash > 155 || name.size() - slash - 1 > 100 || slash == 0)
+            return false;
+        prefix = name.substr(0, slash);
+        member = name.substr(slash + 1);
+    }
+    if (size > 077777777777ull)
+        return false;
+
+    header.assign(BLOCK, '\0');
+    char* block = &header[0];
+    memcpy(block, member.data(), member.size());
+    writeOctal(block + 100, 8, 0644);                           // mode
+    writeOctal(block + 108, 8, 0);                              // uid
+    writeOctal(block + 116, 8, 0);                              // gid
+    writeOctal(block + 124, 12, size);
+    writeOctal(block + 136, 12, modified > 0 ? (uint64_t)modified : 0);
+    block[156] = '0';                                           // Regular file
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+    memcpy(block + 345, prefix.data(), prefix.size());
+
+    // The checksum is computed with its own field set to spaces
+    memset(block + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (size_t i = 0; i < BLOCK; i++)
+        checksum += (unsigned char)block[i];
+    snprintf(block + 148, 8, "%06o", checksum);
+    block[155] = ' ';
+    return true;
+}
+
+bool TarArchive::add(const string& name, time_t modified, const BodyPart& contents)
+{
+    string header;
+    if (!buildHeader(name, contents.length, modified, header))
+        return false;
+    BodyPart headerPart;
+    headerPart.data = std::make_shared<const string>(std::move(header));
+    headerPart.length = BLOCK;
+    parts.push_back(std::move(headerPart));
+    if (contents.length > 0)
+        parts.push_back(contents);
+
+    size_t padding = (size_t)((BLOCK - contents.length % BLOCK) % BLOCK);
+    if (padding > 0)
+    {
+        BodyPart zeros;
+        zeros.data = zeroBlocks();
+        zeros.length = padding;
+        parts.push_back(std::move(zeros));
+    }
+    return true;
+}
+
+bool TarArchive::add(const string& name, time_t modified, const string& contents)
+{
+    BodyPart part;
+    part.data = std::make_shared<const string>(contents);
+    part.length = contents.size();
+    return add(name, modified, part);
+}
+
+vector<BodyPart> TarArchive::finish()
+{
+    BodyPart end;
+    end.data = zeroBlocks();
+    end.length = 2 * BLOCK;
+    parts.push_back(std::move(end));
+    return std::move(parts);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "HttpResponse.h"
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+
+using std::string;
+using std::vector;
+
+// A ustar archive assembled as response body parts: each member is a 512-byte
+// header built here, the file contents by reference (a cached body or an open
+// file, never copied) and zero padding to the next 512-byte block. The size
+// is known before anything is sent, so the response has a Content-Length.
+class TarArchive
+{
+public:
+    // Adds a member; false if the name does not fit a ustar header (at most 100
+    // bytes, or 155 + 100 split at a '/') or the size exceeds the 8 GiB limit
+    bool add(const string& name, time_t modified, const BodyPart& contents);
+
+    // Adds a member with contents in memory
+    bool add(const string& name, time_t modified, const string& contents);
+
+    // Appends the end-of-archive blocks and hands over the parts
+    vector<BodyPart> finish();
+
+private:
+    static const size_t BLOCK = 512;
+
+    static bool buildHeader(const string& name, uint64_t size, time_t modified, string& header);
+
+    vector<BodyPart> parts;
+};
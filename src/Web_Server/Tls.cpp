@@ -0,0 +1,221 @@
+#include "Tls.h"
+
+#ifdef WEB_SERVER_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// Maps SSL_get_error() for a call that returned result
+static TlsStatus statusOf(SSL* ssl, int result)
+{
+    switch (SSL_get_error(ssl, result))
+    {
+    case SSL_ERROR_NONE:
+        return TLS_OK;
+    case SSL_ERROR_WANT_READ:
+        return TLS_WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return TLS_WANT_WRITE;
+    case SSL_ERROR_ZERO_RETURN:
+        return TLS_CLOSED;
+    case SSL_ERROR_SYSCALL:
+        // EOF without close_notify is how most HTTP clients hang up
+        return ERR_peek_error() == 0 && errno == 0 ? TLS_CLOSED : TLS_FAILED;
+    default:
+        return TLS_FAILED;
+    }
+}
+
+TlsSession::~TlsSession()
+{
+    SSL_free(ssl);
+}
+
+TlsStatus TlsSession::handshake()
+{
+    ERR_clear_error();
+    errno = 0;
+    int result = SSL_do_handshake(ssl);
+    if (result != 1)
+        return statusOf(ssl, result);
+#ifndef OPENSSL_NO_KTLS
+    kernelTx = BIO_get_ktls_send(SSL_get_wbio(ssl)) != 0;
+#endif
+    return TLS_OK;
+}
+
+long long TlsSession::read(char* buffer, size_t length, TlsStatus& status)
+{
+    ERR_clear_error();
+    errno = 0;
+    size_t count = 0;
+    if (SSL_read_ex(ssl, buffer, length, &count) == 1)
+    {
+        status = TLS_OK;
+        return (long long)count;
+    }
+    status = statusOf(ssl, 0);
+    return -1;
+}
+
+long long TlsSession::write(const char* data, size_t length, TlsStatus& status)
+{
+    ERR_clear_error();
+    errno = 0;
+    size_t count = 0;
+    if (SSL_write_ex(ssl, data, length, &count) == 1)
+    {
+        status = TLS_OK;
+        return (long long)count;
+    }
+    status = statusOf(ssl, 0);
+    return -1;
+}
+
+bool TlsSession::hasBufferedInput() const
+{
+    return SSL_has_pending(ssl) == 1;
+}
+
+bool TlsSession::resumed() const
+{
+    return SSL_session_reused(ssl) == 1;
+}
+
+string TlsSession::protocol() const
+{
+    const unsigned char* name = nullptr;
+    unsigned int length = 0;
+    SSL_get0_alpn_selected(ssl, &name, &length);
+    return name != nullptr ? string((const char*)name, length) : string();
+}
+
+bool TlsContext::isAvailable()
+{
+    return true;
+}
+
+TlsContext::~TlsContext()
+{
+    SSL_CTX_free(context);
+}
+
+// Picks the first of our protocols the client offers with ALPN: h2 (unless
+// disabled, then arg is null), then HTTP/1.1
+static int selectProtocol(SSL*, const unsigned char** selected, unsigned char* selectedLength,
+    const unsigned char* offered, unsigned int offeredLength, void* arg)
+{
+    static const unsigned char protocols[] = { 2, 'h', '2', 8, 'h', 't', 't', 'p', '/', '1', '.', '1' };
+    const unsigned char* supported = arg != nullptr ? protocols : protocols + 3;
+    unsigned int supportedLength = arg != nullptr ? sizeof(protocols) : sizeof(protocols) - 3;
+    unsigned char* chosen = nullptr;
+    if (SSL_select_next_proto(&chosen, selectedLength, supported, supportedLength, offered, offeredLength) != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK; // Continue without ALPN; the client will speak HTTP/1.1 anyway
+    *selected = chosen;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+bool TlsContext::configure(const TlsSettings& settings, bool offerHttp2, string& error)
+{
+    SSL_CTX* next = SSL_CTX_new(TLS_server_method());
+    if (next == nullptr)
+    {
+        error = "cannot create a TLS context";
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(next, TLS1_2_VERSION);
+
+    char reason[256];
+    if (SSL_CTX_use_certificate_chain_file(next, settings.certificateFile.c_str()) != 1)
+    {
+        ERR_error_string_n(ERR_get_error(), reason, sizeof(reason));
+        error = "cannot load tls_certificate " + settings.certificateFile + ": " + reason;
+        SSL_CTX_free(next);
+        return false;
+    }
+    if (SSL_CTX_use_PrivateKey_file(next, settings.privateKeyFile.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(next) != 1)
+    {
+        ERR_error_string_n(ERR_get_error(), reason, sizeof(reason));
+        error = "cannot load tls_private_key " + settings.privateKeyFile + ": " + reason;
+        SSL_CTX_free(next);
+        return false;
+    }
+
+    // Resumption: a server-side session cache for session IDs, and tickets (stateless)
+    static const unsigned char sessionContext[] = "web_server";
+    SSL_CTX_set_session_id_context(next, sessionContext, sizeof(sessionContext) - 1);
+    SSL_CTX_set_session_cache_mode(next, settings.sessionCacheSize > 0 ? SSL_SESS_CACHE_SERVER : SSL_SESS_CACHE_OFF);
+    if (settings.sessionCacheSize > 0)
+        SSL_CTX_sess_set_cache_size(next, settings.sessionCacheSize);
+    if (!settings.sessionTickets)
+    {
+        SSL_CTX_set_options(next, SSL_OP_NO_TICKET);
+        SSL_CTX_set_num_tickets(next, 0);
+    }
+
+    // Non-blocking writes may complete partially and be retried from a moved buffer
+    SSL_CTX_set_mode(next, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    static const char http2Marker = 0;
+    SSL_CTX_set_alpn_select_cb(next, selectProtocol, offerHttp2 ? (void*)&http2Marker : nullptr);
+#ifdef SSL_OP_ENABLE_KTLS
+    if (settings.kernelOffload)
+        SSL_CTX_set_options(next, SSL_OP_ENABLE_KTLS);
+#endif
+
+    // Sessions hold a reference, so connections still using the old context are unaffected
+    SSL_CTX_free(context);
+    context = next;
+    return true;
+}
+
+std::unique_ptr<TlsSession> TlsContext::accept(SOCKET socketId)
+{
+    if (context == nullptr)
+        return nullptr;
+    SSL* ssl = SSL_new(context);
+    if (ssl == nullptr)
+        return nullptr;
+    if (SSL_set_fd(ssl, (int)socketId) != 1)
+    {
+        SSL_free(ssl);
+        return nullptr;
+    }
+    SSL_set_accept_state(ssl);
+    return std::unique_ptr<TlsSession>(new TlsSession(ssl));
+}
+
+#else // No OpenSSL: TLS settings are rejected when the configuration is loaded
+
+TlsSession::~TlsSession() {}
+TlsStatus TlsSession::handshake() { return TLS_FAILED; }
+long long TlsSession::read(char*, size_t, TlsStatus& status) { status = TLS_FAILED; return -1; }
+long long TlsSession::write(const char*, size_t, TlsStatus& status) { status = TLS_FAILED; return -1; }
+bool TlsSession::hasBufferedInput() const { return false; }
+bool TlsSession::resumed() const { return false; }
+string TlsSession::protocol() const { return string(); }
+
+bool TlsContext::isAvailable()
+{
+    return false;
+}
+
+TlsContext::~TlsContext() {}
+
+bool TlsContext::configure(const TlsSettings&, bool, string& error)
+{
+    error = "this build has no TLS support (OpenSSL was not found)";
+    return false;
+}
+
+std::unique_ptr<TlsSession> TlsContext::accept(SOCKET)
+{
+    return nullptr;
+}
+
+#endif
+
+TlsContext& TlsContext::instance()
+{
+    static TlsContext tls;
+    return tls;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Platform.h"
+#include "ServerConfig.h"
+#include <string>
+#include <memory>
+
+using std::string;
+
+// Opaque OpenSSL types, so only Tls.cpp includes the OpenSSL headers
+struct ssl_st;
+struct ssl_ctx_st;
+
+// Outcome of a TLS call on a non-blocking socket
+enum TlsStatus
+{
+    TLS_OK,          // Done (or some bytes transferred)
+    TLS_WANT_READ,   // Call again when the socket is readable
+    TLS_WANT_WRITE,  // Call again when the socket is writable
+    TLS_CLOSED,      // The peer closed the connection (close_notify or EOF)
+    TLS_FAILED       // Protocol or socket error; drop the connection
+};
+
+// One TLS connection. The handshake and the reads go through OpenSSL. Writes
+// go through OpenSSL too, unless the kernel took over the record layer (kTLS):
+// then the socket itself encrypts, and sendmsg()/sendfile() keep working on it.
+class TlsSession
+{
+public:
+    ~TlsSession();
+    TlsSession(const TlsSession&) = delete;
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    // Advances the handshake; TLS_OK once it has completed
+    TlsStatus handshake();
+
+    // Decrypted bytes read, or -1 with status saying why nothing was read
+    long long read(char* buffer, size_t length, TlsStatus& status);
+
+    // Bytes written (possibly fewer than length), or -1 with status saying why none were
+    long long write(const char* data, size_t length, TlsStatus& status);
+
+    // Decrypted or undecrypted bytes OpenSSL holds that select() cannot see
+    bool hasBufferedInput() const;
+
+    // True if the kernel encrypts writes to the socket (kTLS); plain writes may bypass OpenSSL
+    bool kernelSend() const { return kernelTx; }
+
+    bool resumed() const;
+
+    // Protocol chosen with ALPN ("h2", "http/1.1"), empty if the client offered none
+    string protocol() const;
+
+private:
+    friend class TlsContext;
+    explicit TlsSession(ssl_st* ssl) : ssl(ssl) {}
+
+    ssl_st* ssl;
+    bool kernelTx = false;
+};
+
+// Server TLS settings shared by all connections: certificate, key, session
+// cache and tickets (so returning clients resume without a full handshake)
+// and kTLS. Builds without OpenSSL (WEB_SERVER_TLS undefined) keep the class
+// but report that TLS is unavailable.
+class TlsContext
+{
+public:
+    static TlsContext& instance();
+
+    // True if the server was built with OpenSSL
+    static bool isAvailable();
+
+    // Loads the certificate and key and applies the settings; ALPN offers h2
+    // before http/1.1 if offerHttp2. Connections that are already open keep the
+    // previous context. On failure the previous context stays in use and error says why.
+    bool configure(const TlsSettings& settings, bool offerHttp2, string& error);
+
+    // A session for an accepted socket, in server mode; nullptr if TLS is not configured
+    std::unique_ptr<TlsSession> accept(SOCKET socketId);
+
+private:
+    TlsContext() = default;
+    ~TlsContext();
+
+    ssl_ctx_st* context = nullptr;
+};
@@ -0,0 +1,76 @@
+#include "UriPath.h"
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Completes the segment that starts at result[segment]: "." is dropped, ".."
+// also drops the segment before it, anything else is kept
+static void endSegment(string& result, size_t& segment, bool separator)
+{
+    string_view name(result.data() + segment, result.size() - segment);
+    if (name == ".")
+    {
+        result.resize(segment);
+    }
+    else if (name == "..")
+    {
+        result.resize(segment);
+        if (segment > 1)
+            result.resize(result.rfind('/', segment - 2) + 1); // Never above the root
+    }
+    else if (!name.empty() && separator)
+    {
+        result += '/';
+    }
+    segment = result.size();
+}
+
+bool UriPath::hasHiddenSegment(string_view path)
+{
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        if (path[i] == '.' && (i == 0 || path[i - 1] == '/'))
+            return true;
+    }
+    return false;
+}
+
+bool UriPath::normalize(string_view path, string& result)
+{
+    if (path.empty() || path[0] != '/')
+        return false;
+
+    result.assign(1, '/');
+    result.reserve(path.size());
+    size_t segment = 1; // Start of the current segment in result
+    for (size_t i = 1; i < path.size(); i++)
+    {
+        char c = path[i];
+        if (c == '%')
+        {
+            int high = i + 2 < path.size() ? hexValue(path[i + 1]) : -1;
+            int low = high >= 0 ? hexValue(path[i + 2]) : -1;
+            if (low < 0)
+                return false;
+            c = (char)(high * 16 + low);
+            i += 2;
+        }
+
+        if ((unsigned char)c < 0x20 || c == 0x7f || c == '\\')
+            return false;
+        if (c == '/')
+            endSegment(result, segment, true);
+        else
+            result += c;
+    }
+    endSegment(result, segment, false);
+    return true;
+}
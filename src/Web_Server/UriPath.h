@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+using std::string;
+using std::string_view;
+
+// Turns the path part of a request target into the canonical form the route
+// index and the filesystem layer work with.
+//
+// Percent-decoding and dot-segment removal (RFC 3986 section 5.2.4) happen in
+// a single pass, so an encoded "%2e%2e" is removed like a literal "..", and
+// ".." never climbs above "/". Empty segments ("a//b") are collapsed.
+class UriPath
+{
+public:
+    // path must start with '/'. On success result is the normalized path
+    // (always starting with '/'). Fails on malformed escapes and on decoded
+    // NUL, control characters or backslashes.
+    static bool normalize(string_view path, string& result);
+
+    // True if a segment of a normalized path starts with '.': the server's own
+    // files (".blobs", ".name.upload" staging), which clients may not write or list
+    static bool hasHiddenSegment(string_view path);
+};
@@ -0,0 +1,132 @@
+#include "VirtualHosts.h"
+#include "Platform.h"
+#include "HttpResponse.h"
+#include <iostream>
+
+static const char* const DEFAULT_SITE = "default";
+
+VirtualHosts& VirtualHosts::instance()
+{
+    static VirtualHosts hosts;
+    return hosts;
+}
+
+VirtualHosts::VirtualHosts()
+{
+    // A default site exists before configure() so handlers always have one
+    sites.push_back(std::make_unique<VirtualHost>());
+    sites.front()->name = DEFAULT_SITE;
+}
+
+// Reuses the site with this name (or creates it) and applies its settings
+static unique_ptr<VirtualHost> takeSite(vector<unique_ptr<VirtualHost>>& previous, const string& name,
+    const string& documentRoot, size_t cacheMaxBytes, size_t cacheMaxFileBytes)
+{
+    unique_ptr<VirtualHost> site;
+    for (auto& candidate : previous)
+    {
+        if (candidate && candidate->name == name)
+        {
+            site = std::move(candidate);
+            break;
+        }
+    }
+    if (!site)
+    {
+        site = std::make_unique<VirtualHost>();
+        site->name = name;
+    }
+
+    // Re-pinned on every reload, so a root that was replaced on disk is picked up
+    string previousRoot = site->root.path();
+    if (!site->root.open(documentRoot))
+        std::cout << "Http Server: Cannot open document root " << documentRoot << " for " << name << std::endl;
+    if (site->root.path() != previousRoot)
+    {
+        site->cache.clear();
+        site->routes.setRoot(site->root.path());
+    }
+    site->cache.setLimits(cacheMaxBytes, cacheMaxFileBytes);
+    return site;
+}
+
+void VirtualHosts::configure(const ServerConfig& config)
+{
+    vector<unique_ptr<VirtualHost>> previous = std::move(sites);
+    sites.clear();
+    byHostName.clear();
+
+    string defaultRoot = config.documentRoot.empty() ? Platform::documentRoot() : config.documentRoot;
+    sites.push_back(takeSite(previous, DEFAULT_SITE, defaultRoot, config.cacheMaxBytes, config.cacheMaxFileBytes));
+    HttpResponse::clearErrorPages(); // Read again from the (possibly new) default root
+
+    for (const VirtualHostConfig& settings : config.virtualHosts)
+    {
+        unique_ptr<VirtualHost> site = takeSite(previous, settings.name, settings.documentRoot,
+            settings.cacheMaxBytes, settings.cacheMaxFileBytes);
+        site->limitRequests = settings.requestsPerSecond >= 0;
+        if (site->limitRequests)
+            site->requestLimits.configure(0, settings.requestsPerSecond, settings.requestBurst);
+        for (const string& hostName : settings.hostNames)
+            byHostName[hostName] = site.get();
+        sites.push_back(std::move(site));
+    }
+    for (auto& site : sites)
+    {
+        site->missing.setCapacity((size_t)config.negativeCacheEntries);
+        site->deduplicate = config.dedupStorage;
+        site->uploads.setMaxTotal(config.maxUploadSize);
+    }
+}
+
+VirtualHost& VirtualHosts::select(string_view hostHeader) const
+{
+    if (byHostName.empty())
+        return defaultHost();
+
+    // Drop the port ("[::1]:8080" keeps its brackets) and a trailing dot, then lowercase
+    size_t end = hostHeader.size();
+    size_t colon = hostHeader.rfind(':');
+    if (colon != string_view::npos && hostHeader.find(']', colon) == string_view::npos)
+        end = colon;
+    if (end > 0 && hostHeader[end - 1] == '.')
+        end--;
+
+    string key(hostHeader.substr(0, end));
+    for (char& c : key)
+        if (c >= 'A' && c <= 'Z')
+            c = (char)(c - 'A' + 'a');
+
+    auto it = byHostName.find(key);
+    return it != byHostName.end() ? *it->second : defaultHost();
+}
+
+void VirtualHosts::refreshIfChanged()
+{
+    for (size_t i = 0; i < sites.size(); i++)
+    {
+        if (!sites[i]->routes.refreshIfChanged())
+            continue;
+        sites[i]->missing.clear(); // Some of them may exist now
+        if (i == 0)
+            HttpResponse::clearErrorPages(); // They live in the default root
+    }
+}
+
+void VirtualHosts::fileChanged(VirtualHost& site, const string& relativePath)
+{
+    site.routes.update(relativePath);
+    site.missing.erase(relativePath);
+    if (&site == sites.front().get())
+        HttpResponse::clearErrorPages(); // The file may be one of them
+}
+
+void VirtualHosts::sweep()
+{
+    for (auto& site : sites)
+    {
+        if (site->limitRequests)
+            site->requestLimits.sweep();
+        site->uploads.sweep();
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "RootDirectory.h"
+#include "RouteIndex.h"
+#include "FileCache.h"
+#include "NegativeCache.h"
+#include "PartialUploads.h"
+#include "BlobStore.h"
+#include "ClientLimits.h"
+#include "ServerConfig.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::unique_ptr;
+
+// A site served by this process: its document root, route index, file cache
+// and (optionally) its own per-client request rate.
+struct VirtualHost
+{
+    string name;                 // Section name; "default" for the site from the top-level settings
+    RootDirectory root;          // Pinned document root; all file access goes through it
+    RouteIndex routes;
+    FileCache cache{ root };
+    NegativeCache missing;       // Paths not in the index that were also not on disk
+    PartialUploads uploads{ root }; // Ranged PUTs still missing parts
+    BlobStore blobs{ root };     // Used for PUT bodies when deduplicate is set
+    bool deduplicate = false;
+    ClientLimits requestLimits;  // Used instead of the server-wide rate when limitRequests is set
+    bool limitRequests = false;
+};
+
+// The sites of this process and the Host -> site map used to pick one per request.
+//
+// Host names are lowercased and stored without a port, so selecting a site is
+// one hash probe after normalizing the header. Unknown or missing Host headers
+// get the default site (the top-level document_root).
+class VirtualHosts
+{
+public:
+    // The sites used by request handlers
+    static VirtualHosts& instance();
+
+    // Builds the sites and the Host map from the configuration. Sites are kept
+    // by name across calls (SIGHUP), so their caches survive a reload; a site
+    // is re-indexed only if its document root changed.
+    void configure(const ServerConfig& config);
+
+    // The site for a Host header value ("Example.com:8080" and "example.com." match "example.com")
+    VirtualHost& select(string_view hostHeader) const;
+
+    // The site for requests that match no host name
+    VirtualHost& defaultHost() const { return *sites.front(); }
+
+    // Every site, the default one first
+    const vector<unique_ptr<VirtualHost>>& allSites() const { return sites; }
+
+    // Rebuilds the route index of every site whose tree changed, and forgets
+    // the paths that site had recorded as missing
+    void refreshIfChanged();
+
+    // A request wrote or removed a file of the site (PUT, DELETE): updates its routes
+    // and forgets it as missing, without rescanning the tree
+    void fileChanged(VirtualHost& site, const string& relativePath);
+
+    // Frees idle clients in the per-site rate limiters and drops abandoned uploads
+    void sweep();
+
+private:
+    VirtualHosts();
+
+    vector<unique_ptr<VirtualHost>> sites; // sites[0] is the default site
+    std::unordered_map<string, VirtualHost*> byHostName;
+};